@@ -0,0 +1,69 @@
+"""
+Compares the hot path benchmark (/rest/benchmark) of two builds, e.g. the RP2040 (Pico W) against the RP2350
+(Pico 2 W) build, or a change against the one before it. The cycles and the time per call are listed side by side.
+
+    python3 benchmark_compare.py -a http://192.168.4.1 -b http://192.168.4.2
+    python3 benchmark_compare.py -a rp2040.json -b rp2350.json -n 5000
+"""
+import argparse
+import json
+import logging
+import sys
+import urllib.request
+
+
+def load_benchmark(source, iterations):
+    if source.startswith("http://") or source.startswith("https://"):
+        with urllib.request.urlopen(f"{source.rstrip('/')}/rest/benchmark?n={iterations}") as response:
+            return json.load(response)
+
+    with open(source, "r") as fp:
+        return json.load(fp)
+
+
+def describe(benchmark):
+    return f"{benchmark.get('p', '?')} @ {benchmark['hz'] / 1e6:.0f} MHz"
+
+
+def compare(benchmark_a, benchmark_b):
+    rows = []
+    for case, (_, mean_a, _) in benchmark_a["b"].items():
+        if case not in benchmark_b["b"]:
+            logging.warning(f"{case} is only in the first benchmark")
+            continue
+        _, mean_b, _ = benchmark_b["b"][case]
+
+        time_a_us = mean_a / benchmark_a["hz"] * 1e6
+        time_b_us = mean_b / benchmark_b["hz"] * 1e6
+        speedup = time_a_us / time_b_us if time_b_us > 0 else float("inf")
+
+        rows.append((case, mean_a, mean_b, time_a_us, time_b_us, speedup))
+
+    return rows
+
+
+def main(args):
+    benchmark_a = load_benchmark(args.a, args.iterations)
+    benchmark_b = load_benchmark(args.b, args.iterations)
+
+    print(f"A: {describe(benchmark_a)}, B: {describe(benchmark_b)}, mean of {benchmark_a['n']} / {benchmark_b['n']} calls")
+    print(f"{'case':<22}{'A cycles':>10}{'B cycles':>10}{'A us':>10}{'B us':>10}{'speedup':>9}")
+    for case, mean_a, mean_b, time_a_us, time_b_us, speedup in compare(benchmark_a, benchmark_b):
+        print(f"{case:<22}{mean_a:>10}{mean_b:>10}{time_a_us:>10.2f}{time_b_us:>10.2f}{speedup:>8.2f}x")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+
+    parser.add_argument('-a', help="Address of the first OpenTrickler (http://...) or its saved /rest/benchmark",
+                        required=True)
+    parser.add_argument('-b', help="Address of the second OpenTrickler or its saved /rest/benchmark", required=True)
+    parser.add_argument('-n', '--iterations', type=int, default=1000, help="Calls per case, when run on a board")
+
+    parser.add_argument('-v', '--verbose', action='count', default=0)
+
+    args = parser.parse_args()
+
+    logging.basicConfig(level=logging.DEBUG if args.verbose else logging.WARNING, stream=sys.stdout)
+
+    main(args)
@@ -1,15 +1,22 @@
 """
 This script is created to convert HTML file into the C header file with compressed HTML (as well as CSS and JavaScripts). 
 
+With --gzip the page is stored gzip compressed and sent with Content-Encoding: gzip. Every page carries a strong ETag
+derived from the stored bytes and a ready made 304 response, so browsers revalidate (Cache-Control: no-cache) and only
+download the page again after a firmware update changed it.
+
 Usage
 
     python html2header.py -f ./src/html/config.html -o /src/generated/ -v
+    python html2header.py -f ./src/html/config.html -o /src/generated/ --gzip
 
 Dependencies from pip:
  - minify_html
 """
 
 import argparse
+import gzip
+import hashlib
 import logging
 import sys
 import os
@@ -27,13 +34,48 @@ C_HEADER_TEMPLATE = """// ------------------------------------------------------
 #ifndef {capitalized_filename}_H_
 #define {capitalized_filename}_H_
 
-const char html_{lowercase_filename}[] = "{html_string}";
+#include <stddef.h>
+
+const char html_{lowercase_filename}[] = {html_data};
+const size_t html_{lowercase_filename}_len = {html_len};
+
+const char html_{lowercase_filename}_etag[] = "{escaped_etag}";
+const char html_{lowercase_filename}_not_modified[] = "{escaped_not_modified}";
 
 #endif  //  {capitalized_filename}_H_
 """
+
+HTTP_HEADER_TEMPLATE = ("HTTP/1.1 200 OK\r\n"
+                        "Content-Type: text/html\r\n"
+                        "{content_encoding}"
+                        "Content-Length: {content_len}\r\n"
+                        "Cache-Control: no-cache\r\n"
+                        "ETag: {etag}\r\n"
+                        "\r\n")
+
+HTTP_NOT_MODIFIED_TEMPLATE = ("HTTP/1.1 304 Not Modified\r\n"
+                              "Cache-Control: no-cache\r\n"
+                              "ETag: {etag}\r\n"
+                              "\r\n")
+
+
+def escape_c_string(string):
+    escaped = string.replace("\\", "\\\\")
+    escaped = escaped.replace('"', '\\"')
+    escaped = escaped.replace("'", "\\'")
+    escaped = escaped.replace("\n", "\\n")
+    escaped = escaped.replace("\r", "\\r")
+    return escaped
+
+
+def c_byte_array(data, bytes_per_line=16):
+    lines = []
+    for idx in range(0, len(data), bytes_per_line):
+        lines.append("    " + ", ".join(f"0x{byte:02x}" for byte in data[idx:idx + bytes_per_line]) + ",")
+    return "{\n" + "\n".join(lines) + "\n}"
  
 
-def main(input_filepth, output_filepath, skip_minify):
+def main(input_filepth, output_filepath, skip_minify, use_gzip):
     logging.debug(f"Input path: {input_filepth}, output path: {output_filepath}")
 
     with open(input_filepth) as fp:
@@ -51,15 +93,25 @@ def main(input_filepth, output_filepath, skip_minify):
     else:
         minified_html = input_file
 
-    # Append HTML header
-    minified_html = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n" + minified_html
+    body = minified_html.encode("utf-8")
+    if use_gzip:
+        # Fixed mtime so the same page always gives the same bytes (and ETag)
+        body = gzip.compress(body, compresslevel=9, mtime=0)
 
-    # Escape characters
-    escaped_html = minified_html.replace("\\", "\\\\")
-    escaped_html = escaped_html.replace('"', '\\"')
-    escaped_html = escaped_html.replace("'", "\\'")
-    escaped_html = escaped_html.replace("\n", "\\n")
-    escaped_html = escaped_html.replace("\r", "\\r")
+    etag = '"' + hashlib.sha1(body).hexdigest()[:16] + '"'
+
+    # Prepend HTTP header
+    http_header = HTTP_HEADER_TEMPLATE.format(
+        content_encoding="Content-Encoding: gzip\r\n" if use_gzip else "",
+        content_len=len(body),
+        etag=etag,
+    )
+    response = http_header.encode("ascii") + body
+
+    if use_gzip:
+        html_data = c_byte_array(response)
+    else:
+        html_data = '"' + escape_c_string(response.decode("utf-8")) + '"'
 
     filename = os.path.basename(input_filepth)
 
@@ -69,7 +121,10 @@ def main(input_filepth, output_filepath, skip_minify):
     c_header_string = C_HEADER_TEMPLATE.format(
         capitalized_filename=filename.upper(),
         lowercase_filename=filename.lower(),
-        html_string=escaped_html,
+        html_data=html_data,
+        html_len=len(response),
+        escaped_etag=escape_c_string(etag),
+        escaped_not_modified=escape_c_string(HTTP_NOT_MODIFIED_TEMPLATE.format(etag=etag)),
     )
     logging.debug(c_header_string)
 
@@ -78,8 +133,8 @@ def main(input_filepth, output_filepath, skip_minify):
         fp.write(c_header_string)
 
     input_len = len(input_file)
-    output_data_len = len(escaped_html)
-    logging.info(f"Input HTML includes {input_len} bytes, the output escaped HTML includes {output_data_len} bytes")
+    output_data_len = len(response)
+    logging.info(f"Input HTML includes {input_len} bytes, the output response includes {output_data_len} bytes")
 
     return 0
 
@@ -91,6 +146,7 @@ if __name__ == "__main__":
     parser.add_argument('-f', '--input_filepath', help="Filepath to the HTML file that need to be converted to C header", required=True)
     parser.add_argument('-o', '--output_filepath', help="The output filepath that the C header will be written to", required=True)
     parser.add_argument('--no-minify', help="Do not minify the input file", default=False, action='store_true')
+    parser.add_argument('--gzip', help="Store the page gzip compressed", default=False, action='store_true')
 
     parser.add_argument('-v', '--verbose', action='count', default=0)
     
@@ -106,4 +162,4 @@ if __name__ == "__main__":
     
     logging.basicConfig(stream=sys.stdout, level=logging_levels[args.verbose])
 
-    main(args.input_filepath, args.output_filepath, skip_minify=args.no_minify)
+    main(args.input_filepath, args.output_filepath, skip_minify=args.no_minify, use_gzip=args.gzip)
@@ -0,0 +1,124 @@
+"""
+Turns the hot path trace from /rest/trace into a Chrome trace event file, to be opened in https://ui.perfetto.dev
+or chrome://tracing.
+
+    python3 trace_timeline.py -u http://192.168.4.1 -o trace.json
+    python3 trace_timeline.py -i trace.bin -o trace.json
+"""
+import argparse
+import json
+import logging
+import struct
+import sys
+import urllib.request
+
+
+TRACE_MAGIC = 0x5254544F
+TRACE_VERSION = 1
+
+HEADER_FORMAT = "<IHHII"     # trace_header_t
+RECORD_FORMAT = "<IBBH"      # trace_record_t
+
+# trace_event_t, (name, phase, track). Phase B/E pair up to a duration on the track, i an instant event.
+EVENTS = {
+    1: ("Scale frame", "i", "Scale"),
+    2: ("Scale publish", "i", "Scale"),
+    3: ("Scale take", "i", "Scale"),
+    4: ("PID iteration", "i", "Charge control"),
+    5: ("Motor enqueue", "i", "Motor {arg}"),
+    6: ("Motor ramp", "B", "Motor {arg}"),
+    7: ("Motor ramp", "E", "Motor {arg}"),
+    8: ("Gate move", "B", "Servo gate"),
+    9: ("Gate move", "E", "Servo gate"),
+    10: ("HTTP request", "B", "HTTP {arg:04x}"),
+    11: ("HTTP request", "E", "HTTP {arg:04x}"),
+}
+
+
+def parse_trace(blob):
+    header_size = struct.calcsize(HEADER_FORMAT)
+    record_size = struct.calcsize(RECORD_FORMAT)
+
+    magic, version, record_cnt, now_us, dropped = struct.unpack_from(HEADER_FORMAT, blob, 0)
+    if magic != TRACE_MAGIC or version != TRACE_VERSION:
+        raise ValueError(f"Not a trace (magic 0x{magic:08x}, version {version})")
+
+    records = []
+    for idx in range(record_cnt):
+        records.append(struct.unpack_from(RECORD_FORMAT, blob, header_size + idx * record_size))
+
+    return now_us, dropped, records
+
+
+def to_trace_events(now_us, records):
+    events = []
+    tracks = {}
+
+    for time_us, event, core, arg in records:
+        if event not in EVENTS:
+            logging.warning(f"Unknown event {event}")
+            continue
+
+        name, phase, track = EVENTS[event]
+        track = track.format(arg=arg)
+        tid = tracks.setdefault(track, len(tracks) + 1)
+
+        # The time stamps are 32 bit, count back from the time of the request so a wrap doesn't matter
+        age_us = (now_us - time_us) & 0xFFFFFFFF
+
+        trace_event = {"name": name, "ph": phase, "ts": -age_us, "pid": core, "tid": tid, "args": {"arg": arg}}
+        if phase == "i":
+            trace_event["s"] = "t"
+        events.append(trace_event)
+
+    # Perfetto wants the events of a track in order, and the time line to start at zero
+    events.sort(key=lambda trace_event: trace_event["ts"])
+    if events:
+        start_us = events[0]["ts"]
+        for trace_event in events:
+            trace_event["ts"] -= start_us
+
+    pids = sorted({trace_event["pid"] for trace_event in events})
+    for pid in pids:
+        events.append({"name": "process_name", "ph": "M", "pid": pid, "args": {"name": f"Core {pid}"}})
+        for track, tid in tracks.items():
+            events.append({"name": "thread_name", "ph": "M", "pid": pid, "tid": tid, "args": {"name": track}})
+
+    return events
+
+
+def main(args):
+    if args.input_filepath:
+        with open(args.input_filepath, "rb") as fp:
+            blob = fp.read()
+    else:
+        with urllib.request.urlopen(f"{args.url.rstrip('/')}/rest/trace") as response:
+            blob = response.read()
+
+    if args.raw_filepath:
+        with open(args.raw_filepath, "wb") as fp:
+            fp.write(blob)
+
+    now_us, dropped, records = parse_trace(blob)
+    logging.info(f"{len(records)} records, {dropped} overwritten")
+
+    with open(args.output_filepath, "w") as fp:
+        json.dump({"traceEvents": to_trace_events(now_us, records), "displayTimeUnit": "ms"}, fp)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument('-u', '--url', help="Address of the OpenTrickler, e.g. http://192.168.4.1")
+    source.add_argument('-i', '--input_filepath', help="Trace saved from /rest/trace")
+    parser.add_argument('-o', '--output_filepath', help="The trace event JSON file to write", required=True)
+    parser.add_argument('--raw_filepath', help="Also save the trace as received")
+
+    parser.add_argument('-v', '--verbose', action='count', default=0)
+
+    args = parser.parse_args()
+
+    logging.basicConfig(level=logging.DEBUG if args.verbose else logging.WARNING, stream=sys.stdout)
+
+    main(args)
@@ -3,65 +3,202 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <math.h>
 
 
+/*
+    Fixed capacity ring buffer with statically sized storage (no heap allocation).
+
+    Running sums are maintained on enqueue/dequeue so the mean, standard deviation and slope are O(1).
+    Min/max use monotonic index queues, which is amortized O(1) per enqueue.
+    When the buffer is full, enqueue overwrites the oldest element.
+*/
+template <size_t N>
 class FloatRingBuffer
 {
 
 private:
-    
+    // container
+    float data[N];
+
     size_t read_ptr;
     size_t write_ptr;
     size_t count;
-    
-    // mutex lock
-    bool mux; 
-    
-    // overflow
-    bool is_over_flow;
-
-protected:
-    const size_t buffer_size;
-    
-    // container
-    float *data;
-    
-    
+
+    // Sequence number of the oldest element and of the next enqueue
+    uint32_t head_seq;
+    uint32_t tail_seq;
+
+    // Running statistics. Double precision avoids drift from repeated add/subtract.
+    double sum;
+    double sum_of_sqre;
+    double sum_of_seq_weighted;   // sum(seq * x)
+
+    // Monotonic queues of sequence numbers for min/max
+    uint32_t min_queue[N];
+    uint32_t max_queue[N];
+    size_t min_queue_head, min_queue_count;
+    size_t max_queue_head, max_queue_count;
+
+    float at_seq(uint32_t seq) {
+        return data[(read_ptr + (seq - head_seq)) % N];
+    }
+
+    void remove_oldest() {
+        float out = data[read_ptr];
+
+        sum -= out;
+        sum_of_sqre -= (double) out * out;
+        sum_of_seq_weighted -= (double) head_seq * out;
+
+        // Expire the oldest element from the min/max queues
+        if (min_queue_count && min_queue[min_queue_head] == head_seq) {
+            min_queue_head = (min_queue_head + 1) % N;
+            min_queue_count--;
+        }
+        if (max_queue_count && max_queue[max_queue_head] == head_seq) {
+            max_queue_head = (max_queue_head + 1) % N;
+            max_queue_count--;
+        }
+
+        read_ptr = (read_ptr + 1) % N;
+        head_seq++;
+        count--;
+    }
+
 public:
-    FloatRingBuffer(const size_t size);
-    ~FloatRingBuffer();
-    
-    // psudo mutex
-    bool isLocked();
-    void lock();
-    void unlock();
-    
+    FloatRingBuffer() {
+        reset();
+    }
+
     // enqueue and dequeue
-    void enqueue(float in);
-    float dequeue();
-    void reset();
-    
-    // pointer operation
-    size_t getReadPtr();
-    size_t getWritePtr();
-    size_t getCounter();
-    
-    // overflow
-    bool getOverFlow();
-    void clearOverFlow();
-    
+    void enqueue(float in) {
+        if (count == N) {
+            remove_oldest();
+        }
+
+        data[write_ptr] = in;
+        write_ptr = (write_ptr + 1) % N;
+        count++;
+
+        sum += in;
+        sum_of_sqre += (double) in * in;
+        sum_of_seq_weighted += (double) tail_seq * in;
+
+        // Drop the elements that can no longer be the min/max
+        while (min_queue_count && at_seq(min_queue[(min_queue_head + min_queue_count - 1) % N]) >= in) {
+            min_queue_count--;
+        }
+        min_queue[(min_queue_head + min_queue_count) % N] = tail_seq;
+        min_queue_count++;
+
+        while (max_queue_count && at_seq(max_queue[(max_queue_head + max_queue_count - 1) % N]) <= in) {
+            max_queue_count--;
+        }
+        max_queue[(max_queue_head + max_queue_count) % N] = tail_seq;
+        max_queue_count++;
+
+        tail_seq++;
+    }
+
+    float dequeue() {
+        if (count == 0) {
+            return NAN;
+        }
+
+        float temp = data[read_ptr];
+        remove_oldest();
+
+        return temp;
+    }
+
+    void reset() {
+        read_ptr = 0;
+        write_ptr = 0;
+        count = 0;
+
+        head_seq = 0;
+        tail_seq = 0;
+
+        sum = 0.0;
+        sum_of_sqre = 0.0;
+        sum_of_seq_weighted = 0.0;
+
+        min_queue_head = min_queue_count = 0;
+        max_queue_head = max_queue_count = 0;
+    }
+
+    size_t getCounter() {
+        return count;
+    }
+
+    size_t getCapacity() {
+        return N;
+    }
+
+    bool isFull() {
+        return count == N;
+    }
+
     // operation
-    float first();
-    float last();
-    
-    // random access
-    float operator[](size_t idx);
+    float first() {
+        return count ? data[read_ptr] : NAN;
+    }
+
+    float last() {
+        return count ? data[(write_ptr + N - 1) % N] : NAN;
+    }
+
+    // random access, 0 is the oldest element
+    float operator[](size_t idx) {
+        return data[(read_ptr + idx) % N];
+    }
+
+    // Arithmetic operatings, computed over the stored elements
+    double getSum(void) {
+        return sum;
+    }
+
+    float getMean(void) {
+        return count ? sum / count : NAN;
+    }
+
+    // Population standard deviation
+    float getSd(void) {
+        if (count == 0) {
+            return NAN;
+        }
+
+        double mean = sum / count;
+        double variance = sum_of_sqre / count - mean * mean;
+
+        // Rounding may produce a tiny negative variance
+        return variance > 0 ? sqrt(variance) : 0.0f;
+    }
+
+    float getMin(void) {
+        return min_queue_count ? at_seq(min_queue[min_queue_head]) : NAN;
+    }
+
+    float getMax(void) {
+        return max_queue_count ? at_seq(max_queue[max_queue_head]) : NAN;
+    }
+
+    // Least squares slope per sample (e.g. unit per measurement)
+    float getSlope(void) {
+        if (count < 2) {
+            return 0.0f;
+        }
+
+        // Index the elements 0..n-1 from the oldest, sum(i) and sum(i^2) are closed form
+        double n = count;
+        double sum_i = n * (n - 1) / 2;
+        double sum_ii = (n - 1) * n * (2 * n - 1) / 6;
+        double sum_ix = sum_of_seq_weighted - (double) head_seq * sum;
 
-    // Arithmetic operatings
-    double getSum(void);
-    float getSd(void);
-    float getMean(void);
+        return (n * sum_ix - sum_i * sum) / (n * sum_ii - sum_i * sum_i);
+    }
 
 };
 
-#endif // FLOATRINGBUFFER_H_
\ No newline at end of file
+#endif // FLOATRINGBUFFER_H_
@@ -64,15 +64,27 @@
 // todo need this for lwip FreeRTOS sys_arch to compile
 #define configENABLE_BACKWARD_COMPATIBILITY     1
 #define configNUM_THREAD_LOCAL_STORAGE_POINTERS 5
+// Index 1 wakes the consumers of the scale measurement stream (SCALE_MEASUREMENT_NOTIFY_INDEX)
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES   2
 
 /* System */
 #define configSTACK_DEPTH_TYPE                  uint32_t
 #define configMESSAGE_BUFFER_LENGTH_TYPE        size_t
 
 /* Memory allocation related definitions. */
-#define configSUPPORT_STATIC_ALLOCATION         0
+/* STATIC_ALLOCATION (CMake option) keeps the long-lived kernel objects of the app out of the heap, see static_alloc.h */
+#ifndef STATIC_ALLOCATION
+#define STATIC_ALLOCATION                       0
+#endif
+#define configSUPPORT_STATIC_ALLOCATION         STATIC_ALLOCATION
+#define configKERNEL_PROVIDED_STATIC_MEMORY     STATIC_ALLOCATION
 #define configSUPPORT_DYNAMIC_ALLOCATION        1
+/* The RP2350 has 520 KB of SRAM against the 264 KB of the RP2040 */
+#if PICO_RP2350
+#define configTOTAL_HEAP_SIZE                   (256*1024)
+#else
 #define configTOTAL_HEAP_SIZE                   (128*1024)
+#endif
 #define configAPPLICATION_ALLOCATED_HEAP        0
 
 /* Hook function related definitions. */
@@ -81,7 +93,15 @@
 #define configUSE_DAEMON_TASK_STARTUP_HOOK      0
 
 /* Run time and task stats gathering related definitions. */
-#define configGENERATE_RUN_TIME_STATS           0
+/* The run time counts microseconds off the RP2040 timer (64 bit, doesn't wrap), see /rest/task_stats */
+#define configGENERATE_RUN_TIME_STATS           1
+#define configRUN_TIME_COUNTER_TYPE             uint64_t
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()        freertos_run_time_counter()
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+extern uint64_t freertos_run_time_counter(void);
+#endif
 #define configUSE_TRACE_FACILITY                1
 #define configUSE_STATS_FORMATTING_FUNCTIONS    0
 
@@ -109,8 +129,27 @@
 #define configNUM_CORES                         configNUMBER_OF_CORES  // backward compatible with pick-sdk 
 #define configRUN_MULTIPLE_PRIORITIES           1
 #define configUSE_CORE_AFFINITY                 1
-// #define configTASK_DEFAULT_CORE_AFFINITY        tskNO_AFFINITY
 // #define configTIMER_SERVICE_TASK_CORE_AFFINITY  tskNO_AFFINITY
+
+/* Task placement
+ * The charge loop (scale listener, menu task running the PID, stepper and servo tasks) is pinned to CONTROL_CORE.
+ * Every other task, including cyw43, lwIP/HTTP and display rendering, defaults to the other core so web portal 
+ * traffic doesn't add jitter to the charge loop. Build with -DCONTROL_CORE=-1 to let every task float. */
+#ifndef CONTROL_CORE
+#define CONTROL_CORE                            0
+#endif
+
+#if CONTROL_CORE >= 0
+#define NETWORK_CORE                            (1 - CONTROL_CORE)
+#define CONTROL_CORE_AFFINITY_MASK              (1 << CONTROL_CORE)
+#define NETWORK_CORE_AFFINITY_MASK              (1 << NETWORK_CORE)
+#define configTASK_DEFAULT_CORE_AFFINITY        NETWORK_CORE_AFFINITY_MASK
+#define ASYNC_CONTEXT_DEFAULT_FREERTOS_TASK_CORE_ID  NETWORK_CORE   // cyw43 worker task (pico-sdk async_context)
+#else
+#define NETWORK_CORE                            -1
+#define CONTROL_CORE_AFFINITY_MASK              tskNO_AFFINITY
+#define NETWORK_CORE_AFFINITY_MASK              tskNO_AFFINITY
+#endif
 #define configUSE_PASSIVE_IDLE_HOOK             0
 
 /* RP2040 specific */
@@ -13,21 +13,21 @@
 #include "app.h"
 
 
-typedef union {
-    struct __attribute__((__packed__)){
-        char header[2];
-        char comma;
-        char data[9];
-        char unit[3];
-        char terminator[2];
-    };
-    char bytes[17];
-} scale_standard_data_format_t;
+static const scale_frame_descriptor_t and_fxi_frame_descriptor = {
+    .frame_size = 17,             // header[2], comma, data[9], unit[3], terminator[2]
+    .terminator = '\n',
+    .sign_offset = -1,            // Sign is part of the data
+    .stable_offset = 0,           // Header is ST when stable, US when unstable
+    .stable_char = 'S',
+    .data_offset = 3,
+    .data_length = 9,
+};
 
 
 // Forward declaration
 void _and_scale_listener_task(void *p);
 void scale_press_re_zero_key();
+static void _and_scale_set_fast_report(bool enable);
 
 extern scale_config_t scale_config;
 
@@ -35,59 +35,12 @@ extern scale_config_t scale_config;
 scale_handle_t and_fxi_scale_handle = {
     .read_loop_task = _and_scale_listener_task,
     .force_zero = scale_press_re_zero_key,
+    .set_fast_report = _and_scale_set_fast_report,
 };
 
 
-static float _decode_measurement_msg(scale_standard_data_format_t * msg) {
-    // Decode header
-    // Doesn't really matter though..
-
-    // Decode weight information
-    char *endptr;
-    float weight = strtof(msg->data, &endptr);
-
-    if( endptr == msg->data ) {
-        // Conversion failed
-        return nanf(msg->data);
-    }
-
-    return weight;
-}
-
-
 void _and_scale_listener_task(void *p) {
-    uint8_t string_buf_idx = 0;
-    scale_standard_data_format_t frame;
-
-    while (true) {
-        // Read all data 
-        while (uart_is_readable(SCALE_UART)) {
-            char ch = uart_getc(SCALE_UART);
-
-            frame.bytes[string_buf_idx++] = ch;
-
-            // If we have received 17 bytes then we can decode the message
-            if (string_buf_idx == sizeof(scale_standard_data_format_t)) {
-                // Data is ready, send to decode
-                scale_config.current_scale_measurement = _decode_measurement_msg(&frame);
-
-                // Signal the data is ready
-                if (scale_config.scale_measurement_ready) {
-                    xSemaphoreGive(scale_config.scale_measurement_ready);
-                }
-
-                // Reset
-                string_buf_idx = 0;
-            }
-
-            // \n is the terminator. We shall reset the receive of message on receiving any of those character.
-            if (ch =='\n') {
-                string_buf_idx = 0;
-            }
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(20));
-    }
+    scale_frame_listener_loop(&and_fxi_frame_descriptor);
 }
 
 
@@ -132,7 +85,18 @@ void scale_display_on() {
 }
 
 
-
-// AppState_t scale_enable_fast_report(AppState_t prev_state) {
-//     // TODO: Finish this
-// }
+/*
+    SIR streams every reading, stable or not, at the display refresh rate regardless of the output mode (prt) of the
+    function table. C cancels it and the scale goes back to that mode. The rate tops out at the display refresh
+    (SPd 1 for 10 Hz), which can only be set on the scale.
+*/
+static void _and_scale_set_fast_report(bool enable) {
+    if (enable) {
+        char cmd[] = "SIR\r\n";
+        scale_write(cmd, strlen(cmd));
+    }
+    else {
+        char cmd[] = "C\r\n";
+        scale_write(cmd, strlen(cmd));
+    }
+}
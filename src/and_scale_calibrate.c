@@ -21,60 +21,44 @@ char line1[32] = "";
 char line2[32] = "";
 bool show_next_key = false;
 
-TaskHandle_t scale_calibration_render_task_handler = NULL;
 
 
 extern void scale_press_cal_key();
 extern void scale_press_print_key();
 
 
-void scale_calibration_render_task(void *p) {
-    while (true) {
-        TickType_t last_render_tick = xTaskGetTickCount();
-        u8g2_t * display_handler = get_display_handler();
-
-        u8g2_ClearBuffer(display_handler);
-
-        // Draw title
-        if (strlen(title_string)) {
-            u8g2_SetFont(display_handler, u8g2_font_helvB08_tr);
-            u8g2_DrawStr(display_handler, 5, 10, title_string);
-        }
-
-        // Draw line
-        u8g2_DrawHLine(display_handler, 0, 13, u8g2_GetDisplayWidth(display_handler));
-
-        u8g2_SetFont(display_handler, u8g2_font_helvR08_tr);
-        // Draw line 1
-        if (strlen(line1)) {
-            u8g2_DrawStr(display_handler, 5, 25, line1);
-        }
+static TickType_t scale_calibration_render_scene(u8g2_t * display_handler) {
+    // Draw title
+    if (strlen(title_string)) {
+        u8g2_SetFont(display_handler, u8g2_font_helvB08_tr);
+        u8g2_DrawStr(display_handler, 5, 10, title_string);
+    }
 
-        // Draw line 2
-        if (strlen(line2)) {
-            u8g2_DrawStr(display_handler, 5, 37, line2);
-        }
+    // Draw line
+    u8g2_DrawHLine(display_handler, 0, 13, u8g2_GetDisplayWidth(display_handler));
 
-        // Draw a button
-        if (show_next_key) {
-            u8g2_DrawButtonUTF8(display_handler, 64, 59, U8G2_BTN_HCENTER | U8G2_BTN_INV | U8G2_BTN_BW1, 0, 1, 1, "Next");
-        }
+    u8g2_SetFont(display_handler, u8g2_font_helvR08_tr);
+    // Draw line 1
+    if (strlen(line1)) {
+        u8g2_DrawStr(display_handler, 5, 25, line1);
+    }
 
-        u8g2_SendBuffer(display_handler);
+    // Draw line 2
+    if (strlen(line2)) {
+        u8g2_DrawStr(display_handler, 5, 37, line2);
+    }
 
-        vTaskDelayUntil(&last_render_tick, pdMS_TO_TICKS(20));
+    // Draw a button
+    if (show_next_key) {
+        u8g2_DrawButtonUTF8(display_handler, 64, 59, U8G2_BTN_HCENTER | U8G2_BTN_INV | U8G2_BTN_BW1, 0, 1, 1, "Next");
     }
+
+    return pdMS_TO_TICKS(20);
 }
 
 
 uint8_t scale_calibrate_with_external_weight() {
-    if (scale_calibration_render_task_handler == NULL) {
-        UBaseType_t current_task_priority = uxTaskPriorityGet(xTaskGetCurrentTaskHandle());
-        xTaskCreate(scale_calibration_render_task, "Scale Measurement Render Task", configMINIMAL_STACK_SIZE, NULL, current_task_priority - 1, &scale_calibration_render_task_handler);
-    }
-    else {
-        vTaskResume(scale_calibration_render_task_handler);
-    }
+    display_set_scene(scale_calibration_render_scene);
 
     BaseType_t scheduler_state = xTaskGetSchedulerState();
 
@@ -137,7 +121,7 @@ uint8_t scale_calibrate_with_external_weight() {
     delay_ms(3000, scheduler_state);  // Wait for 3 seconds
     
 
-    vTaskSuspend(scale_calibration_render_task_handler);
+    display_set_scene(NULL);
 
     return 31;  // Returns to scale page
 }
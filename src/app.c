@@ -4,6 +4,7 @@
 
 #include <FreeRTOS.h>
 #include <task.h>
+#include <queue.h>
 #include <stdio.h>
 #include <stdint.h>
 #include "pico/stdlib.h"
@@ -27,43 +28,93 @@
 #include "menu.h"
 #include "profile.h"
 #include "servo_gate.h"
+#include "charge_history.h"
+#include "crc32.h"
+#include "boot.h"
+#include "static_alloc.h"
 
 
-int main()
-{
-    // stdio_init_all();
-    // Initialize EEPROM first
-    eeprom_init();
+typedef enum {
+    APP_BOOT_EEPROM = 0,
+    APP_BOOT_NEOPIXEL,
+    APP_BOOT_MINI_12864,
+    APP_BOOT_WIRELESS,
+    APP_BOOT_MOTORS,
+    APP_BOOT_SCALE,
+    APP_BOOT_CHARGE_MODE,
+    APP_BOOT_CHARGE_HISTORY,
+    APP_BOOT_PROFILE,
+    APP_BOOT_SERVO_GATE,
+    APP_BOOT_MENU,
+    APP_BOOT_STAGE_CNT,
+} app_boot_stage_t;
 
-    // Initialize Neopixel RGB on the mini 12864 board
-    neopixel_led_init();
 
-    // Configure other functions from mini 12864 display
-    mini_12864_module_init();
+extern QueueHandle_t encoder_event_queue;
 
-    // Initialize wireless settings
-    wireless_init();
+static motor_init_err_t motor_init_err = MOTOR_INIT_OK;
 
-    // Load config for motors
-    motor_init_err_t motor_init_err = motors_init();
+
+static bool _motors_boot(void) {
+    motor_init_err = motors_init();
     if (motor_init_err != MOTOR_INIT_OK) {
-        handle_motor_init_error(motor_init_err);
+        // Have the menu pick up the error, see app_handle_boot_failure
+        ButtonEncoderEvent_t button_event = OVERRIDE_FROM_REST;
+        xQueueSend(encoder_event_queue, &button_event, portMAX_DELAY);
+        return false;
     }
 
-    // Initialize UART
-    scale_init();
+    return true;
+}
+
+
+static bool _menu_boot(void) {
+    // Start menu task, it runs the charge loop so it stays with the control tasks
+    return STATIC_TASK_CREATE_AFFINITY_SET(menu_task, "Menu Task", 1024, NULL, 6, CONTROL_CORE_AFFINITY_MASK, NULL) == pdPASS;
+}
+
 
-    // Initialize charge mode settings
-    charge_mode_config_init();
+/*
+    The menu comes up once the display, the inputs and the settings its forms show are loaded. The motors (TMC UART 
+    handshakes) and the charge history scan finish behind it, the menu waits for them before entering a mode.
+*/
+static const boot_stage_t app_boot_stages[APP_BOOT_STAGE_CNT] = {
+    [APP_BOOT_EEPROM] = {"eeprom", eeprom_init, 0},
+    [APP_BOOT_NEOPIXEL] = {"neopixel", neopixel_led_init, BOOT_STAGE(APP_BOOT_EEPROM)},
+    [APP_BOOT_MINI_12864] = {"mini_12864", mini_12864_module_init, 
+                             BOOT_STAGE(APP_BOOT_EEPROM) | BOOT_STAGE(APP_BOOT_NEOPIXEL)},
+    [APP_BOOT_WIRELESS] = {"wireless", wireless_init, BOOT_STAGE(APP_BOOT_EEPROM)},
+    // The error is shown on the display
+    [APP_BOOT_MOTORS] = {"motors", _motors_boot, BOOT_STAGE(APP_BOOT_EEPROM) | BOOT_STAGE(APP_BOOT_MINI_12864)},
+    [APP_BOOT_SCALE] = {"scale", scale_init, BOOT_STAGE(APP_BOOT_EEPROM)},
+    [APP_BOOT_CHARGE_MODE] = {"charge_mode", charge_mode_config_init, BOOT_STAGE(APP_BOOT_EEPROM)},
+    [APP_BOOT_CHARGE_HISTORY] = {"charge_history", charge_history_init, 0},
+    // One flash writer at a time
+    [APP_BOOT_PROFILE] = {"profile", profile_data_init, 
+                          BOOT_STAGE(APP_BOOT_EEPROM) | BOOT_STAGE(APP_BOOT_CHARGE_HISTORY)},
+    [APP_BOOT_SERVO_GATE] = {"servo_gate", servo_gate_init, BOOT_STAGE(APP_BOOT_EEPROM)},
+    [APP_BOOT_MENU] = {"menu", _menu_boot, 
+                       BOOT_STAGE(APP_BOOT_MINI_12864) | BOOT_STAGE(APP_BOOT_SCALE) | BOOT_STAGE(APP_BOOT_CHARGE_MODE) |
+                       BOOT_STAGE(APP_BOOT_PROFILE) | BOOT_STAGE(APP_BOOT_SERVO_GATE)},
+};
+
+
+void app_handle_boot_failure(void) {
+    // The trickler can't run without the motors, the error stays on screen as it did before the menu came up early
+    if (motor_init_err != MOTOR_INIT_OK) {
+        handle_motor_init_error(motor_init_err);
+    }
+}
 
-    // Initialize profile data
-    profile_data_init();
 
-    // Initialize the servo
-    servo_gate_init();
+int main()
+{
+    // stdio_init_all();
+    // The config loads check the CRC on the DMA sniffer
+    crc32_init();
 
-    // Start menu task
-    xTaskCreate(menu_task, "Menu Task", 1024, NULL, 6, NULL);
+    // The subsystems are initialized by the boot workers, see app_boot_stages
+    boot_start(app_boot_stages, APP_BOOT_STAGE_CNT);
 
     // Start RTOS
     vTaskStartScheduler();
@@ -17,6 +17,7 @@ typedef enum {
     APP_STATE_ENTER_EEPROM_ERASE = 8,
     APP_STATE_ENTER_REBOOT = 9,
     APP_STATE_ENTER_WIFI_INFO = 10,
+    APP_STATE_ENTER_DEAD_TIME_MODE = 11,
 } AppState_t;
 
 
@@ -37,6 +38,12 @@ extern "C" {
 bool app_init();
 bool http_app_config();
 
+/**
+ * Called by the menu when the boot stages it waited for didn't all come up. Doesn't return if the failure stops 
+ * the trickler.
+ */
+void app_handle_boot_failure(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,294 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#if BENCHMARK_HOST
+#include <time.h>
+#else
+#include "hardware/structs/systick.h"
+#endif
+#include "hardware/clocks.h"
+
+#include "benchmark.h"
+#include "FloatRingBuffer.h"
+#include "common.h"
+#include "crc32.h"
+#include "motors.h"
+#include "profile.h"
+#include "scale.h"
+
+
+/*
+    Cycle counts of the hot paths on representative inputs, so the optimisation work has numbers behind it and a
+    regression shows between two builds. Run from /rest/benchmark.
+
+    SysTick is left as FreeRTOS configured it (processor clock, wrapping at the tick), a call is timed by the counter
+    values around it and the wrap is accounted for. The overhead of the timing is measured with an empty case and
+    subtracted. Nothing is run with the interrupts disabled, some cases allocate, so the max includes preemption.
+
+    The host build (tests/host, BENCHMARK_HOST) runs the same cases against the monotonic clock, the unit of the
+    results is the nanosecond there.
+*/
+
+static volatile uint32_t benchmark_sink;
+
+
+// Frames the scales send, in the format of the A&D FX-i (fixed) and of the generic driver (line)
+static const scale_frame_descriptor_t benchmark_fixed_frame_descriptor = {
+    .frame_size = 17,
+    .terminator = '\n',
+    .sign_offset = -1,
+    .stable_offset = 0,
+    .stable_char = 'S',
+    .data_offset = 3,
+    .data_length = 9,
+};
+static const char benchmark_fixed_frame[] = "ST,+0012.345  GN\n";
+
+static const scale_frame_descriptor_t benchmark_line_frame_descriptor = {
+    .frame_size = 0,
+    .sign_offset = -1,
+};
+static const char benchmark_line_frame[] = "ST,+   12.345 gr\r\n";
+
+static const char benchmark_uri[] = "/rest/charge_mode_config?c1=%23ff0000&c5=3.000&c14=true&ee=false";
+static uint8_t benchmark_crc_data[256];
+static FloatRingBuffer<20> benchmark_ring_buffer;
+static profile_t benchmark_profile;
+
+#if PICO_RP2350
+#define BENCHMARK_PLATFORM      "RP2350"
+#else
+#define BENCHMARK_PLATFORM      "RP2040"
+#endif
+
+
+static void _benchmark_empty(void) {
+}
+
+
+static void _benchmark_float_ring_buffer(void) {
+    benchmark_ring_buffer.enqueue((float) (benchmark_sink & 0xff) * 0.01f);
+
+    float stats = benchmark_ring_buffer.getMean() + benchmark_ring_buffer.getSd() + benchmark_ring_buffer.getSlope() +
+                  benchmark_ring_buffer.getMin() + benchmark_ring_buffer.getMax();
+    benchmark_sink += (uint32_t) stats;
+}
+
+
+static void _benchmark_frame_decoder(const scale_frame_descriptor_t * descriptor, const char * frame) {
+    scale_frame_decoder_t decoder;
+    memset(&decoder, 0x0, sizeof(decoder));
+
+    float weight = NAN;
+    for (const char * ch = frame; *ch; ch += 1) {
+        scale_frame_decoder_push(descriptor, &decoder, *ch, &weight);
+    }
+    benchmark_sink += (uint32_t) weight;
+}
+
+
+static void _benchmark_fixed_frame_decoder(void) {
+    _benchmark_frame_decoder(&benchmark_fixed_frame_descriptor, benchmark_fixed_frame);
+}
+
+
+static void _benchmark_line_frame_decoder(void) {
+    _benchmark_frame_decoder(&benchmark_line_frame_descriptor, benchmark_line_frame);
+}
+
+
+static void _benchmark_float_to_string(void) {
+    char buf[16];
+    benchmark_sink += float_to_string(buf, 41.237f, DP_3);
+}
+
+
+static void _benchmark_software_crc32(void) {
+    benchmark_sink += software_crc32(benchmark_crc_data, sizeof(benchmark_crc_data));
+}
+
+
+static void _benchmark_speed_to_period(void) {
+    benchmark_sink += speed_to_period(1.234f, 125000000, 200 * 256);
+}
+
+
+// Divisions and a square root, the float work of the controller
+static void _benchmark_flow_speed(void) {
+    benchmark_sink += (uint32_t) profile_get_flow_speed(&benchmark_profile, SELECT_COARSE_TRICKLER_MOTOR, 
+                                                        (float) (benchmark_sink & 0xff) * 0.1f);
+}
+
+
+static void _benchmark_decode_uri(void) {
+    char buf[sizeof(benchmark_uri)];
+    decode_uri(buf, benchmark_uri);
+    benchmark_sink += buf[0];
+}
+
+
+static void _benchmark_rest_get_handler(void) {
+    benchmark_sink += rest_get_handler("/rest/charge_mode_state") != NULL;
+}
+
+
+typedef struct {
+    const char * name;
+    void (*run)(void);
+} _benchmark_case_t;
+
+static const _benchmark_case_t benchmark_cases[] = {
+    {"float_ring_buffer", _benchmark_float_ring_buffer},
+    {"frame_decoder_fixed", _benchmark_fixed_frame_decoder},
+    {"frame_decoder_line", _benchmark_line_frame_decoder},
+    {"float_to_string", _benchmark_float_to_string},
+    {"software_crc32_256", _benchmark_software_crc32},
+    {"speed_to_period", _benchmark_speed_to_period},
+    {"flow_speed", _benchmark_flow_speed},
+    {"decode_uri", _benchmark_decode_uri},
+    {"rest_get_handler", _benchmark_rest_get_handler},
+};
+#define BENCHMARK_CASE_CNT      (sizeof(benchmark_cases) / sizeof(benchmark_cases[0]))
+
+
+#if BENCHMARK_HOST
+static inline uint32_t _benchmark_timer_reload(void) {
+    return 0;
+}
+
+
+static inline uint32_t _benchmark_timer_read(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint32_t) ((uint64_t) now.tv_sec * 1000000000u + now.tv_nsec);
+}
+
+
+// The clock counts up, the 32 bit difference stays right across a wrap
+static inline uint32_t _benchmark_timer_elapsed(uint32_t start, uint32_t end, uint32_t reload) {
+    return end - start;
+}
+#else
+static inline uint32_t _benchmark_timer_reload(void) {
+    return systick_hw->rvr & 0xffffff;
+}
+
+
+static inline uint32_t _benchmark_timer_read(void) {
+    return systick_hw->cvr;
+}
+
+
+// SysTick counts down from the reload value, calls are shorter than one wrap (the FreeRTOS tick)
+static inline uint32_t _benchmark_timer_elapsed(uint32_t start, uint32_t end, uint32_t reload) {
+    return start >= end ? start - end : start + reload + 1 - end;
+}
+#endif
+
+
+static void _benchmark_measure(void (*run)(void), uint32_t iterations, uint32_t overhead, benchmark_result_t * result) {
+    uint32_t reload = _benchmark_timer_reload();
+    uint64_t sum = 0;
+
+    result->min_cycles = UINT32_MAX;
+    result->max_cycles = 0;
+
+    for (uint32_t idx = 0; idx < iterations; idx += 1) {
+        uint32_t start = _benchmark_timer_read();
+        run();
+        uint32_t end = _benchmark_timer_read();
+
+        uint32_t cycles = _benchmark_timer_elapsed(start, end, reload);
+        cycles = cycles > overhead ? cycles - overhead : 0;
+
+        sum += cycles;
+        if (cycles < result->min_cycles) {
+            result->min_cycles = cycles;
+        }
+        if (cycles > result->max_cycles) {
+            result->max_cycles = cycles;
+        }
+    }
+
+    result->mean_cycles = (uint32_t) (sum / iterations);
+}
+
+
+static uint32_t _benchmark_iterations(uint32_t iterations) {
+    if (iterations < 1) {
+        return 1;
+    }
+    return iterations > BENCHMARK_MAX_ITERATIONS ? BENCHMARK_MAX_ITERATIONS : iterations;
+}
+
+
+uint8_t benchmark_run(uint32_t iterations, benchmark_result_t * results, uint8_t max_results) {
+    iterations = _benchmark_iterations(iterations);
+
+    for (size_t idx = 0; idx < sizeof(benchmark_crc_data); idx += 1) {
+        benchmark_crc_data[idx] = (uint8_t) (idx * 31 + 7);
+    }
+    benchmark_ring_buffer.reset();
+    for (size_t idx = 0; idx < benchmark_ring_buffer.getCapacity(); idx += 1) {
+        benchmark_ring_buffer.enqueue(idx * 0.01f);
+    }
+    memset(&benchmark_profile, 0x0, sizeof(benchmark_profile));
+    benchmark_profile.coarse_flow_gain = 8.0f;
+    benchmark_profile.coarse_flow_gain_slope = -0.5f;
+
+    benchmark_result_t empty;
+    _benchmark_measure(_benchmark_empty, iterations, 0, &empty);
+
+    uint8_t count = 0;
+    for (; count < BENCHMARK_CASE_CNT && count < max_results; count += 1) {
+        results[count].name = benchmark_cases[count].name;
+        _benchmark_measure(benchmark_cases[count].run, iterations, empty.min_cycles, &results[count]);
+    }
+
+    return count;
+}
+
+
+bool http_rest_benchmark(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // n (int): Iterations per case, default BENCHMARK_DEFAULT_ITERATIONS
+    //
+    // Response: {"n":<int>,"hz":<system clock>,"p":"<chip>","b":{"<case>":[min,mean,max], ...}}, cycles per call
+    const size_t benchmark_json_buffer_size = 640;
+    char * benchmark_json_buffer = (char *) rest_response_alloc(benchmark_json_buffer_size);
+    if (benchmark_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    uint32_t iterations = BENCHMARK_DEFAULT_ITERATIONS;
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "n") == 0) {
+            iterations = strtoul(values[idx], NULL, 10);
+        }
+    }
+    iterations = _benchmark_iterations(iterations);
+
+    benchmark_result_t results[BENCHMARK_CASE_CNT];
+    uint8_t count = benchmark_run(iterations, results, BENCHMARK_CASE_CNT);
+
+    size_t len = snprintf(benchmark_json_buffer, benchmark_json_buffer_size, "%s{\"n\":%lu,\"hz\":%lu,\"p\":\"%s\",\"b\":{",
+                          http_json_header, iterations, clock_get_hz(clk_sys), BENCHMARK_PLATFORM);
+    for (uint8_t idx = 0; idx < count && len < benchmark_json_buffer_size; idx += 1) {
+        len += snprintf(benchmark_json_buffer + len, benchmark_json_buffer_size - len, "%s\"%s\":[%lu,%lu,%lu]",
+                        idx ? "," : "", results[idx].name, results[idx].min_cycles, results[idx].mean_cycles,
+                        results[idx].max_cycles);
+    }
+    if (len < benchmark_json_buffer_size) {
+        snprintf(benchmark_json_buffer + len, benchmark_json_buffer_size - len, "}}");
+    }
+
+    size_t data_length = strlen(benchmark_json_buffer);
+    file->data = benchmark_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
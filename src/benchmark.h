@@ -0,0 +1,38 @@
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "http_rest.h"
+
+
+#define BENCHMARK_DEFAULT_ITERATIONS    1000
+#define BENCHMARK_MAX_ITERATIONS        100000
+
+
+// Cycles per call of a benchmark case, measured with SysTick (nanoseconds in the host build)
+typedef struct {
+    const char * name;
+    uint32_t min_cycles;
+    uint32_t mean_cycles;
+    uint32_t max_cycles;            // Includes any preemption, compare min and mean between builds
+} benchmark_result_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Runs every benchmark case iterations times on the calling core. Writes up to max_results results, returns the
+ * number of cases.
+ */
+uint8_t benchmark_run(uint32_t iterations, benchmark_result_t * results, uint8_t max_results);
+
+bool http_rest_benchmark(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // BENCHMARK_H_
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <event_groups.h>
+#include "pico/platform.h"
+#include "pico/time.h"
+
+#include "boot.h"
+#include "static_alloc.h"
+
+
+/*
+    Staged boot. A few workers take the stages in table order, each one as soon as the stages it depends on are done,
+    so a stage waiting on its hardware (e.g. the TMC UART handshakes) doesn't hold up the others. The workers stay on
+    core 0, the core main() ran the inits on: the IRQ handlers the inits install are per core.
+*/
+
+#define BOOT_WORKER_CNT                 3
+#define BOOT_WORKER_STACK_SIZE          1024
+#define BOOT_WORKER_PRIORITY            4       // Below the menu task and the display compositor
+#define BOOT_WORKER_CORE_AFFINITY_MASK  (1 << 0)
+
+
+typedef struct {
+    uint32_t start_ms;
+    uint32_t end_ms;
+    bool started;
+    bool is_ok;
+} _boot_stage_state_t;
+
+
+static const boot_stage_t * boot_stages = NULL;
+static uint8_t boot_stage_cnt = 0;
+static uint32_t boot_stage_mask = 0;
+static _boot_stage_state_t boot_stage_states[BOOT_MAX_STAGE_CNT];
+static volatile uint32_t boot_failed_stages = 0;
+static EventGroupHandle_t boot_done_event = NULL;
+
+
+// Takes the next stage that can run, -1 if none can right now
+static int _take_stage(uint32_t done) {
+    int taken = -1;
+
+    taskENTER_CRITICAL();
+    for (uint8_t idx = 0; idx < boot_stage_cnt; idx += 1) {
+        if (!boot_stage_states[idx].started && (boot_stages[idx].depends_on & done) == boot_stages[idx].depends_on) {
+            boot_stage_states[idx].started = true;
+            taken = idx;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return taken;
+}
+
+
+static void boot_worker_task(void * p) {
+    while (true) {
+        uint32_t done = xEventGroupGetBits(boot_done_event) & boot_stage_mask;
+        if (done == boot_stage_mask) {
+            break;
+        }
+
+        int idx = _take_stage(done);
+        if (idx < 0) {
+            // Wake up on the next stage to finish
+            xEventGroupWaitBits(boot_done_event, boot_stage_mask & ~done, pdFALSE, pdFALSE, portMAX_DELAY);
+            continue;
+        }
+
+        _boot_stage_state_t * state = &boot_stage_states[idx];
+        state->start_ms = to_ms_since_boot(get_absolute_time());
+        state->is_ok = boot_stages[idx].init();
+        state->end_ms = to_ms_since_boot(get_absolute_time());
+
+        printf("Boot stage %s %s in %lu ms (at %lu ms)\n", boot_stages[idx].name, state->is_ok ? "done" : "failed",
+               state->end_ms - state->start_ms, state->end_ms);
+
+        // Failures are recorded before the stage shows as done
+        if (!state->is_ok) {
+            taskENTER_CRITICAL();
+            boot_failed_stages |= BOOT_STAGE(idx);
+            taskEXIT_CRITICAL();
+        }
+        xEventGroupSetBits(boot_done_event, BOOT_STAGE(idx));
+    }
+
+    vTaskDelete(NULL);
+}
+
+
+void boot_start(const boot_stage_t * stages, uint8_t stage_cnt) {
+    configASSERT(stage_cnt <= BOOT_MAX_STAGE_CNT);
+
+    boot_stages = stages;
+    boot_stage_cnt = MIN(stage_cnt, BOOT_MAX_STAGE_CNT);
+    boot_stage_mask = boot_stage_cnt == BOOT_MAX_STAGE_CNT ? BOOT_STAGES_ALL : BOOT_STAGE(boot_stage_cnt) - 1;
+    memset(boot_stage_states, 0x0, sizeof(boot_stage_states));
+
+    boot_done_event = STATIC_EVENT_GROUP_CREATE();
+    configASSERT(boot_done_event);
+
+    // The workers delete themselves once the boot is done, their stacks go back to the heap for good
+    for (uint8_t worker = 0; worker < BOOT_WORKER_CNT; worker += 1) {
+        xTaskCreateAffinitySet(boot_worker_task, "Boot", BOOT_WORKER_STACK_SIZE, NULL, BOOT_WORKER_PRIORITY,
+                               BOOT_WORKER_CORE_AFFINITY_MASK, NULL);
+    }
+}
+
+
+bool boot_wait_for_stages(uint32_t stages) {
+    stages &= boot_stage_mask;
+
+    if (stages) {
+        xEventGroupWaitBits(boot_done_event, stages, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+
+    return (boot_failed_stages & stages) == 0;
+}
+
+
+bool http_rest_boot(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Response:
+    // b0 (int): Stages finished
+    // b1 (int): Stages in total
+    // b2 (array): Stages as [name, start_ms, end_ms, state], state 0 = pending, 1 = running, 2 = done, 3 = failed
+    //             Times are since power up, end_ms is 0 until the stage finishes
+    const size_t boot_json_buffer_size = 64 + BOOT_MAX_STAGE_CNT * 48;
+    char * boot_json_buffer = (char *) rest_response_alloc(boot_json_buffer_size);
+    if (boot_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    uint32_t done = xEventGroupGetBits(boot_done_event) & boot_stage_mask;
+    int len = snprintf(boot_json_buffer,
+                       boot_json_buffer_size,
+                       "%s"
+                       "{\"b0\":%u,\"b1\":%u,\"b2\":[",
+                       http_json_header,
+                       __builtin_popcount(done),
+                       boot_stage_cnt);
+
+    for (uint8_t idx = 0; idx < boot_stage_cnt; idx += 1) {
+        // Leave space for the closing brackets
+        if (len + 48 >= (int) boot_json_buffer_size) {
+            break;
+        }
+
+        _boot_stage_state_t * state = &boot_stage_states[idx];
+        uint8_t stage_state = 0;
+        if (done & BOOT_STAGE(idx)) {
+            stage_state = state->is_ok ? 2 : 3;
+        }
+        else if (state->started) {
+            stage_state = 1;
+        }
+
+        len += snprintf(boot_json_buffer + len,
+                        boot_json_buffer_size - len,
+                        "%s[\"%s\",%lu,%lu,%u]",
+                        idx == 0 ? "" : ",",
+                        boot_stages[idx].name,
+                        state->start_ms,
+                        stage_state >= 2 ? state->end_ms : 0,
+                        stage_state);
+    }
+
+    snprintf(boot_json_buffer + len, boot_json_buffer_size - len, "]}");
+
+    size_t data_length = strlen(boot_json_buffer);
+    file->data = boot_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
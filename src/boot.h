@@ -0,0 +1,45 @@
+#ifndef BOOT_H_
+#define BOOT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "http_rest.h"
+
+
+// Stages are the bits of a 24 bit event group
+#define BOOT_MAX_STAGE_CNT              24
+#define BOOT_STAGES_ALL                 ((1u << BOOT_MAX_STAGE_CNT) - 1)
+#define BOOT_STAGE(idx)                 (1u << (idx))
+
+
+typedef bool (*boot_stage_init_t)(void);
+
+typedef struct {
+    const char * name;
+    boot_stage_init_t init;
+    uint32_t depends_on;        // BOOT_STAGE() of the stages (index in the table) to finish first
+} boot_stage_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Starts the workers that run the stages once the scheduler starts. A stage runs as soon as the stages it depends on
+ * have finished, independent stages run side by side. The table shall stay valid, call before vTaskStartScheduler.
+ */
+void boot_start(const boot_stage_t * stages, uint8_t stage_cnt);
+
+/**
+ * Blocks until the stages have finished, returns false if any of them failed.
+ */
+bool boot_wait_for_stages(uint32_t stages);
+
+bool http_rest_boot(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // BOOT_H_
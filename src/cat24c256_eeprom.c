@@ -12,6 +12,8 @@
 
 
 #define PAGE_SIZE   64  // 64 byte page size
+#define WRITE_CYCLE_TIMEOUT_US      10000   // tWR is 5 ms max
+#define ACK_POLL_INTERVAL_US        100     // Before the scheduler runs, otherwise one tick
 
 
 void cat24c256_eeprom_init() {
@@ -45,22 +47,49 @@ bool _cat24c256_write_page(uint16_t data_addr, uint8_t * data, size_t len){
 }
 
 
+/*
+    The EEPROM doesn't acknowledge its address while an internal write cycle is running. Poll it (a one byte current
+    address read) until it does instead of waiting the worst case tWR, yielding to other tasks between the polls.
+*/
+static bool _cat24c256_wait_write_cycle(void) {
+    bool scheduler_running = xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+    absolute_time_t timeout = make_timeout_time_us(WRITE_CYCLE_TIMEOUT_US);
+    uint8_t dummy;
+
+    while (i2c_read_blocking(EEPROM_I2C, EEPROM_ADDR, &dummy, 1, false) == PICO_ERROR_GENERIC) {
+        if (absolute_time_diff_us(get_absolute_time(), timeout) <= 0) {
+            return false;
+        }
+
+        if (scheduler_running) {
+            vTaskDelay(1);
+        }
+        else {
+            busy_wait_us(ACK_POLL_INTERVAL_US);
+        }
+    }
+
+    return true;
+}
+
+
 bool cat24c256_write(uint16_t base_addr, uint8_t * data, size_t len) {
-    uint16_t num_pages = len / PAGE_SIZE;
-    bool is_ok;
-
-    for (uint16_t page = 0; page <= num_pages; page += 1) {
-        uint16_t offset = page * PAGE_SIZE;
-        size_t write_size = PAGE_SIZE;
-        if (page == num_pages) {
-            write_size = len % PAGE_SIZE;
+    size_t offset = 0;
+
+    // A page write wraps around within its page, so split at the page boundaries of the EEPROM
+    while (offset < len) {
+        uint16_t addr = base_addr + offset;
+        size_t write_size = MIN(len - offset, PAGE_SIZE - (addr % PAGE_SIZE));
+
+        if (!_cat24c256_write_page(addr, data + offset, write_size)) {
+            return false;
         }
 
-        is_ok = _cat24c256_write_page(base_addr + offset, data + offset, write_size);
-        busy_wait_us(5 * 1000ULL);
-        if (!is_ok) {
+        if (!_cat24c256_wait_write_cycle()) {
             return false;
         }
+
+        offset += write_size;
     }
 
     return true;
@@ -0,0 +1,231 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include "pico/time.h"
+
+#include "charge_batch.h"
+#include "common.h"
+#include "static_alloc.h"
+
+
+/*
+    Running statistics of a batch of charges, the charge mode session. Everything is updated incrementally as the
+    charges complete: the final weights with Welford's method, the charge times into a histogram the percentiles are
+    read from. Nothing per charge is kept, a batch can be of any size.
+*/
+typedef struct {
+    uint32_t size;
+    uint32_t count;
+    uint32_t over_charges;
+    uint32_t under_charges;
+
+    float weight_mean;
+    float weight_m2;
+    float weight_min;
+    float weight_max;
+
+    float charge_time_sum_s;
+    uint16_t charge_time_hist[CHARGE_BATCH_TIME_BIN_CNT];
+
+    uint64_t start_time_us;
+    uint64_t last_charge_time_us;
+} _charge_batch_t;
+
+static _charge_batch_t charge_batch;
+static SemaphoreHandle_t charge_batch_mutex = NULL;
+
+
+bool charge_batch_init(void) {
+    charge_batch_mutex = STATIC_SEMAPHORE_CREATE_MUTEX();
+    if (charge_batch_mutex == NULL) {
+        return false;
+    }
+
+    charge_batch_start(0);
+    return true;
+}
+
+
+void charge_batch_start(uint32_t size) {
+    if (charge_batch_mutex == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(charge_batch_mutex, portMAX_DELAY);
+    memset(&charge_batch, 0x0, sizeof(charge_batch));
+    charge_batch.size = size;
+    charge_batch.start_time_us = time_us_64();
+    xSemaphoreGive(charge_batch_mutex);
+}
+
+
+bool charge_batch_add(float final_weight, float charge_time_s, bool over_charged, bool under_charged) {
+    if (charge_batch_mutex == NULL || !isfinite(final_weight)) {
+        return false;
+    }
+
+    xSemaphoreTake(charge_batch_mutex, portMAX_DELAY);
+
+    charge_batch.count += 1;
+    charge_batch.over_charges += over_charged ? 1 : 0;
+    charge_batch.under_charges += under_charged ? 1 : 0;
+
+    // Welford
+    float delta = final_weight - charge_batch.weight_mean;
+    charge_batch.weight_mean += delta / charge_batch.count;
+    charge_batch.weight_m2 += delta * (final_weight - charge_batch.weight_mean);
+
+    if (charge_batch.count == 1) {
+        charge_batch.weight_min = final_weight;
+        charge_batch.weight_max = final_weight;
+    }
+    else {
+        charge_batch.weight_min = fminf(charge_batch.weight_min, final_weight);
+        charge_batch.weight_max = fmaxf(charge_batch.weight_max, final_weight);
+    }
+
+    uint32_t bin = (uint32_t) (fmaxf(charge_time_s, 0.0f) * 1000.0f / CHARGE_BATCH_TIME_BIN_MS);
+    if (bin >= CHARGE_BATCH_TIME_BIN_CNT) {
+        bin = CHARGE_BATCH_TIME_BIN_CNT - 1;
+    }
+    if (charge_batch.charge_time_hist[bin] < UINT16_MAX) {
+        charge_batch.charge_time_hist[bin] += 1;
+    }
+    charge_batch.charge_time_sum_s += charge_time_s;
+    charge_batch.last_charge_time_us = time_us_64();
+
+    bool completed = charge_batch.size > 0 && charge_batch.count == charge_batch.size;
+
+    xSemaphoreGive(charge_batch_mutex);
+
+    return completed;
+}
+
+
+bool charge_batch_is_complete(void) {
+    return charge_batch.size > 0 && charge_batch.count >= charge_batch.size;
+}
+
+
+// Upper edge of the histogram bin holding the charge time below which the fraction of the charges completed
+static float _charge_time_percentile_s(float fraction) {
+    uint32_t rank = (uint32_t) ceilf(fraction * charge_batch.count);
+    uint32_t cumulative = 0;
+
+    for (uint32_t bin = 0; bin < CHARGE_BATCH_TIME_BIN_CNT; bin += 1) {
+        cumulative += charge_batch.charge_time_hist[bin];
+        if (cumulative >= rank) {
+            return (bin + 1) * CHARGE_BATCH_TIME_BIN_MS / 1000.0f;
+        }
+    }
+
+    return CHARGE_BATCH_TIME_BIN_CNT * CHARGE_BATCH_TIME_BIN_MS / 1000.0f;
+}
+
+
+void charge_batch_get_summary(charge_batch_summary_t * summary) {
+    memset(summary, 0x0, sizeof(charge_batch_summary_t));
+    if (charge_batch_mutex == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(charge_batch_mutex, portMAX_DELAY);
+
+    summary->size = charge_batch.size;
+    summary->count = charge_batch.count;
+    summary->over_charges = charge_batch.over_charges;
+    summary->under_charges = charge_batch.under_charges;
+
+    if (charge_batch.count > 0) {
+        summary->weight_mean = charge_batch.weight_mean;
+        summary->weight_sd = charge_batch.count > 1 ? sqrtf(charge_batch.weight_m2 / (charge_batch.count - 1)) : 0.0f;
+        summary->weight_min = charge_batch.weight_min;
+        summary->weight_max = charge_batch.weight_max;
+        summary->weight_es = charge_batch.weight_max - charge_batch.weight_min;
+
+        summary->charge_time_mean_s = charge_batch.charge_time_sum_s / charge_batch.count;
+        summary->charge_time_p50_s = _charge_time_percentile_s(0.5f);
+        summary->charge_time_p90_s = _charge_time_percentile_s(0.9f);
+
+        float elapsed_s = (charge_batch.last_charge_time_us - charge_batch.start_time_us) / 1e6f;
+        if (elapsed_s > 0) {
+            summary->charges_per_hour = charge_batch.count * 3600.0f / elapsed_s;
+        }
+    }
+
+    xSemaphoreGive(charge_batch_mutex);
+}
+
+
+bool http_rest_charge_batch(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // n (int): Start a new batch of n charges, 0 for no limit
+    // r (bool): Restart the batch, same size
+    //
+    // b0 (int): Batch size, 0 for no limit
+    // b1 (int): Charges completed
+    // b2 (float): Mean final weight
+    // b3 (float): Standard deviation of the final weight
+    // b4 (float): Extreme spread of the final weight
+    // b5 (float): Lowest final weight
+    // b6 (float): Highest final weight
+    // b7 (int): Over charges
+    // b8 (int): Under charges
+    // b9 (float): Mean charge time (s)
+    // b10 (float): Median charge time (s)
+    // b11 (float): 90th percentile charge time (s)
+    // b12 (float): Charges per hour
+    // b13 (bool): Batch complete
+    const size_t charge_batch_json_buffer_size = 384;
+    char * charge_batch_json_buffer = (char *) rest_response_alloc(charge_batch_json_buffer_size);
+    if (charge_batch_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    // Control
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "n") == 0) {
+            int size = atoi(values[idx]);
+            charge_batch_start(size > 0 ? size : 0);
+        }
+        else if (strcmp(params[idx], "r") == 0 && string_to_boolean(values[idx])) {
+            charge_batch_start(charge_batch.size);
+        }
+    }
+
+    // Response
+    charge_batch_summary_t summary;
+    charge_batch_get_summary(&summary);
+
+    snprintf(charge_batch_json_buffer,
+             charge_batch_json_buffer_size,
+             "%s"
+             "{\"b0\":%lu,\"b1\":%lu,\"b2\":%0.4f,\"b3\":%0.4f,\"b4\":%0.4f,\"b5\":%0.4f,\"b6\":%0.4f,\"b7\":%lu,\"b8\":%lu,"
+             "\"b9\":%0.2f,\"b10\":%0.2f,\"b11\":%0.2f,\"b12\":%0.1f,\"b13\":%s}",
+             http_json_header,
+             summary.size,
+             summary.count,
+             summary.weight_mean,
+             summary.weight_sd,
+             summary.weight_es,
+             summary.weight_min,
+             summary.weight_max,
+             summary.over_charges,
+             summary.under_charges,
+             summary.charge_time_mean_s,
+             summary.charge_time_p50_s,
+             summary.charge_time_p90_s,
+             summary.charges_per_hour,
+             boolean_to_string(summary.size > 0 && summary.count >= summary.size));
+
+    size_t data_length = strlen(charge_batch_json_buffer);
+    file->data = charge_batch_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef CHARGE_BATCH_H_
+#define CHARGE_BATCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "http_rest.h"
+
+
+#define CHARGE_BATCH_TIME_BIN_MS        250     // Resolution of the charge time percentiles
+#define CHARGE_BATCH_TIME_BIN_CNT       240     // Up to 60 s, longer charges count in the last bin
+
+
+// Statistics of the current batch, see charge_batch_get_summary
+typedef struct {
+    uint32_t size;                      // Charges in the batch, 0 for an open ended batch
+    uint32_t count;                     // Charges completed
+    uint32_t over_charges;
+    uint32_t under_charges;
+
+    // Final (settled) weights
+    float weight_mean;
+    float weight_sd;
+    float weight_min;
+    float weight_max;
+    float weight_es;                    // Extreme spread, max - min
+
+    // Charge times and throughput
+    float charge_time_mean_s;
+    float charge_time_p50_s;
+    float charge_time_p90_s;
+    float charges_per_hour;             // From the start of the batch to the last charge
+} charge_batch_summary_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool charge_batch_init(void);
+
+/**
+ * Starts a new batch of size charges (0 for no limit), the statistics of the previous one are dropped.
+ */
+void charge_batch_start(uint32_t size);
+
+/**
+ * Adds a completed charge to the batch. Returns true when it completes the batch.
+ */
+bool charge_batch_add(float final_weight, float charge_time_s, bool over_charged, bool under_charged);
+
+bool charge_batch_is_complete(void);
+
+void charge_batch_get_summary(charge_batch_summary_t * summary);
+
+bool http_rest_charge_batch(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // CHARGE_BATCH_H_
@@ -0,0 +1,362 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <semphr.h>
+#include "hardware/flash.h"
+#include "hardware/regs/addressmap.h"
+#include "pico/flash.h"
+#include "pico/platform.h"
+#include "pico/time.h"
+
+#include "charge_history.h"
+#include "common.h"
+#include "crc32.h"
+#include "static_alloc.h"
+
+
+/*
+    Append-only log of the completed charges in the QSPI flash after the firmware image.
+
+    The log is a ring of fixed size records: the slot of a record is its seq modulo the record count, so the seq is the
+    index and no separate table has to be kept up to date. Appending walks through all the sectors in turn and a sector
+    is erased when the first record lands in it, so every sector sees one erase per lap of the ring (4096 charges).
+    An erased slot reads 0xFF and fails the CRC, as do records that were cut short by a power loss.
+
+    The records are read straight from the XIP mapped flash, on boot to rebuild the summary and by the REST export.
+    Programming stalls both cores (flash_safe_execute), which is done by a low priority task on the network core.
+*/
+
+#define CHARGE_HISTORY_FLASH_OFFSET         (PICO_FLASH_SIZE_BYTES - CHARGE_HISTORY_FLASH_SIZE)
+#define CHARGE_HISTORY_RECORD_COUNT         (CHARGE_HISTORY_FLASH_SIZE / sizeof(charge_history_record_t))
+#define CHARGE_HISTORY_SECTOR_RECORDS       (FLASH_SECTOR_SIZE / sizeof(charge_history_record_t))
+#define CHARGE_HISTORY_PAGE_RECORDS         (FLASH_PAGE_SIZE / sizeof(charge_history_record_t))
+
+#define CHARGE_HISTORY_QUEUE_LENGTH         4
+#define CHARGE_HISTORY_TASK_PRIORITY        1
+#define CHARGE_HISTORY_FLASH_TIMEOUT_MS     1000    // Time for the other core to get out of the way
+
+_Static_assert(sizeof(charge_history_record_t) == 32, "Charge history records shall fit the flash pages");
+
+
+typedef struct {
+    uint32_t offset;
+    const uint8_t * data;           // One page to program, NULL to erase the sector at offset
+} _flash_operation_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t remaining;
+} _export_state_t;
+
+
+extern char __flash_binary_end;
+
+static const charge_history_record_t * const charge_history_log =
+    (const charge_history_record_t *) (XIP_BASE + CHARGE_HISTORY_FLASH_OFFSET);
+
+static charge_history_summary_t charge_history_summary;
+static uint16_t charge_history_session = 0;
+static SemaphoreHandle_t charge_history_mutex = NULL;
+static QueueHandle_t charge_history_queue = NULL;
+static uint8_t charge_history_page[FLASH_PAGE_SIZE];
+
+
+static bool _record_is_valid(const charge_history_record_t * record, uint32_t slot) {
+    return record->seq % CHARGE_HISTORY_RECORD_COUNT == slot &&
+           record->crc32 == crc32_compute(record, offsetof(charge_history_record_t, crc32));
+}
+
+
+static void _summary_update(const charge_history_record_t * record, bool add) {
+    double sign = add ? 1.0 : -1.0;
+    double overthrow = (double) record->final_weight - (double) record->target_weight;
+
+    if (add) {
+        charge_history_summary.count += 1;
+        charge_history_summary.over_charges += (record->flags & CHARGE_HISTORY_FLAG_OVER_CHARGE) ? 1 : 0;
+        charge_history_summary.under_charges += (record->flags & CHARGE_HISTORY_FLAG_UNDER_CHARGE) ? 1 : 0;
+    }
+    else {
+        charge_history_summary.count -= 1;
+        charge_history_summary.over_charges -= (record->flags & CHARGE_HISTORY_FLAG_OVER_CHARGE) ? 1 : 0;
+        charge_history_summary.under_charges -= (record->flags & CHARGE_HISTORY_FLAG_UNDER_CHARGE) ? 1 : 0;
+    }
+
+    charge_history_summary.overthrow_sum += sign * overthrow;
+    charge_history_summary.overthrow_square_sum += sign * overthrow * overthrow;
+    charge_history_summary.charge_time_ms_sum += sign * record->charge_time_ms;
+}
+
+
+static void _flash_operation(void * param) {
+    _flash_operation_t * operation = (_flash_operation_t *) param;
+
+    if (operation->data) {
+        flash_range_program(operation->offset, operation->data, FLASH_PAGE_SIZE);
+    }
+    else {
+        flash_range_erase(operation->offset, FLASH_SECTOR_SIZE);
+    }
+}
+
+
+static void _write_record(charge_history_record_t * record) {
+    xSemaphoreTake(charge_history_mutex, portMAX_DELAY);
+    record->seq = charge_history_summary.next_seq;
+    xSemaphoreGive(charge_history_mutex);
+
+    record->session = charge_history_session;
+    record->crc32 = crc32_compute(record, offsetof(charge_history_record_t, crc32));
+
+    uint32_t slot = record->seq % CHARGE_HISTORY_RECORD_COUNT;
+    _flash_operation_t operation;
+
+    if (slot % CHARGE_HISTORY_SECTOR_RECORDS == 0) {
+        // The records of the sector leave the summary before they are erased
+        xSemaphoreTake(charge_history_mutex, portMAX_DELAY);
+        for (uint32_t idx = slot; idx < slot + CHARGE_HISTORY_SECTOR_RECORDS; idx += 1) {
+            if (_record_is_valid(&charge_history_log[idx], idx)) {
+                _summary_update(&charge_history_log[idx], false);
+            }
+        }
+        if (record->seq + CHARGE_HISTORY_SECTOR_RECORDS > CHARGE_HISTORY_RECORD_COUNT) {
+            charge_history_summary.first_seq = MAX(charge_history_summary.first_seq,
+                                                   record->seq + CHARGE_HISTORY_SECTOR_RECORDS - CHARGE_HISTORY_RECORD_COUNT);
+        }
+        xSemaphoreGive(charge_history_mutex);
+
+        operation.offset = CHARGE_HISTORY_FLASH_OFFSET + slot * sizeof(charge_history_record_t);
+        operation.data = NULL;
+        if (flash_safe_execute(_flash_operation, &operation, CHARGE_HISTORY_FLASH_TIMEOUT_MS) != PICO_OK) {
+            printf("Unable to erase charge history sector at %lx\n", operation.offset);
+        }
+    }
+
+    // Programming leaves the bits of the other records in the page as they are
+    memset(charge_history_page, 0xFF, sizeof(charge_history_page));
+    memcpy(charge_history_page + (slot % CHARGE_HISTORY_PAGE_RECORDS) * sizeof(charge_history_record_t),
+           record, sizeof(charge_history_record_t));
+
+    operation.offset = CHARGE_HISTORY_FLASH_OFFSET + (slot / CHARGE_HISTORY_PAGE_RECORDS) * FLASH_PAGE_SIZE;
+    operation.data = charge_history_page;
+    bool is_ok = flash_safe_execute(_flash_operation, &operation, CHARGE_HISTORY_FLASH_TIMEOUT_MS) == PICO_OK;
+
+    // A failed slot stays a gap, the following records keep their positions
+    xSemaphoreTake(charge_history_mutex, portMAX_DELAY);
+    charge_history_summary.next_seq = record->seq + 1;
+    if (is_ok && _record_is_valid(&charge_history_log[slot], slot)) {
+        _summary_update(&charge_history_log[slot], true);
+    }
+    xSemaphoreGive(charge_history_mutex);
+
+    if (!is_ok) {
+        printf("Unable to program charge history record %lu\n", record->seq);
+    }
+}
+
+
+static void charge_history_task(void * p) {
+    charge_history_record_t record;
+
+    while (true) {
+        if (xQueueReceive(charge_history_queue, &record, portMAX_DELAY) == pdTRUE) {
+            _write_record(&record);
+        }
+    }
+}
+
+
+bool charge_history_init(void) {
+    memset(&charge_history_summary, 0x0, sizeof(charge_history_summary));
+
+    // Without room after the image the log stays empty
+    if ((uintptr_t) &__flash_binary_end > XIP_BASE + CHARGE_HISTORY_FLASH_OFFSET) {
+        printf("No flash left for the charge history\n");
+        return false;
+    }
+
+    // The newest record tells where to continue
+    bool found = false;
+    uint32_t last_seq = 0;
+    for (uint32_t slot = 0; slot < CHARGE_HISTORY_RECORD_COUNT; slot += 1) {
+        const charge_history_record_t * record = &charge_history_log[slot];
+        if (_record_is_valid(record, slot) && (!found || record->seq > last_seq)) {
+            found = true;
+            last_seq = record->seq;
+            charge_history_session = record->session;
+        }
+    }
+
+    if (found) {
+        charge_history_summary.next_seq = last_seq + 1;
+        charge_history_session += 1;
+
+        // Only the last lap of the ring counts, anything older is a leftover
+        uint32_t window_start = last_seq + 1 > CHARGE_HISTORY_RECORD_COUNT ?
+                                last_seq + 1 - CHARGE_HISTORY_RECORD_COUNT : 0;
+        charge_history_summary.first_seq = charge_history_summary.next_seq;
+        for (uint32_t slot = 0; slot < CHARGE_HISTORY_RECORD_COUNT; slot += 1) {
+            const charge_history_record_t * record = &charge_history_log[slot];
+            if (_record_is_valid(record, slot) && record->seq >= window_start) {
+                _summary_update(record, true);
+                charge_history_summary.first_seq = MIN(charge_history_summary.first_seq, record->seq);
+            }
+        }
+    }
+
+    charge_history_mutex = STATIC_SEMAPHORE_CREATE_MUTEX();
+    charge_history_queue = STATIC_QUEUE_CREATE(CHARGE_HISTORY_QUEUE_LENGTH, sizeof(charge_history_record_t));
+    STATIC_TASK_CREATE(charge_history_task, "Charge History", configMINIMAL_STACK_SIZE * 2, NULL,
+                       CHARGE_HISTORY_TASK_PRIORITY, NULL);
+
+    return true;
+}
+
+
+void charge_history_append(float target_weight, float final_weight, float predicted_weight, float charge_time_s,
+                           uint8_t profile_idx, uint8_t flags) {
+    if (charge_history_queue == NULL) {
+        return;
+    }
+
+    charge_history_record_t record;
+    memset(&record, 0x0, sizeof(record));
+    record.profile_idx = profile_idx;
+    record.flags = flags;
+    record.uptime_s = (uint32_t) (time_us_64() / 1000000);
+    record.target_weight = target_weight;
+    record.final_weight = final_weight;
+    record.predicted_weight = predicted_weight;
+    record.charge_time_ms = (uint32_t) (charge_time_s * 1000.0f + 0.5f);
+
+    // The charge loop doesn't wait for the flash, a record is dropped if the writer is that far behind
+    xQueueSend(charge_history_queue, &record, 0);
+}
+
+
+void charge_history_get_summary(charge_history_summary_t * summary) {
+    if (charge_history_mutex == NULL) {
+        memset(summary, 0x0, sizeof(charge_history_summary_t));
+        return;
+    }
+
+    xSemaphoreTake(charge_history_mutex, portMAX_DELAY);
+    memcpy(summary, &charge_history_summary, sizeof(charge_history_summary_t));
+    xSemaphoreGive(charge_history_mutex);
+}
+
+
+bool http_rest_charge_history(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // h0 (int): Number of records in the log
+    // h1 (int): seq of the oldest record
+    // h2 (int): seq of the next record
+    // h3 (float): Mean overthrow
+    // h4 (float): Standard deviation of the overthrow
+    // h5 (float): Mean charge time (s)
+    // h6 (int): Over charges
+    // h7 (int): Under charges
+    // h8 (int): Capacity of the log (records)
+    const size_t charge_history_json_buffer_size = 256;
+    char * charge_history_json_buffer = (char *) rest_response_alloc(charge_history_json_buffer_size);
+    if (charge_history_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    charge_history_summary_t summary;
+    charge_history_get_summary(&summary);
+
+    double overthrow_mean = 0;
+    double overthrow_sd = 0;
+    double charge_time_mean_s = 0;
+    if (summary.count) {
+        overthrow_mean = summary.overthrow_sum / summary.count;
+        overthrow_sd = sqrt(fmax(summary.overthrow_square_sum / summary.count - overthrow_mean * overthrow_mean, 0));
+        charge_time_mean_s = summary.charge_time_ms_sum / summary.count / 1000.0;
+    }
+
+    snprintf(charge_history_json_buffer,
+             charge_history_json_buffer_size,
+             "%s"
+             "{\"h0\":%lu,\"h1\":%lu,\"h2\":%lu,\"h3\":%0.4f,\"h4\":%0.4f,\"h5\":%0.2f,\"h6\":%lu,\"h7\":%lu,\"h8\":%u}",
+             http_json_header,
+             summary.count,
+             summary.first_seq,
+             summary.next_seq,
+             overthrow_mean,
+             overthrow_sd,
+             charge_time_mean_s,
+             summary.over_charges,
+             summary.under_charges,
+             (unsigned) CHARGE_HISTORY_RECORD_COUNT);
+
+    size_t data_length = strlen(charge_history_json_buffer);
+    file->data = charge_history_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
+
+
+// Hands out the records in place, as many as are in one piece before the ring wraps
+static size_t _export_read(void * state, const char ** data, size_t max_len) {
+    _export_state_t * export_state = (_export_state_t *) state;
+
+    uint32_t slot = export_state->seq % CHARGE_HISTORY_RECORD_COUNT;
+    uint32_t records = MIN(export_state->remaining, CHARGE_HISTORY_RECORD_COUNT - slot);
+    records = MIN(records, max_len / sizeof(charge_history_record_t));
+
+    *data = (const char *) &charge_history_log[slot];
+    export_state->seq += records;
+    export_state->remaining -= records;
+
+    return records * sizeof(charge_history_record_t);
+}
+
+
+bool http_rest_charge_history_export(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Parameters
+    // from (int): seq of the first record, defaults to the oldest
+    // n (int): Number of records, defaults to all up to the newest
+    //
+    // Response: the charge_history_record_t of seqs from to from + n - 1 back to back. Slots that were never written
+    // or are erased while the export is sent fail their CRC (or carry another seq) and shall be skipped.
+    charge_history_summary_t summary;
+    charge_history_get_summary(&summary);
+
+    uint32_t from = summary.first_seq;
+    uint32_t count = UINT32_MAX;
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "from") == 0) {
+            from = strtoul(values[idx], NULL, 10);
+        }
+        else if (strcmp(params[idx], "n") == 0) {
+            count = strtoul(values[idx], NULL, 10);
+        }
+    }
+
+    from = MIN(MAX(from, summary.first_seq), summary.next_seq);
+    count = MIN(count, summary.next_seq - from);
+
+    _export_state_t * export_state = (_export_state_t *) rest_response_alloc(sizeof(_export_state_t));
+    if (export_state == NULL) {
+        return rest_response_unavailable(file);
+    }
+    export_state->seq = from;
+    export_state->remaining = count;
+
+    if (!rest_response_stream(file, "application/octet-stream", count * sizeof(charge_history_record_t),
+                              _export_read, export_state)) {
+        return rest_response_unavailable(file);
+    }
+
+    return true;
+}
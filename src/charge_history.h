@@ -0,0 +1,68 @@
+#ifndef CHARGE_HISTORY_H_
+#define CHARGE_HISTORY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "http_rest.h"
+
+
+// Log at the end of the QSPI flash, after the firmware image (4096 records)
+#define CHARGE_HISTORY_FLASH_SIZE       (128 * 1024)
+
+#define CHARGE_HISTORY_FLAG_OVER_CHARGE     (1 << 0)
+#define CHARGE_HISTORY_FLAG_UNDER_CHARGE    (1 << 1)
+
+
+// One charge, 32 bytes as stored in flash and returned by /rest/charge_history_export
+typedef struct __attribute__((packed)) {
+    uint32_t seq;               // Position in the log, also selects the slot (seq % record count)
+    uint16_t session;           // Bumped on every boot, uptime_s is relative to it
+    uint8_t profile_idx;
+    uint8_t flags;              // CHARGE_HISTORY_FLAG_*
+    uint32_t uptime_s;
+    float target_weight;
+    float final_weight;         // Settled weight, overthrow is final_weight - target_weight
+    float predicted_weight;     // Weight predicted at the cutoff, NAN without predictive cutoff
+    uint32_t charge_time_ms;
+    uint32_t crc32;             // Over the fields above
+} charge_history_record_t;
+
+
+// Summary of the records in the log, kept up to date on every append
+typedef struct {
+    uint32_t count;
+    uint32_t first_seq;
+    uint32_t next_seq;
+    uint32_t over_charges;
+    uint32_t under_charges;
+    double overthrow_sum;
+    double overthrow_square_sum;
+    double charge_time_ms_sum;
+} charge_history_summary_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Rebuilds the index and the summary from the log in flash and starts the writer task.
+ */
+bool charge_history_init(void);
+
+/**
+ * Queues a charge for the log. The flash is written by the writer task, so the caller isn't held up by a sector erase.
+ */
+void charge_history_append(float target_weight, float final_weight, float predicted_weight, float charge_time_s,
+                           uint8_t profile_idx, uint8_t flags);
+
+void charge_history_get_summary(charge_history_summary_t * summary);
+
+bool http_rest_charge_history(struct fs_file *file, int num_params, char *params[], char *values[]);
+bool http_rest_charge_history_export(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // CHARGE_HISTORY_H_
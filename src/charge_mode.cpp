@@ -8,6 +8,8 @@
 #include <semphr.h>
 #include <u8g2.h>
 #include <math.h>
+#include "pico/time.h"
+#include "hardware/sync.h"
 
 #include "app.h"
 #include "FloatRingBuffer.h"
@@ -21,6 +23,16 @@
 #include "profile.h"
 #include "common.h"
 #include "servo_gate.h"
+#include "charge_trace.h"
+#include "pid_autotune.h"
+#include "event_stream.h"
+#include "telemetry_publisher.h"
+#include "charge_history.h"
+#include "charge_pipeline.h"
+#include "wireless.h"
+#include "charge_batch.h"
+#include "trace.h"
+#include "static_alloc.h"
 
 
 uint8_t charge_weight_digits[] = {0, 0, 0, 0, 0};
@@ -53,15 +65,178 @@ const eeprom_charge_mode_data_t default_charge_mode_data = {
     .neopixel_under_charge_colour = RGB_COLOUR_YELLOW,        // yellow
     .neopixel_over_charge_colour = RGB_COLOUR_RED,            // red
     .neopixel_not_ready_colour = RGB_COLOUR_BLUE,             // blue
+
+    // Predictive cutoff
+    .predictive_cutoff_enable = false,
+    .cutoff_dead_time_ms = 250,
+
+    // Coarse stop threshold learning
+    .coarse_stop_learning_enable = false,
+    .overthrow_rate_target = 0.05,
+
+    // Control loop deadline monitor
+    .control_deadline_ms = 25,
+    .control_warning_enable = false,
+    .neopixel_control_warning_colour = RGB_COLOUR_BLUE,
+
+    // Coarse flow throttling with the gate
+    .coarse_gate_throttle_band = 0,
+
+    // Cup cycle
+    .cup_cycle_overlap_enable = false,
+
+    // Batch
+    .batch_size = 0,
+
+    // Feedforward and derivative filter
+    .feedforward_enable = false,
+    .feedforward_time_s = 2.0f,
+    .derivative_filter_ms = 0,
 };
 
 // Configures
-TaskHandle_t scale_measurement_render_task_handler = NULL;
 static char title_string[30];
 
 static TickType_t charge_start_tick = 0;
 static float last_charge_elapsed_seconds = 0.0f;
 
+// Charge control task, runs the PID loop of charge_mode_wait_for_complete at the pace of the scale
+#define CHARGE_CONTROL_TASK_PRIORITY            7       // Above the menu task, below the motor and scale tasks
+#define CHARGE_CONTROL_MEASUREMENT_TIMEOUT_MS   200
+#define CHARGE_CONTROL_UI_POLL_MS               20
+#define CHARGE_MODE_OVER_CHARGE_BLINK_PERIOD_MS 500
+#define CHARGE_CONTROL_GATE_THROTTLE_STEP       0.01f   // Smallest gate ratio change worth a new trajectory
+
+static TaskHandle_t charge_control_task_handler = NULL;
+static SemaphoreHandle_t charge_control_done_semaphore = NULL;
+static volatile bool charge_control_abort = false;
+static volatile bool charge_control_completed = false;
+static uint32_t charge_control_max_latency_us = 0;
+static uint32_t charge_control_iterations = 0;
+static uint8_t charge_control_stage = 0;
+
+/*
+    Deadline monitor of the control loop. Catches the iterations that run late (e.g. a blocking motor command or an
+    EEPROM write holding up the loop) and the measurements the loop never saw. Reset per charge, the totals are kept
+    for /metrics.
+*/
+static struct {
+    uint32_t missed_samples;
+    uint32_t deadline_misses;
+    uint32_t max_iteration_us;
+
+    // Running mean and variance of the period (Welford)
+    uint32_t period_cnt;
+    float period_mean_us;
+    float period_m2;
+} charge_control_monitor;
+
+static struct {
+    uint32_t iterations;
+    uint32_t missed_samples;
+    uint32_t deadline_misses;
+    uint32_t degraded_charges;          // Charges with missed samples or deadlines
+} charge_control_totals;
+
+static struct {
+    volatile uint32_t seq;
+    charge_control_state_t state;
+} charge_control_snapshot;
+
+/*
+    Cup cycle throughput, from the completion times of the recent charges of the charge mode session. A cycle covers
+    the charge, the cup removal and return and the zero, so the rate is what the operator gets out of the machine.
+*/
+#define CHARGE_MODE_CYCLE_WINDOW                8       // Charges the rate is averaged over
+
+static struct {
+    TickType_t completion_tick[CHARGE_MODE_CYCLE_WINDOW];
+    uint32_t completed_cnt;             // Charges completed in this session
+    uint32_t last_cycle_ms;             // Completion to completion of the last two charges
+} charge_mode_cycle;
+
+static void charge_mode_cycle_reset(void) {
+    charge_mode_cycle.completed_cnt = 0;
+    charge_mode_cycle.last_cycle_ms = 0;
+}
+
+static void charge_mode_cycle_record(TickType_t tick) {
+    uint32_t cnt = charge_mode_cycle.completed_cnt;
+    if (cnt > 0) {
+        TickType_t last_tick = charge_mode_cycle.completion_tick[(cnt - 1) % CHARGE_MODE_CYCLE_WINDOW];
+        charge_mode_cycle.last_cycle_ms = (tick - last_tick) * portTICK_PERIOD_MS;
+    }
+    charge_mode_cycle.completion_tick[cnt % CHARGE_MODE_CYCLE_WINDOW] = tick;
+    charge_mode_cycle.completed_cnt = cnt + 1;
+}
+
+// Charges per hour over the window, 0 until two charges completed
+static float charge_mode_cycle_get_rate(void) {
+    uint32_t cnt = charge_mode_cycle.completed_cnt;
+    if (cnt < 2) {
+        return 0.0f;
+    }
+
+    uint32_t window = cnt < CHARGE_MODE_CYCLE_WINDOW ? cnt : CHARGE_MODE_CYCLE_WINDOW;
+    TickType_t first_tick = charge_mode_cycle.completion_tick[(cnt - window) % CHARGE_MODE_CYCLE_WINDOW];
+    TickType_t last_tick = charge_mode_cycle.completion_tick[(cnt - 1) % CHARGE_MODE_CYCLE_WINDOW];
+    uint32_t elapsed_ms = (last_tick - first_tick) * portTICK_PERIOD_MS;
+    if (elapsed_ms == 0) {
+        return 0.0f;
+    }
+
+    return (window - 1) * 3600000.0f / elapsed_ms;
+}
+
+/*
+    Precharge of the overlapped cup cycle. The coarse trickler fills the closed gate while the operator handles the
+    cup instead of holding up the cup removal, the next charge waits for it only if the cup came back first.
+*/
+#define CHARGE_MODE_PRECHARGE_GATE_DELAY_MS     500     // Lets the gate fully close before the precharge
+
+static struct {
+    bool pending;                       // The gate closed, the precharge starts after the gate delay
+    bool running;                       // Coarse trickler move in progress
+    TickType_t gate_closed_tick;
+} charge_mode_precharge;
+
+// Starts the pending precharge once the gate delay passed, polled by the cup cycle loops
+static void charge_mode_precharge_poll(void) {
+    if (!charge_mode_precharge.pending ||
+        xTaskGetTickCount() - charge_mode_precharge.gate_closed_tick < pdMS_TO_TICKS(CHARGE_MODE_PRECHARGE_GATE_DELAY_MS)) {
+        return;
+    }
+
+    float speed = charge_mode_config.eeprom_charge_mode_data.precharge_speed_rps;
+    float revolutions = speed * charge_mode_config.eeprom_charge_mode_data.precharge_time_ms / 1000.0f;
+    if (revolutions > 0) {
+        motor_move_revolutions(SELECT_COARSE_TRICKLER_MOTOR, revolutions, speed);
+        charge_mode_precharge.running = true;
+    }
+    charge_mode_precharge.pending = false;
+}
+
+// Waits for the precharge to be delivered before the gate opens for the next charge
+static void charge_mode_precharge_finish(void) {
+    while (charge_mode_precharge.pending) {
+        vTaskDelay(pdMS_TO_TICKS(20));
+        charge_mode_precharge_poll();
+    }
+
+    if (charge_mode_precharge.running) {
+        motor_wait_for_move(SELECT_COARSE_TRICKLER_MOTOR, charge_mode_config.eeprom_charge_mode_data.precharge_time_ms + 1000);
+        charge_mode_precharge.running = false;
+    }
+}
+
+// Charge state stream (event_stream.h)
+#define CHARGE_MODE_STREAM_STATE_SIZE           192
+#define CHARGE_MODE_STREAM_CHARGE_SIZE          256
+
+static volatile uint32_t charge_mode_completed_charges = 0;    // Bumped once the result of a charge is known
+static uint32_t charge_mode_stream_reported_charges = 0;
+static char charge_mode_stream_state[CHARGE_MODE_STREAM_STATE_SIZE];    // Data of the last "state" event
+
 // Menu system
 extern AppState_t exit_state;
 extern QueueHandle_t encoder_event_queue;
@@ -76,6 +251,217 @@ typedef enum {
 } ChargeModeEventBit_t;
 
 
+// Flow rate estimator over the most recent measurements
+#define FLOW_ESTIMATOR_WINDOW       6
+
+typedef struct {
+    float weight[FLOW_ESTIMATOR_WINDOW];
+    uint32_t capture_time_us[FLOW_ESTIMATOR_WINDOW];
+    uint8_t write_idx;
+    uint8_t count;
+} flow_estimator_t;
+
+
+static void flow_estimator_add(flow_estimator_t * estimator, float weight, uint32_t capture_time_us) {
+    estimator->weight[estimator->write_idx] = weight;
+    estimator->capture_time_us[estimator->write_idx] = capture_time_us;
+    estimator->write_idx = (estimator->write_idx + 1) % FLOW_ESTIMATOR_WINDOW;
+
+    if (estimator->count < FLOW_ESTIMATOR_WINDOW) {
+        estimator->count += 1;
+    }
+}
+
+
+/*
+    Least squares slope of weight over time (unit per second). Returns 0 until enough samples are available.
+*/
+static float flow_estimator_get_rate(flow_estimator_t * estimator) {
+    if (estimator->count < 3) {
+        return 0.0f;
+    }
+
+    // Use the time relative to the newest sample to keep the numbers small
+    uint8_t newest_idx = (estimator->write_idx + FLOW_ESTIMATOR_WINDOW - 1) % FLOW_ESTIMATOR_WINDOW;
+    uint32_t reference_time_us = estimator->capture_time_us[newest_idx];
+
+    float sum_t = 0, sum_w = 0, sum_tt = 0, sum_tw = 0;
+    for (uint8_t idx = 0; idx < estimator->count; idx += 1) {
+        float t = (int32_t) (estimator->capture_time_us[idx] - reference_time_us) / 1e6f;
+        float w = estimator->weight[idx];
+
+        sum_t += t;
+        sum_w += w;
+        sum_tt += t * t;
+        sum_tw += t * w;
+    }
+
+    float n = estimator->count;
+    float denominator = n * sum_tt - sum_t * sum_t;
+    if (denominator < 1e-9f) {
+        return 0.0f;
+    }
+
+    return (n * sum_tw - sum_t * sum_w) / denominator;
+}
+
+
+// Settle detector: decides when the reading is stable based on the actual sample rate
+#define SETTLE_DETECTOR_MAX_SAMPLES     16
+#define SETTLE_DETECTOR_MIN_SAMPLES     4
+#define SETTLE_DETECTOR_MIN_WINDOW_US   500000      // Minimum observation time unless the scale reports stable
+#define SETTLE_DETECTOR_MAX_WINDOW_US   1000000     // Older samples are discarded
+
+class SettleDetector
+{
+
+private:
+    FloatRingBuffer<SETTLE_DETECTOR_MAX_SAMPLES> weights;
+    uint32_t capture_time_us[SETTLE_DETECTOR_MAX_SAMPLES];
+    size_t time_write_idx;
+    scale_stability_t last_stability;
+
+    uint32_t oldest_capture_time_us() {
+        size_t idx = (time_write_idx + SETTLE_DETECTOR_MAX_SAMPLES - weights.getCounter()) % SETTLE_DETECTOR_MAX_SAMPLES;
+        return capture_time_us[idx];
+    }
+
+    uint32_t newest_capture_time_us() {
+        return capture_time_us[(time_write_idx + SETTLE_DETECTOR_MAX_SAMPLES - 1) % SETTLE_DETECTOR_MAX_SAMPLES];
+    }
+
+public:
+    SettleDetector() {
+        reset();
+    }
+
+    void reset() {
+        weights.reset();
+        time_write_idx = 0;
+        last_stability = SCALE_STABILITY_UNKNOWN;
+    }
+
+    void add(scale_measurement_t * measurement) {
+        // Any invalid reading (e.g. overload) restarts the observation
+        if (isnan(measurement->weight)) {
+            reset();
+            return;
+        }
+
+        weights.enqueue(measurement->weight);
+        capture_time_us[time_write_idx] = measurement->capture_time_us;
+        time_write_idx = (time_write_idx + 1) % SETTLE_DETECTOR_MAX_SAMPLES;
+        last_stability = measurement->stability;
+
+        // Keep the window within the maximum duration
+        while (weights.getCounter() > SETTLE_DETECTOR_MIN_SAMPLES && 
+               newest_capture_time_us() - oldest_capture_time_us() > SETTLE_DETECTOR_MAX_WINDOW_US) {
+            weights.dequeue();
+        }
+    }
+
+    /*
+        The reading is settled when the spread and the drift over the window are both within sd_margin.
+        If the scale reports its stability, an unstable flag always rejects and a stable flag skips the minimum
+        observation time.
+    */
+    bool isSettled(float sd_margin) {
+        if (weights.getCounter() < SETTLE_DETECTOR_MIN_SAMPLES) {
+            return false;
+        }
+
+        if (last_stability == SCALE_STABILITY_UNSTABLE) {
+            return false;
+        }
+
+        if (last_stability != SCALE_STABILITY_STABLE && 
+            newest_capture_time_us() - oldest_capture_time_us() < SETTLE_DETECTOR_MIN_WINDOW_US) {
+            return false;
+        }
+
+        // Drift across the window
+        float drift = fabsf(weights.getSlope() * (weights.getCounter() - 1));
+
+        return weights.getSd() < sd_margin && drift < sd_margin;
+    }
+
+    float getMean() {
+        return weights.getMean();
+    }
+
+};
+
+
+// Coarse stop threshold learning
+#define COARSE_STOP_CARRY_WINDOW_US         1000000     // Weight gained within this window after the coarse stop counts as carry
+#define COARSE_STOP_CARRY_SAFETY_FACTOR     2.0f        // Never switch closer than this multiple of the carry to the target
+#define COARSE_STOP_LEARNING_RATE           0.1f        // Moving average weight of a new charge
+#define COARSE_STOP_MIN_FINE_TIME_S         1.0f        // No time to gain if the fine stage is already this short
+#define COARSE_STOP_STEP_DOWN               0.95f
+#define COARSE_STOP_STEP_UP                 1.1f
+
+typedef struct {
+    float threshold;            // Threshold used for the current charge, NAN if the profile runs a charge pipeline
+    float stop_weight;          // Weight when the coarse trickler stopped, NAN if it hasn't stopped yet
+    uint32_t stop_time_us;
+    float carry_weight;         // Weight gained within the carry window after the coarse stop, NAN until measured
+    float fine_time_s;          // Time from the coarse stop to the end of the charge
+} coarse_stop_record_t;
+
+static coarse_stop_record_t coarse_stop_record;
+static bool coarse_stop_learning_dirty = false;
+
+
+static float coarse_stop_learning_get_threshold(profile_t * profile) {
+    if (charge_mode_config.eeprom_charge_mode_data.coarse_stop_learning_enable && 
+        profile->learned_coarse_stop_threshold > 0) {
+        return profile->learned_coarse_stop_threshold;
+    }
+
+    return charge_mode_config.eeprom_charge_mode_data.coarse_stop_threshold;
+}
+
+
+/*
+    Moves the switch point from the coarse to the fine trickler towards the target while the over charge rate stays
+    under the target rate, and backs off when it doesn't. The coarse carry bounds how close the switch point can get.
+*/
+static void coarse_stop_learning_update(profile_t * profile, bool over_charged) {
+    if (!charge_mode_config.eeprom_charge_mode_data.coarse_stop_learning_enable ||
+        isnan(coarse_stop_record.threshold) || isnan(coarse_stop_record.carry_weight)) {
+        return;
+    }
+
+    bool first_charge = profile->learned_coarse_stop_threshold <= 0;
+
+    if (first_charge) {
+        profile->learned_coarse_carry_weight = fmaxf(coarse_stop_record.carry_weight, 0);
+        profile->learned_overthrow_rate = over_charged ? 1.0f : 0.0f;
+    }
+    else {
+        profile->learned_coarse_carry_weight += COARSE_STOP_LEARNING_RATE * 
+            (fmaxf(coarse_stop_record.carry_weight, 0) - profile->learned_coarse_carry_weight);
+        profile->learned_overthrow_rate += COARSE_STOP_LEARNING_RATE * 
+            ((over_charged ? 1.0f : 0.0f) - profile->learned_overthrow_rate);
+    }
+
+    float threshold = coarse_stop_record.threshold;
+
+    if (profile->learned_overthrow_rate > charge_mode_config.eeprom_charge_mode_data.overthrow_rate_target) {
+        threshold *= COARSE_STOP_STEP_UP;
+    }
+    else if (coarse_stop_record.fine_time_s > COARSE_STOP_MIN_FINE_TIME_S) {
+        threshold *= COARSE_STOP_STEP_DOWN;
+    }
+
+    float min_threshold = COARSE_STOP_CARRY_SAFETY_FACTOR * profile->learned_coarse_carry_weight + 
+                          charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold;
+    profile->learned_coarse_stop_threshold = fmaxf(threshold, min_threshold);
+
+    coarse_stop_learning_dirty = true;
+}
+
+
 static void format_elapsed_time(char *buffer, size_t len, TickType_t start_tick) {
     TickType_t now = xTaskGetTickCount();
     uint32_t elapsed_ticks = now - start_tick;
@@ -87,66 +473,81 @@ static void format_elapsed_time(char *buffer, size_t len, TickType_t start_tick)
 }
 
 
-void scale_measurement_render_task(void *p) {
-    char current_weight_string[WEIGHT_STRING_LEN];
+static TickType_t charge_mode_render_scene(u8g2_t * display_handler) {
+    static weight_string_cache_t current_weight_cache;
+    const char * current_weight_string;
     char time_buffer[16];
 
-    u8g2_t *display_handler = get_display_handler();
+    // Redrawn by the compositor on new measurements and on display_request_render (state and title changes)
 
-    while (true) {
-        TickType_t last_render_tick = xTaskGetTickCount();
-
-        u8g2_ClearBuffer(display_handler);
+    // Set font for title and timer
+    u8g2_SetFont(display_handler, u8g2_font_helvB08_tr);
 
-        // Set font for title and timer
-        u8g2_SetFont(display_handler, u8g2_font_helvB08_tr);
+    // Format the timer string based on current state
+    if (charge_mode_config.charge_mode_state == CHARGE_MODE_WAIT_FOR_COMPLETE) {
+        format_elapsed_time(time_buffer, sizeof(time_buffer), charge_start_tick);
+    } else if (charge_mode_config.charge_mode_state == CHARGE_MODE_WAIT_FOR_CUP_REMOVAL ||
+               charge_mode_config.charge_mode_state == CHARGE_MODE_WAIT_FOR_CUP_RETURN ||
+               charge_mode_config.charge_mode_state == CHARGE_MODE_WAIT_FOR_ZERO) {
+        snprintf(time_buffer, sizeof(time_buffer), "%.2f s", last_charge_elapsed_seconds);
+    } else {
+        snprintf(time_buffer, sizeof(time_buffer), "--.- s");
+    }
 
-        // Format the timer string based on current state
-        if (charge_mode_config.charge_mode_state == CHARGE_MODE_WAIT_FOR_COMPLETE) {
-            format_elapsed_time(time_buffer, sizeof(time_buffer), charge_start_tick);
-        } else if (charge_mode_config.charge_mode_state == CHARGE_MODE_WAIT_FOR_CUP_REMOVAL ||
-                   charge_mode_config.charge_mode_state == CHARGE_MODE_WAIT_FOR_CUP_RETURN ||
-                   charge_mode_config.charge_mode_state == CHARGE_MODE_WAIT_FOR_ZERO) {
-            snprintf(time_buffer, sizeof(time_buffer), "%.2f s", last_charge_elapsed_seconds);
-        } else {
-            snprintf(time_buffer, sizeof(time_buffer), "--.- s");
-        }
+    // Calculate x positions
+    uint8_t screen_width = u8g2_GetDisplayWidth(display_handler);
+    uint8_t time_width = u8g2_GetStrWidth(display_handler, time_buffer);
 
-        // Calculate x positions
-        uint8_t screen_width = u8g2_GetDisplayWidth(display_handler);
-        uint8_t time_width = u8g2_GetStrWidth(display_handler, time_buffer);
+    // Draw title on left
+    u8g2_DrawStr(display_handler, 5, 10, title_string);
 
-        // Draw title on left
-        u8g2_DrawStr(display_handler, 5, 10, title_string);
+    // Draw timer on right edge
+    u8g2_DrawStr(display_handler, screen_width - time_width - 5, 10, time_buffer);  // 5 px padding from edge
 
-        // Draw timer on right edge
-        u8g2_DrawStr(display_handler, screen_width - time_width - 5, 10, time_buffer);  // 5 px padding from edge
+    // Draw line under title
+    u8g2_DrawHLine(display_handler, 0, 13, screen_width);
 
-        // Draw line under title
-        u8g2_DrawHLine(display_handler, 0, 13, screen_width);
+    // Current weight (only show values > -1.0), each measurement is formatted once
+    scale_measurement_t measurement;
+    if (scale_get_latest_measurement(&measurement) && measurement.weight > -1.0) {
+        current_weight_string = weight_string_cache_format(&current_weight_cache, measurement.seq, measurement.weight, 
+                                                           charge_mode_config.eeprom_charge_mode_data.decimal_places);
+    } else {
+        current_weight_string = "---";
+    }
 
-        // Current weight (only show values > -1.0)
-        memset(current_weight_string, 0x0, sizeof(current_weight_string));
-        float scale_measurement = scale_get_current_measurement();
-        if (scale_measurement > -1.0) {
-            float_to_string(current_weight_string, scale_measurement, charge_mode_config.eeprom_charge_mode_data.decimal_places);
-        } else {
-            strcpy(current_weight_string, "---");
-        }
+    // Draw current weight value
+    u8g2_SetFont(display_handler, u8g2_font_profont22_tf);
+    u8g2_DrawStr(display_handler, 26, 35, current_weight_string);
 
-        // Draw current weight value
-        u8g2_SetFont(display_handler, u8g2_font_profont22_tf);
-        u8g2_DrawStr(display_handler, 26, 35, current_weight_string);
+    // Draw profile name
+    profile_t *current_profile = profile_get_selected();
+    u8g2_SetFont(display_handler, u8g2_font_helvR08_tr);
+    u8g2_DrawStr(display_handler, 5, 61, current_profile->name);
 
-        // Draw profile name
-        profile_t *current_profile = profile_get_selected();
-        u8g2_SetFont(display_handler, u8g2_font_helvR08_tr);
-        u8g2_DrawStr(display_handler, 5, 61, current_profile->name);
+    // Batch statistics, the spread once there are charges and the progress next to the profile name
+    charge_batch_summary_t batch_summary;
+    charge_batch_get_summary(&batch_summary);
 
-        u8g2_SendBuffer(display_handler);
+    char batch_buffer[24];
+    u8g2_SetFont(display_handler, u8g2_font_profont11_tf);
+    if (batch_summary.count > 0) {
+        snprintf(batch_buffer, sizeof(batch_buffer), "SD %.3f ES %.3f", batch_summary.weight_sd, batch_summary.weight_es);
+        u8g2_DrawStr(display_handler, 5, 48, batch_buffer);
+    }
 
-        vTaskDelayUntil(&last_render_tick, pdMS_TO_TICKS(20));
+    if (batch_summary.size > 0) {
+        snprintf(batch_buffer, sizeof(batch_buffer), "%lu/%lu +%lu -%lu", batch_summary.count, batch_summary.size,
+                 batch_summary.over_charges, batch_summary.under_charges);
     }
+    else {
+        snprintf(batch_buffer, sizeof(batch_buffer), "%lu +%lu -%lu", batch_summary.count,
+                 batch_summary.over_charges, batch_summary.under_charges);
+    }
+    u8g2_DrawStr(display_handler, screen_width - u8g2_GetStrWidth(display_handler, batch_buffer) - 5, 61, batch_buffer);
+
+    // The timer digits only change while charging, otherwise sleep until something changes
+    return charge_mode_config.charge_mode_state == CHARGE_MODE_WAIT_FOR_COMPLETE ? 0 : portMAX_DELAY;
 }
 
 
@@ -159,16 +560,15 @@ void charge_mode_wait_for_zero() {
         true
     );
     
-    // Wait for 5 measurements and wait for stable
-    FloatRingBuffer data_buffer(10);
+    SettleDetector settle_detector;
+    uint32_t measurement_seq = scale_get_latest_measurement_seq();
 
     // Update current status
     snprintf(title_string, sizeof(title_string), "Waiting for Zero");
+    display_request_render();
 
-    // Stop condition: 10 stable measurements in 200ms apart (2 seconds minimum)
+    // Stop condition: stable reading around zero
     while (true) {
-        TickType_t last_measurement_tick = xTaskGetTickCount();
-
         // Non block waiting for the input
         ButtonEncoderEvent_t button_encoder_event = button_wait_for_input(false);
         if (button_encoder_event == BUTTON_RST_PRESSED) {
@@ -177,153 +577,547 @@ void charge_mode_wait_for_zero() {
         }
         else if (button_encoder_event == BUTTON_ENCODER_PRESSED) {
             scale_config.scale_handle->force_zero();
+            settle_detector.reset();
         }
 
-        // Perform measurement (max delay 300 seconds   )
-        float current_measurement;
-        if (scale_block_wait_for_next_measurement(300, &current_measurement)){
-            data_buffer.enqueue(current_measurement);
+        charge_mode_precharge_poll();
+
+        // Perform measurement
+        scale_measurement_t measurement;
+        if (!scale_wait_for_measurement(&measurement_seq, 200, &measurement)) {
+            // If no measurement within 200ms then poll the button and retry
+            continue;
         }
+        settle_detector.add(&measurement);
+        event_stream_notify(EVENT_STREAM_TOPIC_CHARGE_STATE);
 
         // Generate stop condition
-        if (data_buffer.getCounter() >= 10){
-            if (data_buffer.getSd() < charge_mode_config.eeprom_charge_mode_data.set_point_sd_margin && 
-                abs(data_buffer.getMean()) < charge_mode_config.eeprom_charge_mode_data.set_point_mean_margin) {
-                break;
-            }
+        if (settle_detector.isSettled(charge_mode_config.eeprom_charge_mode_data.set_point_sd_margin) && 
+            fabsf(settle_detector.getMean()) < charge_mode_config.eeprom_charge_mode_data.set_point_mean_margin) {
+            break;
         }
-
-        // Wait for minimum 300 ms (but can skip if previously wait already)
-        vTaskDelayUntil(&last_measurement_tick, pdMS_TO_TICKS(300));
     }
 
     charge_mode_config.charge_mode_state = CHARGE_MODE_WAIT_FOR_COMPLETE;
 }
 
-void charge_mode_wait_for_complete() {
+static void _charge_control_monitor_reset(void) {
+    memset(&charge_control_monitor, 0, sizeof(charge_control_monitor));
+}
 
-    charge_start_tick = xTaskGetTickCount();
 
-    // Set colour to under charge
-    neopixel_led_set_colour(
-        neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.mini12864_backlight_colour,
-        charge_mode_config.eeprom_charge_mode_data.neopixel_under_charge_colour, 
-        charge_mode_config.eeprom_charge_mode_data.neopixel_under_charge_colour, 
-        true
-    );
+static uint32_t _charge_control_monitor_jitter_us(void) {
+    if (charge_control_monitor.period_cnt < 2) {
+        return 0;
+    }
 
-    // If the servo gate is used then it has to be opened
-    if (servo_gate.eeprom_servo_gate_config.servo_gate_enable) {
-        servo_gate_set_ratio(SERVO_GATE_RATIO_OPEN, false);
+    return (uint32_t) sqrtf(charge_control_monitor.period_m2 / (charge_control_monitor.period_cnt - 1));
+}
+
+
+// Called by the control task only, once per iteration. A period of 0 is the first measurement of the charge.
+static void _charge_control_monitor_update(uint32_t missed_samples, uint32_t period_us, uint32_t latency_us, 
+                                           uint32_t iteration_us) {
+    charge_control_monitor.missed_samples += missed_samples;
+    charge_control_totals.missed_samples += missed_samples;
+    charge_control_totals.iterations += 1;
+
+    uint32_t deadline_us = (uint32_t) (charge_mode_config.eeprom_charge_mode_data.control_deadline_ms * 1000.0f);
+    if (deadline_us > 0 && latency_us > deadline_us) {
+        charge_control_monitor.deadline_misses += 1;
+        charge_control_totals.deadline_misses += 1;
     }
-    // Update current status
-    char target_weight_string[WEIGHT_STRING_LEN];
-    float_to_string(target_weight_string, charge_mode_config.target_charge_weight, charge_mode_config.eeprom_charge_mode_data.decimal_places);
 
-    snprintf(title_string, sizeof(title_string), 
-             "Target: %s", 
-             target_weight_string);
+    if (iteration_us > charge_control_monitor.max_iteration_us) {
+        charge_control_monitor.max_iteration_us = iteration_us;
+    }
+
+    // A period spanning missed samples is not jitter, it is counted above
+    if (period_us > 0 && missed_samples == 0) {
+        charge_control_monitor.period_cnt += 1;
+        float delta = period_us - charge_control_monitor.period_mean_us;
+        charge_control_monitor.period_mean_us += delta / charge_control_monitor.period_cnt;
+        charge_control_monitor.period_m2 += delta * (period_us - charge_control_monitor.period_mean_us);
+    }
+}
+
+
+// Called by the control task only
+static void _charge_control_publish(scale_measurement_t * measurement, float error, float coarse_speed, float fine_speed, 
+                                    uint32_t last_capture_time_us, uint32_t missed_samples, uint32_t take_time_us) {
+    uint32_t now_us = time_us_32();
+    uint32_t latency_us = now_us - measurement->capture_time_us;
+    if (latency_us > charge_control_max_latency_us) {
+        charge_control_max_latency_us = latency_us;
+    }
+    charge_control_iterations += 1;
+
+    uint32_t period_us = charge_control_iterations > 1 ? measurement->capture_time_us - last_capture_time_us : 0;
+    _charge_control_monitor_update(missed_samples, period_us, latency_us, now_us - take_time_us);
+
+    // Seqlock: odd while the snapshot is being updated
+    uint32_t seq = charge_control_snapshot.seq;
+    charge_control_snapshot.seq = seq + 1;
+    __dmb();
+
+    charge_control_snapshot.state.iteration = charge_control_iterations;
+    charge_control_snapshot.state.capture_time_us = measurement->capture_time_us;
+    charge_control_snapshot.state.weight = measurement->weight;
+    charge_control_snapshot.state.error = error;
+    charge_control_snapshot.state.coarse_speed = coarse_speed;
+    charge_control_snapshot.state.fine_speed = fine_speed;
+    charge_control_snapshot.state.period_us = measurement->capture_time_us - last_capture_time_us;
+    charge_control_snapshot.state.latency_us = latency_us;
+    charge_control_snapshot.state.max_latency_us = charge_control_max_latency_us;
+    charge_control_snapshot.state.stage = charge_control_stage;
+    charge_control_snapshot.state.missed_samples = charge_control_monitor.missed_samples;
+    charge_control_snapshot.state.deadline_misses = charge_control_monitor.deadline_misses;
+    charge_control_snapshot.state.period_jitter_us = _charge_control_monitor_jitter_us();
+    charge_control_snapshot.state.max_iteration_us = charge_control_monitor.max_iteration_us;
+
+    __dmb();
+    charge_control_snapshot.seq = seq + 2;
+}
+
+
+// Copy of the latest control loop state, safe to call from any task
+void charge_control_get_state(charge_control_state_t * state) {
+    uint32_t seq;
+    do {
+        seq = charge_control_snapshot.seq;
+        __dmb();
+        *state = charge_control_snapshot.state;
+        __dmb();
+    } while ((seq & 1) || seq != charge_control_snapshot.seq);
+}
+
+
+// The dead time measured for the profile (dead_time_mode.cpp), if it was measured on the scale in use
+static float _get_cutoff_dead_time_ms(const profile_t * profile) {
+    if (profile->measured_dead_time_ms > 0 && 
+        profile->measured_scale_driver == (uint32_t) scale_config.persistent_config.scale_driver) {
+        return profile->measured_dead_time_ms;
+    }
+
+    return charge_mode_config.eeprom_charge_mode_data.cutoff_dead_time_ms;
+}
+
+
+// The coarse and fine stages of the charge mode, run when the profile has no charge pipeline
+static void _charge_pipeline_from_profile(const profile_t * profile, float coarse_stop_threshold, 
+                                          charge_pipeline_t * pipeline) {
+    memset(pipeline, 0x0, sizeof(charge_pipeline_t));
+
+    const charge_stage_motor_t coarse = {profile->coarse_kp, profile->coarse_ki, profile->coarse_kd, 
+                                         profile->coarse_min_flow_speed_rps, profile->coarse_max_flow_speed_rps};
+    const charge_stage_motor_t fine = {profile->fine_kp, profile->fine_ki, profile->fine_kd, 
+                                       profile->fine_min_flow_speed_rps, profile->fine_max_flow_speed_rps};
+
+    // Both tricklers until the coarse stop threshold
+    pipeline->stages[0].actuators = CHARGE_STAGE_ACTUATOR_COARSE | CHARGE_STAGE_ACTUATOR_FINE;
+    pipeline->stages[0].exit_criterion = CHARGE_STAGE_EXIT_ERROR;
+    pipeline->stages[0].exit_threshold = coarse_stop_threshold;
+    pipeline->stages[0].gate_ratio = SERVO_GATE_RATIO_DISABLED;
+    pipeline->stages[0].coarse = coarse;
+    pipeline->stages[0].fine = fine;
+
+    // Then the fine trickler until the fine stop threshold, with the gate at the coarse stop ratio
+    pipeline->stages[1].actuators = CHARGE_STAGE_ACTUATOR_FINE;
+    pipeline->stages[1].exit_criterion = CHARGE_STAGE_EXIT_PREDICTED_ERROR;
+    pipeline->stages[1].exit_threshold = charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold;
+    pipeline->stages[1].gate_ratio = charge_mode_config.eeprom_charge_mode_data.coarse_stop_gate_ratio;
+    pipeline->stages[1].coarse = coarse;
+    pipeline->stages[1].fine = fine;
+
+    pipeline->stage_cnt = 2;
+}
+
+
+static bool _charge_stage_exit(const charge_stage_t * stage, float error, float predicted_error, uint32_t stage_time_us) {
+    switch (stage->exit_criterion) {
+        case CHARGE_STAGE_EXIT_ERROR:
+            return error < stage->exit_threshold;
+        case CHARGE_STAGE_EXIT_PREDICTED_ERROR:
+            return predicted_error < stage->exit_threshold;
+        case CHARGE_STAGE_EXIT_TIME:
+            return stage_time_us >= stage->exit_threshold * 1000.0f;
+        default:
+            return true;
+    }
+}
+
+
+// PID output of a trickler on top of the feedforward speed, within the bounds of the stage and of the motor. 
+// saturation is set to 1 (-1) if the output is limited by the upper (lower) bound, 0 otherwise.
+static float _charge_stage_speed(const charge_stage_motor_t * motor, motor_select_t selected_motor, float feedforward,
+                                 float error, float integral, float derivative, int * saturation) {
+    float max_speed = fmin(get_motor_max_speed(selected_motor), motor->max_flow_speed_rps);
+    float min_speed = fmax(get_motor_min_speed(selected_motor), motor->min_flow_speed_rps);
+
+    float new_speed = feedforward + motor->kp * error + motor->ki * integral + motor->kd * derivative;
+    if (new_speed > max_speed) {
+        *saturation = 1;
+        return max_speed;
+    }
+    if (new_speed < min_speed) {
+        *saturation = -1;
+        return min_speed;
+    }
+
+    *saturation = 0;
+    return new_speed;
+}
+
+
+// Speed of a trickler delivering the error in feedforward_time_s by the flow model of the profile, 0 if disabled or
+// not calibrated
+static float _charge_feedforward_speed(const profile_t * profile, motor_select_t selected_motor, float error) {
+    float feedforward_time_s = charge_mode_config.eeprom_charge_mode_data.feedforward_time_s;
+    if (!charge_mode_config.eeprom_charge_mode_data.feedforward_enable || feedforward_time_s <= 0 || error <= 0) {
+        return 0.0f;
+    }
+
+    float speed = profile_get_flow_speed(profile, selected_motor, error / feedforward_time_s);
+    return isfinite(speed) ? speed : 0.0f;
+}
+
 
+/*
+    The PID loop of a charge, run by the charge control task once per scale measurement. Returns false if the charge
+    is aborted by charge_mode_wait_for_complete.
+
+    The charge runs the stages of the charge pipeline of the profile in order (or the coarse and fine stages of the
+    charge mode), each with its own tricklers, gains, speed bounds and gate ratio, until the exit criterion of the last
+    stage is met or the predicted error is within the fine stop threshold. The integral carries over from one stage
+    to the next and is held while a trickler is saturated towards the error (anti-windup).
+
+    With the feedforward enabled the tricklers run at the speed the flow model of the profile predicts to deliver the
+    error in feedforward_time_s (the coarse trickler if both run) and the PID only corrects the residual.
+*/
+static bool _charge_control_run(void) {
     // Read trickling parameter from the current profile
     profile_t * current_profile = profile_get_selected();
 
-    // Find the minimum of max speed from the motor and the profile
-    float coarse_trickler_max_speed = fmin(get_motor_max_speed(SELECT_COARSE_TRICKLER_MOTOR),
-                                           current_profile->coarse_max_flow_speed_rps);
-    float coarse_trickler_min_speed = fmax(get_motor_min_speed(SELECT_COARSE_TRICKLER_MOTOR),
-                                           current_profile->coarse_min_flow_speed_rps);
-    float fine_trickler_max_speed = fmin(get_motor_max_speed(SELECT_FINE_TRICKLER_MOTOR),
-                                         current_profile->fine_max_flow_speed_rps);
-    float fine_trickler_min_speed = fmax(get_motor_min_speed(SELECT_FINE_TRICKLER_MOTOR),
-                                         current_profile->fine_min_flow_speed_rps);
+    float coarse_stop_threshold = coarse_stop_learning_get_threshold(current_profile);
+    charge_pipeline_t pipeline;
+    bool custom_pipeline = charge_pipeline_get(current_profile->charge_pipeline, &pipeline);
+    if (!custom_pipeline) {
+        _charge_pipeline_from_profile(current_profile, coarse_stop_threshold, &pipeline);
+    }
 
     float integral = 0.0f;
     float last_error = 0.0f;
-
-    TickType_t last_sample_tick = xTaskGetTickCount();
-    TickType_t current_sample_tick = last_sample_tick;
-    bool should_coarse_trickler_move = true;
+    float filtered_derivative = 0.0f;
+
+    // Predictive cutoff
+    flow_estimator_t flow_estimator = {};
+    float cutoff_dead_time_s = _get_cutoff_dead_time_ms(current_profile) / 1000.0f;
+    charge_mode_config.predicted_charge_weight = NAN;
+
+    // Only consume measurements captured from now on
+    uint32_t measurement_seq = scale_get_latest_measurement_seq();
+    uint32_t last_capture_time_us = time_us_32();
+    float gate_throttle_ratio = NAN;
+    charge_control_max_latency_us = 0;
+    charge_control_iterations = 0;
+    _charge_control_monitor_reset();
+
+    // The learned threshold is only used by the coarse and fine stages
+    coarse_stop_record.threshold = custom_pipeline ? NAN : coarse_stop_threshold;
+    coarse_stop_record.stop_weight = NAN;
+    coarse_stop_record.carry_weight = NAN;
+    coarse_stop_record.fine_time_s = 0;
+
+    uint8_t stage_idx = 0;
+    uint32_t stage_start_time_us = last_capture_time_us;
+    charge_control_stage = 0;
+
+    bool gate_enable = servo_gate.eeprom_servo_gate_config.servo_gate_enable;
+    if (gate_enable && pipeline.stages[0].gate_ratio >= 0) {
+        servo_gate_set_ratio(pipeline.stages[0].gate_ratio, false);
+    }
 
     while (true) {
-        // Non block waiting for the input
-        ButtonEncoderEvent_t button_encoder_event = button_wait_for_input(false);
-        if (button_encoder_event == BUTTON_RST_PRESSED) {
-            charge_mode_config.charge_mode_state = CHARGE_MODE_EXIT;
-            return;
+        if (charge_control_abort) {
+            return false;
         }
 
         // Run the PID controlled loop to start charging
         // Perform the measurement
-        float current_weight;
-        if (!scale_block_wait_for_next_measurement(200, &current_weight)) {
-            // If no measurement within 200ms then poll the button and retry
+        scale_measurement_t measurement;
+        uint32_t taken_seq = measurement_seq;
+        if (!scale_wait_for_measurement(&measurement_seq, CHARGE_CONTROL_MEASUREMENT_TIMEOUT_MS, &measurement)) {
+            // If no measurement within the timeout then check for abort and retry
             continue;
         }
-        current_sample_tick = xTaskGetTickCount();
+        uint32_t take_time_us = time_us_32();
+        uint32_t missed_samples = measurement_seq - taken_seq - 1;     // Overwritten in the ring before taken
+        float current_weight = measurement.weight;
+        trace_record(TRACE_EVENT_PID_ITERATION, measurement_seq);
 
         float error = charge_mode_config.target_charge_weight - current_weight;
 
-        // Stop condition
-        if (error < charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold) {
-            // Stop all motors
-            motor_set_speed(SELECT_FINE_TRICKLER_MOTOR, 0);
-            motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, 0);
+        // Predict the final weight from the current flow rate and the dead time of the system 
+        // (powder in flight plus the scale filter delay). The Kalman estimates of the scale filter are used if it 
+        // runs, the regression over the recent readings otherwise.
+        bool kalman_estimate = isfinite(measurement.flow_rate);
+        float predicted_weight = current_weight;
+        if (charge_mode_config.eeprom_charge_mode_data.predictive_cutoff_enable) {
+            flow_estimator_add(&flow_estimator, current_weight, measurement.capture_time_us);
+
+            float flow_rate = kalman_estimate ? measurement.flow_rate : flow_estimator_get_rate(&flow_estimator);
+            if (kalman_estimate) {
+                predicted_weight = measurement.filtered_weight;
+            }
+            if (flow_rate > 0) {
+                predicted_weight += flow_rate * cutoff_dead_time_s;
+            }
+        }
+        float predicted_error = charge_mode_config.target_charge_weight - predicted_weight;
 
-            break;
+        // Measure how much the coarse trickler delivers after it stopped
+        if (!isnan(coarse_stop_record.stop_weight) && isnan(coarse_stop_record.carry_weight) &&
+            measurement.capture_time_us - coarse_stop_record.stop_time_us >= COARSE_STOP_CARRY_WINDOW_US) {
+            coarse_stop_record.carry_weight = current_weight - coarse_stop_record.stop_weight;
         }
 
-                // Coarse trickler move condition
-        else if (error < charge_mode_config.eeprom_charge_mode_data.coarse_stop_threshold &&
-                 should_coarse_trickler_move) {
+        // Setpoints of this iteration, applied together after the PID update
+        motor_command_t command = MOTOR_COMMAND_UNCHANGED;
 
-            should_coarse_trickler_move = false;
-            motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, 0);
+        // Move on through the stages whose exit criterion is met, the charge completes after the last one
+        bool stop = predicted_error < charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold;
+        while (!stop && _charge_stage_exit(&pipeline.stages[stage_idx], error, predicted_error, 
+                                           measurement.capture_time_us - stage_start_time_us)) {
+            if (stage_idx + 1 >= pipeline.stage_cnt) {
+                stop = true;
+                break;
+            }
 
-            // NEW: When the coarse trickler stops, move the servo gate to a configured ratio
+            const charge_stage_t * prev_stage = &pipeline.stages[stage_idx];
+            const charge_stage_t * next_stage = &pipeline.stages[stage_idx + 1];
+            stage_idx += 1;
+            stage_start_time_us = measurement.capture_time_us;
+            charge_control_stage = stage_idx;
+
+            // Coarse trickler stops
+            if ((prev_stage->actuators & CHARGE_STAGE_ACTUATOR_COARSE) && 
+                !(next_stage->actuators & CHARGE_STAGE_ACTUATOR_COARSE)) {
+                if (current_profile->coarse_backoff_revolutions <= 0) {
+                    command.coarse_velocity = 0;
+                }
+
+                coarse_stop_record.stop_weight = current_weight;
+                coarse_stop_record.stop_time_us = measurement.capture_time_us;
+
+                // Move reverse to back off the powder left at the tip of the coarse tube, without waiting for it
+                if (current_profile->coarse_backoff_revolutions > 0) {
+                    motor_move_revolutions(SELECT_COARSE_TRICKLER_MOTOR, 
+                                           -current_profile->coarse_backoff_revolutions, 
+                                           fmin(get_motor_max_speed(SELECT_COARSE_TRICKLER_MOTOR),
+                                                prev_stage->coarse.max_flow_speed_rps));
+                }
+            }
+
+            // Fine trickler stops
+            if ((prev_stage->actuators & CHARGE_STAGE_ACTUATOR_FINE) && 
+                !(next_stage->actuators & CHARGE_STAGE_ACTUATOR_FINE)) {
+                command.fine_velocity = 0;
+            }
+
+            // Move the servo gate to the ratio of the stage
             // Ratio convention: 0.0 = open, 1.0 = close
-            if (servo_gate.eeprom_servo_gate_config.servo_gate_enable) {
-                float r = charge_mode_config.eeprom_charge_mode_data.coarse_stop_gate_ratio;
+            if (gate_enable && next_stage->gate_ratio >= 0) {
+                command.gate_ratio = next_stage->gate_ratio;
+                gate_throttle_ratio = NAN;
+            }
+        }
+
+        // Stop condition
+        if (stop) {
+            charge_mode_config.predicted_charge_weight = predicted_weight;
+
+            // Stop all motors
+            motor_command_t stop_command = {0.0f, 0.0f, command.gate_ratio};
+            motor_apply_command(&stop_command);
+
+            charge_trace_record(measurement.capture_time_us, current_weight, 0, 0, servo_gate.gate_ratio, 
+                                CHARGE_MODE_WAIT_FOR_COMPLETE);
+            _charge_control_publish(&measurement, error, 0, 0, last_capture_time_us, missed_samples, take_time_us);
+
+            if (!isnan(coarse_stop_record.stop_weight)) {
+                coarse_stop_record.fine_time_s = (measurement.capture_time_us - coarse_stop_record.stop_time_us) / 1e6f;
+
+                // The charge completed within the carry window
+                if (isnan(coarse_stop_record.carry_weight)) {
+                    coarse_stop_record.carry_weight = current_weight - coarse_stop_record.stop_weight;
+                }
+            }
+
+            return true;
+        }
 
-                servo_gate_set_ratio(r, false); // don't block the charge loop
+        const charge_stage_t * stage = &pipeline.stages[stage_idx];
+        const charge_stage_t * next_stage = stage_idx + 1 < pipeline.stage_cnt ? &pipeline.stages[stage_idx + 1] : NULL;
+
+        // Throttle the coarse flow with the gate on the way to the coarse stop, the gate is the third actuator
+        float gate_throttle_band = charge_mode_config.eeprom_charge_mode_data.coarse_gate_throttle_band;
+        if (gate_enable && gate_throttle_band > 0 && next_stage && next_stage->gate_ratio > 0 &&
+            (stage->actuators & CHARGE_STAGE_ACTUATOR_COARSE) && !(next_stage->actuators & CHARGE_STAGE_ACTUATOR_COARSE) &&
+            stage->exit_criterion != CHARGE_STAGE_EXIT_TIME) {
+            float stage_error = stage->exit_criterion == CHARGE_STAGE_EXIT_PREDICTED_ERROR ? predicted_error : error;
+            float closing = fmaxf(0.0f, fminf((stage->exit_threshold + gate_throttle_band - stage_error) / gate_throttle_band, 
+                                              1.0f));
+            float ratio = next_stage->gate_ratio * closing;
+
+            // The gate moves at its configured speed, only a noticeable change starts a new trajectory
+            if (isnan(gate_throttle_ratio) || fabsf(ratio - gate_throttle_ratio) >= CHARGE_CONTROL_GATE_THROTTLE_STEP) {
+                command.gate_ratio = ratio;
+                gate_throttle_ratio = ratio;
             }
-            // TODO: When turning off the coarse trickler, also move reverse to back off some powder
         }
-    
 
         // Update PID variables
-        float elapse_time_ms = (current_sample_tick - last_sample_tick) / portTICK_RATE_MS;
-        integral += error;
-        float derivative = (error - last_error) / elapse_time_ms;
-
-        // Update fine trickler speed
-        float new_p = current_profile->fine_kp * error;
-        float new_i = current_profile->fine_ki * integral;
-        float new_d = current_profile->fine_kd * derivative;
-        float new_speed = fmax(fine_trickler_min_speed, fmin(new_p + new_i + new_d, fine_trickler_max_speed));
+        // Use the capture time of the frame so the scheduling jitter of this task doesn't affect the derivative
+        float elapse_time_ms = (measurement.capture_time_us - last_capture_time_us) / 1000.0f;
+        float next_integral = integral + error;
+        float derivative = elapse_time_ms > 0 ? (error - last_error) / elapse_time_ms : 0.0f;
+        if (kalman_estimate) {
+            // The error falls as fast as the powder flows, without the noise of the difference of two readings
+            derivative = -measurement.flow_rate / 1000.0f;
+        }
 
-        motor_set_speed(SELECT_FINE_TRICKLER_MOTOR, new_speed);
+        float derivative_filter_ms = charge_mode_config.eeprom_charge_mode_data.derivative_filter_ms;
+        if (derivative_filter_ms > 0 && elapse_time_ms > 0) {
+            filtered_derivative += elapse_time_ms / (derivative_filter_ms + elapse_time_ms) * 
+                                   (derivative - filtered_derivative);
+            derivative = filtered_derivative;
+        }
 
-        // Update coarse trickler speed
-        if (should_coarse_trickler_move) {
-            new_p = current_profile->coarse_kp * error;
-            new_i = current_profile->coarse_ki * integral;
-            new_d = current_profile->coarse_kd * derivative;
+        // Update trickler speeds
+        float fine_speed = 0;
+        float coarse_speed = 0;
+        int fine_saturation = 0;
+        int coarse_saturation = 0;
+        bool coarse_active = stage->actuators & CHARGE_STAGE_ACTUATOR_COARSE;
+
+        if (stage->actuators & CHARGE_STAGE_ACTUATOR_FINE) {
+            float feedforward = coarse_active ? 0.0f : 
+                                _charge_feedforward_speed(current_profile, SELECT_FINE_TRICKLER_MOTOR, error);
+            fine_speed = _charge_stage_speed(&stage->fine, SELECT_FINE_TRICKLER_MOTOR, feedforward, 
+                                             error, next_integral, derivative, &fine_saturation);
+            command.fine_velocity = fine_speed;
+        }
 
-            new_speed = fmax(coarse_trickler_min_speed, fmin(new_p + new_i + new_d, coarse_trickler_max_speed));
+        if (coarse_active) {
+            float feedforward = _charge_feedforward_speed(current_profile, SELECT_COARSE_TRICKLER_MOTOR, error);
+            coarse_speed = _charge_stage_speed(&stage->coarse, SELECT_COARSE_TRICKLER_MOTOR, feedforward, 
+                                               error, next_integral, derivative, &coarse_saturation);
+            command.coarse_velocity = coarse_speed;
+        }
 
-            motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, new_speed);
+        // Conditional integration, the integral doesn't grow while an output can't follow it
+        int error_sign = (error > 0) - (error < 0);
+        if (fine_saturation != error_sign && coarse_saturation != error_sign) {
+            integral = next_integral;
         }
 
+        motor_apply_command(&command);
+
+        charge_trace_record(measurement.capture_time_us, current_weight, coarse_speed, fine_speed, servo_gate.gate_ratio, 
+                            CHARGE_MODE_WAIT_FOR_COMPLETE);
+        _charge_control_publish(&measurement, error, coarse_speed, fine_speed, last_capture_time_us, 
+                                missed_samples, take_time_us);
+
         // Record state
-        last_sample_tick = current_sample_tick;
+        last_capture_time_us = measurement.capture_time_us;
         last_error = error;
     }
+}
+
+
+void charge_control_task(void * p) {
+    while (true) {
+        // Wait for charge_mode_wait_for_complete to start a charge
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        charge_control_completed = _charge_control_run();
+        xSemaphoreGive(charge_control_done_semaphore);
+    }
+}
+
+
+void charge_mode_wait_for_complete() {
+    // The powder of an overlapped precharge has to be behind the gate before it opens
+    charge_mode_precharge_finish();
+
+    charge_start_tick = xTaskGetTickCount();
+    charge_trace_start(time_us_32());
+
+    int64_t coarse_start_position = motor_get_position_steps(SELECT_COARSE_TRICKLER_MOTOR);
+    int64_t fine_start_position = motor_get_position_steps(SELECT_FINE_TRICKLER_MOTOR);
+
+    // Set colour to under charge
+    neopixel_led_set_colour(
+        neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.mini12864_backlight_colour,
+        charge_mode_config.eeprom_charge_mode_data.neopixel_under_charge_colour, 
+        charge_mode_config.eeprom_charge_mode_data.neopixel_under_charge_colour, 
+        true
+    );
+
+    // If the servo gate is used then it has to be opened
+    if (servo_gate.eeprom_servo_gate_config.servo_gate_enable) {
+        servo_gate_set_ratio(SERVO_GATE_RATIO_OPEN, false);
+    }
+    // Update current status
+    char target_weight_string[WEIGHT_STRING_LEN];
+    float_to_string(target_weight_string, charge_mode_config.target_charge_weight, charge_mode_config.eeprom_charge_mode_data.decimal_places);
+
+    snprintf(title_string, sizeof(title_string), 
+             "Target: %s", 
+             target_weight_string);
+    display_request_render();
+
+    // Hand the charge over to the control task, this task only looks after the buttons until it completes
+    xSemaphoreTake(charge_control_done_semaphore, 0);
+    charge_control_abort = false;
+    xTaskNotifyGive(charge_control_task_handler);
+
+    while (xSemaphoreTake(charge_control_done_semaphore, pdMS_TO_TICKS(CHARGE_CONTROL_UI_POLL_MS)) != pdTRUE) {
+        ButtonEncoderEvent_t button_encoder_event = button_wait_for_input(false);
+        if (button_encoder_event == BUTTON_RST_PRESSED) {
+            // Wake the control task from the measurement wait, it leaves the loop and signals the completion
+            charge_control_abort = true;
+            xTaskAbortDelay(charge_control_task_handler);
+        }
+
+        // Weight and elapsed time, the stream merges the updates into one event per period
+        event_stream_notify(EVENT_STREAM_TOPIC_CHARGE_STATE);
+
+        // Charge progress on the PWM OUT LED chain
+        if (charge_mode_config.target_charge_weight > 0) {
+            charge_control_state_t control_state;
+            charge_control_get_state(&control_state);
+            neopixel_led_set_progress(control_state.weight / charge_mode_config.target_charge_weight);
+        }
+    }
+    neopixel_led_set_progress(NAN);
+
+    if (!charge_control_completed) {
+        charge_mode_config.charge_mode_state = CHARGE_MODE_EXIT;
+        return;
+    }
 
     // Stop the timer 
     TickType_t now = xTaskGetTickCount();
     TickType_t elapsed_ticks = now - charge_start_tick;
     last_charge_elapsed_seconds = (float)(elapsed_ticks * portTICK_PERIOD_MS) / 1000.0f;
 
+    // Delivered revolutions (the motor may still be decelerating, the remainder is small)
+    charge_mode_config.coarse_revolutions = motor_steps_to_revolutions(
+        SELECT_COARSE_TRICKLER_MOTOR, motor_get_position_steps(SELECT_COARSE_TRICKLER_MOTOR) - coarse_start_position);
+    charge_mode_config.fine_revolutions = motor_steps_to_revolutions(
+        SELECT_FINE_TRICKLER_MOTOR, motor_get_position_steps(SELECT_FINE_TRICKLER_MOTOR) - fine_start_position);
+
     // Close the gate if the servo gate is present
     if (servo_gate.eeprom_servo_gate_config.servo_gate_enable) {
     servo_gate_set_ratio(SERVO_GATE_RATIO_CLOSED, true);
@@ -331,6 +1125,13 @@ void charge_mode_wait_for_complete() {
 
     // Precharge
     if (charge_mode_config.eeprom_charge_mode_data.precharge_enable &&
+    servo_gate.eeprom_servo_gate_config.servo_gate_enable &&
+    charge_mode_config.eeprom_charge_mode_data.cup_cycle_overlap_enable) {
+        // Run by the cup cycle loops, the cup can be removed right away
+        charge_mode_precharge.pending = true;
+        charge_mode_precharge.gate_closed_tick = xTaskGetTickCount();
+    }
+    else if (charge_mode_config.eeprom_charge_mode_data.precharge_enable &&
     servo_gate.eeprom_servo_gate_config.servo_gate_enable) {
         // Set a fixed delay between closing the gate and precharge to allow the gate to fully close
         vTaskDelay(pdMS_TO_TICKS(500));
@@ -351,35 +1152,84 @@ void charge_mode_wait_for_complete() {
 void charge_mode_wait_for_cup_removal() {
     // Update current status
     snprintf(title_string, sizeof(title_string), "Remove Cup");
+    display_request_render();
 
-    FloatRingBuffer data_buffer(5);
+    SettleDetector settle_detector;
+    uint32_t measurement_seq = scale_get_latest_measurement_seq();
 
     // Post charge analysis (while waiting for removal of the cup)
-    vTaskDelay(pdMS_TO_TICKS(1000));  // Wait for other tasks to complete
+    // Wait for the charge to settle, but no longer than the previous fixed delay
+    float current_measurement = NAN;
+    TimeOut_t settle_timeout;
+    TickType_t settle_ticks_left = pdMS_TO_TICKS(1000);
+    vTaskSetTimeOutState(&settle_timeout);
+
+    while (xTaskCheckForTimeOut(&settle_timeout, &settle_ticks_left) == pdFALSE) {
+        scale_measurement_t measurement;
+        if (!scale_wait_for_measurement(&measurement_seq, settle_ticks_left * portTICK_PERIOD_MS, &measurement)) {
+            continue;
+        }
+        settle_detector.add(&measurement);
+
+        // Record how the charge settles
+        charge_trace_record(measurement.capture_time_us, measurement.weight, 0, 0, servo_gate.gate_ratio, 
+                            CHARGE_MODE_WAIT_FOR_CUP_REMOVAL);
+
+        if (settle_detector.isSettled(charge_mode_config.eeprom_charge_mode_data.set_point_sd_margin)) {
+            current_measurement = settle_detector.getMean();
+            break;
+        }
+    }
+
+    // Not settled in time, take current measurement
+    if (isnan(current_measurement)) {
+        current_measurement = scale_get_current_measurement();
+    }
+    settle_detector.reset();
 
-    // Take current measurement
-    float current_measurement = scale_get_current_measurement();
     float error = charge_mode_config.target_charge_weight - current_measurement;
+    charge_mode_config.measured_overthrow = -error;
+
+    bool over_charged = error <= -charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold;
+    bool under_charged = !over_charged && error >= charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold;
+    coarse_stop_learning_update(profile_get_selected(), over_charged);
+
+    // Feed the charge result to the tuner when it is running
+    pid_autotune_charge_complete(last_charge_elapsed_seconds, error, 
+                                 charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold);
+
+    // The control loop fell behind during the charge
+    charge_control_state_t control_state;
+    charge_control_get_state(&control_state);
+    bool control_degraded = control_state.missed_samples > 0 || control_state.deadline_misses > 0;
+    if (control_degraded) {
+        charge_control_totals.degraded_charges += 1;
+    }
+
+    // Update LED colour before moving to the next stage, LED2 shows the control warning if enabled
+    bool show_control_warning = control_degraded && charge_mode_config.eeprom_charge_mode_data.control_warning_enable;
 
-    // Update LED colour before moving to the next stage
     // Over charged
-    if (error <= -charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold) {
-        neopixel_led_set_colour(
+    if (over_charged) {
+        // Blink so an over charge isn't mistaken for a normal one
+        neopixel_led_blink(
             neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.mini12864_backlight_colour,
             charge_mode_config.eeprom_charge_mode_data.neopixel_over_charge_colour, 
-            charge_mode_config.eeprom_charge_mode_data.neopixel_over_charge_colour, 
-            true
+            show_control_warning ? charge_mode_config.eeprom_charge_mode_data.neopixel_control_warning_colour :
+                                   charge_mode_config.eeprom_charge_mode_data.neopixel_over_charge_colour, 
+            CHARGE_MODE_OVER_CHARGE_BLINK_PERIOD_MS
         );
 
         // Set over charge
         charge_mode_config.charge_mode_event |= CHARGE_MODE_EVENT_OVER_CHARGE;
     }
     // Under charged
-    else if (error >= charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold) {
+    else if (under_charged) {
         neopixel_led_set_colour(
             neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.mini12864_backlight_colour, 
             charge_mode_config.eeprom_charge_mode_data.neopixel_under_charge_colour, 
-            charge_mode_config.eeprom_charge_mode_data.neopixel_under_charge_colour, 
+            show_control_warning ? charge_mode_config.eeprom_charge_mode_data.neopixel_control_warning_colour :
+                                   charge_mode_config.eeprom_charge_mode_data.neopixel_under_charge_colour, 
             true
         );
 
@@ -392,7 +1242,8 @@ void charge_mode_wait_for_cup_removal() {
         neopixel_led_set_colour(
             neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.mini12864_backlight_colour, 
             charge_mode_config.eeprom_charge_mode_data.neopixel_normal_charge_colour, 
-            charge_mode_config.eeprom_charge_mode_data.neopixel_normal_charge_colour, 
+            show_control_warning ? charge_mode_config.eeprom_charge_mode_data.neopixel_control_warning_colour :
+                                   charge_mode_config.eeprom_charge_mode_data.neopixel_normal_charge_colour, 
             true
         );
 
@@ -400,10 +1251,28 @@ void charge_mode_wait_for_cup_removal() {
         charge_mode_config.charge_mode_event &= ~(CHARGE_MODE_EVENT_UNDER_CHARGE | CHARGE_MODE_EVENT_OVER_CHARGE);
     }
 
-    // Stop condition: 5 stable measurements in 300ms apart (1.5 seconds minimum)
-    while (true) {
-        TickType_t last_sample_tick = xTaskGetTickCount();
+    charge_mode_cycle_record(xTaskGetTickCount());
+
+    // Every stream subscriber gets the result, unlike the event bits that the first poll clears
+    charge_mode_completed_charges += 1;
+    event_stream_notify(EVENT_STREAM_TOPIC_CHARGE_STATE);
+    telemetry_publisher_notify();
+
+    charge_history_append(charge_mode_config.target_charge_weight, current_measurement,
+                          charge_mode_config.predicted_charge_weight, last_charge_elapsed_seconds,
+                          profile_get_selected_idx(),
+                          (over_charged ? CHARGE_HISTORY_FLAG_OVER_CHARGE : 0) |
+                          (under_charged ? CHARGE_HISTORY_FLAG_UNDER_CHARGE : 0));
 
+    bool batch_complete = charge_batch_add(current_measurement, last_charge_elapsed_seconds, 
+                                           over_charged, under_charged);
+    if (batch_complete) {
+        snprintf(title_string, sizeof(title_string), "Batch Complete");
+        display_request_render();
+    }
+
+    // Stop condition: stable reading with the cup removed
+    while (true) {
         // Non block waiting for the input
         ButtonEncoderEvent_t button_encoder_event = button_wait_for_input(false);
         if (button_encoder_event == BUTTON_RST_PRESSED) {
@@ -411,24 +1280,22 @@ void charge_mode_wait_for_cup_removal() {
             return;
         }
 
+        charge_mode_precharge_poll();
+
         // Perform measurement
-        float current_weight;
-        if (!scale_block_wait_for_next_measurement(200, &current_weight)) {
+        scale_measurement_t measurement;
+        if (!scale_wait_for_measurement(&measurement_seq, 200, &measurement)) {
             // If no measurement within 200ms then poll the button and retry
             continue;
         }
-        data_buffer.enqueue(current_weight);
+        settle_detector.add(&measurement);
+        event_stream_notify(EVENT_STREAM_TOPIC_CHARGE_STATE);
 
         // Generate stop condition
-        if (data_buffer.getCounter() >= 5) {
-            if (data_buffer.getSd() < charge_mode_config.eeprom_charge_mode_data.set_point_sd_margin && 
-                data_buffer.getMean() + 10 < charge_mode_config.eeprom_charge_mode_data.set_point_mean_margin){
-                break;
-            }
+        if (settle_detector.isSettled(charge_mode_config.eeprom_charge_mode_data.set_point_sd_margin) && 
+            settle_detector.getMean() + 10 < charge_mode_config.eeprom_charge_mode_data.set_point_mean_margin) {
+            break;
         }
-
-        // Wait for next measurement
-        vTaskDelayUntil(&last_sample_tick, pdMS_TO_TICKS(300));
     }
 
     // Reset LED to default colour
@@ -437,9 +1304,67 @@ void charge_mode_wait_for_cup_removal() {
                             neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.led2_colour,
                             true);
 
+    // The last charge of the batch is off the scale
+    if (batch_complete) {
+        charge_mode_config.charge_mode_state = CHARGE_MODE_EXIT;
+        return;
+    }
+
     charge_mode_config.charge_mode_state = CHARGE_MODE_WAIT_FOR_CUP_RETURN;
 }
 
+/*
+    Cup return of the overlapped cup cycle. The zero is judged on the samples from the moment the cup is back on the
+    scale, a cup that settles around zero starts the next charge right away without a separate zero wait.
+*/
+static void _charge_mode_wait_for_cup_settled() {
+    SettleDetector settle_detector;
+    uint32_t measurement_seq = scale_get_latest_measurement_seq();
+
+    while (true) {
+        // Non block waiting for the input
+        ButtonEncoderEvent_t button_encoder_event = button_wait_for_input(false);
+        if (button_encoder_event == BUTTON_RST_PRESSED) {
+            charge_mode_config.charge_mode_state = CHARGE_MODE_EXIT;
+            return;
+        }
+        else if (button_encoder_event == BUTTON_ENCODER_PRESSED) {
+            scale_config.scale_handle->force_zero();
+            settle_detector.reset();
+        }
+
+        charge_mode_precharge_poll();
+
+        // Perform measurement
+        scale_measurement_t measurement;
+        if (!scale_wait_for_measurement(&measurement_seq, 200, &measurement)) {
+            // If no measurement within 200ms then poll the button and retry
+            continue;
+        }
+        event_stream_notify(EVENT_STREAM_TOPIC_CHARGE_STATE);
+
+        // Still off the scale, or on its way down
+        if (measurement.weight < 0) {
+            settle_detector.reset();
+            continue;
+        }
+        settle_detector.add(&measurement);
+
+        if (settle_detector.isSettled(charge_mode_config.eeprom_charge_mode_data.set_point_sd_margin)) {
+            break;
+        }
+    }
+
+    // A cup that isn't at zero (e.g. another cup) waits for the zero as usual
+    if (fabsf(settle_detector.getMean()) < charge_mode_config.eeprom_charge_mode_data.set_point_mean_margin) {
+        charge_mode_config.charge_mode_state = CHARGE_MODE_WAIT_FOR_COMPLETE;
+    }
+    else {
+        charge_mode_config.charge_mode_state = CHARGE_MODE_WAIT_FOR_ZERO;
+    }
+}
+
+
 void charge_mode_wait_for_cup_return() { 
     // Set colour to not ready
     neopixel_led_set_colour(
@@ -450,9 +1375,14 @@ void charge_mode_wait_for_cup_return() {
     );
 
     snprintf(title_string, sizeof(title_string), "Return Cup");
+    display_request_render();
 
+    if (charge_mode_config.eeprom_charge_mode_data.cup_cycle_overlap_enable) {
+        _charge_mode_wait_for_cup_settled();
+        return;
+    }
 
-    FloatRingBuffer data_buffer(5);
+    FloatRingBuffer<5> data_buffer;
 
     while (true) {
         TickType_t last_sample_tick = xTaskGetTickCount();
@@ -473,6 +1403,7 @@ void charge_mode_wait_for_cup_return() {
             // If no measurement within 200ms then poll the button and retry
             continue;
         }
+        event_stream_notify(EVENT_STREAM_TOPIC_CHARGE_STATE);
 
         if (current_weight >= 0) {
             break;
@@ -510,15 +1441,7 @@ uint8_t charge_mode_menu(bool charge_mode_skip_user_input) {
         }
     }
 
-    // If the display task is never created then we shall create one, otherwise we shall resume the task
-    if (scale_measurement_render_task_handler == NULL) {
-        // The render task shall have lower priority than the current one
-        UBaseType_t current_task_priority = uxTaskPriorityGet(xTaskGetCurrentTaskHandle());
-        xTaskCreate(scale_measurement_render_task, "Scale Measurement Render Task", configMINIMAL_STACK_SIZE, NULL, current_task_priority - 1, &scale_measurement_render_task_handler);
-    }
-    else {
-        vTaskResume(scale_measurement_render_task_handler);
-    }
+    display_set_scene(charge_mode_render_scene);
 
     // Enable motor on entering the charge mode
     motor_enable(SELECT_COARSE_TRICKLER_MOTOR, true);
@@ -526,8 +1449,22 @@ uint8_t charge_mode_menu(bool charge_mode_skip_user_input) {
     
     charge_mode_config.charge_mode_state = CHARGE_MODE_WAIT_FOR_ZERO;
 
+    // Fastest output of the scale while charging, the readings decide when the tricklers stop
+    scale_set_fast_report(true);
+
+    // Lowest latency of the REST and event stream delivery while charging
+    wireless_set_charging(true);
+
+    // Throughput and statistics of this session
+    charge_mode_cycle_reset();
+    charge_batch_start(charge_mode_config.eeprom_charge_mode_data.batch_size);
+
     bool quit = false;
     while (quit == false) {
+        // Redraw and stream the new state
+        display_request_render();
+        event_stream_notify(EVENT_STREAM_TOPIC_CHARGE_STATE);
+
         switch (charge_mode_config.charge_mode_state) {
             case CHARGE_MODE_WAIT_FOR_ZERO:
                 charge_mode_wait_for_zero();
@@ -554,8 +1491,28 @@ uint8_t charge_mode_menu(bool charge_mode_skip_user_input) {
                             neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.led2_colour,
                             true);
 
-    // vTaskDelete(scale_measurement_render_handler);
-    vTaskSuspend(scale_measurement_render_task_handler);
+    // Back to the output mode the scale was set to
+    scale_set_fast_report(false);
+    wireless_set_charging(false);
+
+    // Cancel a precharge still pending or running
+    if (charge_mode_precharge.running) {
+        motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, 0);
+    }
+    charge_mode_precharge.pending = false;
+    charge_mode_precharge.running = false;
+
+    // Candidate gains shall not outlive the charge mode, keep the best ones
+    pid_autotune_stop();
+
+    // Persist the learned coarse stop threshold once per session rather than after every charge
+    if (coarse_stop_learning_dirty) {
+        coarse_stop_learning_dirty = false;
+        profile_data_save();
+    }
+
+    // Give the display back to the menu
+    display_set_scene(NULL);
 
     // Diable motors on exiting the mode
     motor_enable(SELECT_COARSE_TRICKLER_MOTOR, false);
@@ -565,6 +1522,158 @@ uint8_t charge_mode_menu(bool charge_mode_skip_user_input) {
 }
 
 
+static void _format_charge_weight(char * buffer, float weight) {
+    if (isfinite(weight)) {
+        float_to_string(buffer, weight, DP_3);
+    }
+    else {
+        sprintf(buffer, "\"nan\"");
+    }
+}
+
+
+size_t charge_mode_format_state(char * buffer, size_t buffer_size, weight_string_cache_t * weight_cache) {
+    scale_measurement_t measurement;
+    const char * weight_string;
+    if (!scale_get_latest_measurement(&measurement) || !isfinite(measurement.weight)) {
+        weight_string = "\"nan\"";
+    }
+    else {
+        weight_string = weight_string_cache_format(weight_cache, measurement.seq, measurement.weight, DP_3);
+    }
+
+    float elapsed_seconds = last_charge_elapsed_seconds;
+    if (charge_mode_config.charge_mode_state == CHARGE_MODE_WAIT_FOR_COMPLETE) {
+        elapsed_seconds = (float)((xTaskGetTickCount() - charge_start_tick) * portTICK_PERIOD_MS) / 1000.0f;
+    }
+
+    int len = snprintf(buffer, buffer_size, 
+                       "{\"s0\":%0.3f,\"s1\":%s,\"s2\":%d,\"s4\":\"%s\",\"s5\":\"%.2f\"}",
+                       charge_mode_config.target_charge_weight,
+                       weight_string,
+                       (int) charge_mode_config.charge_mode_state,
+                       profile_get_selected()->name,
+                       elapsed_seconds);
+
+    return (len > 0 && (size_t) len < buffer_size) ? len : 0;
+}
+
+
+size_t charge_mode_format_charge_result(char * buffer, size_t buffer_size, uint32_t * reported_charges) {
+    uint32_t completed_charges = charge_mode_completed_charges;
+    if (completed_charges == *reported_charges) {
+        return 0;
+    }
+    *reported_charges = completed_charges;
+
+    char predicted_weight_string[16];
+    char overthrow_string[16];
+    _format_charge_weight(predicted_weight_string, charge_mode_config.predicted_charge_weight);
+    _format_charge_weight(overthrow_string, charge_mode_config.measured_overthrow);
+
+    charge_control_state_t control_state;
+    charge_control_get_state(&control_state);
+
+    int len = snprintf(buffer, buffer_size, 
+                       "{\"s3\":%lu,\"s5\":\"%.2f\",\"s6\":%s,\"s7\":%s,\"s8\":%0.3f,\"s9\":%0.3f,"
+                       "\"s13\":%lu,\"s14\":%lu,\"s15\":%lu,\"s16\":%lu,\"s17\":%lu}",
+                       charge_mode_config.charge_mode_event,
+                       last_charge_elapsed_seconds,
+                       predicted_weight_string,
+                       overthrow_string,
+                       isfinite(charge_mode_config.coarse_revolutions) ? charge_mode_config.coarse_revolutions : 0.0f,
+                       isfinite(charge_mode_config.fine_revolutions) ? charge_mode_config.fine_revolutions : 0.0f,
+                       control_state.max_latency_us,
+                       control_state.missed_samples,
+                       control_state.deadline_misses,
+                       control_state.period_jitter_us,
+                       control_state.max_iteration_us);
+
+    return (len > 0 && (size_t) len < buffer_size) ? len : 0;
+}
+
+
+/*
+    Producer of the charge state stream (event_stream.h), the push version of /rest/charge_mode_state with the same
+    keys. A "state" event carries the set point, the weight, the state, the profile and the elapsed time and is sent
+    whenever any of them changes. A "charge" event follows each completed charge with its result and statistics.
+    The charge mode only notifies, all the formatting is done here in the stream task.
+*/
+static size_t charge_mode_stream_produce(char * buffer, size_t buffer_size, bool full) {
+    static weight_string_cache_t weight_cache;
+    bool state_changed = false;
+    size_t len = 0;
+
+    if (!full || charge_mode_stream_state[0] == '\0') {
+        char state_buffer[CHARGE_MODE_STREAM_STATE_SIZE];
+        charge_mode_format_state(state_buffer, sizeof(state_buffer), &weight_cache);
+
+        // A notification that didn't change anything visible sends nothing
+        if (strcmp(state_buffer, charge_mode_stream_state) != 0) {
+            strcpy(charge_mode_stream_state, state_buffer);
+            state_changed = true;
+        }
+    }
+
+    if (full || state_changed) {
+        len += snprintf(buffer + len, buffer_size - len, "event: state\ndata: %s\n\n", charge_mode_stream_state);
+    }
+
+    // One result per charge. It isn't part of the state, a new subscriber starts with the next charge.
+    if (!full) {
+        char charge_buffer[CHARGE_MODE_STREAM_CHARGE_SIZE];
+        if (charge_mode_format_charge_result(charge_buffer, sizeof(charge_buffer), 
+                                             &charge_mode_stream_reported_charges)) {
+            len += snprintf(buffer + len, buffer_size - len, "event: charge\ndata: %s\n\n", charge_buffer);
+        }
+    }
+
+    return len;
+}
+
+
+// Deadline monitor metrics for /metrics, the gauges are of the last (or the current) charge
+static size_t charge_control_format_metrics(char * buffer, size_t buffer_size) {
+    charge_control_state_t control_state;
+    charge_control_get_state(&control_state);
+
+    return snprintf(buffer, buffer_size, 
+                    "# TYPE opentrickler_charge_control_iterations_total counter\n"
+                    "opentrickler_charge_control_iterations_total %lu\n"
+                    "# TYPE opentrickler_charge_control_missed_samples_total counter\n"
+                    "opentrickler_charge_control_missed_samples_total %lu\n"
+                    "# TYPE opentrickler_charge_control_deadline_misses_total counter\n"
+                    "opentrickler_charge_control_deadline_misses_total %lu\n"
+                    "# TYPE opentrickler_charge_control_degraded_charges_total counter\n"
+                    "opentrickler_charge_control_degraded_charges_total %lu\n"
+                    "# TYPE opentrickler_charge_control_latency_max_seconds gauge\n"
+                    "opentrickler_charge_control_latency_max_seconds %0.6f\n"
+                    "# TYPE opentrickler_charge_control_iteration_max_seconds gauge\n"
+                    "opentrickler_charge_control_iteration_max_seconds %0.6f\n"
+                    "# TYPE opentrickler_charge_control_period_jitter_seconds gauge\n"
+                    "opentrickler_charge_control_period_jitter_seconds %0.6f\n",
+                    charge_control_totals.iterations,
+                    charge_control_totals.missed_samples,
+                    charge_control_totals.deadline_misses,
+                    charge_control_totals.degraded_charges,
+                    control_state.max_latency_us / 1e6,
+                    control_state.max_iteration_us / 1e6,
+                    control_state.period_jitter_us / 1e6);
+}
+
+
+// Cup cycle throughput for /metrics
+static size_t charge_mode_cycle_format_metrics(char * buffer, size_t buffer_size) {
+    return snprintf(buffer, buffer_size, 
+                    "# TYPE opentrickler_charge_mode_charges_per_hour gauge\n"
+                    "opentrickler_charge_mode_charges_per_hour %0.1f\n"
+                    "# TYPE opentrickler_charge_mode_cycle_seconds gauge\n"
+                    "opentrickler_charge_mode_cycle_seconds %0.3f\n",
+                    charge_mode_cycle_get_rate(),
+                    charge_mode_cycle.last_cycle_ms / 1e3);
+}
+
+
 bool charge_mode_config_init(void) {
     bool is_ok = false;
 
@@ -575,9 +1684,40 @@ bool charge_mode_config_init(void) {
         return is_ok;
     }
 
+    // No charge statistics yet
+    charge_mode_config.predicted_charge_weight = NAN;
+    charge_mode_config.measured_overthrow = NAN;
+    charge_mode_config.coarse_revolutions = NAN;
+    charge_mode_config.fine_revolutions = NAN;
+
     // Register to eeprom save all
     eeprom_register_handler(charge_mode_config_save);
 
+    // Stages the profiles can run instead of the coarse and fine stages
+    if (!charge_pipeline_init()) {
+        return false;
+    }
+
+    // Statistics of the charge mode session
+    if (!charge_batch_init()) {
+        return false;
+    }
+
+    // Served together with the other modules by /rest/config
+    rest_register_config_module("charge_mode_config", http_rest_charge_mode_config);
+
+    // Deadline monitor of the control loop
+    rest_register_metrics(charge_control_format_metrics);
+    rest_register_metrics(charge_mode_cycle_format_metrics);
+
+    // Push alternative to polling /rest/charge_mode_state
+    event_stream_register_topic(EVENT_STREAM_TOPIC_CHARGE_STATE, "/charge_mode_state", charge_mode_stream_produce);
+
+    // The control loop stays on the control core with the scale and the motor tasks
+    charge_control_done_semaphore = STATIC_SEMAPHORE_CREATE_BINARY();
+    STATIC_TASK_CREATE_AFFINITY_SET(charge_control_task, "Charge Control", 512, NULL, CHARGE_CONTROL_TASK_PRIORITY, 
+                                    CONTROL_CORE_AFFINITY_MASK, &charge_control_task_handler);
+
     return true;
 }
 
@@ -605,61 +1745,75 @@ bool http_rest_charge_mode_config(struct fs_file *file, int num_params, char *pa
     // c11 (int): precharge_time_ms
     // c12 (float): precharge_speed_rps
     // c13 (float): coarse_stop_gate_ratio
+    // c14 (bool): predictive_cutoff_enable
+    // c15 (float): cutoff_dead_time_ms
+    // c16 (bool): coarse_stop_learning_enable
+    // c17 (float): overthrow_rate_target
+    // c18 (float): control_deadline_ms
+    // c19 (bool): control_warning_enable
+    // c20 (str): neopixel_control_warning_colour
+    // c21 (float): coarse_gate_throttle_band
+    // c22 (bool): cup_cycle_overlap_enable
+    // c23 (int): batch_size, 0 for no limit
+    // c24 (bool): feedforward_enable
+    // c25 (float): feedforward_time_s
+    // c26 (float): derivative_filter_ms, 0 to disable
     // ee (bool): save to eeprom
 
-    static char charge_mode_json_buffer[256];
-    bool save_to_eeprom = false;
+    const size_t charge_mode_json_buffer_size = 640;
+    char * charge_mode_json_buffer = (char *) rest_response_alloc(charge_mode_json_buffer_size);
+    if (charge_mode_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    static const rest_param_t charge_mode_config_params[] = {
+        REST_PARAM_COLOUR("c1", charge_mode_config.eeprom_charge_mode_data.neopixel_normal_charge_colour._raw_colour),
+        REST_PARAM_COLOUR("c2", charge_mode_config.eeprom_charge_mode_data.neopixel_under_charge_colour._raw_colour),
+        REST_PARAM_COLOUR("c3", charge_mode_config.eeprom_charge_mode_data.neopixel_over_charge_colour._raw_colour),
+        REST_PARAM_COLOUR("c4", charge_mode_config.eeprom_charge_mode_data.neopixel_not_ready_colour._raw_colour),
+        REST_PARAM_FLOAT("c5", charge_mode_config.eeprom_charge_mode_data.coarse_stop_threshold),
+        REST_PARAM_FLOAT("c6", charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold),
+        REST_PARAM_FLOAT("c7", charge_mode_config.eeprom_charge_mode_data.set_point_sd_margin),
+        REST_PARAM_FLOAT("c8", charge_mode_config.eeprom_charge_mode_data.set_point_mean_margin),
+        REST_PARAM_INT("c9", charge_mode_config.eeprom_charge_mode_data.decimal_places),
 
-    // Control
-    for (int idx = 0; idx < num_params; idx += 1) {
-        if (strcmp(params[idx], "c5") == 0) {
-            charge_mode_config.eeprom_charge_mode_data.coarse_stop_threshold = strtof(values[idx], NULL);
-        }
-        else if (strcmp(params[idx], "c6") == 0) {
-            charge_mode_config.eeprom_charge_mode_data.fine_stop_threshold = strtof(values[idx], NULL);
-        }
-        else if (strcmp(params[idx], "c7") == 0) {
-            charge_mode_config.eeprom_charge_mode_data.set_point_sd_margin = strtof(values[idx], NULL);
-        }
-        else if (strcmp(params[idx], "c8") == 0) {
-            charge_mode_config.eeprom_charge_mode_data.set_point_mean_margin = strtof(values[idx], NULL);
-        }
-        else if (strcmp(params[idx], "c9") == 0) {
-            charge_mode_config.eeprom_charge_mode_data.decimal_places = (decimal_places_t) atoi(values[idx]);
-        }
-        
         // Pre charge related settings
-        else if (strcmp(params[idx], "c10") == 0) {
-            charge_mode_config.eeprom_charge_mode_data.precharge_enable = string_to_boolean(values[idx]);
-        }
-        else if (strcmp(params[idx], "c11") == 0) {
-            charge_mode_config.eeprom_charge_mode_data.precharge_time_ms = strtol(values[idx], NULL, 10);
-        }
-        else if (strcmp(params[idx], "c12") == 0) {
-            charge_mode_config.eeprom_charge_mode_data.precharge_speed_rps = strtof(values[idx], NULL);
-        }
-        else if (strcmp(params[idx], "c13") == 0) {
-            charge_mode_config.eeprom_charge_mode_data.coarse_stop_gate_ratio = strtof(values[idx], NULL);
-        }
+        REST_PARAM_BOOL("c10", charge_mode_config.eeprom_charge_mode_data.precharge_enable),
+        REST_PARAM_INT("c11", charge_mode_config.eeprom_charge_mode_data.precharge_time_ms),
+        REST_PARAM_FLOAT("c12", charge_mode_config.eeprom_charge_mode_data.precharge_speed_rps),
+        REST_PARAM_FLOAT("c13", charge_mode_config.eeprom_charge_mode_data.coarse_stop_gate_ratio),
 
+        // Predictive cutoff
+        REST_PARAM_BOOL("c14", charge_mode_config.eeprom_charge_mode_data.predictive_cutoff_enable),
+        REST_PARAM_FLOAT("c15", charge_mode_config.eeprom_charge_mode_data.cutoff_dead_time_ms),
 
-        // LED related settings
-        else if (strcmp(params[idx], "c1") == 0) {
-            charge_mode_config.eeprom_charge_mode_data.neopixel_normal_charge_colour._raw_colour = hex_string_to_decimal(values[idx]);
-        }
-        else if (strcmp(params[idx], "c2") == 0) {
-            charge_mode_config.eeprom_charge_mode_data.neopixel_under_charge_colour._raw_colour = hex_string_to_decimal(values[idx]);
-        }
-        else if (strcmp(params[idx], "c3") == 0) {
-            charge_mode_config.eeprom_charge_mode_data.neopixel_over_charge_colour._raw_colour = hex_string_to_decimal(values[idx]);
-        }
-        else if (strcmp(params[idx], "c4") == 0) {
-            charge_mode_config.eeprom_charge_mode_data.neopixel_not_ready_colour._raw_colour = hex_string_to_decimal(values[idx]);
-        }
-        else if (strcmp(params[idx], "ee") == 0) {
-            save_to_eeprom = string_to_boolean(values[idx]);
-        }
-    }
+        // Coarse stop threshold learning
+        REST_PARAM_BOOL("c16", charge_mode_config.eeprom_charge_mode_data.coarse_stop_learning_enable),
+        REST_PARAM_FLOAT("c17", charge_mode_config.eeprom_charge_mode_data.overthrow_rate_target),
+
+        // Control loop deadline monitor
+        REST_PARAM_FLOAT("c18", charge_mode_config.eeprom_charge_mode_data.control_deadline_ms),
+        REST_PARAM_BOOL("c19", charge_mode_config.eeprom_charge_mode_data.control_warning_enable),
+        REST_PARAM_COLOUR("c20", charge_mode_config.eeprom_charge_mode_data.neopixel_control_warning_colour._raw_colour),
+
+        // Coarse flow throttling with the gate
+        REST_PARAM_FLOAT("c21", charge_mode_config.eeprom_charge_mode_data.coarse_gate_throttle_band),
+
+        // Cup cycle
+        REST_PARAM_BOOL("c22", charge_mode_config.eeprom_charge_mode_data.cup_cycle_overlap_enable),
+
+        // Batch
+        REST_PARAM_INT("c23", charge_mode_config.eeprom_charge_mode_data.batch_size),
+
+        // Feedforward and derivative filter
+        REST_PARAM_BOOL("c24", charge_mode_config.eeprom_charge_mode_data.feedforward_enable),
+        REST_PARAM_FLOAT("c25", charge_mode_config.eeprom_charge_mode_data.feedforward_time_s),
+        REST_PARAM_FLOAT("c26", charge_mode_config.eeprom_charge_mode_data.derivative_filter_ms),
+    };
+
+    // Control
+    bool save_to_eeprom = rest_apply_params(charge_mode_config_params, REST_PARAM_TABLE_SIZE(charge_mode_config_params), 
+                                            num_params, params, values);
     
     // Perform action
     if (save_to_eeprom) {
@@ -668,10 +1822,12 @@ bool http_rest_charge_mode_config(struct fs_file *file, int num_params, char *pa
 
     // Response
     snprintf(charge_mode_json_buffer, 
-             sizeof(charge_mode_json_buffer),
+             charge_mode_json_buffer_size,
              "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n"
              "{\"c1\":\"#%06lx\",\"c2\":\"#%06lx\",\"c3\":\"#%06lx\",\"c4\":\"#%06lx\","
-             "\"c5\":%.3f,\"c6\":%.3f,\"c7\":%.3f,\"c8\":%.3f,\"c9\":%d,\"c10\":%s,\"c11\":%ld,\"c12\":%0.3f,\"c13\":%0.3f}",
+             "\"c5\":%.3f,\"c6\":%.3f,\"c7\":%.3f,\"c8\":%.3f,\"c9\":%d,\"c10\":%s,\"c11\":%ld,\"c12\":%0.3f,\"c13\":%0.3f,\"c14\":%s,\"c15\":%0.1f,\"c16\":%s,\"c17\":%0.3f,"
+             "\"c18\":%0.1f,\"c19\":%s,\"c20\":\"#%06lx\",\"c21\":%0.3f,\"c22\":%s,\"c23\":%lu,"
+             "\"c24\":%s,\"c25\":%0.2f,\"c26\":%0.1f}",
              charge_mode_config.eeprom_charge_mode_data.neopixel_normal_charge_colour._raw_colour,
              charge_mode_config.eeprom_charge_mode_data.neopixel_under_charge_colour._raw_colour,
              charge_mode_config.eeprom_charge_mode_data.neopixel_over_charge_colour._raw_colour,
@@ -684,7 +1840,20 @@ bool http_rest_charge_mode_config(struct fs_file *file, int num_params, char *pa
              boolean_to_string(charge_mode_config.eeprom_charge_mode_data.precharge_enable),
              charge_mode_config.eeprom_charge_mode_data.precharge_time_ms,
              charge_mode_config.eeprom_charge_mode_data.precharge_speed_rps,
-             charge_mode_config.eeprom_charge_mode_data.coarse_stop_gate_ratio);
+             charge_mode_config.eeprom_charge_mode_data.coarse_stop_gate_ratio,
+             boolean_to_string(charge_mode_config.eeprom_charge_mode_data.predictive_cutoff_enable),
+             charge_mode_config.eeprom_charge_mode_data.cutoff_dead_time_ms,
+             boolean_to_string(charge_mode_config.eeprom_charge_mode_data.coarse_stop_learning_enable),
+             charge_mode_config.eeprom_charge_mode_data.overthrow_rate_target,
+             charge_mode_config.eeprom_charge_mode_data.control_deadline_ms,
+             boolean_to_string(charge_mode_config.eeprom_charge_mode_data.control_warning_enable),
+             charge_mode_config.eeprom_charge_mode_data.neopixel_control_warning_colour._raw_colour,
+             charge_mode_config.eeprom_charge_mode_data.coarse_gate_throttle_band,
+             boolean_to_string(charge_mode_config.eeprom_charge_mode_data.cup_cycle_overlap_enable),
+             charge_mode_config.eeprom_charge_mode_data.batch_size,
+             boolean_to_string(charge_mode_config.eeprom_charge_mode_data.feedforward_enable),
+             charge_mode_config.eeprom_charge_mode_data.feedforward_time_s,
+             charge_mode_config.eeprom_charge_mode_data.derivative_filter_ms);
 
     size_t data_length = strlen(charge_mode_json_buffer);
     file->data = charge_mode_json_buffer;
@@ -704,8 +1873,27 @@ bool http_rest_charge_mode_state(struct fs_file *file, int num_params, char *par
     // s3 (uint32_t): Charge mode event
     // s4 (string): Profile Name
     // s5 (string): Elapsed time in seconds, live during charging
-
-    static char charge_mode_json_buffer[160];  // Increased to fit s5
+    // s6 (float): Predicted final weight when the trickler stopped (last charge)
+    // s7 (float): Measured overthrow, settled weight - set point (last charge)
+    // s8 (float): Coarse trickler revolutions (last charge)
+    // s9 (float): Fine trickler revolutions (last charge)
+    // s10 (uint32_t): Control loop iterations (current or last charge)
+    // s11 (uint32_t): Control period, time between the last two measurements acted on (us)
+    // s12 (uint32_t): Control latency, measurement capture to motor command (us)
+    // s13 (uint32_t): Worst control latency of the charge (us)
+    // s14 (uint32_t): Measurements missed by the control loop during the charge
+    // s15 (uint32_t): Control iterations with a latency above the control deadline (c18)
+    // s16 (uint32_t): Control period jitter, standard deviation of the period (us)
+    // s17 (uint32_t): Worst control iteration time, measurement taken to motor command (us)
+    // s18 (uint8_t): Charge stage, index into the charge pipeline of the profile (current or last charge)
+    // s19 (float): Charges per hour over the recent cup cycles of the charge mode session
+    // s20 (uint32_t): Last cup cycle, completion to completion of the last two charges (ms)
+
+    const size_t charge_mode_json_buffer_size = 512;
+    char * charge_mode_json_buffer = (char *) rest_response_alloc(charge_mode_json_buffer_size);
+    if (charge_mode_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
     char elapsed_time_buffer[16] = {0};
 
     // Control
@@ -735,17 +1923,37 @@ bool http_rest_charge_mode_state(struct fs_file *file, int num_params, char *par
         }
     }
 
-    // Handle the special case
-    float current_measurement = scale_get_current_measurement();
-    char weight_string[16];
-    if (isnanf(current_measurement)) {
-        sprintf(weight_string, "\"nan\"");
+    if (num_params) {
+        event_stream_notify(EVENT_STREAM_TOPIC_CHARGE_STATE);
     }
-    else if (isinff(current_measurement)) {
-        sprintf(weight_string, "\"inf\"");
+
+    // Handle the special case, each measurement is formatted once however often it is polled
+    static weight_string_cache_t weight_cache;
+    scale_measurement_t measurement;
+    const char * weight_string;
+    if (!scale_get_latest_measurement(&measurement) || isnanf(measurement.weight)) {
+        weight_string = "\"nan\"";
+    }
+    else if (isinff(measurement.weight)) {
+        weight_string = "\"inf\"";
     }
     else {
-        sprintf(weight_string, "%0.3f", current_measurement);
+        weight_string = weight_string_cache_format(&weight_cache, measurement.seq, measurement.weight, DP_3);
+    }
+
+    char predicted_weight_string[16];
+    char overthrow_string[16];
+    if (isfinite(charge_mode_config.predicted_charge_weight)) {
+        float_to_string(predicted_weight_string, charge_mode_config.predicted_charge_weight, DP_3);
+    }
+    else {
+        sprintf(predicted_weight_string, "\"nan\"");
+    }
+    if (isfinite(charge_mode_config.measured_overthrow)) {
+        float_to_string(overthrow_string, charge_mode_config.measured_overthrow, DP_3);
+    }
+    else {
+        sprintf(overthrow_string, "\"nan\"");
     }
 
     // Format elapsed time
@@ -757,18 +1965,38 @@ bool http_rest_charge_mode_state(struct fs_file *file, int num_params, char *par
         snprintf(elapsed_time_buffer, sizeof(elapsed_time_buffer), "%.2f", last_charge_elapsed_seconds);
     }
 
+    charge_control_state_t control_state;
+    charge_control_get_state(&control_state);
+
     // Response
     snprintf(charge_mode_json_buffer, 
-             sizeof(charge_mode_json_buffer),
+             charge_mode_json_buffer_size,
              "%s"
-             "{\"s0\":%0.3f,\"s1\":%s,\"s2\":%d,\"s3\":%lu,\"s4\":\"%s\",\"s5\":\"%s\"}",
+             "{\"s0\":%0.3f,\"s1\":%s,\"s2\":%d,\"s3\":%lu,\"s4\":\"%s\",\"s5\":\"%s\",\"s6\":%s,\"s7\":%s,\"s8\":%0.3f,\"s9\":%0.3f,"
+             "\"s10\":%lu,\"s11\":%lu,\"s12\":%lu,\"s13\":%lu,\"s14\":%lu,\"s15\":%lu,\"s16\":%lu,\"s17\":%lu,"
+             "\"s18\":%u,\"s19\":%0.1f,\"s20\":%lu}",
              http_json_header,
              charge_mode_config.target_charge_weight,
              weight_string,
              (int) charge_mode_config.charge_mode_state,
              charge_mode_config.charge_mode_event,
              profile_get_selected()->name,
-             elapsed_time_buffer);
+             elapsed_time_buffer,
+             predicted_weight_string,
+             overthrow_string,
+             isfinite(charge_mode_config.coarse_revolutions) ? charge_mode_config.coarse_revolutions : 0.0f,
+             isfinite(charge_mode_config.fine_revolutions) ? charge_mode_config.fine_revolutions : 0.0f,
+             control_state.iteration,
+             control_state.period_us,
+             control_state.latency_us,
+             control_state.max_latency_us,
+             control_state.missed_samples,
+             control_state.deadline_misses,
+             control_state.period_jitter_us,
+             control_state.max_iteration_us,
+             control_state.stage,
+             charge_mode_cycle_get_rate(),
+             charge_mode_cycle.last_cycle_ms);
 
     // Clear events
     charge_mode_config.charge_mode_event = 0;
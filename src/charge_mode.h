@@ -42,6 +42,33 @@ typedef struct {
     rgbw_u32_t neopixel_over_charge_colour;
     rgbw_u32_t neopixel_not_ready_colour;
 
+    // Predictive cutoff (stop early to account for the powder in flight and the scale delay)
+    bool predictive_cutoff_enable;
+    float cutoff_dead_time_ms;
+
+    // Learn the coarse stop threshold per profile from the recorded charges
+    bool coarse_stop_learning_enable;
+    float overthrow_rate_target;        // Acceptable fraction of over charges (0.0 - 1.0)
+
+    // Control loop deadline monitor
+    float control_deadline_ms;          // Longest acceptable capture to motor command latency
+    bool control_warning_enable;        // Show the warning colour on LED2 after a charge that missed samples or deadlines
+    rgbw_u32_t neopixel_control_warning_colour;
+
+    // Close the gate gradually over this error band above the coarse stop threshold, down to coarse_stop_gate_ratio
+    float coarse_gate_throttle_band;    // 0 to disable
+
+    // Overlap the cup cycle: precharge while the cup is off, accept the zero as soon as the returned cup settles
+    bool cup_cycle_overlap_enable;
+
+    // Charges per batch, the charge mode leaves once the batch is complete
+    uint32_t batch_size;                // 0 for no limit
+
+    // Feedforward from the flow model of the profile, the PID corrects the residual
+    bool feedforward_enable;
+    float feedforward_time_s;           // Command the speed delivering the error in this time
+    float derivative_filter_ms;         // Time constant of the low pass on the derivative, 0 to disable
+
 } eeprom_charge_mode_data_t;
 
 typedef struct {
@@ -49,9 +76,36 @@ typedef struct {
     float target_charge_weight;
     uint32_t charge_mode_event;
     charge_mode_state_t charge_mode_state;
+
+    // Last charge statistics
+    float predicted_charge_weight;      // Predicted final weight when the trickler stopped
+    float measured_overthrow;           // Settled weight - target weight
+    float coarse_revolutions;           // Trickler revolutions delivered, from the step counters
+    float fine_revolutions;
 } charge_mode_config_t;
 
 
+// Latest state of the charge control loop, published once per scale measurement
+typedef struct {
+    uint32_t iteration;                 // Control iterations of the current charge
+    uint32_t capture_time_us;           // Capture time of the measurement acted on
+    float weight;
+    float error;
+    float coarse_speed;
+    float fine_speed;
+    uint32_t period_us;                 // Time between the last two measurements acted on
+    uint32_t latency_us;                // Capture to motor command
+    uint32_t max_latency_us;            // Worst latency of the current charge
+    uint8_t stage;                      // Charge pipeline stage
+
+    // Deadline monitor, over the current charge
+    uint32_t missed_samples;            // Measurements skipped over, from the sequence gaps
+    uint32_t deadline_misses;           // Iterations with a latency above control_deadline_ms
+    uint32_t period_jitter_us;          // Standard deviation of period_us
+    uint32_t max_iteration_us;          // Worst time from taking a measurement to the motor command
+} charge_control_state_t;
+
+
 // C Functions
 #ifdef __cplusplus
 extern "C" {
@@ -61,6 +115,15 @@ extern "C" {
 bool charge_mode_config_init(void);
 uint8_t charge_mode_menu(bool charge_mode_skip_user_input);
 bool charge_mode_config_save(void);
+void charge_control_task(void * p);
+void charge_control_get_state(charge_control_state_t * state);
+
+// JSON object with the keys of /rest/charge_mode_state: set point, weight, state, profile and elapsed time
+size_t charge_mode_format_state(char * buffer, size_t buffer_size, weight_string_cache_t * weight_cache);
+
+// JSON object with the result of the last charge, written only if a charge completed since *reported_charges (which
+// is then updated). Returns 0 otherwise. Each consumer keeps its own counter.
+size_t charge_mode_format_charge_result(char * buffer, size_t buffer_size, uint32_t * reported_charges);
 
 // REST interface
 bool http_rest_charge_mode_config(struct fs_file *file, int num_params, char *params[], char *values[]);
@@ -0,0 +1,247 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "pico/platform.h"
+
+#include "charge_pipeline.h"
+#include "servo_gate.h"
+#include "eeprom.h"
+#include "common.h"
+
+
+/*
+    Charge pipelines, ordered lists of stages a profile can run instead of the coarse and fine stages of the charge
+    mode (profile_t charge_pipeline). The stages are run by the charge control loop, see _charge_control_run.
+*/
+eeprom_charge_pipeline_data_t charge_pipeline_data;
+
+// Gains and speed bounds of the AR2208,gr profile
+#define _DEFAULT_COARSE_MOTOR(max_speed)    {.kp = 0.025f, .ki = 0.0f, .kd = 0.3f, \
+                                             .min_flow_speed_rps = 0.1f, .max_flow_speed_rps = (max_speed)}
+#define _DEFAULT_FINE_MOTOR(max_speed)      {.kp = 2.0f, .ki = 0.0f, .kd = 10.0f, \
+                                             .min_flow_speed_rps = 0.08f, .max_flow_speed_rps = (max_speed)}
+
+// Pipeline 1 is an example to start from: bulk coarse, tapered coarse, fine and a final pulse of the fine trickler
+const eeprom_charge_pipeline_data_t default_charge_pipeline_data = {
+    .charge_pipeline_data_rev = 0,
+    .pipelines[0] = {
+        .stage_cnt = 4,
+        .stages = {
+            {
+                .actuators = CHARGE_STAGE_ACTUATOR_COARSE | CHARGE_STAGE_ACTUATOR_FINE,
+                .exit_criterion = CHARGE_STAGE_EXIT_ERROR,
+                .exit_threshold = 10.0f,
+                .gate_ratio = SERVO_GATE_RATIO_DISABLED,
+                .coarse = _DEFAULT_COARSE_MOTOR(5.0f),
+                .fine = _DEFAULT_FINE_MOTOR(5.0f),
+            },
+            {
+                .actuators = CHARGE_STAGE_ACTUATOR_COARSE | CHARGE_STAGE_ACTUATOR_FINE,
+                .exit_criterion = CHARGE_STAGE_EXIT_ERROR,
+                .exit_threshold = 3.0f,
+                .gate_ratio = SERVO_GATE_RATIO_DISABLED,
+                .coarse = _DEFAULT_COARSE_MOTOR(1.5f),
+                .fine = _DEFAULT_FINE_MOTOR(5.0f),
+            },
+            {
+                .actuators = CHARGE_STAGE_ACTUATOR_FINE,
+                .exit_criterion = CHARGE_STAGE_EXIT_PREDICTED_ERROR,
+                .exit_threshold = 0.1f,
+                .gate_ratio = SERVO_GATE_RATIO_DISABLED,
+                .coarse = _DEFAULT_COARSE_MOTOR(5.0f),
+                .fine = _DEFAULT_FINE_MOTOR(5.0f),
+            },
+            {
+                .actuators = CHARGE_STAGE_ACTUATOR_FINE,
+                .exit_criterion = CHARGE_STAGE_EXIT_TIME,
+                .exit_threshold = 500.0f,
+                .gate_ratio = SERVO_GATE_RATIO_DISABLED,
+                .coarse = _DEFAULT_COARSE_MOTOR(5.0f),
+                .fine = {.kp = 0.0f, .ki = 0.0f, .kd = 0.0f, .min_flow_speed_rps = 0.08f, .max_flow_speed_rps = 0.08f},
+            },
+        },
+    },
+};
+
+
+bool charge_pipeline_save(void) {
+    bool is_ok = save_config(EEPROM_CHARGE_PIPELINE_BASE_ADDR, &charge_pipeline_data, sizeof(charge_pipeline_data));
+    return is_ok;
+}
+
+
+bool charge_pipeline_init(void) {
+    bool is_ok = load_config(EEPROM_CHARGE_PIPELINE_BASE_ADDR, &charge_pipeline_data, &default_charge_pipeline_data,
+                             sizeof(charge_pipeline_data), EEPROM_CHARGE_PIPELINE_DATA_REV);
+    if (!is_ok) {
+        printf("Unable to read charge pipeline configuration\n");
+        return false;
+    }
+
+    // Register to eeprom save all
+    eeprom_register_handler(charge_pipeline_save);
+
+    // Served together with the other modules by /rest/config
+    rest_register_config_module("charge_pipeline_config", http_rest_charge_pipeline_config);
+
+    return true;
+}
+
+
+bool charge_pipeline_get(uint32_t idx, charge_pipeline_t * pipeline) {
+    if (idx < 1 || idx > CHARGE_PIPELINE_CNT) {
+        return false;
+    }
+
+    const charge_pipeline_t * stored_pipeline = &charge_pipeline_data.pipelines[idx - 1];
+    if (stored_pipeline->stage_cnt == 0 || stored_pipeline->stage_cnt > CHARGE_PIPELINE_MAX_STAGE_CNT) {
+        return false;
+    }
+
+    memcpy(pipeline, stored_pipeline, sizeof(charge_pipeline_t));
+    return true;
+}
+
+
+static float * _stage_motor_field(charge_stage_motor_t * motor, unsigned field) {
+    switch (field) {
+        case 0: return &motor->kp;
+        case 1: return &motor->ki;
+        case 2: return &motor->kd;
+        case 3: return &motor->min_flow_speed_rps;
+        case 4: return &motor->max_flow_speed_rps;
+        default: return NULL;
+    }
+}
+
+
+static int _format_stage_motor(char * buffer, size_t buffer_size, const charge_stage_motor_t * motor) {
+    return snprintf(buffer, buffer_size, "[%0.3f,%0.3f,%0.3f,%0.3f,%0.3f]",
+                    motor->kp, motor->ki, motor->kd, motor->min_flow_speed_rps, motor->max_flow_speed_rps);
+}
+
+
+bool http_rest_charge_pipeline_config(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // pl (int): pipeline index (1 - 4), default 1
+    // n (int): stage count, 0 leaves the pipeline unused
+    // s<i>a (int): actuators of stage i, charge_stage_actuator_t bits (1 coarse, 2 fine)
+    // s<i>x (int): exit criterion of stage i, charge_stage_exit_t
+    // s<i>t (float): exit threshold of stage i, weight or ms
+    // s<i>g (float): gate ratio of stage i, -1 leaves the gate
+    // s<i>c<j> (float): coarse trickler of stage i, j: 0 kp, 1 ki, 2 kd, 3 min_flow_speed_rps, 4 max_flow_speed_rps
+    // s<i>f<j> (float): fine trickler of stage i, as above
+    // ee (bool): save to eeprom
+    //
+    // Response: {"pl":<int>,"n":<int>,"s":[{"a":..,"x":..,"t":..,"g":..,"c":[kp,ki,kd,min,max],"f":[..]}, ..]}
+    const size_t buf_size = 768;
+    char * buf = (char *) rest_response_alloc(buf_size);
+    if (buf == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    uint32_t pipeline_idx = 1;
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "pl") == 0) {
+            pipeline_idx = (uint32_t) atoi(values[idx]);
+        }
+    }
+
+    size_t len = snprintf(buf, buf_size, "%s", http_json_header);
+
+    if (pipeline_idx < 1 || pipeline_idx > CHARGE_PIPELINE_CNT) {
+        len += snprintf(buf + len, buf_size - len, "{\"error\":\"InvalidPipelineIndex\"}");
+    }
+    else {
+        charge_pipeline_t * pipeline = &charge_pipeline_data.pipelines[pipeline_idx - 1];
+        bool save_to_eeprom = false;
+
+        // Control
+        for (int idx = 0; idx < num_params; idx += 1) {
+            unsigned stage_idx;
+            char field;
+            unsigned sub_field = 0;
+
+            if (strcmp(params[idx], "n") == 0) {
+                int stage_cnt = atoi(values[idx]);
+                pipeline->stage_cnt = MAX(0, MIN(stage_cnt, CHARGE_PIPELINE_MAX_STAGE_CNT));
+            }
+            else if (strcmp(params[idx], "ee") == 0) {
+                save_to_eeprom = string_to_boolean(values[idx]);
+            }
+            else if (sscanf(params[idx], "s%u%c%u", &stage_idx, &field, &sub_field) >= 2 &&
+                     stage_idx < CHARGE_PIPELINE_MAX_STAGE_CNT) {
+                charge_stage_t * stage = &pipeline->stages[stage_idx];
+                float * target = NULL;
+
+                switch (field) {
+                    case 'a':
+                        stage->actuators = (uint8_t) atoi(values[idx]) &
+                                           (CHARGE_STAGE_ACTUATOR_COARSE | CHARGE_STAGE_ACTUATOR_FINE);
+                        break;
+                    case 'x':
+                        stage->exit_criterion = (uint8_t) atoi(values[idx]);
+                        break;
+                    case 't':
+                        target = &stage->exit_threshold;
+                        break;
+                    case 'g':
+                        target = &stage->gate_ratio;
+                        break;
+                    case 'c':
+                        target = _stage_motor_field(&stage->coarse, sub_field);
+                        break;
+                    case 'f':
+                        target = _stage_motor_field(&stage->fine, sub_field);
+                        break;
+                    default:
+                        break;
+                }
+
+                if (target) {
+                    *target = strtof(values[idx], NULL);
+                }
+            }
+        }
+
+        // Perform action
+        if (save_to_eeprom) {
+            charge_pipeline_save();
+        }
+
+        // Response
+        len += snprintf(buf + len, buf_size - len, "{\"pl\":%lu,\"n\":%u,\"s\":[", pipeline_idx, pipeline->stage_cnt);
+
+        for (uint8_t stage_idx = 0; stage_idx < CHARGE_PIPELINE_MAX_STAGE_CNT && len < buf_size; stage_idx += 1) {
+            const charge_stage_t * stage = &pipeline->stages[stage_idx];
+
+            len += snprintf(buf + len, buf_size - len, "%s{\"a\":%u,\"x\":%u,\"t\":%0.3f,\"g\":%0.3f,\"c\":",
+                            stage_idx ? "," : "", stage->actuators, stage->exit_criterion, stage->exit_threshold,
+                            stage->gate_ratio);
+            if (len < buf_size) {
+                len += _format_stage_motor(buf + len, buf_size - len, &stage->coarse);
+            }
+            if (len < buf_size) {
+                len += snprintf(buf + len, buf_size - len, ",\"f\":");
+            }
+            if (len < buf_size) {
+                len += _format_stage_motor(buf + len, buf_size - len, &stage->fine);
+            }
+            if (len < buf_size) {
+                len += snprintf(buf + len, buf_size - len, "}");
+            }
+        }
+
+        if (len < buf_size) {
+            len += snprintf(buf + len, buf_size - len, "]}");
+        }
+    }
+
+    size_t data_length = strlen(buf);
+    file->data = buf;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
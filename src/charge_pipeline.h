@@ -0,0 +1,76 @@
+#ifndef CHARGE_PIPELINE_H_
+#define CHARGE_PIPELINE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "http_rest.h"
+
+
+#define EEPROM_CHARGE_PIPELINE_DATA_REV         1               // 16 bit
+
+#define CHARGE_PIPELINE_CNT                     4               // Pipelines the profiles can refer to, 1 based
+#define CHARGE_PIPELINE_MAX_STAGE_CNT           4
+
+
+// Tricklers driven by a stage, the others are stopped when the stage is entered
+typedef enum {
+    CHARGE_STAGE_ACTUATOR_COARSE = (1 << 0),
+    CHARGE_STAGE_ACTUATOR_FINE = (1 << 1),
+} charge_stage_actuator_t;
+
+typedef enum {
+    CHARGE_STAGE_EXIT_ERROR = 0,                // Error (set point - weight) below exit_threshold
+    CHARGE_STAGE_EXIT_PREDICTED_ERROR = 1,      // As above with the predicted final weight (predictive cutoff)
+    CHARGE_STAGE_EXIT_TIME = 2,                 // exit_threshold ms after the stage was entered
+} charge_stage_exit_t;
+
+typedef struct {
+    float kp;
+    float ki;
+    float kd;
+    float min_flow_speed_rps;
+    float max_flow_speed_rps;
+} charge_stage_motor_t;
+
+typedef struct {
+    uint8_t actuators;                          // charge_stage_actuator_t bits
+    uint8_t exit_criterion;                     // charge_stage_exit_t
+    float exit_threshold;
+    float gate_ratio;                           // Moved to when the stage is entered, SERVO_GATE_RATIO_DISABLED leaves it
+    charge_stage_motor_t coarse;
+    charge_stage_motor_t fine;
+} charge_stage_t;
+
+typedef struct {
+    uint8_t stage_cnt;                          // 0 for an unused pipeline
+    charge_stage_t stages[CHARGE_PIPELINE_MAX_STAGE_CNT];
+} charge_pipeline_t;
+
+typedef struct {
+    uint16_t charge_pipeline_data_rev;
+    charge_pipeline_t pipelines[CHARGE_PIPELINE_CNT];
+} eeprom_charge_pipeline_data_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+bool charge_pipeline_init(void);
+bool charge_pipeline_save(void);
+
+/**
+ * Copies pipeline idx (1 to CHARGE_PIPELINE_CNT). Returns false if there is no such pipeline or it has no stages,
+ * the charge mode then runs its coarse and fine stages from the profile.
+ */
+bool charge_pipeline_get(uint32_t idx, charge_pipeline_t * pipeline);
+
+// REST interface
+bool http_rest_charge_pipeline_config(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // CHARGE_PIPELINE_H_
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "charge_trace.h"
+#include "common.h"
+
+
+typedef struct {
+    charge_trace_sample_t samples[CHARGE_TRACE_MAX_SAMPLES];
+    uint32_t start_time_us;
+    uint32_t total_count;       // Samples recorded since the start, the ring keeps the latest ones
+    uint32_t charge_id;         // Increments on every new charge
+} charge_trace_t;
+
+
+// Preallocated so recording never touches the heap during a charge
+static charge_trace_t charge_trace;
+
+
+void charge_trace_start(uint32_t start_time_us) {
+    charge_trace.start_time_us = start_time_us;
+    charge_trace.total_count = 0;
+    charge_trace.charge_id += 1;
+}
+
+
+void charge_trace_record(uint32_t capture_time_us, float weight, float coarse_speed_rps, float fine_speed_rps, 
+                         float gate_ratio, uint8_t charge_mode_state) {
+    charge_trace_sample_t * sample = &charge_trace.samples[charge_trace.total_count % CHARGE_TRACE_MAX_SAMPLES];
+
+    sample->time_ms = (capture_time_us - charge_trace.start_time_us) / 1000;
+    sample->weight = weight;
+    sample->coarse_speed_rps = coarse_speed_rps;
+    sample->fine_speed_rps = fine_speed_rps;
+    sample->gate_ratio = gate_ratio;
+    sample->charge_mode_state = charge_mode_state;
+
+    charge_trace.total_count += 1;
+}
+
+
+bool http_rest_charge_trace(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings:
+    // i0 (int): Index of the first sample to return
+    //
+    // Response:
+    // s0 (int): Charge id, changes when a new charge starts
+    // s1 (int): Total number of samples recorded for the charge
+    // s2 (int): Index of the oldest sample still available
+    // s3 (int): Index of the first returned sample
+    // s4 (array): Samples as [time_ms, weight, coarse_speed_rps, fine_speed_rps, gate_ratio, charge_mode_state]
+
+    const size_t charge_trace_json_buffer_size = 96 + CHARGE_TRACE_REST_PAGE_SIZE * 56;
+    char * charge_trace_json_buffer = (char *) rest_response_alloc(charge_trace_json_buffer_size);
+    if (charge_trace_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    uint32_t start_idx = 0;
+
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "i0") == 0) {
+            start_idx = strtoul(values[idx], NULL, 10);
+        }
+    }
+
+    uint32_t total_count = charge_trace.total_count;
+    uint32_t oldest_idx = total_count > CHARGE_TRACE_MAX_SAMPLES ? total_count - CHARGE_TRACE_MAX_SAMPLES : 0;
+    if (start_idx < oldest_idx) {
+        start_idx = oldest_idx;
+    }
+
+    int len = snprintf(charge_trace_json_buffer, 
+                       charge_trace_json_buffer_size,
+                       "%s"
+                       "{\"s0\":%lu,\"s1\":%lu,\"s2\":%lu,\"s3\":%lu,\"s4\":[",
+                       http_json_header,
+                       charge_trace.charge_id,
+                       total_count,
+                       oldest_idx,
+                       start_idx);
+
+    for (uint32_t idx = start_idx; idx < total_count && idx < start_idx + CHARGE_TRACE_REST_PAGE_SIZE; idx += 1) {
+        // Leave space for the closing brackets
+        if (len + 64 >= (int) charge_trace_json_buffer_size) {
+            break;
+        }
+
+        charge_trace_sample_t * sample = &charge_trace.samples[idx % CHARGE_TRACE_MAX_SAMPLES];
+
+        len += snprintf(charge_trace_json_buffer + len, 
+                        charge_trace_json_buffer_size - len,
+                        "%s[%lu,%0.3f,%0.2f,%0.2f,%0.2f,%u]",
+                        idx == start_idx ? "" : ",",
+                        sample->time_ms,
+                        isfinite(sample->weight) ? sample->weight : 0.0f,
+                        sample->coarse_speed_rps,
+                        sample->fine_speed_rps,
+                        sample->gate_ratio,
+                        sample->charge_mode_state);
+    }
+
+    snprintf(charge_trace_json_buffer + len, charge_trace_json_buffer_size - len, "]}");
+
+    size_t data_length = strlen(charge_trace_json_buffer);
+    file->data = charge_trace_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
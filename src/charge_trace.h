@@ -0,0 +1,45 @@
+#ifndef CHARGE_TRACE_H_
+#define CHARGE_TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "http_rest.h"
+
+
+// Number of samples kept for the last charge (~50 seconds at 10 Hz, ~200 seconds on the RP2350)
+#if PICO_RP2350
+#define CHARGE_TRACE_MAX_SAMPLES        2048
+#else
+#define CHARGE_TRACE_MAX_SAMPLES        512
+#endif
+
+// Number of samples returned per REST request
+#define CHARGE_TRACE_REST_PAGE_SIZE     32
+
+
+typedef struct {
+    uint32_t time_ms;           // Since the start of the charge
+    float weight;
+    float coarse_speed_rps;     // Commanded speed
+    float fine_speed_rps;       // Commanded speed
+    float gate_ratio;           // 0.0 = open, 1.0 = closed, -1.0 = disabled
+    uint8_t charge_mode_state;  // charge_mode_state_t
+} charge_trace_sample_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Discard the previous trace and start recording a new charge
+void charge_trace_start(uint32_t start_time_us);
+void charge_trace_record(uint32_t capture_time_us, float weight, float coarse_speed_rps, float fine_speed_rps, 
+                         float gate_ratio, uint8_t charge_mode_state);
+
+bool http_rest_charge_trace(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // CHARGE_TRACE_H_
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include "pico/time.h"
 #include "app.h"
 #include "u8g2.h"
 #include "mini_12864_module.h"
@@ -14,6 +15,7 @@
 #include "charge_mode.h"
 #include "cleanup_mode.h"
 #include "servo_gate.h"
+#include "profile.h"
 
 
 // Memory from other modules
@@ -27,87 +29,272 @@ extern QueueHandle_t encoder_event_queue;
 cleanup_mode_config_t cleanup_mode_config;
 
 
+/*
+    Flow calibration. Each trickler is run at CLEANUP_CALIBRATION_STEP_CNT speeds across the flow speed range of the
+    selected profile, the flow rate at a speed is the slope of a line fitted to the weight once the flow settled. A
+    line fitted to the weight per revolution over the speeds is the flow model stored to the profile, see
+    profile_get_flow_rate. Press the encoder with the tricklers stopped to start, any button aborts.
+*/
+#define CLEANUP_CALIBRATION_SETTLE_US               1000000     // The flow settles to the new speed
+#define CLEANUP_CALIBRATION_FIT_DURATION_US         3000000
+#define CLEANUP_CALIBRATION_MIN_FIT_SAMPLES         5
+#define CLEANUP_CALIBRATION_MEASUREMENT_TIMEOUT_MS  300
+
+
 static char title_string[30];
-TaskHandle_t cleanup_render_task_handler = NULL;
 
 
-void cleanup_render_task(void *p) {
+static TickType_t cleanup_render_scene(u8g2_t * display_handler) {
     char buf[32];
-    float prev_weight = 0;
+    static float prev_weight = 0;
+    static uint32_t prev_render_time_us = 0;
+
+    // Draw title
+    if (strlen(title_string)) {
+        u8g2_SetFont(display_handler, u8g2_font_helvB08_tr);
+        u8g2_DrawStr(display_handler, 5, 10, title_string);
+    }
+
+    // Draw line
+    u8g2_DrawHLine(display_handler, 0, 13, u8g2_GetDisplayWidth(display_handler));
+
+    // Draw charge weight
+    static weight_string_cache_t weight_cache;
+    scale_measurement_t measurement;
+    if (!scale_get_latest_measurement(&measurement)) {
+        measurement.weight = NAN;
+        measurement.seq = 0;
+    }
+    float current_weight = measurement.weight;
+    memset(buf, 0x0, sizeof(buf));
+    
+    // Convert to weight string with given decimal places, once per measurement
+    const char * weight_string = weight_string_cache_format(&weight_cache, measurement.seq, current_weight, 
+                                                            charge_mode_config.eeprom_charge_mode_data.decimal_places);
+
+    snprintf(buf, sizeof(buf), "Weight: %s", weight_string);
+    u8g2_SetFont(display_handler, u8g2_font_profont11_tf);
+    u8g2_DrawStr(display_handler, 5, 25, buf);
+
+    // Draw flow rate, the estimate of the scale filter if it runs one
+    // The frame interval is capped by the display frame rate, use the time actually elapsed
+    uint32_t now_us = time_us_32();
+    float weight_diff = current_weight - prev_weight;
+    float elapsed_s = (now_us - prev_render_time_us) / 1e6f;
+    prev_weight = current_weight;
+    prev_render_time_us = now_us;
+    float flow_rate = elapsed_s > 0 ? weight_diff / elapsed_s : 0.0f;
+    if (measurement.seq && isfinite(measurement.flow_rate)) {
+        flow_rate = measurement.flow_rate;
+    }
 
-    u8g2_t * display_handler = get_display_handler();
+    memset(buf, 0x0, sizeof(buf));
+    sprintf(buf, "Flow: %0.3f/s", flow_rate);
+    u8g2_SetFont(display_handler, u8g2_font_profont11_tf);
+    u8g2_DrawStr(display_handler, 5, 35, buf);
+
+    // Draw current motor speed
+    memset(buf, 0x0, sizeof(buf));
+    sprintf(buf, "Speed: %0.3f", cleanup_mode_config.trickler_speed);
+    u8g2_SetFont(display_handler, u8g2_font_profont11_tf);
+    u8g2_DrawStr(display_handler, 5, 45, buf);
+
+    memset(buf, 0x0, sizeof(buf));
+    switch (cleanup_mode_config.calibration_phase) {
+        case CLEANUP_CALIBRATION_COARSE:
+        case CLEANUP_CALIBRATION_FINE:
+            snprintf(buf, sizeof(buf), "Calibrating %s %u/%u", 
+                     cleanup_mode_config.calibration_phase == CLEANUP_CALIBRATION_COARSE ? "Coarse" : "Fine",
+                     cleanup_mode_config.calibration_step, CLEANUP_CALIBRATION_STEP_CNT);
+            break;
+        case CLEANUP_CALIBRATION_DONE:
+            snprintf(buf, sizeof(buf), "C %0.3f F %0.3f /rev", cleanup_mode_config.coarse_flow_model.gain,
+                     cleanup_mode_config.fine_flow_model.gain);
+            break;
+        case CLEANUP_CALIBRATION_FAILED:
+            snprintf(buf, sizeof(buf), "Calibration failed");
+            break;
+        default:
+            snprintf(buf, sizeof(buf), "Servo Gate: %s", gate_state_to_string(servo_gate.gate_state));
+            break;
+    }
+    u8g2_SetFont(display_handler, u8g2_font_profont11_tf);
+    u8g2_DrawStr(display_handler, 5, 55, buf);
+
+    return pdMS_TO_TICKS(20);
+}
 
-    while (true) {
-        TickType_t last_render_tick = xTaskGetTickCount();
 
-        u8g2_ClearBuffer(display_handler);
+// True if a button stopped the calibration, quit if it was the one leaving the mode
+static bool _calibration_poll_abort(bool * quit) {
+    ButtonEncoderEvent_t button_encoder_event;
 
-        // Draw title
-        if (strlen(title_string)) {
-            u8g2_SetFont(display_handler, u8g2_font_helvB08_tr);
-            u8g2_DrawStr(display_handler, 5, 10, title_string);
+    while (xQueueReceive(encoder_event_queue, &button_encoder_event, 0) == pdTRUE) {
+        if (button_encoder_event == BUTTON_RST_PRESSED) {
+            *quit = true;
+            return true;
+        }
+        if (button_encoder_event == BUTTON_ENCODER_PRESSED) {
+            return true;
         }
+    }
 
-        // Draw line
-        u8g2_DrawHLine(display_handler, 0, 13, u8g2_GetDisplayWidth(display_handler));
+    return false;
+}
 
-        // Draw charge weight
-        float current_weight = scale_get_current_measurement();
-        memset(buf, 0x0, sizeof(buf));
-        
-        // Convert to weight string with given decimal places
-        char weight_string[WEIGHT_STRING_LEN];
-        float_to_string(weight_string, current_weight, charge_mode_config.eeprom_charge_mode_data.decimal_places);
 
-        sprintf(buf, "Weight: %s", weight_string);
-        u8g2_SetFont(display_handler, u8g2_font_profont11_tf);
-        u8g2_DrawStr(display_handler, 5, 25, buf);
+// Runs the trickler at speed and measures the flow rate (weight / s), NAN if too few readings. False if aborted.
+static bool _calibration_measure_flow(motor_select_t motor, float speed, float * flow_rate, bool * quit) {
+    uint32_t seq = scale_get_latest_measurement_seq();
+    scale_measurement_t measurement;
 
-        // Draw flow rate
-        float weight_diff = current_weight - prev_weight;
-        prev_weight = current_weight;
-        float flow_rate = weight_diff / 0.02;  // 20 ms per sampling period, see below
+    cleanup_mode_config.trickler_speed = speed;
+    motor_set_speed(motor, speed);
+    uint32_t start_time_us = time_us_32();
 
-        memset(buf, 0x0, sizeof(buf));
-        sprintf(buf, "Flow: %0.3f/s", flow_rate);
-        u8g2_SetFont(display_handler, u8g2_font_profont11_tf);
-        u8g2_DrawStr(display_handler, 5, 35, buf);
+    uint32_t fit_count = 0;
+    double sum_t = 0, sum_w = 0, sum_tt = 0, sum_tw = 0;
 
-        // Draw current motor speed
-        memset(buf, 0x0, sizeof(buf));
-        sprintf(buf, "Speed: %0.3f", cleanup_mode_config.trickler_speed);
-        u8g2_SetFont(display_handler, u8g2_font_profont11_tf);
-        u8g2_DrawStr(display_handler, 5, 45, buf);
+    while (time_us_32() - start_time_us < CLEANUP_CALIBRATION_SETTLE_US + CLEANUP_CALIBRATION_FIT_DURATION_US) {
+        if (_calibration_poll_abort(quit)) {
+            return false;
+        }
+        if (!scale_wait_for_measurement(&seq, CLEANUP_CALIBRATION_MEASUREMENT_TIMEOUT_MS, &measurement)) {
+            continue;
+        }
 
-        memset(buf, 0x0, sizeof(buf));
-        sprintf(buf, "Servo Gate: %s", gate_state_to_string(servo_gate.gate_state));
-        u8g2_SetFont(display_handler, u8g2_font_profont11_tf);
-        u8g2_DrawStr(display_handler, 5, 55, buf);
+        int32_t elapsed_us = (int32_t) (measurement.capture_time_us - start_time_us);
+        if (elapsed_us < CLEANUP_CALIBRATION_SETTLE_US || !isfinite(measurement.weight)) {
+            continue;
+        }
 
-        u8g2_SendBuffer(display_handler);
+        double t = (elapsed_us - CLEANUP_CALIBRATION_SETTLE_US) / 1e6;
+        sum_t += t;
+        sum_w += measurement.weight;
+        sum_tt += t * t;
+        sum_tw += t * measurement.weight;
+        fit_count += 1;
+    }
 
-        vTaskDelayUntil(&last_render_tick, pdMS_TO_TICKS(20));
+    // Least squares line through the weight
+    double denominator = fit_count * sum_tt - sum_t * sum_t;
+    if (fit_count < CLEANUP_CALIBRATION_MIN_FIT_SAMPLES || denominator <= 0) {
+        *flow_rate = NAN;
+    }
+    else {
+        *flow_rate = (fit_count * sum_tw - sum_t * sum_w) / denominator;
     }
+
+    return true;
 }
 
 
-uint8_t cleanup_mode_menu() {
-    // If the display task is never created then we shall create one, otherwise we shall resume the task
-    if (cleanup_render_task_handler == NULL) {
-        // The render task shall have lower priority than the current one
-        UBaseType_t current_task_priority = uxTaskPriorityGet(xTaskGetCurrentTaskHandle());
-        xTaskCreate(cleanup_render_task, "Cleanup Render Task", configMINIMAL_STACK_SIZE, NULL, current_task_priority - 1, &cleanup_render_task_handler);
+// Sweeps the speeds of a trickler and fits its flow model. False if aborted or no flow.
+static bool _calibrate_trickler(motor_select_t motor, float min_speed, float max_speed, 
+                                cleanup_flow_model_t * model, bool * abort, bool * quit) {
+    min_speed = fmaxf(min_speed, get_motor_min_speed(motor));
+    max_speed = fminf(max_speed, get_motor_max_speed(motor));
+    if (!(max_speed > min_speed)) {
+        return false;
+    }
+
+    double sum_s = 0, sum_g = 0, sum_ss = 0, sum_sg = 0;
+    bool is_ok = true;
+
+    cleanup_mode_config.calibration_step = 0;
+    for (uint8_t step = 0; step < CLEANUP_CALIBRATION_STEP_CNT; step += 1) {
+        float speed = min_speed + (max_speed - min_speed) * step / (CLEANUP_CALIBRATION_STEP_CNT - 1);
+
+        float flow_rate;
+        if (!_calibration_measure_flow(motor, speed, &flow_rate, quit)) {
+            *abort = true;
+            is_ok = false;
+            break;
+        }
+
+        cleanup_mode_config.calibration_flow_rate = isfinite(flow_rate) ? flow_rate : 0.0f;
+        if (!(flow_rate > 0)) {
+            is_ok = false;
+            break;
+        }
+
+        double gain = flow_rate / speed;
+        sum_s += speed;
+        sum_g += gain;
+        sum_ss += speed * speed;
+        sum_sg += speed * gain;
+
+        cleanup_mode_config.calibration_step = step + 1;
+        display_request_render();
+    }
+
+    motor_set_speed(motor, 0);
+    cleanup_mode_config.trickler_speed = 0;
+
+    if (is_ok) {
+        // Least squares line through the weight per revolution, the speeds are distinct
+        double denominator = CLEANUP_CALIBRATION_STEP_CNT * sum_ss - sum_s * sum_s;
+        model->slope = (CLEANUP_CALIBRATION_STEP_CNT * sum_sg - sum_s * sum_g) / denominator;
+        model->gain = (sum_g - model->slope * sum_s) / CLEANUP_CALIBRATION_STEP_CNT;
+    }
+
+    return is_ok;
+}
+
+
+static void _flow_calibration_run(bool * quit) {
+    profile_t * profile = profile_get_selected();
+    bool abort = false;
+
+    motor_set_speed(SELECT_BOTH_MOTOR, 0);
+
+    cleanup_mode_config.calibration_phase = CLEANUP_CALIBRATION_COARSE;
+    snprintf(title_string, sizeof(title_string), "Flow Calibration");
+    bool is_ok = _calibrate_trickler(SELECT_COARSE_TRICKLER_MOTOR, 
+                                     profile->coarse_min_flow_speed_rps, profile->coarse_max_flow_speed_rps,
+                                     &cleanup_mode_config.coarse_flow_model, &abort, quit);
+
+    if (is_ok) {
+        cleanup_mode_config.calibration_phase = CLEANUP_CALIBRATION_FINE;
+        is_ok = _calibrate_trickler(SELECT_FINE_TRICKLER_MOTOR,
+                                    profile->fine_min_flow_speed_rps, profile->fine_max_flow_speed_rps,
+                                    &cleanup_mode_config.fine_flow_model, &abort, quit);
+    }
+
+    if (is_ok) {
+        profile->coarse_flow_gain = cleanup_mode_config.coarse_flow_model.gain;
+        profile->coarse_flow_gain_slope = cleanup_mode_config.coarse_flow_model.slope;
+        profile->measured_flow_gain = cleanup_mode_config.fine_flow_model.gain;
+        profile->fine_flow_gain_slope = cleanup_mode_config.fine_flow_model.slope;
+        profile_data_save();
+
+        cleanup_mode_config.calibration_phase = CLEANUP_CALIBRATION_DONE;
     }
     else {
-        vTaskResume(cleanup_render_task_handler);
+        cleanup_mode_config.calibration_phase = abort ? CLEANUP_CALIBRATION_IDLE : CLEANUP_CALIBRATION_FAILED;
     }
 
+    snprintf(title_string, sizeof(title_string), "Adjust Speed");
+    display_request_render();
+}
+
+
+uint8_t cleanup_mode_menu() {
+    display_set_scene(cleanup_render_scene);
+
     // Initialize the cleanup mode config
     memset(&cleanup_mode_config, 0x0, sizeof(cleanup_mode_config));
 
     // Enter the clean up mode
     cleanup_mode_config.cleanup_mode_state = CLEANUP_MODE_ENTER;
 
+    // Flow model of the selected profile, until calibrated again
+    profile_t * profile = profile_get_selected();
+    cleanup_mode_config.coarse_flow_model.gain = profile->coarse_flow_gain;
+    cleanup_mode_config.coarse_flow_model.slope = profile->coarse_flow_gain_slope;
+    cleanup_mode_config.fine_flow_model.gain = profile->measured_flow_gain;
+    cleanup_mode_config.fine_flow_model.slope = profile->fine_flow_gain_slope;
+
     // Enable both motors
     motor_enable(SELECT_COARSE_TRICKLER_MOTOR, true);
     motor_enable(SELECT_FINE_TRICKLER_MOTOR, true);
@@ -143,6 +330,11 @@ uint8_t cleanup_mode_menu() {
                 break;
 
             case BUTTON_ENCODER_PRESSED:
+                // Pressed again with the tricklers stopped, calibrate the flow
+                if (cleanup_mode_config.trickler_speed == 0) {
+                    cleanup_mode_config.calibration_request = true;
+                }
+
                 cleanup_mode_config.trickler_speed = 0;
                 motor_set_speed(SELECT_BOTH_MOTOR, cleanup_mode_config.trickler_speed);
                 
@@ -150,7 +342,11 @@ uint8_t cleanup_mode_menu() {
             default:
                 break;
         }
-        
+
+        if (!quit && cleanup_mode_config.calibration_request) {
+            cleanup_mode_config.calibration_request = false;
+            _flow_calibration_run(&quit);
+        }
     }
 
     motor_enable(SELECT_COARSE_TRICKLER_MOTOR, false);
@@ -158,7 +354,7 @@ uint8_t cleanup_mode_menu() {
 
     cleanup_mode_config.cleanup_mode_state = CLEANUP_MODE_EXIT;
 
-    vTaskSuspend(cleanup_render_task_handler);
+    display_set_scene(NULL);
     return 1;  // Return backs to the main menu view
 }
 
@@ -167,8 +363,20 @@ bool http_rest_cleanup_mode_state(struct fs_file *file, int num_params, char *pa
     // Mappings
     // s0 (cleanup_mode_state_t | int): Cleanup mode state
     // s1 (float): Trickler speed
-
-    static char cleanup_mode_json_buffer[128];
+    // s2 (bool): Start the flow calibration
+    // s3 (cleanup_calibration_phase_t | int): Flow calibration phase
+    // s4 (int): Speeds completed of the trickler being calibrated, out of CLEANUP_CALIBRATION_STEP_CNT
+    // s5 (float): Flow rate at the last speed (weight / s)
+    // s6 (float): Coarse trickler weight per revolution, gain
+    // s7 (float): Coarse trickler weight per revolution, slope over the speed
+    // s8 (float): Fine trickler weight per revolution, gain
+    // s9 (float): Fine trickler weight per revolution, slope over the speed
+
+    const size_t cleanup_mode_json_buffer_size = 256;
+    char * cleanup_mode_json_buffer = (char *) rest_response_alloc(cleanup_mode_json_buffer_size);
+    if (cleanup_mode_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
 
     // Control
     for (int idx = 0; idx < num_params; idx += 1) {
@@ -197,16 +405,36 @@ bool http_rest_cleanup_mode_state(struct fs_file *file, int num_params, char *pa
             cleanup_mode_config.trickler_speed = strtof(values[idx], NULL);
             motor_set_speed(SELECT_BOTH_MOTOR, cleanup_mode_config.trickler_speed);
         }
+        else if (strcmp(params[idx], "s2") == 0) {
+            if (string_to_boolean(values[idx]) && cleanup_mode_config.cleanup_mode_state == CLEANUP_MODE_ENTER &&
+                cleanup_mode_config.calibration_phase != CLEANUP_CALIBRATION_COARSE &&
+                cleanup_mode_config.calibration_phase != CLEANUP_CALIBRATION_FINE) {
+                // Wake the menu loop to start it
+                cleanup_mode_config.calibration_request = true;
+                ButtonEncoderEvent_t button_event = OVERRIDE_FROM_REST;
+                xQueueSend(encoder_event_queue, &button_event, portMAX_DELAY);
+            }
+        }
     }
 
     // Response
     snprintf(cleanup_mode_json_buffer, 
-             sizeof(cleanup_mode_json_buffer),
+             cleanup_mode_json_buffer_size,
              "%s"
-             "{\"s0\":%d,\"s1\":%0.3f}",
+             "{\"s0\":%d,\"s1\":%0.3f,\"s2\":%s,\"s3\":%d,\"s4\":%u,\"s5\":%0.3f,"
+             "\"s6\":%0.4f,\"s7\":%0.4f,\"s8\":%0.4f,\"s9\":%0.4f}",
              http_json_header,
              (int) cleanup_mode_config.cleanup_mode_state,
-             cleanup_mode_config.trickler_speed);
+             cleanup_mode_config.trickler_speed,
+             boolean_to_string(cleanup_mode_config.calibration_phase == CLEANUP_CALIBRATION_COARSE ||
+                               cleanup_mode_config.calibration_phase == CLEANUP_CALIBRATION_FINE),
+             (int) cleanup_mode_config.calibration_phase,
+             cleanup_mode_config.calibration_step,
+             cleanup_mode_config.calibration_flow_rate,
+             cleanup_mode_config.coarse_flow_model.gain,
+             cleanup_mode_config.coarse_flow_model.slope,
+             cleanup_mode_config.fine_flow_model.gain,
+             cleanup_mode_config.fine_flow_model.slope);
 
 
     size_t data_length = strlen(cleanup_mode_json_buffer);
@@ -6,15 +6,42 @@
 #include "motors.h"
 
 
+#define CLEANUP_CALIBRATION_STEP_CNT    4           // Speeds per trickler, over the flow speed range of the profile
+
+
 typedef enum {
     CLEANUP_MODE_EXIT = 0,
     CLEANUP_MODE_ENTER = 1,
 } cleanup_mode_state_t;
 
 
+typedef enum {
+    CLEANUP_CALIBRATION_IDLE = 0,
+    CLEANUP_CALIBRATION_COARSE = 1,     // Sweeping the speeds of the coarse trickler
+    CLEANUP_CALIBRATION_FINE = 2,       // Then the fine trickler
+    CLEANUP_CALIBRATION_DONE = 3,       // Flow model stored to the selected profile
+    CLEANUP_CALIBRATION_FAILED = 4,     // No flow at a speed, e.g. empty hopper
+} cleanup_calibration_phase_t;
+
+
+// Flow model of a trickler, weight per revolution = gain + slope * speed (rps)
+typedef struct {
+    float gain;
+    float slope;
+} cleanup_flow_model_t;
+
+
 typedef struct {
     float trickler_speed;
     cleanup_mode_state_t cleanup_mode_state;
+
+    // Flow calibration
+    volatile bool calibration_request;  // Set over REST, started by the menu loop
+    cleanup_calibration_phase_t calibration_phase;
+    uint8_t calibration_step;           // Speeds completed of the trickler being calibrated
+    float calibration_flow_rate;        // At the last speed (weight / s)
+    cleanup_flow_model_t coarse_flow_model;
+    cleanup_flow_model_t fine_flow_model;
 } cleanup_mode_config_t;
 
 
@@ -2,12 +2,14 @@
 #include <task.h>
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
 
 #include "common.h"
 #include "pico/time.h"
 #include "hardware/dma.h"
 
 #include "eeprom.h"
+#include "crc32.h"
 
 const char * http_json_header = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n";
 
@@ -40,67 +42,108 @@ bool string_to_boolean(char * s) {
 
 
 int float_to_string(char * output_decimal_str, float var, decimal_places_t decimal_places) {
-    int return_value = 0;
-    
+    uint32_t scale;
+    uint8_t digits;
+
     switch (decimal_places) {
         case DP_2:
-            return_value = sprintf(output_decimal_str, "%0.02f", var);
+            scale = 100;
+            digits = 2;
             break;
         case DP_3:
-            return_value = sprintf(output_decimal_str, "%0.03f", var);
+            scale = 1000;
+            digits = 3;
             break;
         default:
-            break;
+            return 0;
+    }
+
+    // Out of the fixed point range, including nan and inf
+    if (!isfinite(var) || fabsf(var) >= (float) UINT32_MAX) {
+        return sprintf(output_decimal_str, digits == 2 ? "%0.02f" : "%0.03f", var);
     }
-    
-    return return_value;
+
+    char * out = output_decimal_str;
+    if (signbit(var)) {
+        *out++ = '-';
+    }
+
+    // Split off the integer part (exact). The fraction has at most 24 significant bits, so scaling it by 100 or
+    // 1000 is exact in double precision and the rounding matches printf (half to even on exact ties).
+    float magnitude = fabsf(var);
+    uint32_t whole = (uint32_t) magnitude;
+    double scaled_fraction = (double) (magnitude - whole) * scale;
+    uint32_t fraction = (uint32_t) scaled_fraction;
+    double remainder = scaled_fraction - fraction;
+    if (remainder > 0.5 || (remainder == 0.5 && (fraction & 1))) {
+        fraction += 1;
+    }
+    if (fraction >= scale) {
+        whole += 1;
+        fraction -= scale;
+    }
+
+    // Integer part, written backwards
+    char reversed[10];
+    uint8_t whole_len = 0;
+    do {
+        reversed[whole_len++] = '0' + whole % 10;
+        whole /= 10;
+    } while (whole);
+
+    while (whole_len) {
+        *out++ = reversed[--whole_len];
+    }
+
+    *out++ = '.';
+    for (uint8_t idx = digits; idx > 0; idx -= 1) {
+        out[idx - 1] = '0' + fraction % 10;
+        fraction /= 10;
+    }
+    out += digits;
+    *out = '\0';
+
+    return out - output_decimal_str;
+}
+
+
+const char * weight_string_cache_format(weight_string_cache_t * cache, uint32_t seq, float weight, decimal_places_t decimal_places) {
+    if (seq == 0 || cache->seq != seq || cache->decimal_places != decimal_places) {
+        float_to_string(cache->string, weight, decimal_places);
+        cache->seq = seq;
+        cache->decimal_places = decimal_places;
+    }
+
+    return cache->string;
 }
 
 
-// POLYNOMIAL 0xEDB88320
-const uint32_t crc32_table[256] = {
-0x00000000,0x77073096,0xEE0E612C,0x990951BA,0x076DC419,0x706AF48F,0xE963A535,0x9E6495A3,
-0x0EDB8832,0x79DCB8A4,0xE0D5E91E,0x97D2D988,0x09B64C2B,0x7EB17CBD,0xE7B82D07,0x90BF1D91,
-0x1DB71064,0x6AB020F2,0xF3B97148,0x84BE41DE,0x1ADAD47D,0x6DDDE4EB,0xF4D4B551,0x83D385C7,
-0x136C9856,0x646BA8C0,0xFD62F97A,0x8A65C9EC,0x14015C4F,0x63066CD9,0xFA0F3D63,0x8D080DF5,
-0x3B6E20C8,0x4C69105E,0xD56041E4,0xA2677172,0x3C03E4D1,0x4B04D447,0xD20D85FD,0xA50AB56B,
-0x35B5A8FA,0x42B2986C,0xDBBBC9D6,0xACBCF940,0x32D86CE3,0x45DF5C75,0xDCD60DCF,0xABD13D59,
-0x26D930AC,0x51DE003A,0xC8D75180,0xBFD06116,0x21B4F4B5,0x56B3C423,0xCFBA9599,0xB8BDA50F,
-0x2802B89E,0x5F058808,0xC60CD9B2,0xB10BE924,0x2F6F7C87,0x58684C11,0xC1611DAB,0xB6662D3D,
-0x76DC4190,0x01DB7106,0x98D220BC,0xEFD5102A,0x71B18589,0x06B6B51F,0x9FBFE4A5,0xE8B8D433,
-0x7807C9A2,0x0F00F934,0x9609A88E,0xE10E9818,0x7F6A0DBB,0x086D3D2D,0x91646C97,0xE6635C01,
-0x6B6B51F4,0x1C6C6162,0x856530D8,0xF262004E,0x6C0695ED,0x1B01A57B,0x8208F4C1,0xF50FC457,
-0x65B0D9C6,0x12B7E950,0x8BBEB8EA,0xFCB9887C,0x62DD1DDF,0x15DA2D49,0x8CD37CF3,0xFBD44C65,
-0x4DB26158,0x3AB551CE,0xA3BC0074,0xD4BB30E2,0x4ADFA541,0x3DD895D7,0xA4D1C46D,0xD3D6F4FB,
-0x4369E96A,0x346ED9FC,0xAD678846,0xDA60B8D0,0x44042D73,0x33031DE5,0xAA0A4C5F,0xDD0D7CC9,
-0x5005713C,0x270241AA,0xBE0B1010,0xC90C2086,0x5768B525,0x206F85B3,0xB966D409,0xCE61E49F,
-0x5EDEF90E,0x29D9C998,0xB0D09822,0xC7D7A8B4,0x59B33D17,0x2EB40D81,0xB7BD5C3B,0xC0BA6CAD,
-0xEDB88320,0x9ABFB3B6,0x03B6E20C,0x74B1D29A,0xEAD54739,0x9DD277AF,0x04DB2615,0x73DC1683,
-0xE3630B12,0x94643B84,0x0D6D6A3E,0x7A6A5AA8,0xE40ECF0B,0x9309FF9D,0x0A00AE27,0x7D079EB1,
-0xF00F9344,0x8708A3D2,0x1E01F268,0x6906C2FE,0xF762575D,0x806567CB,0x196C3671,0x6E6B06E7,
-0xFED41B76,0x89D32BE0,0x10DA7A5A,0x67DD4ACC,0xF9B9DF6F,0x8EBEEFF9,0x17B7BE43,0x60B08ED5,
-0xD6D6A3E8,0xA1D1937E,0x38D8C2C4,0x4FDFF252,0xD1BB67F1,0xA6BC5767,0x3FB506DD,0x48B2364B,
-0xD80D2BDA,0xAF0A1B4C,0x36034AF6,0x41047A60,0xDF60EFC3,0xA867DF55,0x316E8EEF,0x4669BE79,
-0xCB61B38C,0xBC66831A,0x256FD2A0,0x5268E236,0xCC0C7795,0xBB0B4703,0x220216B9,0x5505262F,
-0xC5BA3BBE,0xB2BD0B28,0x2BB45A92,0x5CB36A04,0xC2D7FFA7,0xB5D0CF31,0x2CD99E8B,0x5BDEAE1D,
-0x9B64C2B0,0xEC63F226,0x756AA39C,0x026D930A,0x9C0906A9,0xEB0E363F,0x72076785,0x05005713,
-0x95BF4A82,0xE2B87A14,0x7BB12BAE,0x0CB61B38,0x92D28E9B,0xE5D5BE0D,0x7CDCEFB7,0x0BDBDF21,
-0x86D3D2D4,0xF1D4E242,0x68DDB3F8,0x1FDA836E,0x81BE16CD,0xF6B9265B,0x6FB077E1,0x18B74777,
-0x88085AE6,0xFF0F6A70,0x66063BCA,0x11010B5C,0x8F659EFF,0xF862AE69,0x616BFFD3,0x166CCF45,
-0xA00AE278,0xD70DD2EE,0x4E048354,0x3903B3C2,0xA7672661,0xD06016F7,0x4969474D,0x3E6E77DB,
-0xAED16A4A,0xD9D65ADC,0x40DF0B66,0x37D83BF0,0xA9BCAE53,0xDEBB9EC5,0x47B2CF7F,0x30B5FFE9,
-0xBDBDF21C,0xCABAC28A,0x53B39330,0x24B4A3A6,0xBAD03605,0xCDD70693,0x54DE5729,0x23D967BF,
-0xB3667A2E,0xC4614AB8,0x5D681B02,0x2A6F2B94,0xB40BBE37,0xC30C8EA1,0x5A05DF1B,0x2D02EF8D
-};
-uint32_t software_crc32(void * data, size_t length) {
-    const uint8_t *p = (const uint8_t *)data;
-    uint32_t crc = 0xffffffff;
-
-    while (length--) {
-        crc = crc32_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
-    }
-
-    return crc ^ 0xffffffff;
+size_t base64_encode(char * output_str, size_t output_size, const uint8_t * data, size_t len) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t output_len = 4 * ((len + 2) / 3);
+
+    if (output_len + 1 > output_size) {
+        return 0;
+    }
+
+    char * out = output_str;
+    for (size_t idx = 0; idx < len; idx += 3) {
+        uint32_t triple = (uint32_t) data[idx] << 16;
+        if (idx + 1 < len) {
+            triple |= (uint32_t) data[idx + 1] << 8;
+        }
+        if (idx + 2 < len) {
+            triple |= data[idx + 2];
+        }
+
+        *out++ = alphabet[(triple >> 18) & 0x3f];
+        *out++ = alphabet[(triple >> 12) & 0x3f];
+        *out++ = idx + 1 < len ? alphabet[(triple >> 6) & 0x3f] : '=';
+        *out++ = idx + 2 < len ? alphabet[triple & 0x3f] : '=';
+    }
+    *out = '\0';
+
+    return output_len;
 }
 
 
@@ -118,8 +161,8 @@ bool load_config(uint16_t addr, void * cfg, const void * default_cfg, size_t siz
         return false;
     }
 
-    // Read data
-    is_ok = eeprom_read(addr, buf, read_size);
+    // Read data, the CRC is worked out as it comes in
+    is_ok = eeprom_read_crc32(addr, buf, read_size, size, &calculated_crc32);
 
     // Unable to read from eeprom, then we will quit
     if (!is_ok) {
@@ -155,7 +198,6 @@ bool load_config(uint16_t addr, void * cfg, const void * default_cfg, size_t siz
     // Verify crc
     uint32_t received_crc32 = 0;
 
-    calculated_crc32 = software_crc32(buf, size);
     memcpy(&received_crc32, buf + size, sizeof(received_crc32));
 
     // We will validate if the rev (first 2 byte) is 0, AND CRC check matches. 
@@ -183,6 +225,34 @@ bool load_config(uint16_t addr, void * cfg, const void * default_cfg, size_t siz
 }
 
 
+bool read_config(uint16_t addr, void * cfg, size_t size) {
+    uint32_t calculated_crc32;
+    size_t read_size = size + sizeof(calculated_crc32);
+    uint8_t * buf = malloc(read_size);
+
+    if (!buf) {
+        printf("Unable to allocate buffer with size: %d", read_size);
+        return false;
+    }
+
+    bool is_ok = eeprom_read_crc32(addr, buf, read_size, size, &calculated_crc32);
+
+    // Same validation as load_config: the rev (first 2 byte) is 0 and the CRC32 matches
+    uint16_t received_rev;
+    uint32_t received_crc32;
+    memcpy(&received_rev, buf, sizeof(received_rev));
+    memcpy(&received_crc32, buf + size, sizeof(received_crc32));
+    is_ok = is_ok && received_rev == 0 && received_crc32 == calculated_crc32;
+
+    if (is_ok) {
+        memcpy(cfg, buf, size);
+    }
+    free(buf);
+
+    return is_ok;
+}
+
+
 bool save_config(uint16_t addr, void * cfg, size_t size) {
     bool is_ok;
     uint32_t calculated_crc32;
@@ -197,7 +267,7 @@ bool save_config(uint16_t addr, void * cfg, size_t size) {
     }
 
     // Calculate CRC
-    calculated_crc32 = software_crc32(cfg, size);
+    calculated_crc32 = crc32_compute(cfg, size);
 
     // Build write buffer by copying configuration appended with crc32
     memcpy(buf, cfg, size);
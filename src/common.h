@@ -33,13 +33,41 @@ void delay_ms(uint32_t ms, BaseType_t scheduler_state);
 const char * boolean_to_string(bool var);
 bool string_to_boolean(char * s);
 
+/**
+ * @brief Fixed point formatting of a weight with the given decimal places, same output as "%0.2f" / "%0.3f" without
+ * going through printf. Returns the string length.
+ */
 int float_to_string(char * output_decimal_str, float var, decimal_places_t decimal_places);
 
+// Formatted weight of one measurement, see weight_string_cache_format
+typedef struct {
+    uint32_t seq;                       // Sequence number of the cached measurement, 0 if empty
+    decimal_places_t decimal_places;
+    char string[16];
+} weight_string_cache_t;
+
+/**
+ * @brief Format a measurement once. Returns the cached string if it was formatted for the same sequence number and 
+ * decimal places already, otherwise formats it into the cache. Each caller shall own its cache.
+ */
+const char * weight_string_cache_format(weight_string_cache_t * cache, uint32_t seq, float weight, decimal_places_t decimal_places);
+
+/**
+ * @brief Base64 encode len bytes into a null terminated string. Returns the string length, or 0 if it doesn't fit.
+ */
+size_t base64_encode(char * output_str, size_t output_size, const uint8_t * data, size_t len);
+
 /** 
  * @brief Load configuration from persistent storage. 
  */
 bool load_config(uint16_t addr, void * cfg, const void * default_cfg, size_t size, uint16_t rev_validation);
 
+/**
+ * @brief Read a configuration stored by save_config with exactly this size. Unlike load_config nothing is written, 
+ * returns false if there is no valid configuration of that size (e.g. the layout of an older firmware is stored).
+ */
+bool read_config(uint16_t addr, void * cfg, size_t size);
+
 /**
  * @brief Save configuration to persistent storage
  */
@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "pico/platform.h"
+
+#include "config_snapshot.h"
+#include "eeprom.h"
+#include "crc32.h"
+#include "common.h"
+
+
+/*
+    The configs in the EEPROM as one blob. The export takes every region as the modules stored it, revs and CRCs
+    included. The import is sent in chunks, checked as a whole and then written in one go through the write-behind
+    cache, so a blob that fails any check leaves the configs as they are. The modules only read their configs at
+    start up, a reboot (without saving) applies the import.
+*/
+
+#define CONFIG_SNAPSHOT_MAX_LENGTH      4096
+
+
+// Regions of eeprom.h
+static const uint16_t config_snapshot_regions[] = {
+    EEPROM_METADATA_BASE_ADDR,
+    EEPROM_SCALE_CONFIG_BASE_ADDR,
+    EEPROM_WIRELESS_CONFIG_BASE_ADDR,
+    EEPROM_MOTOR_CONFIG_BASE_ADDR,
+    EEPROM_CHARGE_MODE_BASE_ADDR,
+    EEPROM_APP_CONFIG_BASE_ADDR,
+    EEPROM_NEOPIXEL_LED_CONFIG_BASE_ADDR,
+    EEPROM_MINI_12864_CONFIG_BASE_ADDR,
+    EEPROM_PROFILE_DATA_BASE_ADDR,
+    EEPROM_SERVO_GATE_CONFIG_BASE_ADDR,
+    EEPROM_CHARGE_PIPELINE_BASE_ADDR,
+};
+
+typedef struct {
+    const uint8_t * blob;
+    size_t length;
+    size_t offset;
+} _export_state_t;
+
+
+static uint8_t * import_blob = NULL;
+static size_t import_length = 0;
+static size_t import_received = 0;
+
+
+static size_t _export_read(void * state, const char ** data, size_t max_len) {
+    _export_state_t * export_state = (_export_state_t *) state;
+
+    size_t len = MIN(export_state->length - export_state->offset, max_len);
+    *data = (const char *) export_state->blob + export_state->offset;
+    export_state->offset += len;
+
+    return len;
+}
+
+
+bool http_rest_config_snapshot(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Response: the snapshot blob, see config_snapshot_header_t
+    size_t length = sizeof(config_snapshot_header_t) + sizeof(uint32_t);
+    for (size_t idx = 0; idx < count_of(config_snapshot_regions); idx += 1) {
+        size_t size = eeprom_region_size(config_snapshot_regions[idx]);
+        if (size) {
+            length += sizeof(config_snapshot_region_t) + size;
+        }
+    }
+
+    _export_state_t * export_state = (_export_state_t *) rest_response_alloc(sizeof(_export_state_t));
+    uint8_t * blob = (uint8_t *) rest_response_alloc(length);
+    if (export_state == NULL || blob == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    config_snapshot_header_t * header = (config_snapshot_header_t *) blob;
+    header->magic = CONFIG_SNAPSHOT_MAGIC;
+    header->version = CONFIG_SNAPSHOT_VERSION;
+    header->region_cnt = 0;
+
+    size_t offset = sizeof(config_snapshot_header_t);
+    for (size_t idx = 0; idx < count_of(config_snapshot_regions); idx += 1) {
+        config_snapshot_region_t region = {
+            .addr = config_snapshot_regions[idx],
+            .size = eeprom_region_size(config_snapshot_regions[idx]),
+        };
+
+        // Read from the shadows, a region can't grow between the two passes
+        if (region.size == 0 || offset + sizeof(region) + region.size + sizeof(uint32_t) > length) {
+            continue;
+        }
+        if (!eeprom_read(region.addr, blob + offset + sizeof(region), region.size)) {
+            continue;
+        }
+
+        memcpy(blob + offset, &region, sizeof(region));
+        offset += sizeof(region) + region.size;
+        header->region_cnt += 1;
+    }
+
+    header->length = offset + sizeof(uint32_t);
+    uint32_t crc = crc32_compute(blob, offset);
+    memcpy(blob + offset, &crc, sizeof(crc));
+
+    export_state->blob = blob;
+    export_state->length = header->length;
+    export_state->offset = 0;
+
+    if (!rest_response_stream(file, "application/octet-stream", export_state->length, _export_read, export_state)) {
+        return rest_response_unavailable(file);
+    }
+
+    return true;
+}
+
+
+static bool _is_known_region(uint16_t addr) {
+    for (size_t idx = 0; idx < count_of(config_snapshot_regions); idx += 1) {
+        if (config_snapshot_regions[idx] == addr) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static config_snapshot_import_status_t _import_add_chunk(size_t offset, const char * hex) {
+    size_t len = strlen(hex);
+
+    if (import_blob == NULL || offset != import_received || len % 2 || len / 2 > import_length - offset) {
+        return CONFIG_SNAPSHOT_IMPORT_BAD_CHUNK;
+    }
+
+    for (size_t idx = 0; idx < len / 2; idx += 1) {
+        char byte_string[3] = {hex[idx * 2], hex[idx * 2 + 1], '\0'};
+        char * end;
+
+        import_blob[offset + idx] = strtoul(byte_string, &end, 16);
+        if (*end != '\0') {
+            return CONFIG_SNAPSHOT_IMPORT_BAD_CHUNK;
+        }
+    }
+    import_received += len / 2;
+
+    return CONFIG_SNAPSHOT_IMPORT_PENDING;
+}
+
+
+static config_snapshot_import_status_t _import_validate(void) {
+    config_snapshot_header_t header;
+    uint32_t crc;
+
+    if (import_blob == NULL || import_received != import_length || 
+        import_length < sizeof(config_snapshot_header_t) + sizeof(uint32_t)) {
+        return CONFIG_SNAPSHOT_IMPORT_BAD_CHUNK;
+    }
+
+    memcpy(&header, import_blob, sizeof(header));
+    memcpy(&crc, import_blob + import_length - sizeof(crc), sizeof(crc));
+    if (header.magic != CONFIG_SNAPSHOT_MAGIC || header.version != CONFIG_SNAPSHOT_VERSION || 
+        header.length != import_length || crc != crc32_compute(import_blob, import_length - sizeof(crc))) {
+        return CONFIG_SNAPSHOT_IMPORT_BAD_BLOB;
+    }
+
+    size_t offset = sizeof(header);
+    for (uint16_t idx = 0; idx < header.region_cnt; idx += 1) {
+        config_snapshot_region_t region;
+
+        if (offset + sizeof(region) > import_length - sizeof(crc)) {
+            return CONFIG_SNAPSHOT_IMPORT_BAD_BLOB;
+        }
+        memcpy(&region, import_blob + offset, sizeof(region));
+        offset += sizeof(region);
+
+        if (region.size < sizeof(uint32_t) || offset + region.size > import_length - sizeof(crc)) {
+            return CONFIG_SNAPSHOT_IMPORT_BAD_BLOB;
+        }
+
+        // Same layout as this firmware, with the CRC load_config checks
+        uint32_t region_crc;
+        memcpy(&region_crc, import_blob + offset + region.size - sizeof(region_crc), sizeof(region_crc));
+        if (!_is_known_region(region.addr) || region.size != eeprom_region_size(region.addr) ||
+            region_crc != crc32_compute(import_blob + offset, region.size - sizeof(region_crc))) {
+            return CONFIG_SNAPSHOT_IMPORT_BAD_REGION;
+        }
+
+        offset += region.size;
+    }
+
+    if (offset != import_length - sizeof(crc)) {
+        return CONFIG_SNAPSHOT_IMPORT_BAD_BLOB;
+    }
+
+    return CONFIG_SNAPSHOT_IMPORT_PENDING;
+}
+
+
+static config_snapshot_import_status_t _import_commit(void) {
+    config_snapshot_import_status_t status = _import_validate();
+    if (status != CONFIG_SNAPSHOT_IMPORT_PENDING) {
+        return status;
+    }
+
+    config_snapshot_header_t header;
+    memcpy(&header, import_blob, sizeof(header));
+
+    size_t offset = sizeof(header);
+    for (uint16_t idx = 0; idx < header.region_cnt; idx += 1) {
+        config_snapshot_region_t region;
+        memcpy(&region, import_blob + offset, sizeof(region));
+        offset += sizeof(region);
+
+        // The unit keeps its own id
+        if (region.addr != EEPROM_METADATA_BASE_ADDR) {
+            eeprom_write(region.addr, import_blob + offset, region.size);
+        }
+
+        offset += region.size;
+    }
+
+    // The pages that changed in every region, written as one pass
+    return eeprom_flush() ? CONFIG_SNAPSHOT_IMPORT_WRITTEN : CONFIG_SNAPSHOT_IMPORT_WRITE_FAILED;
+}
+
+
+bool http_rest_config_snapshot_import(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // n (int): Length of the blob, starts a new import
+    // o (int): Offset of d in the blob, the chunks shall be sent in order
+    // d (hex): Up to CONFIG_SNAPSHOT_IMPORT_CHUNK_SIZE bytes of the blob
+    // c (bool): Check the blob and write it, apply with a reboot without saving (/rest/system_control?s5=true)
+    //
+    // Response:
+    // i0 (int): Bytes received
+    // i1 (int): Status, see config_snapshot_import_status_t
+    const size_t import_json_buffer_size = 64;
+    char * import_json_buffer = (char *) rest_response_alloc(import_json_buffer_size);
+    if (import_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    config_snapshot_import_status_t status = CONFIG_SNAPSHOT_IMPORT_PENDING;
+    size_t offset = 0;
+    const char * data = NULL;
+    bool commit = false;
+
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "n") == 0) {
+            size_t length = strtoul(values[idx], NULL, 10);
+
+            free(import_blob);
+            import_blob = NULL;
+            import_length = 0;
+            import_received = 0;
+
+            if (length > CONFIG_SNAPSHOT_MAX_LENGTH) {
+                status = CONFIG_SNAPSHOT_IMPORT_BAD_BLOB;
+            }
+            else {
+                import_blob = malloc(length);
+                if (import_blob == NULL) {
+                    status = CONFIG_SNAPSHOT_IMPORT_NO_MEMORY;
+                }
+                else {
+                    import_length = length;
+                }
+            }
+        }
+        else if (strcmp(params[idx], "o") == 0) {
+            offset = strtoul(values[idx], NULL, 10);
+        }
+        else if (strcmp(params[idx], "d") == 0) {
+            data = values[idx];
+        }
+        else if (strcmp(params[idx], "c") == 0) {
+            commit = string_to_boolean(values[idx]);
+        }
+    }
+
+    if (status == CONFIG_SNAPSHOT_IMPORT_PENDING && data) {
+        status = strlen(data) > 2 * CONFIG_SNAPSHOT_IMPORT_CHUNK_SIZE ? CONFIG_SNAPSHOT_IMPORT_BAD_CHUNK : 
+                                                                      _import_add_chunk(offset, data);
+    }
+
+    if (status == CONFIG_SNAPSHOT_IMPORT_PENDING && commit) {
+        status = _import_commit();
+    }
+
+    size_t received = import_received;
+
+    // Start over after a failed chunk or once written
+    if (status != CONFIG_SNAPSHOT_IMPORT_PENDING) {
+        free(import_blob);
+        import_blob = NULL;
+        import_length = 0;
+        import_received = 0;
+    }
+
+    snprintf(import_json_buffer,
+             import_json_buffer_size,
+             "%s"
+             "{\"i0\":%u,\"i1\":%d}",
+             http_json_header,
+             received,
+             (int) status);
+
+    size_t data_length = strlen(import_json_buffer);
+    file->data = import_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
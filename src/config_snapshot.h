@@ -0,0 +1,57 @@
+#ifndef CONFIG_SNAPSHOT_H_
+#define CONFIG_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "http_rest.h"
+
+
+#define CONFIG_SNAPSHOT_MAGIC           0x5343544F      // "OTCS"
+#define CONFIG_SNAPSHOT_VERSION         1
+
+// Bytes per import request, the request line and the browser headers shall fit the httpd request buffer
+#define CONFIG_SNAPSHOT_IMPORT_CHUNK_SIZE   128
+
+
+/*
+    Snapshot blob, little endian:
+        config_snapshot_header_t
+        region_cnt times: config_snapshot_region_t followed by size bytes as stored in the EEPROM (config and CRC32)
+        CRC32 of all the bytes above
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t region_cnt;
+    uint32_t length;            // Of the whole blob, including the trailing CRC32
+} config_snapshot_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t addr;
+    uint16_t size;
+} config_snapshot_region_t;
+
+
+typedef enum {
+    CONFIG_SNAPSHOT_IMPORT_PENDING = 0,
+    CONFIG_SNAPSHOT_IMPORT_WRITTEN = 1,
+    CONFIG_SNAPSHOT_IMPORT_BAD_CHUNK = 2,       // Offset, length or hex digits
+    CONFIG_SNAPSHOT_IMPORT_BAD_BLOB = 3,        // Magic, version, length or CRC
+    CONFIG_SNAPSHOT_IMPORT_BAD_REGION = 4,      // Unknown address, another size or a config failing its CRC
+    CONFIG_SNAPSHOT_IMPORT_NO_MEMORY = 5,
+    CONFIG_SNAPSHOT_IMPORT_WRITE_FAILED = 6,
+} config_snapshot_import_status_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool http_rest_config_snapshot(struct fs_file *file, int num_params, char *params[], char *values[]);
+bool http_rest_config_snapshot_import(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // CONFIG_SNAPSHOT_H_
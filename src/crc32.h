@@ -0,0 +1,52 @@
+#ifndef CRC32_H_
+#define CRC32_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+// Shorter data is done in software, the DMA set up costs more than the table loop
+#define CRC32_DMA_MIN_LENGTH        64
+
+
+// CRC of data passed in parts, see crc32_stream_start
+typedef struct {
+    uint32_t crc;
+    bool dma;                   // Computed by the DMA sniffer, crc is unused
+} crc32_stream_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Claims the DMA channel of the sniffer. Without it (or while another CRC holds the sniffer) the CRC is done in
+ * software, with the same result.
+ */
+void crc32_init(void);
+
+/**
+ * CRC-32 (IEEE 802.3, as zlib) of data.
+ */
+uint32_t crc32_compute(const void * data, size_t length);
+
+/**
+ * Table driven CRC-32, for callers that can't use the DMA (e.g. with the flash in use).
+ */
+uint32_t software_crc32(const void * data, size_t length);
+
+/**
+ * Starts a CRC over data that arrives in parts. With the sniffer each part is checked by the DMA while the caller
+ * gets the next one, so a part shall stay in place until the next crc32_stream_update or crc32_stream_finish.
+ */
+void crc32_stream_start(crc32_stream_t * stream);
+void crc32_stream_update(crc32_stream_t * stream, const void * data, size_t length);
+uint32_t crc32_stream_finish(crc32_stream_t * stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // CRC32_H_
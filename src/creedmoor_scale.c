@@ -23,17 +23,13 @@ Example data
 +009.198 g  \r\n
 */
 
-typedef union {
-    struct __attribute__((__packed__)) {
-        char header[1];         // Sign (+ or -)
-        char data[7];           // Unsigned integer with leading zeros
-        char _space;            // Space
-        char unit[2];           // Unit GN (or something else)
-        char _space2;           // Space   
-        char terminator[2];     // \r\n (carriage return)
-    };
-    char bytes[14];
-} creedmoor_data_format_t ;
+static const scale_frame_descriptor_t creedmoor_frame_descriptor = {
+    .frame_size = 14,             // sign, data[7], space, unit[2], space, terminator[2]
+    .terminator = '\n',
+    .sign_offset = 0,
+    .data_offset = 1,
+    .data_length = 7,
+};
 
 // Forward declaration
 void _creedmoor_scale_listener_task(void *p);
@@ -46,62 +42,8 @@ scale_handle_t creedmoor_scale_handle = {
     .force_zero = force_zero,
 };
 
-static float _decode_measurement_msg(creedmoor_data_format_t * msg) {
-    // Determine sign
-    int sign = 1;
-
-    // Check if the header contains a negative sign
-    if (msg->header[0] == '-') {
-        sign = -1;
-    }
-
-    char *endptr;
-    float weight = strtof(msg->data, &endptr);
-
-    if( endptr == msg->data ) {
-        // Conversion failed
-        return nanf(msg->data);
-    }
-
-    // Apply the sign
-    weight *= sign;
-
-    return weight;
-}
-
 void _creedmoor_scale_listener_task(void *p) {
-    uint8_t string_buf_idx = 0;
-    creedmoor_data_format_t frame;
-
-    while (true) {
-        // Read all data 
-        while (uart_is_readable(SCALE_UART)) {
-            char ch = uart_getc(SCALE_UART);
-
-            frame.bytes[string_buf_idx++] = ch;
-
-            // If we have received 14 bytes then we can decode the message
-            if (string_buf_idx == sizeof(creedmoor_data_format_t)) {
-                // Data is ready, send to decode
-                scale_config.current_scale_measurement = _decode_measurement_msg(&frame);
-
-                // Signal the data is ready
-                if (scale_config.scale_measurement_ready) {
-                    xSemaphoreGive(scale_config.scale_measurement_ready);
-                }
-
-                // Reset
-                string_buf_idx = 0;
-            }
-
-            // \n is the terminator. We shall reset the receive of message on receiving any of those character.
-            if (ch =='\n') {
-                string_buf_idx = 0;
-            }
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(20));
-    }
+    scale_frame_listener_loop(&creedmoor_frame_descriptor);
 }
 
 static void force_zero() {
@@ -0,0 +1,316 @@
+#include <FreeRTOS.h>
+#include <task.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "custom_scale.h"
+#include "scale.h"
+#include "common.h"
+
+
+/*
+    Scale driver of a user defined protocol, for the scales without a driver of their own. The protocol is stored with
+    the scale config (scale_custom_protocol_t) and set by /rest/custom_scale_config. The driver turns it into a frame
+    descriptor once, after boot and after every change, the frames are then decoded by scale_frame_decoder_push as the
+    frames of the built-in drivers.
+*/
+#define CUSTOM_SCALE_IDLE_WAIT_MS               100     // Longest wait for a frame, a protocol change is picked up after
+#define CUSTOM_SCALE_MIN_POLL_INTERVAL_MS       10
+
+extern scale_config_t scale_config;
+
+static struct {
+    scale_frame_descriptor_t descriptor;
+    char header[SCALE_CUSTOM_STRING_SIZE];
+    char poll_command[SCALE_CUSTOM_STRING_SIZE];
+    size_t poll_command_length;
+    uint32_t poll_interval_ms;
+    bool is_valid;
+} custom_scale;
+
+// Changed by every REST request, the driver rebuilds the descriptor when it differs from the one it was built for
+static volatile uint32_t custom_scale_protocol_rev = 1;
+
+
+void _custom_scale_listener_task(void *p);
+static void _custom_scale_force_zero(void);
+
+scale_handle_t custom_scale_handle = {
+    .read_loop_task = _custom_scale_listener_task,
+    .force_zero = _custom_scale_force_zero,
+};
+
+
+static int _hex_digit(char ch) {
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    ch = (char) tolower((unsigned char) ch);
+    if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    }
+    return -1;
+}
+
+
+// Expands the backslash escapes (\r \n \t \\ \xHH) of src into dst. Returns the length, -1 if it doesn't fit.
+static int _custom_scale_unescape(char * dst, size_t dst_size, const char * src) {
+    size_t len = 0;
+
+    while (*src) {
+        char ch = *src++;
+
+        if (ch == '\\' && *src) {
+            char escape = *src++;
+            switch (escape) {
+                case 'r': ch = '\r'; break;
+                case 'n': ch = '\n'; break;
+                case 't': ch = '\t'; break;
+                case 'x': {
+                    int high = _hex_digit(src[0]);
+                    int low = high >= 0 ? _hex_digit(src[1]) : -1;
+                    if (low < 0) {
+                        return -1;
+                    }
+                    ch = (char) (high * 16 + low);
+                    src += 2;
+                    break;
+                }
+                default: ch = escape; break;
+            }
+        }
+
+        if (len + 1 >= dst_size) {
+            return -1;
+        }
+        dst[len++] = ch;
+    }
+
+    dst[len] = '\0';
+    return (int) len;
+}
+
+
+bool custom_scale_protocol_is_valid(const scale_custom_protocol_t * protocol) {
+    char buf[SCALE_CUSTOM_STRING_SIZE];
+
+    int header_length = _custom_scale_unescape(buf, sizeof(buf), protocol->header);
+    if (header_length < 0 || _custom_scale_unescape(buf, sizeof(buf), protocol->poll_command) < 0 ||
+        _custom_scale_unescape(buf, sizeof(buf), protocol->zero_command) < 0) {
+        return false;
+    }
+
+    // A line is only read for its number
+    if (protocol->frame_size == 0) {
+        return true;
+    }
+
+    return protocol->frame_size <= SCALE_FRAME_MAX_SIZE &&
+           header_length <= protocol->frame_size &&
+           protocol->data_length > 0 &&
+           protocol->data_offset + protocol->data_length <= protocol->frame_size &&
+           protocol->sign_offset < (int) protocol->frame_size &&
+           (protocol->stable_char == 0 || protocol->stable_offset < protocol->frame_size);
+}
+
+
+static void _custom_scale_build(const scale_custom_protocol_t * protocol) {
+    memset(&custom_scale, 0x0, sizeof(custom_scale));
+
+    custom_scale.is_valid = custom_scale_protocol_is_valid(protocol);
+    if (!custom_scale.is_valid) {
+        printf("Invalid custom scale protocol, no frames are decoded\n");
+        return;
+    }
+
+    int header_length = _custom_scale_unescape(custom_scale.header, sizeof(custom_scale.header), protocol->header);
+    int poll_command_length = _custom_scale_unescape(custom_scale.poll_command, sizeof(custom_scale.poll_command),
+                                                     protocol->poll_command);
+
+    custom_scale.descriptor = (scale_frame_descriptor_t) {
+        .frame_size = protocol->frame_size,
+        .sync_char = protocol->sync_char,
+        .terminator = protocol->terminator,
+        .header = header_length > 0 ? custom_scale.header : NULL,
+        .header_length = (uint8_t) header_length,
+        .sign_offset = protocol->sign_offset,
+        .stable_offset = protocol->stable_offset,
+        .stable_char = protocol->stable_char,
+        .data_offset = protocol->data_offset,
+        .data_length = protocol->data_length,
+    };
+
+    custom_scale.poll_command_length = poll_command_length;
+    custom_scale.poll_interval_ms = protocol->poll_interval_ms < CUSTOM_SCALE_MIN_POLL_INTERVAL_MS ?
+                                    CUSTOM_SCALE_MIN_POLL_INTERVAL_MS : protocol->poll_interval_ms;
+}
+
+
+/*
+    Without a poll command the driver reads the frames the scale sends. With one, the next request goes out as soon as
+    the response is in, or after poll_interval_ms without one (as _gng_scale_listener_task).
+*/
+void _custom_scale_listener_task(void *p) {
+    scale_frame_decoder_t decoder = {0};
+    uint32_t protocol_rev = 0;
+
+    while (true) {
+        if (protocol_rev != custom_scale_protocol_rev) {
+            protocol_rev = custom_scale_protocol_rev;
+
+            _custom_scale_build(&scale_config.persistent_config.custom_protocol);
+            memset(&decoder, 0x0, sizeof(decoder));
+
+            // A fixed frame is complete on its terminator, a line on either line ending
+            scale_uart_set_frame_terminator(custom_scale.descriptor.frame_size ? custom_scale.descriptor.terminator : 0);
+        }
+
+        if (custom_scale.poll_command_length) {
+            scale_write(custom_scale.poll_command, custom_scale.poll_command_length);
+        }
+
+        TimeOut_t frame_timeout;
+        TickType_t ticks_left = pdMS_TO_TICKS(custom_scale.poll_command_length ? custom_scale.poll_interval_ms :
+                                                                                 CUSTOM_SCALE_IDLE_WAIT_MS);
+        vTaskSetTimeOutState(&frame_timeout);
+
+        bool received = false;
+        while (!received && xTaskCheckForTimeOut(&frame_timeout, &ticks_left) == pdFALSE) {
+            // Wait for the RX interrupt to receive the next frame
+            scale_uart_wait_for_frame(ticks_left);
+
+            // Read all data, an invalid protocol only drains the buffer
+            while (scale_uart_is_readable()) {
+                char ch = scale_uart_getc();
+                float weight;
+
+                if (custom_scale.is_valid && scale_frame_decoder_push(&custom_scale.descriptor, &decoder, ch, &weight)) {
+                    scale_publish_measurement(weight, decoder.stability);
+                    received = true;
+                }
+            }
+        }
+    }
+}
+
+
+static void _custom_scale_force_zero(void) {
+    char cmd[SCALE_CUSTOM_STRING_SIZE];
+
+    int len = _custom_scale_unescape(cmd, sizeof(cmd), scale_config.persistent_config.custom_protocol.zero_command);
+    if (len > 0) {
+        scale_write(cmd, len);
+    }
+}
+
+
+// JSON string of s, the escapes as entered are kept
+static int _format_json_string(char * buffer, size_t buffer_size, const char * s) {
+    size_t len = 0;
+
+    if (len + 1 < buffer_size) {
+        buffer[len++] = '"';
+    }
+    for (; *s && len + 7 < buffer_size; s += 1) {
+        if (*s == '"' || *s == '\\') {
+            buffer[len++] = '\\';
+            buffer[len++] = *s;
+        }
+        else if ((unsigned char) *s < 0x20) {
+            len += snprintf(buffer + len, buffer_size - len, "\\u%04x", (unsigned char) *s);
+        }
+        else {
+            buffer[len++] = *s;
+        }
+    }
+    if (len + 1 < buffer_size) {
+        buffer[len++] = '"';
+    }
+    buffer[len] = '\0';
+
+    return len;
+}
+
+
+bool http_rest_custom_scale_config(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings, see scale_custom_protocol_t and scale_frame_descriptor_t
+    // q0 (int): frame_size, 0 for variable length lines terminated by \r or \n
+    // q1 (int): sync_char (ASCII code), 0 if none
+    // q2 (int): terminator (ASCII code), 0 if none
+    // q3 (str): header, empty to accept any
+    // q4 (int): sign_offset, -1 if the sign is part of the data
+    // q5 (int): stable_offset
+    // q6 (int): stable_char (ASCII code), 0 if not reported
+    // q7 (int): data_offset
+    // q8 (int): data_length
+    // q9 (str): poll_command, empty if the scale sends on its own
+    // q10 (int): poll_interval_ms
+    // q11 (str): zero_command
+    // q12 (bool): Protocol valid (read only), see custom_scale_protocol_is_valid
+    // ee (bool): save to eeprom
+    //
+    // The strings take the backslash escapes \r \n \t \\ \xHH
+    const size_t custom_scale_config_json_buffer_size = 512;
+    char * custom_scale_config_json_buffer = (char *) rest_response_alloc(custom_scale_config_json_buffer_size);
+    if (custom_scale_config_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    scale_custom_protocol_t * protocol = &scale_config.persistent_config.custom_protocol;
+
+    static const rest_param_t custom_scale_config_params[] = {
+        REST_PARAM_INT("q0", scale_config.persistent_config.custom_protocol.frame_size),
+        REST_PARAM_INT("q1", scale_config.persistent_config.custom_protocol.sync_char),
+        REST_PARAM_INT("q2", scale_config.persistent_config.custom_protocol.terminator),
+        REST_PARAM_STRING("q3", scale_config.persistent_config.custom_protocol.header),
+        REST_PARAM_INT("q4", scale_config.persistent_config.custom_protocol.sign_offset),
+        REST_PARAM_INT("q5", scale_config.persistent_config.custom_protocol.stable_offset),
+        REST_PARAM_INT("q6", scale_config.persistent_config.custom_protocol.stable_char),
+        REST_PARAM_INT("q7", scale_config.persistent_config.custom_protocol.data_offset),
+        REST_PARAM_INT("q8", scale_config.persistent_config.custom_protocol.data_length),
+        REST_PARAM_STRING("q9", scale_config.persistent_config.custom_protocol.poll_command),
+        REST_PARAM_INT("q10", scale_config.persistent_config.custom_protocol.poll_interval_ms),
+        REST_PARAM_STRING("q11", scale_config.persistent_config.custom_protocol.zero_command),
+    };
+
+    // If the argument includes control, then update the settings
+    bool save_to_eeprom = rest_apply_params(custom_scale_config_params, REST_PARAM_TABLE_SIZE(custom_scale_config_params),
+                                            num_params, params, values);
+
+    // Perform action
+    if (num_params > 0) {
+        custom_scale_protocol_rev += 1;
+    }
+
+    if (save_to_eeprom) {
+        scale_config_save();
+    }
+
+    // Response
+    size_t len = snprintf(custom_scale_config_json_buffer, custom_scale_config_json_buffer_size,
+                          "%s{\"q0\":%u,\"q1\":%d,\"q2\":%d,\"q3\":",
+                          http_json_header, protocol->frame_size, protocol->sync_char, protocol->terminator);
+    len += _format_json_string(custom_scale_config_json_buffer + len, custom_scale_config_json_buffer_size - len,
+                               protocol->header);
+    len += snprintf(custom_scale_config_json_buffer + len, custom_scale_config_json_buffer_size - len,
+                    ",\"q4\":%d,\"q5\":%u,\"q6\":%d,\"q7\":%u,\"q8\":%u,\"q9\":",
+                    protocol->sign_offset, protocol->stable_offset, protocol->stable_char, protocol->data_offset,
+                    protocol->data_length);
+    len += _format_json_string(custom_scale_config_json_buffer + len, custom_scale_config_json_buffer_size - len,
+                               protocol->poll_command);
+    len += snprintf(custom_scale_config_json_buffer + len, custom_scale_config_json_buffer_size - len,
+                    ",\"q10\":%u,\"q11\":", protocol->poll_interval_ms);
+    len += _format_json_string(custom_scale_config_json_buffer + len, custom_scale_config_json_buffer_size - len,
+                               protocol->zero_command);
+    snprintf(custom_scale_config_json_buffer + len, custom_scale_config_json_buffer_size - len, ",\"q12\":%s}",
+             boolean_to_string(custom_scale_protocol_is_valid(protocol)));
+
+    size_t data_length = strlen(custom_scale_config_json_buffer);
+    file->data = custom_scale_config_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
@@ -0,0 +1,24 @@
+#ifndef CUSTOM_SCALE_H_
+#define CUSTOM_SCALE_H_
+
+#include <stdbool.h>
+#include "http_rest.h"
+#include "scale.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Checks the custom protocol fits the frame decoder: fields within the frame, the frame within SCALE_FRAME_MAX_SIZE.
+ */
+bool custom_scale_protocol_is_valid(const scale_custom_protocol_t * protocol);
+
+bool http_rest_custom_scale_config(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // CUSTOM_SCALE_H_
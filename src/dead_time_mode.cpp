@@ -0,0 +1,402 @@
+#include <FreeRTOS.h>
+#include <queue.h>
+#include <task.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "pico/time.h"
+#include "app.h"
+#include "u8g2.h"
+#include "FloatRingBuffer.h"
+#include "mini_12864_module.h"
+#include "motors.h"
+#include "scale.h"
+#include "display.h"
+#include "common.h"
+#include "charge_mode.h"
+#include "dead_time_mode.h"
+#include "servo_gate.h"
+#include "profile.h"
+
+
+/*
+    Measures the step response of the fine trickler as seen through the scale, which sets how far ahead the predictive
+    cutoff has to look.
+
+    Each step starts the fine trickler from rest on a settled scale. The powder shows on the scale after the
+    response delay, then the weight ramps up at the settled flow rate. A line fitted to the ramp crosses the resting
+    weight after the delay plus the lag of the flow (the time constant). Once the trickler is stopped the weight keeps
+    rising for a while: this carry, divided by the flow rate, is the dead time the cutoff predicts the final weight
+    with. The results of the steps are averaged and stored to the selected profile along with the scale driver, as
+    they hold for that powder on that scale.
+*/
+
+#define DEAD_TIME_BASELINE_SAMPLES          10
+#define DEAD_TIME_DETECT_SD_FACTOR          5.0f        // A change above this many times the noise is a response
+#define DEAD_TIME_MIN_DETECT_WEIGHT         0.02f       // Or above the resolution of a typical scale
+#define DEAD_TIME_RESPONSE_TIMEOUT_US       5000000     // No visible change by then, no powder or no pan
+#define DEAD_TIME_FIT_DELAY_US              500000      // The ramp is fitted once the flow settled
+#define DEAD_TIME_FIT_DURATION_US           2000000
+#define DEAD_TIME_MIN_FIT_SAMPLES           5
+#define DEAD_TIME_SETTLE_US                 3000000     // The carry arrives within this time after the stop
+#define DEAD_TIME_MEASUREMENT_TIMEOUT_MS    300
+
+
+// Memory from other modules
+extern QueueHandle_t encoder_event_queue;
+extern charge_mode_config_t charge_mode_config;
+extern scale_config_t scale_config;
+extern servo_gate_t servo_gate;
+extern AppState_t exit_state;
+
+// Internal
+dead_time_mode_config_t dead_time_mode_config;
+
+
+static char title_string[30];
+
+
+static const char * _phase_to_string(dead_time_phase_t phase) {
+    switch (phase) {
+        case DEAD_TIME_PHASE_BASELINE:
+            return "Settling";
+        case DEAD_TIME_PHASE_STEP:
+            return "Trickling";
+        case DEAD_TIME_PHASE_SETTLE:
+            return "Stopped";
+        case DEAD_TIME_PHASE_DONE:
+            return "Done";
+        case DEAD_TIME_PHASE_FAILED:
+            return "Failed";
+        default:
+            return "";
+    }
+}
+
+
+static TickType_t dead_time_render_scene(u8g2_t * display_handler) {
+    char buf[32];
+
+    // Draw title
+    if (strlen(title_string)) {
+        u8g2_SetFont(display_handler, u8g2_font_helvB08_tr);
+        u8g2_DrawStr(display_handler, 5, 10, title_string);
+    }
+
+    // Draw line
+    u8g2_DrawHLine(display_handler, 0, 13, u8g2_GetDisplayWidth(display_handler));
+
+    // Draw weight
+    static weight_string_cache_t weight_cache;
+    scale_measurement_t measurement;
+    if (!scale_get_latest_measurement(&measurement)) {
+        measurement.weight = NAN;
+        measurement.seq = 0;
+    }
+    const char * weight_string = weight_string_cache_format(&weight_cache, measurement.seq, measurement.weight,
+                                                            charge_mode_config.eeprom_charge_mode_data.decimal_places);
+
+    u8g2_SetFont(display_handler, u8g2_font_profont11_tf);
+
+    snprintf(buf, sizeof(buf), "Weight: %s", weight_string);
+    u8g2_DrawStr(display_handler, 5, 25, buf);
+
+    snprintf(buf, sizeof(buf), "%s %d/%d", _phase_to_string(dead_time_mode_config.phase),
+             dead_time_mode_config.step_count, DEAD_TIME_STEP_CNT);
+    u8g2_DrawStr(display_handler, 5, 35, buf);
+
+    if (dead_time_mode_config.step_count) {
+        snprintf(buf, sizeof(buf), "Dead time: %0.0f ms", dead_time_mode_config.result.dead_time_ms);
+        u8g2_DrawStr(display_handler, 5, 45, buf);
+
+        snprintf(buf, sizeof(buf), "Delay: %0.0f Lag: %0.0f ms", dead_time_mode_config.result.response_delay_ms,
+                 dead_time_mode_config.result.time_constant_ms);
+        u8g2_DrawStr(display_handler, 5, 55, buf);
+    }
+
+    return pdMS_TO_TICKS(100);
+}
+
+
+// True if the mode shall stop
+static bool _poll_abort() {
+    ButtonEncoderEvent_t button_encoder_event;
+
+    while (xQueueReceive(encoder_event_queue, &button_encoder_event, 0) == pdTRUE) {
+        if (button_encoder_event == BUTTON_RST_PRESSED) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// Next measurement, false to stop
+static bool _next_measurement(uint32_t * seq, scale_measurement_t * measurement) {
+    while (!scale_wait_for_measurement(seq, DEAD_TIME_MEASUREMENT_TIMEOUT_MS, measurement)) {
+        if (_poll_abort()) {
+            return false;
+        }
+    }
+
+    return !_poll_abort();
+}
+
+
+static bool _measure_step(float speed, dead_time_result_t * result, bool * abort) {
+    uint32_t seq = scale_get_latest_measurement_seq();
+    scale_measurement_t measurement;
+    *abort = true;
+
+    // Weight at rest and its noise
+    dead_time_mode_config.phase = DEAD_TIME_PHASE_BASELINE;
+    FloatRingBuffer<DEAD_TIME_BASELINE_SAMPLES> baseline_weights;
+    while (!baseline_weights.isFull()) {
+        if (!_next_measurement(&seq, &measurement)) {
+            return false;
+        }
+        baseline_weights.enqueue(measurement.weight);
+    }
+    float baseline = baseline_weights.getMean();
+    float threshold = fmaxf(DEAD_TIME_DETECT_SD_FACTOR * baseline_weights.getSd(), DEAD_TIME_MIN_DETECT_WEIGHT);
+
+    // Step, times are relative to the speed command
+    dead_time_mode_config.phase = DEAD_TIME_PHASE_STEP;
+    uint32_t start_time_us = time_us_32();
+    motor_set_speed(SELECT_FINE_TRICKLER_MOTOR, speed);
+
+    int32_t response_time_us = -1;
+    uint32_t fit_count = 0;
+    double sum_t = 0, sum_w = 0, sum_tt = 0, sum_tw = 0;
+
+    while (true) {
+        if (!_next_measurement(&seq, &measurement)) {
+            motor_set_speed(SELECT_FINE_TRICKLER_MOTOR, 0);
+            return false;
+        }
+
+        int32_t elapsed_us = (int32_t) (measurement.capture_time_us - start_time_us);
+        float weight = measurement.weight - baseline;
+
+        if (response_time_us < 0) {
+            if (elapsed_us > 0 && weight > threshold) {
+                response_time_us = elapsed_us;
+            }
+            else if (elapsed_us > DEAD_TIME_RESPONSE_TIMEOUT_US) {
+                break;
+            }
+        }
+        else if (elapsed_us - response_time_us >= DEAD_TIME_FIT_DELAY_US + DEAD_TIME_FIT_DURATION_US) {
+            break;
+        }
+        else if (elapsed_us - response_time_us >= DEAD_TIME_FIT_DELAY_US) {
+            double t = elapsed_us / 1e6;
+            sum_t += t;
+            sum_w += weight;
+            sum_tt += t * t;
+            sum_tw += t * weight;
+            fit_count += 1;
+        }
+    }
+
+    uint32_t stop_time_us = time_us_32();
+    motor_set_speed(SELECT_FINE_TRICKLER_MOTOR, 0);
+
+    // Least squares line through the ramp
+    double denominator = fit_count * sum_tt - sum_t * sum_t;
+    if (response_time_us < 0 || fit_count < DEAD_TIME_MIN_FIT_SAMPLES || denominator <= 0) {
+        *abort = false;
+        return false;
+    }
+    double flow_rate = (fit_count * sum_tw - sum_t * sum_w) / denominator;
+    double offset = (sum_w - flow_rate * sum_t) / fit_count;
+    if (flow_rate <= 0) {
+        *abort = false;
+        return false;
+    }
+
+    // Weight still arriving after the stop
+    dead_time_mode_config.phase = DEAD_TIME_PHASE_SETTLE;
+    FloatRingBuffer<DEAD_TIME_BASELINE_SAMPLES> settled_weights;
+    while (true) {
+        if (!_next_measurement(&seq, &measurement)) {
+            return false;
+        }
+        settled_weights.enqueue(measurement.weight - baseline);
+
+        if ((int32_t) (measurement.capture_time_us - stop_time_us) >= DEAD_TIME_SETTLE_US && settled_weights.isFull()) {
+            break;
+        }
+    }
+    double weight_at_stop = offset + flow_rate * ((stop_time_us - start_time_us) / 1e6);
+    double carry = settled_weights.getMean() - weight_at_stop;
+
+    result->dead_time_ms = fmax(carry / flow_rate * 1000, 0);
+    result->response_delay_ms = response_time_us / 1000.0f;
+    result->time_constant_ms = fmax(-offset / flow_rate * 1000 - result->response_delay_ms, 0);
+    result->flow_gain = flow_rate / speed;
+
+    return true;
+}
+
+
+static void _store_result(const dead_time_result_t * result, float speed) {
+    profile_t * profile = profile_get_selected();
+
+    profile->measured_dead_time_ms = result->dead_time_ms;
+    profile->measured_response_delay_ms = result->response_delay_ms;
+    profile->measured_time_constant_ms = result->time_constant_ms;
+
+    // The gain of the flow model, the speed dependence from the flow calibration (if any) is kept
+    profile->measured_flow_gain = result->flow_gain - profile->fine_flow_gain_slope * speed;
+    profile->measured_scale_driver = scale_config.persistent_config.scale_driver;
+
+    profile_data_save();
+}
+
+
+uint8_t dead_time_mode_menu() {
+    display_set_scene(dead_time_render_scene);
+
+    // Keep the step speed set over REST
+    dead_time_mode_config.dead_time_mode_state = DEAD_TIME_MODE_ENTER;
+    dead_time_mode_config.phase = DEAD_TIME_PHASE_IDLE;
+    dead_time_mode_config.step_count = 0;
+    memset(&dead_time_mode_config.result, 0x0, sizeof(dead_time_result_t));
+
+    float speed = dead_time_mode_config.step_speed;
+    if (speed <= 0) {
+        speed = profile_get_selected()->fine_max_flow_speed_rps;
+    }
+    speed = fminf(speed, get_motor_max_speed(SELECT_FINE_TRICKLER_MOTOR));
+
+    motor_enable(SELECT_FINE_TRICKLER_MOTOR, true);
+
+    // Open servo gate (if enabled)
+    if (servo_gate.gate_state != GATE_DISABLED) {
+        servo_gate_set_ratio(SERVO_GATE_RATIO_OPEN, true);
+    }
+
+    snprintf(title_string, sizeof(title_string), "Dead Time");
+
+    dead_time_result_t sum = {};
+    bool abort = false;
+    while (dead_time_mode_config.step_count < DEAD_TIME_STEP_CNT) {
+        dead_time_result_t step_result;
+        if (!_measure_step(speed, &step_result, &abort)) {
+            break;
+        }
+
+        sum.dead_time_ms += step_result.dead_time_ms;
+        sum.response_delay_ms += step_result.response_delay_ms;
+        sum.time_constant_ms += step_result.time_constant_ms;
+        sum.flow_gain += step_result.flow_gain;
+        dead_time_mode_config.step_count += 1;
+
+        dead_time_mode_config.result.dead_time_ms = sum.dead_time_ms / dead_time_mode_config.step_count;
+        dead_time_mode_config.result.response_delay_ms = sum.response_delay_ms / dead_time_mode_config.step_count;
+        dead_time_mode_config.result.time_constant_ms = sum.time_constant_ms / dead_time_mode_config.step_count;
+        dead_time_mode_config.result.flow_gain = sum.flow_gain / dead_time_mode_config.step_count;
+        display_request_render();
+    }
+
+    motor_enable(SELECT_FINE_TRICKLER_MOTOR, false);
+
+    if (!abort) {
+        if (dead_time_mode_config.step_count == DEAD_TIME_STEP_CNT) {
+            _store_result(&dead_time_mode_config.result, speed);
+            dead_time_mode_config.phase = DEAD_TIME_PHASE_DONE;
+        }
+        else {
+            dead_time_mode_config.phase = DEAD_TIME_PHASE_FAILED;
+        }
+        snprintf(title_string, sizeof(title_string), "Dead Time (Press to exit)");
+        display_request_render();
+
+        // Show the result until a button is pressed
+        ButtonEncoderEvent_t button_encoder_event;
+        do {
+            xQueueReceive(encoder_event_queue, &button_encoder_event, portMAX_DELAY);
+        } while (button_encoder_event != BUTTON_RST_PRESSED && button_encoder_event != BUTTON_ENCODER_PRESSED);
+    }
+
+    dead_time_mode_config.dead_time_mode_state = DEAD_TIME_MODE_EXIT;
+
+    display_set_scene(NULL);
+    return 1;  // Return backs to the main menu view
+}
+
+
+bool http_rest_dead_time_mode_state(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // s0 (dead_time_mode_state_t | int): Mode state, 1 starts a run
+    // s1 (float): Fine trickler speed of the steps (rps), 0 for the fine_max_flow_speed_rps of the profile
+    // s2 (dead_time_phase_t | int): Phase of the run
+    // s3 (int): Steps completed, out of DEAD_TIME_STEP_CNT
+    // s4 (float): Dead time (ms)
+    // s5 (float): Response delay (ms)
+    // s6 (float): Time constant (ms)
+    // s7 (float): Flow gain (weight per revolution)
+
+    const size_t dead_time_mode_json_buffer_size = 192;
+    char * dead_time_mode_json_buffer = (char *) rest_response_alloc(dead_time_mode_json_buffer_size);
+    if (dead_time_mode_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    // Control
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "s1") == 0) {
+            dead_time_mode_config.step_speed = strtof(values[idx], NULL);
+        }
+    }
+
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "s0") == 0) {
+            dead_time_mode_state_t new_state = (dead_time_mode_state_t) atoi(values[idx]);
+
+            // Exit
+            if (new_state == DEAD_TIME_MODE_EXIT && dead_time_mode_config.dead_time_mode_state != DEAD_TIME_MODE_EXIT) {
+                ButtonEncoderEvent_t button_event = BUTTON_RST_PRESSED;
+                xQueueSend(encoder_event_queue, &button_event, portMAX_DELAY);
+            }
+
+            // Enter
+            else if (new_state == DEAD_TIME_MODE_ENTER && dead_time_mode_config.dead_time_mode_state != DEAD_TIME_MODE_ENTER) {
+                // Set exit_status for the menu
+                exit_state = APP_STATE_ENTER_DEAD_TIME_MODE;
+
+                // Then signal the menu to stop
+                ButtonEncoderEvent_t button_event = OVERRIDE_FROM_REST;
+                xQueueSend(encoder_event_queue, &button_event, portMAX_DELAY);
+            }
+
+            dead_time_mode_config.dead_time_mode_state = new_state;
+        }
+    }
+
+    // Response
+    snprintf(dead_time_mode_json_buffer,
+             dead_time_mode_json_buffer_size,
+             "%s"
+             "{\"s0\":%d,\"s1\":%0.3f,\"s2\":%d,\"s3\":%d,\"s4\":%0.1f,\"s5\":%0.1f,\"s6\":%0.1f,\"s7\":%0.4f}",
+             http_json_header,
+             (int) dead_time_mode_config.dead_time_mode_state,
+             dead_time_mode_config.step_speed,
+             (int) dead_time_mode_config.phase,
+             dead_time_mode_config.step_count,
+             dead_time_mode_config.result.dead_time_ms,
+             dead_time_mode_config.result.response_delay_ms,
+             dead_time_mode_config.result.time_constant_ms,
+             dead_time_mode_config.result.flow_gain);
+
+    size_t data_length = strlen(dead_time_mode_json_buffer);
+    file->data = dead_time_mode_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
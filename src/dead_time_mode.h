@@ -0,0 +1,60 @@
+#ifndef DEAD_TIME_MODE_H_
+#define DEAD_TIME_MODE_H_
+
+#include <stdint.h>
+#include "http_rest.h"
+#include "motors.h"
+
+
+#define DEAD_TIME_STEP_CNT              3           // Speed steps averaged per run
+
+
+typedef enum {
+    DEAD_TIME_MODE_EXIT = 0,
+    DEAD_TIME_MODE_ENTER = 1,
+} dead_time_mode_state_t;
+
+
+typedef enum {
+    DEAD_TIME_PHASE_IDLE = 0,
+    DEAD_TIME_PHASE_BASELINE = 1,       // Weight and noise at rest
+    DEAD_TIME_PHASE_STEP = 2,           // Fine trickler running, waiting for the flow to show and settle
+    DEAD_TIME_PHASE_SETTLE = 3,         // Stopped, collecting the weight still arriving
+    DEAD_TIME_PHASE_DONE = 4,           // Results stored to the selected profile
+    DEAD_TIME_PHASE_FAILED = 5,         // No usable response, e.g. no powder or no pan
+} dead_time_phase_t;
+
+
+// Step response of the fine trickler as seen by the scale, averaged over the steps of a run
+typedef struct {
+    float dead_time_ms;                 // Weight still arriving after a stop, in ms of flow
+    float response_delay_ms;            // Speed step to the first visible weight change
+    float time_constant_ms;             // Lag of the flow after the first visible change
+    float flow_gain;                    // Settled flow per trickler speed (weight per revolution)
+} dead_time_result_t;
+
+
+typedef struct {
+    dead_time_mode_state_t dead_time_mode_state;
+    dead_time_phase_t phase;
+    float step_speed;                   // rps, 0 for the fine_max_flow_speed_rps of the profile
+    uint8_t step_count;                 // Steps completed
+    dead_time_result_t result;
+} dead_time_mode_config_t;
+
+
+// C Functions
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+uint8_t dead_time_mode_menu();
+
+bool http_rest_dead_time_mode_state(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+#ifdef __cplusplus
+}  // __cplusplus
+#endif
+
+#endif  // DEAD_TIME_MODE_H_
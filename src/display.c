@@ -4,22 +4,232 @@
 #include <u8g2.h>
 #include <FreeRTOS.h>
 #include <semphr.h>
+#include <task.h>
 
+#include "common.h"
 #include "display.h"
+#include "event_stream.h"
 #include "http_rest.h"
+#include "mini_12864_module.h"
+#include "scale.h"
+#include "static_alloc.h"
 
 
+#define DISPLAY_SHADOW_BUFFER_SIZE      1024    // 128x64 monochrome
+#define DISPLAY_COMPOSITOR_PRIORITY     5       // Below the menu task, as the per mode render tasks were
+#define DISPLAY_STREAM_PACKET_SIZE      1100    // Header plus every tile row as one span in the worst case
+
+
+extern mini_12864_module_config_t mini_12864_module_config;
+
 // Local variables
 u8g2_t display_handler;
 SemaphoreHandle_t display_buffer_access_mutex = NULL;
 
+// Copy of the frame last sent to the panel, used to find the tiles that changed
+static uint8_t display_shadow_buffer[DISPLAY_SHADOW_BUFFER_SIZE];
+static bool display_shadow_valid = false;
+
+// Compositor
+static TaskHandle_t display_compositor_task_handler = NULL;
+static display_scene_render_t display_scene = NULL;
+static volatile bool display_scene_changed = false;
+
+// Frame as last streamed to the display mirror, and the encoded packet
+static uint8_t display_stream_shadow[DISPLAY_SHADOW_BUFFER_SIZE];
+static uint8_t display_stream_packet[DISPLAY_STREAM_PACKET_SIZE];
+
 u8g2_t * get_display_handler(void) {
     return &display_handler;
 }
 
+
+// Force the next display_update to send the whole frame
+void display_invalidate(void) {
+    display_shadow_valid = false;
+}
+
+
+/*
+    Replacement of u8g2_SendBuffer that only sends the tiles (8x8 pixels) that changed since the last update. Each
+    tile row is sent as one span covering its first to last changed tile, so a new weight reading typically costs a
+    few hundred bytes over SPI instead of the full 1 KB frame.
+*/
+void display_update(u8g2_t * u8g2) {
+    uint8_t tile_width = u8g2_GetBufferTileWidth(u8g2);
+    uint8_t tile_height = u8g2_GetBufferTileHeight(u8g2);
+    size_t row_size = 8 * tile_width;
+    size_t buffer_size = row_size * tile_height;
+    uint8_t * buffer = u8g2_GetBufferPtr(u8g2);
+
+    if (buffer_size > sizeof(display_shadow_buffer)) {
+        u8g2_SendBuffer(u8g2);
+        return;
+    }
+
+    if (!display_shadow_valid) {
+        u8g2_SendBuffer(u8g2);
+        memcpy(display_shadow_buffer, buffer, buffer_size);
+        display_shadow_valid = true;
+        event_stream_notify(EVENT_STREAM_TOPIC_DISPLAY);
+        return;
+    }
+
+    bool changed = false;
+
+    for (uint8_t ty = 0; ty < tile_height; ty += 1) {
+        uint8_t * row = buffer + ty * row_size;
+        uint8_t * shadow_row = display_shadow_buffer + ty * row_size;
+
+        int first_tile = -1;
+        int last_tile = -1;
+        for (uint8_t tx = 0; tx < tile_width; tx += 1) {
+            if (memcmp(row + tx * 8, shadow_row + tx * 8, 8) != 0) {
+                if (first_tile < 0) {
+                    first_tile = tx;
+                }
+                last_tile = tx;
+            }
+        }
+
+        if (first_tile < 0) {
+            continue;
+        }
+
+        u8g2_UpdateDisplayArea(u8g2, first_tile, ty, last_tile - first_tile + 1, 1);
+        memcpy(shadow_row + first_tile * 8, row + first_tile * 8, (last_tile - first_tile + 1) * 8);
+        changed = true;
+    }
+
+    if (changed) {
+        event_stream_notify(EVENT_STREAM_TOPIC_DISPLAY);
+    }
+}
+
+
+/*
+    PackBits style run length coding. A control byte below 0x80 is followed by (control + 1) literal bytes, otherwise
+    the next byte is repeated (control - 125) times, i.e. 3 to 130. Mostly blank tiles shrink to a few bytes.
+*/
+static size_t _run_length_encode(uint8_t * output, const uint8_t * data, size_t len) {
+    size_t output_len = 0;
+    size_t idx = 0;
+
+    while (idx < len) {
+        size_t run = 1;
+        while (idx + run < len && run < 130 && data[idx + run] == data[idx]) {
+            run += 1;
+        }
+
+        if (run >= 3) {
+            output[output_len++] = (uint8_t) (run + 125);
+            output[output_len++] = data[idx];
+            idx += run;
+            continue;
+        }
+
+        // Literals until the next run worth coding
+        size_t literal_start = idx;
+        size_t literal_len = 0;
+        while (idx < len && literal_len < 128) {
+            if (idx + 2 < len && data[idx] == data[idx + 1] && data[idx] == data[idx + 2]) {
+                break;
+            }
+            idx += 1;
+            literal_len += 1;
+        }
+
+        output[output_len++] = (uint8_t) (literal_len - 1);
+        memcpy(output + output_len, data + literal_start, literal_len);
+        output_len += literal_len;
+    }
+
+    return output_len;
+}
+
+
+/*
+    Producer of the display mirror stream (event_stream.h), one "tiles" event per flushed frame. The data line is the
+    base64 of:
+
+        [tile width] [tile height] [flags, bit 0: full frame]
+        then per span: [tile row] [first tile] [tile count] [run length encoded tile bytes (tile count * 8)]
+
+    A change event holds one span per tile row covering its first to last tile that differs from the previous event,
+    a full event holds every tile row. The panel shadow buffer is read without a lock; a tile caught mid update is
+    simply different from what the panel ends up with and goes out again with the next event.
+*/
+static size_t display_stream_produce(char * buffer, size_t buffer_size, bool full) {
+    uint8_t tile_width = u8g2_GetBufferTileWidth(&display_handler);
+    uint8_t tile_height = u8g2_GetBufferTileHeight(&display_handler);
+    size_t row_size = 8 * tile_width;
+
+    if (row_size * tile_height > sizeof(display_stream_shadow) || (!full && !display_shadow_valid)) {
+        return 0;
+    }
+
+    size_t packet_len = 0;
+    display_stream_packet[packet_len++] = tile_width;
+    display_stream_packet[packet_len++] = tile_height;
+    display_stream_packet[packet_len++] = full ? 0x01 : 0x00;
+
+    for (uint8_t ty = 0; ty < tile_height; ty += 1) {
+        uint8_t * row = display_shadow_buffer + ty * row_size;
+        uint8_t * stream_row = display_stream_shadow + ty * row_size;
+
+        int first_tile = 0;
+        int last_tile = tile_width - 1;
+        if (!full) {
+            first_tile = -1;
+            for (uint8_t tx = 0; tx < tile_width; tx += 1) {
+                if (memcmp(row + tx * 8, stream_row + tx * 8, 8) != 0) {
+                    if (first_tile < 0) {
+                        first_tile = tx;
+                    }
+                    last_tile = tx;
+                }
+            }
+
+            if (first_tile < 0) {
+                continue;
+            }
+
+            memcpy(stream_row + first_tile * 8, row + first_tile * 8, (last_tile - first_tile + 1) * 8);
+        }
+
+        uint8_t tile_count = last_tile - first_tile + 1;
+        display_stream_packet[packet_len++] = ty;
+        display_stream_packet[packet_len++] = first_tile;
+        display_stream_packet[packet_len++] = tile_count;
+        packet_len += _run_length_encode(display_stream_packet + packet_len, stream_row + first_tile * 8, tile_count * 8);
+    }
+
+    // Nothing changed
+    if (packet_len == 3 && !full) {
+        return 0;
+    }
+
+    const char * event_prefix = "event: tiles\ndata: ";
+    size_t len = strlen(event_prefix);
+    if (buffer_size < len + 3) {
+        return 0;
+    }
+    memcpy(buffer, event_prefix, len);
+
+    size_t encoded_len = base64_encode(buffer + len, buffer_size - len - 2, display_stream_packet, packet_len);
+    if (encoded_len == 0) {
+        return 0;
+    }
+    len += encoded_len;
+    buffer[len++] = '\n';
+    buffer[len++] = '\n';
+
+    return len;
+}
+
 void acquire_display_buffer_access() {
     if (!display_buffer_access_mutex) {
-        display_buffer_access_mutex = xSemaphoreCreateMutex();
+        display_buffer_access_mutex = STATIC_SEMAPHORE_CREATE_MUTEX();
     }
 
     assert(display_buffer_access_mutex);
@@ -34,6 +244,90 @@ void release_display_buffer_access() {
 }
 
 
+/*
+    The compositor task draws the active scene (one per mode, e.g. charge mode) into the frame buffer and sends the
+    changes to the panel. It renders when asked to (display_request_render), on every new scale measurement and 
+    when the scene asks for its next frame, but never faster than the configured max frame rate. Without a scene the 
+    display belongs to the menu task.
+*/
+static void display_compositor_task(void * p) {
+    TickType_t last_frame_tick = xTaskGetTickCount();
+    TickType_t timeout_ticks = portMAX_DELAY;
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, timeout_ticks);
+
+        // A new scene is drawn straight away, otherwise hold off until one frame interval after the previous frame
+        if (!display_scene_changed) {
+            uint8_t max_frame_rate_hz = mini_12864_module_config.max_frame_rate_hz ? mini_12864_module_config.max_frame_rate_hz : 1;
+            TickType_t frame_ticks = pdMS_TO_TICKS(1000 / max_frame_rate_hz);
+            TickType_t since_last_frame = xTaskGetTickCount() - last_frame_tick;
+            if (since_last_frame < frame_ticks) {
+                vTaskDelay(frame_ticks - since_last_frame);
+            }
+            ulTaskNotifyTake(pdTRUE, 0);
+        }
+        last_frame_tick = xTaskGetTickCount();
+
+        acquire_display_buffer_access();
+        display_scene_changed = false;
+
+        if (display_scene) {
+            u8g2_ClearBuffer(&display_handler);
+            timeout_ticks = display_scene(&display_handler);
+            display_update(&display_handler);
+        }
+        else {
+            timeout_ticks = portMAX_DELAY;
+        }
+
+        release_display_buffer_access();
+    }
+}
+
+
+void display_compositor_init(void) {
+    if (display_compositor_task_handler) {
+        return;
+    }
+
+    // Created up front, the compositor and display_set_scene run on different cores
+    if (!display_buffer_access_mutex) {
+        display_buffer_access_mutex = STATIC_SEMAPHORE_CREATE_MUTEX();
+    }
+
+    STATIC_TASK_CREATE(display_compositor_task, "Display Compositor", configMINIMAL_STACK_SIZE * 2, NULL, 
+                       DISPLAY_COMPOSITOR_PRIORITY, &display_compositor_task_handler);
+
+    // Scenes showing the weight are redrawn on every measurement
+    scale_register_measurement_listener(display_compositor_task_handler);
+
+    // Display mirror
+    event_stream_register_topic(EVENT_STREAM_TOPIC_DISPLAY, "/display", display_stream_produce);
+}
+
+
+/*
+    Hands the display to a scene, or back to the menu task with NULL. Once this returns the previous scene is no 
+    longer drawn.
+*/
+void display_set_scene(display_scene_render_t scene) {
+    acquire_display_buffer_access();
+    display_scene = scene;
+    display_scene_changed = true;
+    release_display_buffer_access();
+
+    display_request_render();
+}
+
+
+void display_request_render(void) {
+    if (display_compositor_task_handler) {
+        xTaskNotifyGive(display_compositor_task_handler);
+    }
+}
+
+
 /* u8g2 buffer structure can be decoded according to the description here: 
     https://github.com/olikraus/u8g2/wiki/u8g2reference#memory-structure-for-controller-with-u8x8-support
 
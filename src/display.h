@@ -2,6 +2,7 @@
 #define DISPLAY_H_
 
 #include <u8g2.h>
+#include <FreeRTOS.h>
 #include "http_rest.h"
 
 #ifdef __cplusplus
@@ -9,6 +10,17 @@ extern "C" {
 #endif
 
 u8g2_t *get_display_handler(void);
+void display_update(u8g2_t * u8g2);
+void display_invalidate(void);
+
+// Compositor
+// A scene draws a full frame into the (cleared) buffer and returns the ticks until it needs the next frame, or 
+// portMAX_DELAY to be redrawn only on display_request_render and new scale measurements.
+typedef TickType_t (*display_scene_render_t)(u8g2_t * u8g2);
+
+void display_compositor_init(void);
+void display_set_scene(display_scene_render_t scene);
+void display_request_render(void);
 
 // REST
 bool http_get_display_buffer(struct fs_file *file, int num_params, char *params[], char *values[]);
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "pico/platform.h"
 #include "hardware/regs/rosc.h"
 #include "hardware/regs/addressmap.h"
 
@@ -14,12 +15,14 @@
 #include "motors.h"
 #include "charge_mode.h"
 #include "common.h"
+#include "crc32.h"
 #include "wireless.h"
 #include "app.h"
 #include "neopixel_led.h"
 #include "mini_12864_module.h"
 #include "profile.h"
 #include "system_control.h"
+#include "static_alloc.h"
 
 
 extern bool cat24c256_eeprom_erase();
@@ -27,17 +30,44 @@ extern void cat24c256_eeprom_init();
 extern bool cat24c256_write(uint16_t data_addr, uint8_t * data, size_t len);
 extern bool cat24c256_read(uint16_t data_addr, uint8_t * data, size_t len);
 
+#define EEPROM_PAGE_SIZE                64
+#define EEPROM_REGION_MAX_PAGES         32      // Limit of the dirty page mask, larger regions are written through
+#define EEPROM_FLUSH_DELAY_MS           200     // Saves within this window are written together
+#define EEPROM_FLUSH_RETRY_MS           1000
+#define EEPROM_FLUSH_TASK_PRIORITY      1
+#define EEPROM_MAX_REGIONS              16      // STATIC_ALLOCATION pools
+#define EEPROM_SHADOW_POOL_SIZE         (4 * 1024)
+#define EEPROM_MAX_SAVE_HANDLERS        16
+
 // Linked list implementation
 typedef struct _eeprom_save_handler_node {
     eeprom_save_handler_t function_handler;
     struct _eeprom_save_handler_node * next;
 } _eeprom_save_handler_node_t;
 
+/*
+    Write-behind cache. Each config region (the addr and size load_config / save_config use) has a RAM shadow of its
+    content in the EEPROM. A write only updates the shadow and marks the EEPROM pages that changed, the flush task
+    then writes those pages in the background. Saving a config that changed one field costs one page write, done 
+    outside the task that saved it.
+*/
+typedef struct _eeprom_region {
+    uint16_t addr;
+    uint16_t size;
+    uint32_t dirty_pages;               // Bit n: EEPROM page (addr / EEPROM_PAGE_SIZE + n) differs from the shadow
+    uint8_t * shadow;
+    struct _eeprom_region * next;
+} _eeprom_region_t;
+
 // Singleton variables
-SemaphoreHandle_t eeprom_access_mutex = NULL;
+SemaphoreHandle_t eeprom_access_mutex = NULL;      // EEPROM (I2C) access, held for a whole flush pass
 eeprom_metadata_t metadata;
 static _eeprom_save_handler_node_t * eeprom_save_handler_head = NULL;
 
+static SemaphoreHandle_t eeprom_cache_mutex = NULL; // Region list, shadows and dirty pages
+static _eeprom_region_t * eeprom_region_head = NULL;
+static TaskHandle_t eeprom_flush_task_handler = NULL;
+
 
 uint32_t rnd(void){
     int k, random=0;
@@ -53,13 +83,181 @@ uint32_t rnd(void){
 }
 
 
+static inline void _take_mutex(BaseType_t scheduler_state) {
+    if (scheduler_state != taskSCHEDULER_NOT_STARTED){
+        xSemaphoreTake(eeprom_access_mutex, portMAX_DELAY);
+    }
+}
+
+static inline void _give_mutex(BaseType_t scheduler_state) {
+    if (scheduler_state != taskSCHEDULER_NOT_STARTED){
+        xSemaphoreGive(eeprom_access_mutex);
+    }
+}
+
+static inline void _take_cache_mutex(BaseType_t scheduler_state) {
+    if (scheduler_state != taskSCHEDULER_NOT_STARTED){
+        xSemaphoreTake(eeprom_cache_mutex, portMAX_DELAY);
+    }
+}
+
+static inline void _give_cache_mutex(BaseType_t scheduler_state) {
+    if (scheduler_state != taskSCHEDULER_NOT_STARTED){
+        xSemaphoreGive(eeprom_cache_mutex);
+    }
+}
+
+
+static _eeprom_region_t * _find_region(uint16_t addr) {
+    for (_eeprom_region_t * region = eeprom_region_head; region != NULL; region = region->next) {
+        if (region->addr == addr) {
+            return region;
+        }
+    }
+
+    return NULL;
+}
+
+
+static _eeprom_region_t * _add_region(uint16_t addr, size_t size) {
+    uint16_t page_count = (addr + size - 1) / EEPROM_PAGE_SIZE - addr / EEPROM_PAGE_SIZE + 1;
+    if (size == 0 || page_count > EEPROM_REGION_MAX_PAGES) {
+        return NULL;
+    }
+
+#if STATIC_ALLOCATION
+    // Out of pool the region is written through
+    static _eeprom_region_t region_pool[EEPROM_MAX_REGIONS];
+    static uint8_t shadow_pool[EEPROM_SHADOW_POOL_SIZE];
+    static uint8_t region_cnt = 0;
+    static size_t shadow_used = 0;
+
+    if (region_cnt >= EEPROM_MAX_REGIONS || size > EEPROM_SHADOW_POOL_SIZE - shadow_used) {
+        return NULL;
+    }
+    _eeprom_region_t * region = &region_pool[region_cnt++];
+    uint8_t * shadow = &shadow_pool[shadow_used];
+    shadow_used += size;
+#else
+    _eeprom_region_t * region = malloc(sizeof(_eeprom_region_t));
+    uint8_t * shadow = malloc(size);
+    if (region == NULL || shadow == NULL) {
+        free(region);
+        free(shadow);
+        return NULL;
+    }
+#endif
+
+    region->addr = addr;
+    region->size = size;
+    region->dirty_pages = 0;
+    region->shadow = shadow;
+    region->next = eeprom_region_head;
+    eeprom_region_head = region;
+
+    return region;
+}
+
+
+/*
+    Write the dirty pages. Only the bytes of the region within each page are written, the EEPROM keeps the rest of
+    the page. Holding eeprom_access_mutex for the whole pass, eeprom_flush returns only once a pass running in the 
+    flush task is done as well. Returns false if a page couldn't be written, it stays dirty.
+*/
+static bool _flush_dirty_pages(BaseType_t scheduler_state) {
+    uint8_t page_buffer[EEPROM_PAGE_SIZE];
+    bool is_ok = true;
+
+    _take_mutex(scheduler_state);
+
+    _take_cache_mutex(scheduler_state);
+    _eeprom_region_t * region = eeprom_region_head;
+    _give_cache_mutex(scheduler_state);
+
+    // Regions are only ever added at the head and never removed, the list can be walked without the lock
+    for (; region != NULL && is_ok; region = region->next) {
+        uint16_t first_page = region->addr / EEPROM_PAGE_SIZE;
+
+        for (uint8_t page = 0; page < EEPROM_REGION_MAX_PAGES; page += 1) {
+            _take_cache_mutex(scheduler_state);
+            if ((region->dirty_pages & (1u << page)) == 0) {
+                _give_cache_mutex(scheduler_state);
+                continue;
+            }
+
+            uint16_t page_start = MAX((first_page + page) * EEPROM_PAGE_SIZE, region->addr);
+            uint16_t page_end = MIN((first_page + page + 1) * EEPROM_PAGE_SIZE, region->addr + region->size);
+            memcpy(page_buffer, region->shadow + (page_start - region->addr), page_end - page_start);
+
+            // Cleared first, a write to the page from now on marks it again
+            region->dirty_pages &= ~(1u << page);
+            _give_cache_mutex(scheduler_state);
+
+            if (!cat24c256_write(page_start, page_buffer, page_end - page_start)) {
+                _take_cache_mutex(scheduler_state);
+                region->dirty_pages |= 1u << page;
+                _give_cache_mutex(scheduler_state);
+
+                printf("Unable to flush EEPROM page at: 0x%04x\n", page_start);
+                is_ok = false;
+                break;
+            }
+        }
+    }
+
+    _give_mutex(scheduler_state);
+
+    return is_ok;
+}
+
+
+static void eeprom_flush_task(void * p) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Let a burst of saves (e.g. eeprom_save_all) land in the shadows first
+        vTaskDelay(pdMS_TO_TICKS(EEPROM_FLUSH_DELAY_MS));
+
+        while (!_flush_dirty_pages(taskSCHEDULER_RUNNING)) {
+            vTaskDelay(pdMS_TO_TICKS(EEPROM_FLUSH_RETRY_MS));
+        }
+    }
+}
+
+
+bool eeprom_flush(void) {
+    return _flush_dirty_pages(xTaskGetSchedulerState());
+}
+
+
+size_t eeprom_region_size(uint16_t data_addr) {
+    BaseType_t scheduler_state = xTaskGetSchedulerState();
+
+    _take_cache_mutex(scheduler_state);
+    _eeprom_region_t * region = _find_region(data_addr);
+    size_t size = region ? region->size : 0;
+    _give_cache_mutex(scheduler_state);
+
+    return size;
+}
+
+
 void eeprom_register_handler(eeprom_save_handler_t handler) {
+    // Append to the head, the boot stages register side by side
+    taskENTER_CRITICAL();
+#if STATIC_ALLOCATION
+    static _eeprom_save_handler_node_t node_pool[EEPROM_MAX_SAVE_HANDLERS];
+    static uint8_t node_cnt = 0;
+
+    configASSERT(node_cnt < EEPROM_MAX_SAVE_HANDLERS);
+    _eeprom_save_handler_node_t * new_node = &node_pool[node_cnt++];
+#else
     _eeprom_save_handler_node_t * new_node = malloc(sizeof(_eeprom_save_handler_node_t));
+#endif
     new_node->function_handler = handler;
-
-    // Append to the head
     new_node->next = eeprom_save_handler_head;
     eeprom_save_handler_head = new_node;
+    taskEXIT_CRITICAL();
 }
 
 
@@ -74,7 +272,19 @@ uint8_t eeprom_save_all() {
 
 
 uint8_t eeprom_erase(bool reboot) {
+    BaseType_t scheduler_state = xTaskGetSchedulerState();
+
+    // Pending writes are dropped, the shadows follow the erased EEPROM
+    _take_mutex(scheduler_state);
+    _take_cache_mutex(scheduler_state);
+    for (_eeprom_region_t * region = eeprom_region_head; region != NULL; region = region->next) {
+        memset(region->shadow, 0xff, region->size);
+        region->dirty_pages = 0;
+    }
+    _give_cache_mutex(scheduler_state);
+
     cat24c256_eeprom_erase();
+    _give_mutex(scheduler_state);
 
     if (reboot) {
         software_reboot();
@@ -86,12 +296,17 @@ uint8_t eeprom_erase(bool reboot) {
 
 bool eeprom_init(void) {
     bool is_ok = true;
-    eeprom_access_mutex = xSemaphoreCreateMutex();
+    eeprom_access_mutex = STATIC_SEMAPHORE_CREATE_MUTEX();
+    eeprom_cache_mutex = STATIC_SEMAPHORE_CREATE_MUTEX();
 
-    if (eeprom_access_mutex == NULL) {
+    if (eeprom_access_mutex == NULL || eeprom_cache_mutex == NULL) {
         printf("Unable to create EEPROM mutex\n");
         return false;
     }
+
+    // Writes the pages the config saves leave dirty
+    STATIC_TASK_CREATE(eeprom_flush_task, "EEPROM Flush", configMINIMAL_STACK_SIZE, NULL, EEPROM_FLUSH_TASK_PRIORITY, 
+                       &eeprom_flush_task_handler);
     
     cat24c256_eeprom_init();
 
@@ -125,27 +340,87 @@ bool eeprom_config_save() {
 }
 
 
-static inline void _take_mutex(BaseType_t scheduler_state) {
-    if (scheduler_state != taskSCHEDULER_NOT_STARTED){
-        xSemaphoreTake(eeprom_access_mutex, portMAX_DELAY);
+// Reads from the EEPROM a page at a time, the CRC of a page runs on the DMA while the next one is read
+static bool _read_with_crc(uint16_t data_addr, uint8_t * data, size_t len, crc32_stream_t * stream, size_t crc_len) {
+    for (size_t offset = 0; offset < len; ) {
+        size_t chunk = MIN(len - offset, EEPROM_PAGE_SIZE - (data_addr + offset) % EEPROM_PAGE_SIZE);
+
+        if (!cat24c256_read(data_addr + offset, data + offset, chunk)) {
+            return false;
+        }
+
+        if (offset < crc_len) {
+            crc32_stream_update(stream, data + offset, MIN(chunk, crc_len - offset));
+        }
+
+        offset += chunk;
     }
+
+    return true;
 }
 
-static inline void _give_mutex(BaseType_t scheduler_state) {
-    if (scheduler_state != taskSCHEDULER_NOT_STARTED){
-        xSemaphoreGive(eeprom_access_mutex);
+
+static bool _eeprom_read(uint16_t data_addr, uint8_t * data, size_t len, crc32_stream_t * stream, size_t crc_len) {
+    BaseType_t scheduler_state = xTaskGetSchedulerState();
+    bool is_ok = true;
+
+    // The shadow is what the EEPROM holds once flushed
+    _take_cache_mutex(scheduler_state);
+    _eeprom_region_t * region = _find_region(data_addr);
+    if (region && region->size == len) {
+        memcpy(data, region->shadow, len);
+        _give_cache_mutex(scheduler_state);
+
+        if (stream) {
+            crc32_stream_update(stream, data, crc_len);
+        }
+        return true;
     }
+    _give_cache_mutex(scheduler_state);
+
+    // Pending pages of a region read with another size would be missed
+    if (region) {
+        eeprom_flush();
+    }
+
+    _take_mutex(scheduler_state);
+    if (stream) {
+        is_ok = _read_with_crc(data_addr, data, len, stream, crc_len);
+    }
+    else {
+        is_ok = cat24c256_read(data_addr, data, len);
+    }
+    _give_mutex(scheduler_state);
+
+    // The first read of a region is its shadow, the following saves only write the pages that differ from it
+    if (is_ok && region == NULL) {
+        _take_cache_mutex(scheduler_state);
+        region = _add_region(data_addr, len);
+        if (region) {
+            memcpy(region->shadow, data, len);
+        }
+        _give_cache_mutex(scheduler_state);
+    }
+
+    return is_ok;
 }
 
+
 bool eeprom_read(uint16_t data_addr, uint8_t * data, size_t len) {
-    BaseType_t scheduler_state = xTaskGetSchedulerState();
-    bool is_ok;
+    return _eeprom_read(data_addr, data, len, NULL, 0);
+}
 
-    _take_mutex(scheduler_state);
 
-    is_ok = cat24c256_read(data_addr, data, len);
+bool eeprom_read_crc32(uint16_t data_addr, uint8_t * data, size_t len, size_t crc_len, uint32_t * crc) {
+    crc32_stream_t stream;
 
-    _give_mutex(scheduler_state);
+    if (crc_len > len) {
+        return false;
+    }
+
+    crc32_stream_start(&stream);
+    bool is_ok = _eeprom_read(data_addr, data, len, &stream, crc_len);
+    *crc = crc32_stream_finish(&stream);
 
     return is_ok;
 }
@@ -153,14 +428,59 @@ bool eeprom_read(uint16_t data_addr, uint8_t * data, size_t len) {
 
 bool eeprom_write(uint16_t data_addr, uint8_t * data, size_t len) {
     BaseType_t scheduler_state = xTaskGetSchedulerState();
-    bool is_ok;
+    bool is_ok = true;
 
-    _take_mutex(scheduler_state);
+    _take_cache_mutex(scheduler_state);
+    _eeprom_region_t * region = _find_region(data_addr);
+    bool known_content = region != NULL;
+    if (region == NULL) {
+        region = _add_region(data_addr, len);
+    }
 
-    is_ok = cat24c256_write(data_addr, data, len);
+    if (region && region->size == len) {
+        uint16_t first_page = data_addr / EEPROM_PAGE_SIZE;
+
+        for (size_t offset = 0; offset < len; ) {
+            uint16_t page = (data_addr + offset) / EEPROM_PAGE_SIZE - first_page;
+            size_t chunk = MIN(len - offset, (first_page + page + 1) * EEPROM_PAGE_SIZE - (data_addr + offset));
+
+            if (!known_content || memcmp(region->shadow + offset, data + offset, chunk) != 0) {
+                memcpy(region->shadow + offset, data + offset, chunk);
+                region->dirty_pages |= 1u << page;
+            }
+            offset += chunk;
+        }
+        bool is_dirty = region->dirty_pages != 0;
+        _give_cache_mutex(scheduler_state);
+
+        // Before the scheduler runs (defaults written by load_config at start up) there is no flush task yet
+        if (scheduler_state == taskSCHEDULER_NOT_STARTED) {
+            is_ok = eeprom_flush();
+        }
+        else if (is_dirty && eeprom_flush_task_handler) {
+            xTaskNotifyGive(eeprom_flush_task_handler);
+        }
+
+        return is_ok;
+    }
+    _give_cache_mutex(scheduler_state);
+
+    // Not cached (out of memory, larger than EEPROM_REGION_MAX_PAGES or a region written with another size)
+    if (region) {
+        eeprom_flush();
+    }
 
+    _take_mutex(scheduler_state);
+    is_ok = cat24c256_write(data_addr, data, len);
     _give_mutex(scheduler_state);
 
+    // Keep a shadow of another size in line with the EEPROM
+    if (is_ok && region) {
+        _take_cache_mutex(scheduler_state);
+        memcpy(region->shadow, data, MIN(len, region->size));
+        _give_cache_mutex(scheduler_state);
+    }
+
     return is_ok;
 }
 
@@ -16,6 +16,7 @@
 #define EEPROM_MINI_12864_CONFIG_BASE_ADDR      8 * 1024       // 8k 
 #define EEPROM_PROFILE_DATA_BASE_ADDR           9 * 1024       // 9k
 #define EEPROM_SERVO_GATE_CONFIG_BASE_ADDR     10 * 1024       // 10k
+#define EEPROM_CHARGE_PIPELINE_BASE_ADDR       11 * 1024       // 11k
 
 #define EEPROM_METADATA_REV                     2              // 16 byte 
 
@@ -36,8 +37,28 @@ extern "C" {
 bool eeprom_init(void);
 bool eeprom_config_save();
 bool eeprom_read(uint16_t data_addr, uint8_t * data, size_t len);
+
+/*
+ * eeprom_read that also returns the CRC-32 of the first crc_len bytes, computed while the rest is still being read.
+ */
+bool eeprom_read_crc32(uint16_t data_addr, uint8_t * data, size_t len, size_t crc_len, uint32_t * crc);
+
+/*
+ * Write-behind: updates the RAM shadow of the region and returns, the changed pages are written by the flush task.
+ * Reads of the region see the new content right away.
+ */
 bool eeprom_write(uint16_t data_addr, uint8_t * data, size_t len);
 
+/*
+ * Writes the pending pages now, returns once they are in the EEPROM (e.g. before a reboot).
+ */
+bool eeprom_flush(void);
+
+/*
+ * Size of the config stored at data_addr (the config and its CRC) as last read or written, 0 if it wasn't accessed.
+ */
+size_t eeprom_region_size(uint16_t data_addr);
+
 bool eeprom_get_board_id(char *board_id_buffer, size_t bytes_to_copy);
 
 /*
@@ -0,0 +1,317 @@
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <pico/cyw43_arch.h>
+#include "lwip/tcp.h"
+
+#include "event_stream.h"
+#include "static_alloc.h"
+
+
+/*
+    Server-sent events (text/event-stream) for clients that would otherwise poll a REST endpoint.
+
+    The lwIP httpd serves every response from one buffer and closes the request, so it cannot keep a stream open.
+    This is a small listener on its own port instead: a client sends "GET /<topic path>", gets the event stream
+    headers and a full event, then one event whenever the topic producer reports a change. Each subscriber holds a
+    single TCP PCB for as long as it watches, rather than one per poll plus the ones waiting in TIME_WAIT.
+
+    The lwIP callbacks run in the lwIP context, the producers run in the stream task and everything touching a PCB
+    or the client table is done under the lwIP lock.
+*/
+
+#define EVENT_STREAM_MAX_CLIENTS        4
+#define EVENT_STREAM_REQUEST_SIZE       64      // Only the request line is looked at
+#define EVENT_STREAM_BUFFER_SIZE        1536
+#define EVENT_STREAM_MIN_PERIOD_MS      50      // Changes within this window are merged into one event
+#define EVENT_STREAM_KEEPALIVE_MS       15000
+#define EVENT_STREAM_TASK_PRIORITY      2
+
+
+typedef struct {
+    struct tcp_pcb * pcb;                       // NULL if the slot is free
+    int8_t topic;                               // -1 until the request line is received
+    bool needs_full;                            // Shall receive a full event before the next change
+    uint8_t request_len;
+    char request[EVENT_STREAM_REQUEST_SIZE];
+} event_stream_client_t;
+
+typedef struct {
+    const char * path;
+    event_stream_producer_t producer;
+} event_stream_topic_entry_t;
+
+
+static const char event_stream_http_header[] = "HTTP/1.1 200 OK\r\n"
+                                               "Content-Type: text/event-stream\r\n"
+                                               "Cache-Control: no-cache\r\n"
+                                               "Access-Control-Allow-Origin: *\r\n"
+                                               "Connection: keep-alive\r\n\r\n";
+static const char event_stream_http_not_found[] = "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n";
+static const char event_stream_keepalive[] = ": keepalive\n\n";
+
+static event_stream_topic_entry_t event_stream_topics[EVENT_STREAM_TOPIC_CNT];
+static event_stream_client_t event_stream_clients[EVENT_STREAM_MAX_CLIENTS];
+static char event_stream_buffer[EVENT_STREAM_BUFFER_SIZE];
+static TaskHandle_t event_stream_task_handler = NULL;
+
+
+static err_t _client_close(event_stream_client_t * client) {
+    err_t err = ERR_OK;
+    struct tcp_pcb * pcb = client->pcb;
+
+    client->pcb = NULL;
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_err(pcb, NULL);
+
+    if (tcp_close(pcb) != ERR_OK) {
+        tcp_abort(pcb);
+        err = ERR_ABRT;
+    }
+
+    return err;
+}
+
+
+// Queue the whole event or nothing, a partial event would corrupt the stream
+static bool _client_send(event_stream_client_t * client, const char * data, size_t len) {
+    if (tcp_sndbuf(client->pcb) < len) {
+        return false;
+    }
+
+    if (tcp_write(client->pcb, data, len, TCP_WRITE_FLAG_COPY) != ERR_OK) {
+        return false;
+    }
+
+    tcp_output(client->pcb);
+    return true;
+}
+
+
+static int8_t _find_topic(const char * request) {
+    // Request line: GET <path>[?query] HTTP/1.1
+    if (strncmp(request, "GET ", 4) != 0) {
+        return -1;
+    }
+
+    const char * path = request + 4;
+    size_t path_len = strcspn(path, " ?\r\n");
+
+    for (int8_t topic = 0; topic < EVENT_STREAM_TOPIC_CNT; topic += 1) {
+        const char * topic_path = event_stream_topics[topic].path;
+        if (topic_path && strlen(topic_path) == path_len && strncmp(path, topic_path, path_len) == 0) {
+            return topic;
+        }
+    }
+
+    return -1;
+}
+
+
+static void _client_err(void * arg, err_t err) {
+    event_stream_client_t * client = (event_stream_client_t *) arg;
+
+    // The PCB is already freed by lwIP
+    if (client) {
+        client->pcb = NULL;
+    }
+}
+
+
+static err_t _client_recv(void * arg, struct tcp_pcb * pcb, struct pbuf * p, err_t err) {
+    event_stream_client_t * client = (event_stream_client_t *) arg;
+
+    // Closed by the remote
+    if (p == NULL) {
+        return _client_close(client);
+    }
+
+    tcp_recved(pcb, p->tot_len);
+
+    // Anything after the request line (headers, further data) is ignored
+    if (client->topic < 0) {
+        size_t free_space = sizeof(client->request) - 1 - client->request_len;
+        client->request_len += pbuf_copy_partial(p, client->request + client->request_len, free_space, 0);
+        client->request[client->request_len] = '\0';
+    }
+    pbuf_free(p);
+
+    if (client->topic >= 0 || strstr(client->request, "\r\n") == NULL) {
+        // Drop a client that never completes its request line
+        if (client->topic < 0 && client->request_len >= sizeof(client->request) - 1) {
+            return _client_close(client);
+        }
+        return ERR_OK;
+    }
+
+    int8_t topic = _find_topic(client->request);
+    if (topic < 0) {
+        _client_send(client, event_stream_http_not_found, strlen(event_stream_http_not_found));
+        return _client_close(client);
+    }
+
+    if (!_client_send(client, event_stream_http_header, strlen(event_stream_http_header))) {
+        return _client_close(client);
+    }
+
+    client->topic = topic;
+    client->needs_full = true;
+    event_stream_notify((event_stream_topic_t) topic);
+
+    return ERR_OK;
+}
+
+
+static err_t _accept(void * arg, struct tcp_pcb * pcb, err_t err) {
+    if (err != ERR_OK || pcb == NULL) {
+        return ERR_VAL;
+    }
+
+    for (uint8_t idx = 0; idx < EVENT_STREAM_MAX_CLIENTS; idx += 1) {
+        event_stream_client_t * client = &event_stream_clients[idx];
+
+        if (client->pcb == NULL) {
+            memset(client, 0x0, sizeof(event_stream_client_t));
+            client->pcb = pcb;
+            client->topic = -1;
+
+            tcp_arg(pcb, client);
+            tcp_recv(pcb, _client_recv);
+            tcp_err(pcb, _client_err);
+
+            return ERR_OK;
+        }
+    }
+
+    // No free slot
+    tcp_abort(pcb);
+    return ERR_ABRT;
+}
+
+
+static bool _topic_needs_full(event_stream_topic_t topic) {
+    bool needs_full = false;
+
+    cyw43_arch_lwip_begin();
+    for (uint8_t idx = 0; idx < EVENT_STREAM_MAX_CLIENTS; idx += 1) {
+        event_stream_client_t * client = &event_stream_clients[idx];
+        if (client->pcb && client->topic == topic && client->needs_full) {
+            needs_full = true;
+        }
+    }
+    cyw43_arch_lwip_end();
+
+    return needs_full;
+}
+
+
+// Send to the subscribers of the topic that are (full) or aren't (changes) waiting for a full event
+static void _broadcast(event_stream_topic_t topic, const char * data, size_t len, bool full) {
+    cyw43_arch_lwip_begin();
+    for (uint8_t idx = 0; idx < EVENT_STREAM_MAX_CLIENTS; idx += 1) {
+        event_stream_client_t * client = &event_stream_clients[idx];
+        if (client->pcb == NULL || client->topic != topic || client->needs_full != full) {
+            continue;
+        }
+
+        // A client that missed a change is brought back in line with a full event
+        client->needs_full = !_client_send(client, data, len);
+    }
+    cyw43_arch_lwip_end();
+}
+
+
+static void event_stream_task(void * p) {
+    TickType_t last_keepalive_tick = xTaskGetTickCount();
+
+    while (true) {
+        uint32_t changed_topics = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &changed_topics, pdMS_TO_TICKS(EVENT_STREAM_KEEPALIVE_MS));
+
+        for (uint8_t topic = 0; topic < EVENT_STREAM_TOPIC_CNT; topic += 1) {
+            event_stream_producer_t producer = event_stream_topics[topic].producer;
+            if (producer == NULL) {
+                continue;
+            }
+
+            // Changes first, so the full event for new subscribers describes the same state the others now have
+            if (changed_topics & (1u << topic)) {
+                size_t len = producer(event_stream_buffer, sizeof(event_stream_buffer), false);
+                if (len) {
+                    _broadcast(topic, event_stream_buffer, len, false);
+                }
+            }
+
+            if (_topic_needs_full(topic)) {
+                size_t len = producer(event_stream_buffer, sizeof(event_stream_buffer), true);
+                if (len) {
+                    _broadcast(topic, event_stream_buffer, len, true);
+                }
+            }
+        }
+
+        // Comment lines keep idle streams from being timed out by proxies and browsers
+        if (xTaskGetTickCount() - last_keepalive_tick >= pdMS_TO_TICKS(EVENT_STREAM_KEEPALIVE_MS)) {
+            last_keepalive_tick = xTaskGetTickCount();
+
+            cyw43_arch_lwip_begin();
+            for (uint8_t idx = 0; idx < EVENT_STREAM_MAX_CLIENTS; idx += 1) {
+                event_stream_client_t * client = &event_stream_clients[idx];
+                if (client->pcb && client->topic >= 0) {
+                    _client_send(client, event_stream_keepalive, strlen(event_stream_keepalive));
+                }
+            }
+            cyw43_arch_lwip_end();
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(EVENT_STREAM_MIN_PERIOD_MS));
+    }
+}
+
+
+void event_stream_register_topic(event_stream_topic_t topic, const char * path, event_stream_producer_t producer) {
+    if (topic >= EVENT_STREAM_TOPIC_CNT) {
+        return;
+    }
+
+    event_stream_topics[topic].path = path;
+    event_stream_topics[topic].producer = producer;
+}
+
+
+void event_stream_init(void) {
+    if (event_stream_task_handler) {
+        return;
+    }
+
+    // The producers format floats
+    STATIC_TASK_CREATE(event_stream_task, "Event Stream", configMINIMAL_STACK_SIZE * 2, NULL, EVENT_STREAM_TASK_PRIORITY,
+                       &event_stream_task_handler);
+
+    cyw43_arch_lwip_begin();
+    struct tcp_pcb * pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if (pcb) {
+        struct tcp_pcb * listen_pcb = NULL;
+        if (tcp_bind(pcb, IP_ANY_TYPE, EVENT_STREAM_PORT) == ERR_OK) {
+            listen_pcb = tcp_listen(pcb);
+        }
+
+        if (listen_pcb) {
+            tcp_accept(listen_pcb, _accept);
+        }
+        else {
+            tcp_close(pcb);
+        }
+    }
+    cyw43_arch_lwip_end();
+}
+
+
+void event_stream_notify(event_stream_topic_t topic) {
+    if (event_stream_task_handler && topic < EVENT_STREAM_TOPIC_CNT) {
+        xTaskNotify(event_stream_task_handler, 1u << topic, eSetBits);
+    }
+}
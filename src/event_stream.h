@@ -0,0 +1,53 @@
+#ifndef EVENT_STREAM_H_
+#define EVENT_STREAM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+#define EVENT_STREAM_PORT       8080
+
+
+typedef enum {
+    EVENT_STREAM_TOPIC_DISPLAY = 0,
+    EVENT_STREAM_TOPIC_CHARGE_STATE,
+
+    EVENT_STREAM_TOPIC_CNT,
+} event_stream_topic_t;
+
+
+/**
+ * Writes the next server-sent event of a topic (including the "event:" and "data:" lines) into buffer and returns
+ * its length, 0 when there is nothing to send. Without full the event carries what changed since the previous call and
+ * the producer moves on to the new state. With full it carries the complete state as of that previous call, so a new
+ * subscriber lines up with the changes that follow.
+ */
+typedef size_t (*event_stream_producer_t)(char * buffer, size_t buffer_size, bool full);
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Binds a topic to its request path (e.g. "/display") and its producer. Requests for a topic are answered with 404
+ * until it is registered.
+ */
+void event_stream_register_topic(event_stream_topic_t topic, const char * path, event_stream_producer_t producer);
+
+/**
+ * Starts the event stream server on EVENT_STREAM_PORT. Shall be called after the network is up.
+ */
+void event_stream_init(void);
+
+/**
+ * Tells the stream task that a topic has new data. Cheap and safe to call from any task.
+ */
+void event_stream_notify(event_stream_topic_t topic);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // EVENT_STREAM_H_
@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <task.h>
+#include "pico/time.h"
 
 
 void vApplicationMallocFailedHook( void )
@@ -80,4 +81,11 @@ void vApplicationTickHook( void )
         #endif
     }
 #endif
-}
\ No newline at end of file
+}
+/*-----------------------------------------------------------*/
+
+uint64_t freertos_run_time_counter( void )
+{
+    /* Run time stats clock, 1 us resolution. */
+    return time_us_64();
+}
@@ -21,15 +21,13 @@ const static char CMD_BACKLIGHT[] = "!u\r\n";
 
 
 
-typedef union {
-    struct __attribute__((__packed__)){
-        char header[2];
-        char data[7];
-        char unit[3];
-        char terminator[2];
-    };
-    char bytes[14];
-} gngscale_standard_data_format_t;
+static const scale_frame_descriptor_t gng_frame_descriptor = {
+    .frame_size = 14,             // header[2], data[7], unit[3], terminator[2]
+    .terminator = '\n',
+    .sign_offset = 0,             // + or - in the header
+    .data_offset = 2,
+    .data_length = 7,
+};
 
 
 // Forward declaration
@@ -45,65 +43,41 @@ scale_handle_t gng_scale_handle = {
     .force_zero = scalegng_press_tare_key,
 };
 
-static float _decode_measurement_msg(gngscale_standard_data_format_t * msg) {
-    // Decode header
-    // Determine sign
-    int sign = 1;
-
-    // Check if the header contains a negative sign
-    if (msg->header[0] == '-') {
-        sign = -1;
-    }
-
-    // Decode weight information
-    char *endptr;
-    float weight = strtof(msg->data, &endptr);
-
-    if( endptr == msg->data ) {
-        // Conversion failed
-        return nanf(msg->data);
-    }
-
-    // Apply the sign
-    weight *= sign;
-
-    return weight;
-}
+/*
+    The scale only answers requests, so the next request goes out as soon as a response is in and the loop runs at 
+    the response rate of the scale (reported by /rest/scale_config s3). A response that doesn't come, e.g. a request 
+    the scale dropped while busy, is requested again after the timeout.
+*/
+#define GNG_RESPONSE_TIMEOUT_MS     100
 
 //read UART
 void _gng_scale_listener_task(void *p) {
-    uint8_t string_buf_idx = 0;
-    gngscale_standard_data_format_t frame;
+    scale_frame_decoder_t decoder = {0};
+    scale_uart_set_frame_terminator(gng_frame_descriptor.terminator);
 
     while (true) {
         // Request for a data transfer (ESC p)
-        uart_puts(SCALE_UART, CMD_REQUEST_DATA_TRANSFER);
+        scale_write(CMD_REQUEST_DATA_TRANSFER, strlen(CMD_REQUEST_DATA_TRANSFER));
 
-            // Read all data 
-        while (uart_is_readable(SCALE_UART)) {   
-            char ch = uart_getc(SCALE_UART);
-            frame.bytes[string_buf_idx++] = ch;
-
-            // If we have received 14 bytes then we can decode the message
-            if (string_buf_idx == sizeof(gngscale_standard_data_format_t)) {
-                // Data is ready, send to decode
-                scale_config.current_scale_measurement = _decode_measurement_msg(&frame);
-                // Signal the data is ready
-                if (scale_config.scale_measurement_ready) {
-                    xSemaphoreGive(scale_config.scale_measurement_ready);
-                }
+        TimeOut_t response_timeout;
+        TickType_t ticks_left = pdMS_TO_TICKS(GNG_RESPONSE_TIMEOUT_MS);
+        vTaskSetTimeOutState(&response_timeout);
 
-                // Reset
-                string_buf_idx = 0;
-            }
+        bool received = false;
+        while (!received && xTaskCheckForTimeOut(&response_timeout, &ticks_left) == pdFALSE) {
+            // Wait for the RX interrupt to receive the response
+            scale_uart_wait_for_frame(ticks_left);
 
-            // \n is the terminator. We shall reset the receive of message on receiving any of those character.
-            if (ch =='\n') {
-                string_buf_idx = 0;
+            // Read all data 
+            while (scale_uart_is_readable()) {
+                float weight;
+
+                if (scale_frame_decoder_push(&gng_frame_descriptor, &decoder, scale_uart_getc(), &weight)) {
+                    scale_publish_measurement(weight, decoder.stability);
+                    received = true;
+                }
             }
         }
-
-        vTaskDelay(pdMS_TO_TICKS(250));
     }
 }
 
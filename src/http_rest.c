@@ -111,6 +111,9 @@
 #include <string.h> /* memset */
 #include <stdlib.h> /* atoi */
 #include <stdio.h>
+#include "pico/time.h"
+#include "hardware/regs/addressmap.h"
+#include "trace.h"
 
 #if LWIP_TCP && LWIP_CALLBACK_API
 
@@ -131,9 +134,16 @@
 
 /* This defines checks whether tcp_write has to copy data or not */
 
+/** Data in XIP flash (the embedded pages, the 304 responses) can't change or be released, the segments can reference
+ * it. The XIP cache aliases are left out, XIP_SRAM is writable. */
+#define HTTP_IS_FLASH_DATA(ptr)         ((uintptr_t)(ptr) >= XIP_BASE && \
+                                         (uintptr_t)(ptr) < XIP_BASE + PICO_FLASH_SIZE_BYTES)
+
 #ifndef HTTP_IS_DATA_VOLATILE
-/** tcp_write does not have to copy data when sent from rom-file-system directly */
-#define HTTP_IS_DATA_VOLATILE(hs)       (HTTP_IS_DYNAMIC_FILE(hs) ? TCP_WRITE_FLAG_COPY : 0)
+/** tcp_write does not have to copy data sent from flash directly. Everything in RAM is copied: the rest_response_alloc
+ * buffers are released before the data is acknowledged, static buffers and streamed parts are reused. */
+#define HTTP_IS_DATA_VOLATILE(hs)       ((HTTP_IS_DYNAMIC_FILE(hs) || !HTTP_IS_FLASH_DATA((hs)->file)) ? \
+                                         TCP_WRITE_FLAG_COPY : 0)
 #endif
 /** Default: dynamic headers are sent from ROM (non-dynamic headers are handled like file data) */
 #ifndef HTTP_IS_HDR_VOLATILE
@@ -238,6 +248,11 @@ struct http_ssi_tag_description {
 
 #endif /* LWIP_HTTPD_SSI */
 
+/* Response buffer of a REST handler, the buffer follows the node */
+struct http_response_alloc {
+  struct http_response_alloc *next;
+};
+
 struct http_state {
 #if LWIP_HTTPD_KILL_OLD_ON_CONNECTIONS_EXCEEDED
   struct http_state *next;
@@ -256,6 +271,9 @@ struct http_state {
   int buf_len;      /* Size of file read buffer, buf. */
 #endif /* LWIP_HTTPD_DYNAMIC_FILE_READ */
   u32_t left;       /* Number of unsent bytes in buf. */
+  struct http_response_alloc *response_allocs; /* Buffers of the REST handlers, freed with the file */
+  u32_t send_started_us; /* Handler done, time of the response being sent (see http_metrics_record_send) */
+  u8_t send_timed;
   u8_t retries;
 #if LWIP_HTTPD_SUPPORT_11_KEEPALIVE
   u8_t keepalive;
@@ -308,6 +326,21 @@ LWIP_MEMPOOL_DECLARE(HTTPD_SSI_STATE, MEMP_NUM_PARALLEL_HTTPD_SSI_CONNS, sizeof(
 static err_t http_close_conn(struct altcp_pcb *pcb, struct http_state *hs);
 static err_t http_close_or_abort_conn(struct altcp_pcb *pcb, struct http_state *hs, u8_t abort_conn);
 static err_t http_find_file(struct http_state *hs, const char *uri, int is_09);
+
+/* Header lines of the request being handled, valid only while its REST handler runs */
+static const char *http_request_headers;
+static u16_t http_request_headers_len;
+
+/* Connection of the REST handler being called, owner of its rest_response_alloc buffers */
+static struct http_state *http_current_state;
+static const char *http_find_header(const char *headers, size_t headers_len, const char *name, const char **value_end);
+
+/* Connection pool occupancy, reported by http_rest_metrics */
+static u16_t http_connections_active;
+static u16_t http_connections_peak;
+static u32_t http_connections_total;
+static u32_t http_connections_aborted;
+static void http_metrics_record_send(struct http_state *hs);
 static err_t http_init_file(struct http_state *hs, struct fs_file *file, int is_09, const char *uri, u8_t tag_check, char *params);
 static err_t http_poll(void *arg, struct altcp_pcb *pcb);
 static u8_t http_check_eof(struct altcp_pcb *pcb, struct http_state *hs);
@@ -467,6 +500,10 @@ http_state_alloc(void)
   if (ret != NULL) {
     http_state_init(ret);
     http_add_connection(ret);
+
+    http_connections_active++;
+    http_connections_total++;
+    http_connections_peak = LWIP_MAX(http_connections_peak, http_connections_active);
   }
   return ret;
 }
@@ -493,6 +530,11 @@ http_state_eof(struct http_state *hs)
     hs->buf = NULL;
   }
 #endif /* LWIP_HTTPD_DYNAMIC_FILE_READ */
+  while (hs->response_allocs != NULL) {
+    struct http_response_alloc *next = hs->response_allocs->next;
+    free(hs->response_allocs);
+    hs->response_allocs = next;
+  }
 #if LWIP_HTTPD_SSI
   if (hs->ssi) {
     http_ssi_state_free(hs->ssi);
@@ -517,6 +559,7 @@ http_state_free(struct http_state *hs)
     http_state_eof(hs);
     http_remove_connection(hs);
     HTTP_FREE_HTTP_STATE(hs);
+    http_connections_active--;
   }
 }
 
@@ -654,6 +697,9 @@ http_close_conn(struct altcp_pcb *pcb, struct http_state *hs)
 static void
 http_eof(struct altcp_pcb *pcb, struct http_state *hs)
 {
+  http_metrics_record_send(hs);
+  trace_record(TRACE_EVENT_HTTP_REQUEST_END, (uintptr_t) hs >> 2);
+
   /* HTTP/1.1 persistent connection? (Not supported for SSI) */
 #if LWIP_HTTPD_SUPPORT_11_KEEPALIVE
   if (hs->keepalive) {
@@ -1083,6 +1129,46 @@ http_send_headers(struct altcp_pcb *pcb, struct http_state *hs)
 }
 #endif /* LWIP_HTTPD_DYNAMIC_HEADERS */
 
+#if !LWIP_HTTPD_DYNAMIC_FILE_READ
+// Body source of a streamed response, see rest_response_stream
+typedef struct {
+  rest_stream_read_t read;
+  void *state;
+} http_response_stream_t;
+
+/** Sub-function of http_check_eof(): point the send state at the next part of a streamed response.
+ *
+ * @returns: 0 if the response is not streamed or the stream ended (the file is closed)
+ *           1 if the next part is ready to send
+ */
+static u8_t
+http_stream_next(struct altcp_pcb *pcb, struct http_state *hs, int bytes_left)
+{
+  http_response_stream_t *stream = (http_response_stream_t *)hs->handle->pextension;
+  const char *data = NULL;
+  size_t count = 0;
+
+  if (stream != NULL) {
+    count = stream->read(stream->state, &data, (size_t)bytes_left);
+  }
+
+  if (count == 0 || count > (size_t)bytes_left) {
+    LWIP_DEBUGF(HTTPD_DEBUG, ("Stream ended before its Content-Length.\n"));
+#if LWIP_HTTPD_SUPPORT_11_KEEPALIVE
+    /* The client can't find the end of a short response, it only ends with the connection */
+    hs->keepalive = 0;
+#endif /* LWIP_HTTPD_SUPPORT_11_KEEPALIVE */
+    http_eof(pcb, hs);
+    return 0;
+  }
+
+  hs->handle->index += (int)count;
+  hs->left = count;
+  hs->file = data;
+  return 1;
+}
+#endif /* !LWIP_HTTPD_DYNAMIC_FILE_READ */
+
 /** Sub-function of http_send(): end-of-file (or block) is reached,
  * either close the file or read the next block (if supported).
  *
@@ -1178,7 +1264,8 @@ http_check_eof(struct altcp_pcb *pcb, struct http_state *hs)
   }
 #endif /* LWIP_HTTPD_SSI */
 #else /* LWIP_HTTPD_DYNAMIC_FILE_READ */
-  LWIP_ASSERT("SSI and DYNAMIC_HEADERS turned off but eof not reached", 0);
+  /* Streamed REST responses (rest_response_stream) hand over their next part instead */
+  return http_stream_next(pcb, hs, bytes_left);
 #endif /* LWIP_HTTPD_SSI || LWIP_HTTPD_DYNAMIC_HEADERS */
   return 1;
 }
@@ -1198,8 +1285,19 @@ http_send_data_nonssi(struct altcp_pcb *pcb, struct http_state *hs)
   /* We are not processing an SHTML file so no tag checking is necessary.
    * Just send the data as we received it from the file. */
   len = (u16_t)LWIP_MIN(hs->left, 0xffff);
+  u8_t apiflags = HTTP_IS_DATA_VOLATILE(hs);
+
+  if (!(apiflags & TCP_WRITE_FLAG_COPY)) {
+    /* Every referenced piece takes a pbuf (MEMP_NUM_PBUF), whole segments keep it at one per segment: while more
+     * follows, the part of the send buffer short of a full segment is left for the next acknowledgement */
+    u16_t mss = altcp_mss(pcb);
+    u16_t sndbuf = altcp_sndbuf(pcb);
+    if (len > sndbuf && sndbuf >= mss) {
+      len = (u16_t)(sndbuf - (sndbuf % mss));
+    }
+  }
 
-  err = http_write(pcb, hs->file, &len, HTTP_IS_DATA_VOLATILE(hs));
+  err = http_write(pcb, hs->file, &len, apiflags);
   if (err == ERR_OK) {
     data_to_send = 1;
     hs->file += len;
@@ -2084,13 +2182,19 @@ http_parse_request(struct pbuf *inp, struct http_state *hs, struct altcp_pcb *pc
         if (lwip_strnstr(data, CRLF CRLF, data_len) != NULL) {
           char *uri = sp1 + 1;
 #if LWIP_HTTPD_SUPPORT_11_KEEPALIVE
-          /* This is HTTP/1.0 compatible: for strict 1.1, a connection
-             would always be persistent unless "close" was specified. */
-          if (!is_09 && (lwip_strnstr(data, HTTP11_CONNECTIONKEEPALIVE, data_len) ||
-                         lwip_strnstr(data, HTTP11_CONNECTIONKEEPALIVE2, data_len))) {
-            hs->keepalive = 1;
-          } else {
-            hs->keepalive = 0;
+          /* HTTP/1.1 connections are persistent unless "close" was specified,
+             HTTP/1.0 ones only if "keep-alive" was. */
+          hs->keepalive = 0;
+          if (!is_09) {
+            const char *conn_end = NULL;
+            const char *conn = http_find_header(crlf + 2, data_len - (crlf + 2 - data), "Connection", &conn_end);
+            if (strncmp(sp2 + 1, "HTTP/1.1", 8) == 0) {
+              hs->keepalive = (conn == NULL) || (lwip_strnstr(conn, "close", conn_end - conn) == NULL &&
+                                                 lwip_strnstr(conn, "Close", conn_end - conn) == NULL);
+            } else if (conn != NULL) {
+              hs->keepalive = (lwip_strnstr(conn, "keep-alive", conn_end - conn) != NULL ||
+                               lwip_strnstr(conn, "Keep-Alive", conn_end - conn) != NULL);
+            }
           }
 #endif /* LWIP_HTTPD_SUPPORT_11_KEEPALIVE */
           /* null-terminate the METHOD (pbuf is freed anyway wen returning) */
@@ -2119,7 +2223,15 @@ http_parse_request(struct pbuf *inp, struct http_state *hs, struct altcp_pcb *pc
           } else
 #endif /* LWIP_HTTPD_SUPPORT_POST */
           {
-            return http_find_file(hs, uri, is_09);
+            err_t find_err;
+
+            http_request_headers = crlf + 2;
+            http_request_headers_len = (u16_t)(data_len - (crlf + 2 - data));
+            find_err = http_find_file(hs, uri, is_09);
+            http_request_headers = NULL;
+            http_request_headers_len = 0;
+
+            return find_err;
           }
         }
       } else {
@@ -2385,7 +2497,8 @@ http_init_file(struct http_state *hs, struct fs_file *file, int is_09, const cha
     } else
 #endif /* LWIP_HTTPD_CUSTOM_FILES */
     {
-      hs->left = (u32_t)file->len;
+      /* A streamed response only has its header in memory, see http_stream_next */
+      hs->left = (u32_t)(file->pextension != NULL ? file->index : file->len);
     }
     hs->retries = 0;
 #if LWIP_HTTPD_TIMING
@@ -2453,6 +2566,7 @@ http_err(void *arg, err_t err)
   LWIP_DEBUGF(HTTPD_DEBUG, ("http_err: %s", lwip_strerr(err)));
 
   if (hs != NULL) {
+    http_connections_aborted++;
     http_state_free(hs);
   }
 }
@@ -2777,72 +2891,531 @@ http_set_cgi_handlers(const tCGI *cgis, int num_handlers)
 // //////////////////////////////////
 
 #include "eeprom.h"
+#include "common.h"
+#include "lwip/sys.h"
+#include "http_rest_routes.h"
+
+#define REST_METRICS_BUFFER_SIZE    6144
+
+/*
+    Latency histograms of the metrics endpoint (http_rest_metrics). Counts are kept per bucket and made cumulative,
+    as Prometheus expects, when reported.
+*/
+static const uint32_t rest_metrics_bucket_bounds_us[REST_METRICS_BUCKET_CNT - 1] = {500, 2000, 10000, 50000, 250000};
+static const char * const rest_metrics_bucket_labels[REST_METRICS_BUCKET_CNT] = {
+    "0.0005", "0.002", "0.01", "0.05", "0.25", "+Inf",
+};
+
+static _rest_histogram_t rest_metrics_send_time;   // Handler done to the last byte handed to TCP, all routes
+static uint32_t rest_metrics_not_found = 0;
+
+// Metric families of the other modules, see rest_register_metrics
+#define REST_MAX_METRICS_FORMATTERS 4
+
+static rest_metrics_formatter_t rest_metrics_formatters[REST_MAX_METRICS_FORMATTERS];
+static size_t rest_metrics_formatter_count = 0;
+
+
+static void _rest_histogram_add(_rest_histogram_t * histogram, uint32_t elapsed_us) {
+    uint8_t bucket = 0;
+    while (bucket < REST_METRICS_BUCKET_CNT - 1 && elapsed_us > rest_metrics_bucket_bounds_us[bucket]) {
+        bucket += 1;
+    }
+
+    histogram->buckets[bucket] += 1;
+    histogram->sum_us += elapsed_us;
+    histogram->count += 1;
+}
 
-typedef struct _rest_endpoint_node{
-    char * uri;
+
+// Called by http_find_file once the handler of uri returned
+static void http_metrics_record_request(const char * uri, uint32_t handler_us, bool is_ok, 
+                                        const struct fs_file * file) {
+    _rest_route_t * route = rest_route_find(uri);
+    if (route == NULL) {
+        return;
+    }
+
+    route->requests += 1;
+    _rest_histogram_add(&route->handler_time, handler_us);
+
+    // Status line: HTTP/1.x NNN
+    int status = 0;
+    if (file->data && file->len > 12 && (file->flags & FS_FILE_FLAGS_HEADER_INCLUDED)) {
+        status = atoi(file->data + 9);
+    }
+    if (!is_ok || status >= 400) {
+        route->errors += 1;
+    }
+}
+
+
+static void http_metrics_record_send(struct http_state * hs) {
+    if (hs->send_timed) {
+        hs->send_timed = 0;
+        _rest_histogram_add(&rest_metrics_send_time, time_us_32() - hs->send_started_us);
+    }
+}
+
+
+// The series of one histogram, labels (e.g. route="/404") may be empty
+static size_t _rest_metrics_format_histogram(char * buffer, size_t buffer_size, const char * name, 
+                                             const char * labels, const _rest_histogram_t * histogram) {
+    const char * separator = labels[0] ? "," : "";
+    uint32_t cumulative_count = 0;
+    size_t len = 0;
+
+    for (uint8_t bucket = 0; bucket < REST_METRICS_BUCKET_CNT && len < buffer_size; bucket += 1) {
+        cumulative_count += histogram->buckets[bucket];
+        len += snprintf(buffer + len, buffer_size - len, "%s_bucket{%s%sle=\"%s\"} %lu\n", 
+                        name, labels, separator, rest_metrics_bucket_labels[bucket], cumulative_count);
+    }
+
+    if (len < buffer_size) {
+        len += snprintf(buffer + len, buffer_size - len, 
+                        "%s_sum%s%s%s %0.6f\n"
+                        "%s_count%s%s%s %lu\n",
+                        name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "", histogram->sum_us / 1e6,
+                        name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "", histogram->count);
+    }
+
+    return len;
+}
+
+
+bool http_rest_metrics(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Metrics in the Prometheus text exposition format: request and error counters and the handler time histogram
+    // per route (routes that have not been requested yet are left out), the send time histogram over all routes,
+    // the connection pool occupancy and the metrics of the modules (rest_register_metrics).
+    static const char metrics_http_header[] = "HTTP/1.1 200 OK\r\n"
+                                              "Content-Type: text/plain; version=0.0.4\r\n"
+                                              "Cache-Control: no-store\r\n"
+                                              "Content-Length: %u\r\n\r\n";
+
+    // The header is written in front of the body once its length is known
+    const size_t header_reserve = sizeof(metrics_http_header) + 8;
+    const size_t metrics_buffer_size = REST_METRICS_BUFFER_SIZE;
+    char * metrics_buffer = (char *) rest_response_alloc(metrics_buffer_size);
+    if (metrics_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    char * body = metrics_buffer + header_reserve;
+    size_t body_size = metrics_buffer_size - header_reserve;
+
+    size_t len = snprintf(body, body_size, 
+                          "# TYPE opentrickler_http_connections gauge\n"
+                          "opentrickler_http_connections %u\n"
+                          "# TYPE opentrickler_http_connections_peak gauge\n"
+                          "opentrickler_http_connections_peak %u\n"
+                          "# TYPE opentrickler_http_connections_total counter\n"
+                          "opentrickler_http_connections_total %lu\n"
+                          "# TYPE opentrickler_http_connections_aborted_total counter\n"
+                          "opentrickler_http_connections_aborted_total %lu\n"
+                          "# TYPE opentrickler_http_not_found_total counter\n"
+                          "opentrickler_http_not_found_total %lu\n"
+                          "# TYPE opentrickler_http_send_seconds histogram\n",
+                          http_connections_active,
+                          http_connections_peak,
+                          http_connections_total,
+                          http_connections_aborted,
+                          rest_metrics_not_found);
+    len += _rest_metrics_format_histogram(body + len, body_size - len, "opentrickler_http_send_seconds", "", 
+                                          &rest_metrics_send_time);
+
+    static const char * const route_metric_types[] = {
+        "# TYPE opentrickler_http_requests_total counter\n",
+        "# TYPE opentrickler_http_errors_total counter\n",
+        "# TYPE opentrickler_http_handler_seconds histogram\n",
+    };
+
+    // One metric family after the other, the exposition format doesn't allow them to interleave
+    for (uint8_t metric = 0; metric < 3 && len < body_size; metric += 1) {
+        len += snprintf(body + len, body_size - len, "%s", route_metric_types[metric]);
+
+        for (size_t idx = 0; idx < rest_route_get_count() && len < body_size; idx += 1) {
+            const _rest_route_t * route = rest_route_get(idx);
+            if (route->requests == 0) {
+                continue;
+            }
+
+            char labels[LWIP_HTTPD_MAX_REQUEST_URI_LEN + 16];
+            snprintf(labels, sizeof(labels), "route=\"%s\"", route->uri);
+
+            if (metric == 0) {
+                len += snprintf(body + len, body_size - len, "opentrickler_http_requests_total{%s} %lu\n", 
+                                labels, route->requests);
+            }
+            else if (metric == 1) {
+                len += snprintf(body + len, body_size - len, "opentrickler_http_errors_total{%s} %lu\n", 
+                                labels, route->errors);
+            }
+            else {
+                len += _rest_metrics_format_histogram(body + len, body_size - len, 
+                                                      "opentrickler_http_handler_seconds", labels, 
+                                                      &route->handler_time);
+            }
+        }
+    }
+
+    for (size_t idx = 0; idx < rest_metrics_formatter_count && len < body_size; idx += 1) {
+        len += rest_metrics_formatters[idx](body + len, body_size - len);
+    }
+
+    // Truncated, drop the partial last line
+    if (len >= body_size) {
+        len = body_size - 1;
+        while (len > 0 && body[len - 1] != '\n') {
+            len -= 1;
+        }
+    }
+
+    char header[sizeof(metrics_http_header) + 8];
+    size_t header_len = snprintf(header, sizeof(header), metrics_http_header, (unsigned) len);
+    memcpy(body - header_len, header, header_len);
+
+    size_t data_length = header_len + len;
+    file->data = body - header_len;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT;
+
+    return true;
+}
+
+
+void rest_register_metrics(rest_metrics_formatter_t f) {
+    // Modules register from the boot stages, which run side by side
+    SYS_ARCH_DECL_PROTECT(lev);
+    SYS_ARCH_PROTECT(lev);
+
+    LWIP_ASSERT("Too many metrics formatters, increase REST_MAX_METRICS_FORMATTERS", 
+                rest_metrics_formatter_count < REST_MAX_METRICS_FORMATTERS);
+    if (rest_metrics_formatter_count < REST_MAX_METRICS_FORMATTERS) {
+        rest_metrics_formatters[rest_metrics_formatter_count] = f;
+        rest_metrics_formatter_count += 1;
+    }
+
+    SYS_ARCH_UNPROTECT(lev);
+}
+
+
+/*
+    Config modules, served together by http_rest_config. Each module registers the same handler as its own
+    /rest/<name> endpoint.
+*/
+#define REST_MAX_CONFIG_MODULES     12
+#define REST_CONFIG_BUFFER_SIZE     4096
+
+typedef struct {
+    const char * name;
     rest_handler_t function_handler;
-    struct _rest_endpoint_node * next;
-} _rest_endpoint_node_t;
+} _rest_config_module_t;
+
+static _rest_config_module_t rest_config_modules[REST_MAX_CONFIG_MODULES];
+static size_t rest_config_module_count = 0;
+
+
+void rest_register_config_module(const char * name, rest_handler_t f) {
+    // Modules register from the boot stages, which run side by side
+    SYS_ARCH_DECL_PROTECT(lev);
+    SYS_ARCH_PROTECT(lev);
+
+    LWIP_ASSERT("Too many config modules, increase REST_MAX_CONFIG_MODULES", 
+                rest_config_module_count < REST_MAX_CONFIG_MODULES);
+    if (rest_config_module_count < REST_MAX_CONFIG_MODULES) {
+        rest_config_modules[rest_config_module_count].name = name;
+        rest_config_modules[rest_config_module_count].function_handler = f;
+        rest_config_module_count += 1;
+    }
+
+    SYS_ARCH_UNPROTECT(lev);
+}
+
+
+bool http_rest_config(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // <module>.<key>: Passed to the module handler as <key>, e.g. charge_mode_config.c5=4.5
+    // ee (bool): save to eeprom, passed to every module receiving a parameter
+    //
+    // Response: {"<module>":<response of /rest/<module>>, ...}
+    const size_t config_json_buffer_size = REST_CONFIG_BUFFER_SIZE;
+    char * config_json_buffer = (char *) rest_response_alloc(config_json_buffer_size);
+    if (config_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+    char * module_params[LWIP_HTTPD_MAX_CGI_PARAMETERS];
+    char * module_values[LWIP_HTTPD_MAX_CGI_PARAMETERS];
+
+    size_t len = snprintf(config_json_buffer, config_json_buffer_size, "%s{", http_json_header);
+
+    for (size_t module_idx = 0; module_idx < rest_config_module_count; module_idx += 1) {
+        const _rest_config_module_t * module = &rest_config_modules[module_idx];
+        size_t name_len = strlen(module->name);
+
+        // Parameters addressed to this module
+        int module_num_params = 0;
+        int ee_idx = -1;
+        for (int idx = 0; idx < num_params; idx += 1) {
+            if (strcmp(params[idx], "ee") == 0) {
+                ee_idx = idx;
+            }
+            else if (strncmp(params[idx], module->name, name_len) == 0 && params[idx][name_len] == '.') {
+                module_params[module_num_params] = params[idx] + name_len + 1;
+                module_values[module_num_params] = values[idx];
+                module_num_params += 1;
+            }
+        }
+        if (module_num_params && ee_idx >= 0) {
+            module_params[module_num_params] = params[ee_idx];
+            module_values[module_num_params] = values[ee_idx];
+            module_num_params += 1;
+        }
+
+        struct fs_file module_file;
+        memset(&module_file, 0x0, sizeof(module_file));
+        module->function_handler(&module_file, module_num_params, module_params, module_values);
+
+        // Keep the body only
+        const char * body = module_file.data ? lwip_strnstr(module_file.data, CRLF CRLF, module_file.len) : NULL;
+        if (body == NULL) {
+            continue;
+        }
+        body += 4;
+        size_t body_len = module_file.len - (body - module_file.data);
+
+        // Leave room for the separator, the key and the closing brace
+        if (len + body_len + name_len + 8 >= config_json_buffer_size) {
+            LWIP_DEBUGF(HTTPD_DEBUG, ("Config of %s doesn't fit into the bulk response\n", module->name));
+            continue;
+        }
+
+        len += snprintf(config_json_buffer + len, config_json_buffer_size - len, "%s\"%s\":%.*s", 
+                        config_json_buffer[len - 1] == '{' ? "" : ",", module->name, (int) body_len, body);
+    }
+
+    len += snprintf(config_json_buffer + len, config_json_buffer_size - len, "}");
+
+    file->data = config_json_buffer;
+    file->len = len;
+    file->index = len;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
+
+
+bool rest_apply_params(const rest_param_t * table, size_t table_size, int num_params, char *params[], char *values[]) {
+    bool save_to_eeprom = false;
+
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "ee") == 0) {
+            save_to_eeprom = string_to_boolean(values[idx]);
+            continue;
+        }
+
+        // Unknown keys are left to the handler
+        const rest_param_t * param = NULL;
+        for (size_t table_idx = 0; table_idx < table_size; table_idx += 1) {
+            if (strcmp(params[idx], table[table_idx].key) == 0) {
+                param = &table[table_idx];
+                break;
+            }
+        }
+        if (param == NULL) {
+            continue;
+        }
+
+        char * value = values[idx];
+        switch (param->type) {
+            case REST_PARAM_TYPE_BOOL:
+                *(bool *) param->target = string_to_boolean(value);
+                break;
+            case REST_PARAM_TYPE_INT: {
+                long int_value = strtol(value, NULL, 10);
+                if (param->size == sizeof(int8_t)) {
+                    *(int8_t *) param->target = (int8_t) int_value;
+                }
+                else if (param->size == sizeof(int16_t)) {
+                    *(int16_t *) param->target = (int16_t) int_value;
+                }
+                else if (param->size == sizeof(int32_t)) {
+                    *(int32_t *) param->target = (int32_t) int_value;
+                }
+                break;
+            }
+            case REST_PARAM_TYPE_FLOAT:
+                *(float *) param->target = strtof(value, NULL);
+                break;
+            case REST_PARAM_TYPE_COLOUR:
+                // Valid colour starts with #, for example #ff00ff
+                *(uint32_t *) param->target = value[0] == '#' ? strtoul(value + 1, NULL, 16) : 0;
+                break;
+            case REST_PARAM_TYPE_STRING:
+                strncpy((char *) param->target, value, param->size - 1);
+                ((char *) param->target)[param->size - 1] = '\0';
+                break;
+            default:
+                break;
+        }
+    }
+
+    return save_to_eeprom;
+}
+
+
+void * rest_response_alloc(size_t size) {
+    if (http_current_state == NULL) {
+        return NULL;
+    }
+
+    struct http_response_alloc * node = malloc(sizeof(struct http_response_alloc) + size);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    node->next = http_current_state->response_allocs;
+    http_current_state->response_allocs = node;
+
+    return node + 1;
+}
 
-static _rest_endpoint_node_t * rest_endpoint_head = NULL;
 
+bool rest_response_unavailable(struct fs_file *file) {
+    static const char http_service_unavailable[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                                   "Content-Type: application/json\r\n"
+                                                   "Retry-After: 1\r\n\r\n"
+                                                   "{\"error\":503}";
 
-void rest_register_handler(char * uri, rest_handler_t f) {
-    _rest_endpoint_node_t * new_node = malloc(sizeof(_rest_endpoint_node_t));
-    new_node->uri = strdup(uri);
-    new_node->function_handler = f;
+    size_t data_length = sizeof(http_service_unavailable) - 1;
+    file->data = http_service_unavailable;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
 
-    // Add to the head
-    new_node->next = rest_endpoint_head;
-    rest_endpoint_head = new_node;
+    return true;
 }
 
-rest_handler_t rest_get_handler(const char *uri) {
-    rest_handler_t target_handler = NULL;
-    for (_rest_endpoint_node_t * node = rest_endpoint_head; node != NULL; node = node->next) {
-        if (strcmp(uri, node->uri) == 0) {
-            target_handler = node->function_handler;
+
+bool rest_response_stream(struct fs_file *file, const char * content_type, size_t body_len, 
+                          rest_stream_read_t read, void * state) {
+    const size_t header_size = 128;
+    char * header = (char *) rest_response_alloc(header_size);
+    http_response_stream_t * stream = (http_response_stream_t *) rest_response_alloc(sizeof(http_response_stream_t));
+    if (header == NULL || stream == NULL) {
+        return false;
+    }
+
+    size_t header_len = snprintf(header, header_size, 
+                                 "HTTP/1.1 200 OK\r\n"
+                                 "Content-Type: %s\r\n"
+                                 "Content-Length: %u\r\n\r\n",
+                                 content_type, (unsigned) body_len);
+    if (header_len >= header_size) {
+        return false;
+    }
+
+    stream->read = read;
+    stream->state = state;
+
+    // Only the header is in memory, the body is pulled by http_stream_next as the connection drains
+    file->data = header;
+    file->len = header_len + body_len;
+    file->index = header_len;
+    file->pextension = stream;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT;
+
+    return true;
+}
+
+
+// Value of the header line name within headers (the lines after the request or status line), NULL if not present
+static const char * http_find_header(const char * headers, size_t headers_len, const char * name, 
+                                     const char ** value_end) {
+    size_t name_len = strlen(name);
+    const char * line = headers;
+    const char * headers_end = headers + headers_len;
+
+    while (line < headers_end) {
+        const char * line_end = lwip_strnstr(line, CRLF, headers_end - line);
+        if (line_end == NULL || line_end == line) {
+            // End of the headers
             break;
         }
+
+        // Header names are case insensitive
+        if ((size_t)(line_end - line) > name_len && lwip_strnicmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            *value_end = line_end;
+            return line + name_len + 1;
+        }
+
+        line = line_end + 2;
     }
 
-    return target_handler;
+    return NULL;
 }
 
-/*
-  Decode special characters in URI into the regular ASCII characters
 
-  Reference: https://stackoverflow.com/a/14530993
+bool rest_request_header_contains(const char * name, const char * token) {
+    if (http_request_headers == NULL) {
+        return false;
+    }
+
+    const char * value_end = NULL;
+    const char * value = http_find_header(http_request_headers, http_request_headers_len, name, &value_end);
+
+    return value != NULL && lwip_strnstr(value, token, value_end - value) != NULL;
+}
+
+
+#if LWIP_HTTPD_SUPPORT_11_KEEPALIVE
+/*
+    A persistent connection needs the length of every response. Handlers write their own header, so a response 
+    that has no Content-Length yet is copied with one added. Responses that can't be made persistent (e.g. out of 
+    memory) are still sent, the connection is then closed after them as before.
 */
-void decode_uri(char * dst, const char * src) {
-    char a, b;
-    while (*src) {
-        if ((*src == '%') &&
-            ((a = src[1]) && (b = src[2])) &&
-            (isxdigit(a) && isxdigit(b))) {
-                if (a >= 'a')
-                      a -= 'a'-'A';
-                if (a >= 'A')
-                      a -= ('A' - 10);
-                else
-                      a -= '0';
-                if (b >= 'a')
-                      b -= 'a'-'A';
-                if (b >= 'A')
-                      b -= ('A' - 10);
-                else
-                      b -= '0';
-                *dst++ = 16*a+b;
-                src+=3;
-        } else if (*src == '+') {
-            *dst++ = ' ';
-            src++;
-        } else {
-            *dst++ = *src++;
-        }
+static void http_make_response_persistent(struct fs_file * file) {
+    if ((file->flags & (FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT)) != 
+        FS_FILE_FLAGS_HEADER_INCLUDED) {
+        return;
+    }
+
+    const char * status_end = lwip_strnstr(file->data, CRLF, file->len);
+    const char * header_end = lwip_strnstr(file->data, CRLF CRLF, file->len);
+    if (status_end == NULL || header_end == NULL) {
+        return;
+    }
+
+    // Header up to and including the CRLF of its last line, the body follows the empty line
+    size_t header_len = header_end + 2 - file->data;
+    size_t body_len = file->len - header_len - 2;
+
+    const char * value_end = NULL;
+    if (http_find_header(status_end + 2, header_end + 2 - (status_end + 2), "Content-Length", &value_end)) {
+        file->flags |= FS_FILE_FLAGS_HEADER_PERSISTENT;
+        return;
     }
-    *dst++ = '\0';
+
+    char content_length[32];
+    size_t content_length_len = snprintf(content_length, sizeof(content_length), 
+                                         "Content-Length: %u" CRLF CRLF, (unsigned) body_len);
+
+    size_t response_len = header_len + content_length_len + body_len;
+    char * response = (char *) rest_response_alloc(response_len);
+    if (response == NULL) {
+        return;
+    }
+
+    memcpy(response, file->data, header_len);
+    memcpy(response + header_len, content_length, content_length_len);
+    memcpy(response + header_len + content_length_len, header_end + 4, body_len);
+
+    file->data = response;
+    file->len = response_len;
+    file->index = response_len;
+    file->flags |= FS_FILE_FLAGS_HEADER_PERSISTENT;
 }
+#endif  // LWIP_HTTPD_SUPPORT_11_KEEPALIVE
 
 
 static err_t http_find_file(struct http_state * hs, const char * uri, int is_09) {
@@ -2865,14 +3438,21 @@ static err_t http_find_file(struct http_state * hs, const char * uri, int is_09)
 
     // Look for handler
     rest_handler_t rest_handler = rest_get_handler(decoded_uri);
+    http_current_state = hs;
 
     if (rest_handler) {
         // Extract parameters from the uri
         http_cgi_paramcount = extract_uri_parameters(hs, params);
 
-        rest_handler(&hs->file_handle, http_cgi_paramcount, hs->params, hs->param_vals);
+        uint32_t handler_started_us = time_us_32();
+        trace_record(TRACE_EVENT_HTTP_REQUEST_START, (uintptr_t) hs >> 2);
+        bool is_ok = rest_handler(&hs->file_handle, http_cgi_paramcount, hs->params, hs->param_vals);
+        http_metrics_record_request(decoded_uri, time_us_32() - handler_started_us, is_ok, &hs->file_handle);
         file = &hs->file_handle;
     }
+    else {
+        rest_metrics_not_found += 1;
+    }
 
     if (file == NULL) {
         rest_handler = rest_get_handler("/404");
@@ -2884,6 +3464,16 @@ static err_t http_find_file(struct http_state * hs, const char * uri, int is_09)
 
     }
 
+#if LWIP_HTTPD_SUPPORT_11_KEEPALIVE
+    if (hs->keepalive) {
+        http_make_response_persistent(file);
+    }
+#endif  // LWIP_HTTPD_SUPPORT_11_KEEPALIVE
+    http_current_state = NULL;
+
+    hs->send_started_us = time_us_32();
+    hs->send_timed = 1;
+
     uint8_t tag_check = 0;
     return http_init_file(hs, file, is_09, uri, tag_check, params);
 }
@@ -135,14 +135,102 @@ typedef enum {
 
 typedef bool (*rest_handler_t)(struct fs_file *file, int num_params, char *params[], char *values[]); 
 
+
+// Parameter descriptors, applied to their target fields by rest_apply_params
+typedef enum {
+    REST_PARAM_TYPE_BOOL,           // "true" or anything else for false
+    REST_PARAM_TYPE_INT,            // Signed or unsigned integer (or enum) of 1, 2 or 4 bytes
+    REST_PARAM_TYPE_FLOAT,
+    REST_PARAM_TYPE_COLOUR,         // "#rrggbb" into a uint32_t
+    REST_PARAM_TYPE_STRING,         // Copied and null terminated within the field size
+} rest_param_type_t;
+
+typedef struct {
+    const char * key;
+    rest_param_type_t type;
+    void * target;
+    size_t size;
+} rest_param_t;
+
+#define REST_PARAM_BOOL(key, field)     {key, REST_PARAM_TYPE_BOOL, (void *) &(field), sizeof(field)}
+#define REST_PARAM_INT(key, field)      {key, REST_PARAM_TYPE_INT, (void *) &(field), sizeof(field)}
+#define REST_PARAM_FLOAT(key, field)    {key, REST_PARAM_TYPE_FLOAT, (void *) &(field), sizeof(field)}
+#define REST_PARAM_COLOUR(key, field)   {key, REST_PARAM_TYPE_COLOUR, (void *) &(field), sizeof(field)}
+#define REST_PARAM_STRING(key, field)   {key, REST_PARAM_TYPE_STRING, (void *) (field), sizeof(field)}
+
+#define REST_PARAM_TABLE_SIZE(table)    (sizeof(table) / sizeof((table)[0]))
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
-void rest_register_handler(char * uri, rest_handler_t f);
+void rest_register_handler(const char * uri, rest_handler_t f);
 rest_handler_t rest_get_handler(const char *uri);
 
+// Decodes the %XX escapes of src into dst, dst shall be as long as src
+void decode_uri(char * dst, const char * src);
+
+/**
+ * Adds a module config handler (the handler of /rest/<name>) to the bulk config endpoint, see http_rest_config.
+ */
+void rest_register_config_module(const char * name, rest_handler_t f);
+bool http_rest_config(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+/**
+ * Request counters, latency histograms and connection pool occupancy of the httpd, in the Prometheus text format.
+ */
+bool http_rest_metrics(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+/**
+ * Writes the metric families of a module in the Prometheus text format, returns the length written. Called by
+ * http_rest_metrics from the httpd task, after the httpd metrics.
+ */
+typedef size_t (*rest_metrics_formatter_t)(char * buffer, size_t buffer_size);
+
+/**
+ * Adds the metrics of a module to http_rest_metrics.
+ */
+void rest_register_metrics(rest_metrics_formatter_t f);
+
+/**
+ * Apply the request parameters found in the descriptor table in one pass. Keys that are not in the table are left
+ * to the handler. Returns true if the request asks to save to EEPROM (ee=true).
+ */
+bool rest_apply_params(const rest_param_t * table, size_t table_size, int num_params, char *params[], char *values[]);
+
+/**
+ * Returns a response buffer of size bytes owned by the connection being handled, released once the response is sent
+ * (or the connection is dropped). Replaces static handler buffers, so concurrent clients don't share one. Returns NULL
+ * outside a REST handler or when out of memory, see rest_response_unavailable.
+ */
+void * rest_response_alloc(size_t size);
+
+/**
+ * Answers the request with 503 Service Unavailable, for handlers that can't get a response buffer. Returns true.
+ */
+bool rest_response_unavailable(struct fs_file *file);
+
+/**
+ * Next part of a streamed response body: points data at up to max_len bytes and returns their length, 0 if the body
+ * ends early (the connection is then closed). The bytes are copied before the next call.
+ */
+typedef size_t (*rest_stream_read_t)(void * state, const char ** data, size_t max_len);
+
+/**
+ * Answers the request with body_len bytes of content_type pulled from read as the connection drains, instead of
+ * formatting the whole body into one buffer. state shall outlive the response (e.g. from rest_response_alloc). Returns
+ * false when out of memory, see rest_response_unavailable.
+ */
+bool rest_response_stream(struct fs_file *file, const char * content_type, size_t body_len, 
+                          rest_stream_read_t read, void * state);
+
+/**
+ * Returns true if the request header (e.g. "If-None-Match") of the request being handled is present and its value
+ * contains token. Only valid within a REST handler.
+ */
+bool rest_request_header_contains(const char * name, const char * token);
+
 
 #ifdef __cplusplus
 }  // __cplusplus
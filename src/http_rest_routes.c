@@ -0,0 +1,120 @@
+#include <string.h>
+#include <ctype.h>
+#include "lwip/debug.h"
+
+#include "http_rest.h"
+#include "http_rest_routes.h"
+
+/*
+    Routes are kept in a static array sorted by URI, so registering takes no heap and a lookup is a binary search.
+    Registration only happens at start up (rest_endpoints_init), lookups run for every request.
+*/
+static _rest_route_t rest_routes[REST_MAX_ROUTES];
+static size_t rest_route_count = 0;
+
+
+// Index of the uri if registered, otherwise the index it shall be inserted at (negated, minus one)
+static int _rest_find_route(const char * uri) {
+    int low = 0;
+    int high = (int) rest_route_count - 1;
+
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        int cmp = strcmp(uri, rest_routes[mid].uri);
+
+        if (cmp == 0) {
+            return mid;
+        }
+        else if (cmp < 0) {
+            high = mid - 1;
+        }
+        else {
+            low = mid + 1;
+        }
+    }
+
+    return -low - 1;
+}
+
+
+void rest_register_handler(const char * uri, rest_handler_t f) {
+    int idx = _rest_find_route(uri);
+
+    // Registering the same URI again replaces the handler
+    if (idx >= 0) {
+        rest_routes[idx].function_handler = f;
+        return;
+    }
+
+    LWIP_ASSERT("Too many REST routes, increase REST_MAX_ROUTES", rest_route_count < REST_MAX_ROUTES);
+    if (rest_route_count >= REST_MAX_ROUTES) {
+        return;
+    }
+
+    idx = -idx - 1;
+    memmove(&rest_routes[idx + 1], &rest_routes[idx], (rest_route_count - idx) * sizeof(_rest_route_t));
+    memset(&rest_routes[idx], 0x0, sizeof(_rest_route_t));
+    rest_routes[idx].uri = uri;
+    rest_routes[idx].function_handler = f;
+    rest_route_count += 1;
+}
+
+rest_handler_t rest_get_handler(const char *uri) {
+    int idx = _rest_find_route(uri);
+
+    return idx >= 0 ? rest_routes[idx].function_handler : NULL;
+}
+
+
+_rest_route_t * rest_route_find(const char * uri) {
+    int idx = _rest_find_route(uri);
+
+    return idx >= 0 ? &rest_routes[idx] : NULL;
+}
+
+
+size_t rest_route_get_count(void) {
+    return rest_route_count;
+}
+
+
+_rest_route_t * rest_route_get(size_t idx) {
+    return idx < rest_route_count ? &rest_routes[idx] : NULL;
+}
+
+
+/*
+  Decode special characters in URI into the regular ASCII characters
+
+  Reference: https://stackoverflow.com/a/14530993
+*/
+void decode_uri(char * dst, const char * src) {
+    char a, b;
+    while (*src) {
+        if ((*src == '%') &&
+            ((a = src[1]) && (b = src[2])) &&
+            (isxdigit(a) && isxdigit(b))) {
+                if (a >= 'a')
+                      a -= 'a'-'A';
+                if (a >= 'A')
+                      a -= ('A' - 10);
+                else
+                      a -= '0';
+                if (b >= 'a')
+                      b -= 'a'-'A';
+                if (b >= 'A')
+                      b -= ('A' - 10);
+                else
+                      b -= '0';
+                *dst++ = 16*a+b;
+                src+=3;
+        } else if (*src == '+') {
+            *dst++ = ' ';
+            src++;
+        } else {
+            *dst++ = *src++;
+        }
+    }
+    *dst++ = '\0';
+}
+
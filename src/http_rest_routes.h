@@ -0,0 +1,49 @@
+#ifndef HTTP_REST_ROUTES_H_
+#define HTTP_REST_ROUTES_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "http_rest.h"
+
+/*
+    Route table of the REST handlers (http_rest_routes.c), shared with the metrics of http_rest.c. Kept apart from the
+    lwIP httpd so the lookup builds on its own (tests/host).
+*/
+#define REST_MAX_ROUTES             48
+
+// Latency histograms of the metrics endpoint, see http_rest_metrics
+#define REST_METRICS_BUCKET_CNT     6
+
+typedef struct {
+    uint32_t buckets[REST_METRICS_BUCKET_CNT];
+    uint64_t sum_us;
+    uint32_t count;
+} _rest_histogram_t;
+
+typedef struct {
+    const char * uri;
+    rest_handler_t function_handler;
+
+    // Metrics
+    uint32_t requests;
+    uint32_t errors;                // Handler failed or answered with a 4xx / 5xx status
+    _rest_histogram_t handler_time;
+} _rest_route_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Route of the uri, NULL if not registered
+_rest_route_t * rest_route_find(const char * uri);
+
+// Routes in the order of their URI
+size_t rest_route_get_count(void);
+_rest_route_t * rest_route_get(size_t idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HTTP_REST_ROUTES_H_
@@ -13,22 +13,14 @@
 #include "app.h"
 
 
-typedef union {
-    struct __attribute__((__packed__)){
-        char header;
-        char _space;
-        char stable_state;
-        char symbol;
-        char weighing_data[9];
-        char _space2;
-        char weighing_unit[3];
-        char terminator[2];
-    };
-    char bytes[19];
-} jm_science_frame_data_format_t;
-
+static const scale_frame_descriptor_t jm_science_frame_descriptor = {
+    .frame_size = 19,             // header, space, stable_state, symbol, data[9], space, unit[3], terminator[2]
+    .sync_char = 'E',             // Frame header, resets the decode sequence
+    .sign_offset = 3,             // Symbol
+    .data_offset = 4,
+    .data_length = 9,
+};
 
-const static char JM_SCIENCE_FRAME_HEADER = 'E';
 
 
 // Forward declaration
@@ -44,62 +36,8 @@ scale_handle_t jm_science_scale_handle = {
 };
 
 
-static float _decode_measurement_msg(jm_science_frame_data_format_t * frame) {
-    // decode sign 
-    int sign = 1;
-    if (frame->symbol == '-') {
-        sign = -1;
-    }
-
-    // Decode weight information
-    char *endptr;
-    float weight = strtof(frame->weighing_data, &endptr);
-
-    if( endptr == frame->weighing_data ) {
-        // Conversion failed
-        return nanf(frame->weighing_data);
-    }
-
-    weight *= sign;
-
-    return weight;
-}
-
-
 void _jm_science_scale_listener_task(void *p) {
-    jm_science_frame_data_format_t frame;
-    uint8_t byte_idx = 0;
-
-    while (true) {
-        // Read all data 
-        while (uart_is_readable(SCALE_UART)) {
-            char ch = uart_getc(SCALE_UART);
-
-            // Determine if the frame header is received
-            // If a header is received then we should reset the decode sequence
-            if (ch == JM_SCIENCE_FRAME_HEADER) {
-                byte_idx = 0;
-            }
-
-            frame.bytes[byte_idx++] = ch;
-
-            // If we have received 17 bytes then we can decode the message
-            if (byte_idx == sizeof(jm_science_frame_data_format_t)) {
-                // Data is ready, send to decode
-                scale_config.current_scale_measurement = _decode_measurement_msg(&frame);
-
-                // Signal the data is ready
-                if (scale_config.scale_measurement_ready) {
-                    xSemaphoreGive(scale_config.scale_measurement_ready);
-                }
-
-                // Reset buffer index to avoid overflow
-                byte_idx = 0;
-            }
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(20));
-    }
+    scale_frame_listener_loop(&jm_science_frame_descriptor);
 }
 
 
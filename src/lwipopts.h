@@ -33,6 +33,7 @@
 #define LWIP_HTTPD_DYNAMIC_HEADERS      0
 #define LWIP_HTTPD_MAX_REQUEST_URI_LEN  128
 #define LWIP_HTTPD_DYNAMIC_HEADERS      0
+#define LWIP_HTTPD_SUPPORT_11_KEEPALIVE 1    // Persistent connections, see http_make_response_persistent
 #define LWIP_SOCKETS 1
 
 // MDNS
@@ -43,5 +44,6 @@
 #define MDNS_RESP_USENETIF_EXTCALLBACK  1
 #define MEMP_NUM_SYS_TIMEOUT (LWIP_NUM_SYS_TIMEOUT_INTERNAL + 8)
 #define MEMP_NUM_TCP_PCB 12
+#define MEMP_NUM_PBUF 48     // Referenced (not copied) segments of the pages sent from flash, see HTTP_IS_DATA_VOLATILE
 
 #endif
\ No newline at end of file
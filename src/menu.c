@@ -14,9 +14,11 @@
 #include "eeprom.h"
 #include "charge_mode.h"
 #include "cleanup_mode.h"
+#include "dead_time_mode.h"
 #include "eeprom.h"
 #include "wireless.h"
 #include "system_control.h"
+#include "boot.h"
 
 // External variables
 extern muif_t muif_list[];
@@ -41,7 +43,7 @@ void menu_task(void *p){
     // Render the menu before user input
     u8g2_ClearBuffer(display_handler);
     mui_Draw(&mui);
-    u8g2_SendBuffer(display_handler);
+    display_update(display_handler);
 
     while (true) {
         if (mui_IsFormActive(&mui)) {
@@ -64,6 +66,12 @@ void menu_task(void *p){
         }
         else {
             uint8_t exit_form_id = 1;  // by default it goes to the main menu
+
+            // The modes drive the hardware the boot may still be bringing up
+            if (!boot_wait_for_stages(BOOT_STAGES_ALL)) {
+                app_handle_boot_failure();
+            }
+
             // menu is not active, leave the control to the app
             switch (exit_state) {
                 case APP_STATE_ENTER_CHARGE_MODE:
@@ -75,6 +83,9 @@ void menu_task(void *p){
                 case APP_STATE_ENTER_CLEANUP_MODE:
                     exit_form_id = cleanup_mode_menu();
                     break;
+                case APP_STATE_ENTER_DEAD_TIME_MODE:
+                    exit_form_id = dead_time_mode_menu();
+                    break;
                 case APP_STATE_ENTER_SCALE_CALIBRATION:
                     exit_form_id = scale_calibrate_with_external_weight();
                     break;
@@ -99,6 +110,6 @@ void menu_task(void *p){
 
         u8g2_ClearBuffer(display_handler);
         mui_Draw(&mui);
-        u8g2_SendBuffer(display_handler);
+        display_update(display_handler);
     }
 }
@@ -41,6 +41,7 @@
 #include "common.h"
 #include "mini_12864_module.h"
 #include "display.h"
+#include "static_alloc.h"
 
 
 // Configs
@@ -49,11 +50,29 @@ const mini_12864_module_config_t default_mini_12864_module_config = {
     .data_rev = 0,
     .inverted_encoder_direction = false,
     .display_rotation = DISPLAY_ROTATION_0,
+    .max_frame_rate_hz = 20,
 };
 
 // Statics (to be shared between IRQ and tasks)
 QueueHandle_t encoder_event_queue = NULL;
 
+// Encoder acceleration, rotation speed (detents per second) to step size. Slow turns keep single steps.
+#define ENCODER_ACCELERATION_TIMEOUT_US     150000      // A longer pause between detents starts over at single steps
+
+static const struct {
+    uint16_t min_rate_hz;
+    uint8_t step;
+} encoder_acceleration_curve[] = {
+    {0, 1},
+    {8, 2},
+    {15, 5},
+    {25, 10},
+};
+
+static volatile uint32_t encoder_last_detent_us = 0;
+static volatile uint32_t encoder_detent_interval_us = 0;    // Smoothed, 0 when not spinning
+static volatile ButtonEncoderEvent_t encoder_last_direction = BUTTON_NO_EVENT;
+
 // Local variables
 extern u8g2_t display_handler;
 
@@ -64,6 +83,45 @@ extern const size_t muif_cnt;
 
 
 
+// Timestamp a detent and update the smoothed interval, called from the encoder ISR
+static void _record_detent(ButtonEncoderEvent_t direction) {
+    uint32_t now_us = time_us_32();
+    uint32_t interval_us = now_us - encoder_last_detent_us;
+
+    if (direction != encoder_last_direction || interval_us > ENCODER_ACCELERATION_TIMEOUT_US) {
+        encoder_detent_interval_us = 0;
+    }
+    else if (encoder_detent_interval_us == 0) {
+        encoder_detent_interval_us = interval_us;
+    }
+    else {
+        encoder_detent_interval_us = (3 * encoder_detent_interval_us + interval_us) / 4;
+    }
+
+    encoder_last_detent_us = now_us;
+    encoder_last_direction = direction;
+}
+
+
+uint8_t button_get_encoder_step(void) {
+    uint32_t interval_us = encoder_detent_interval_us;
+
+    if (interval_us == 0 || time_us_32() - encoder_last_detent_us > ENCODER_ACCELERATION_TIMEOUT_US) {
+        return 1;
+    }
+
+    uint32_t rate_hz = 1000000 / interval_us;
+    uint8_t step = 1;
+    for (size_t idx = 0; idx < sizeof(encoder_acceleration_curve) / sizeof(encoder_acceleration_curve[0]); idx += 1) {
+        if (rate_hz >= encoder_acceleration_curve[idx].min_rate_hz) {
+            step = encoder_acceleration_curve[idx].step;
+        }
+    }
+
+    return step;
+}
+
+
 void _isr_on_encoder_update(uint gpio, uint32_t event){
     static uint8_t state = 2;
     static int8_t count = 0;
@@ -130,7 +188,8 @@ void _isr_on_encoder_update(uint gpio, uint32_t event){
         else {
             button_encoder_event = BUTTON_ENCODER_ROTATE_CW;
         }
-        
+
+        _record_detent(button_encoder_event);
         if (encoder_event_queue) {
             xQueueSendFromISR(encoder_event_queue, &button_encoder_event, NULL);
         }
@@ -145,6 +204,7 @@ void _isr_on_encoder_update(uint gpio, uint32_t event){
             button_encoder_event = BUTTON_ENCODER_ROTATE_CCW;
         }
 
+        _record_detent(button_encoder_event);
         if (encoder_event_queue) {
             xQueueSendFromISR(encoder_event_queue, &button_encoder_event, NULL);
         }
@@ -198,6 +258,9 @@ bool mini_12864_module_init() {
     // Register to eeprom save all
     eeprom_register_handler(mini_12864_module_config_save);
 
+    // Served together with the other modules by /rest/config
+    rest_register_config_module("mini_12864_config", http_rest_mini_12864_module_config);
+
     // Run subsequent function inits
     button_init();
     display_init();
@@ -233,7 +296,7 @@ void button_init() {
     irq_handler.register_interrupt(BUTTON0_ENC_PIN, gpio_irq_handler::irq_event::fall, _isr_on_button_enc_update);
     irq_handler.register_interrupt(BUTTON0_RST_PIN, gpio_irq_handler::irq_event::fall, _isr_on_button_rst_update);
 
-    encoder_event_queue = xQueueCreate(5, sizeof(ButtonEncoderEvent_t));
+    encoder_event_queue = STATIC_QUEUE_CREATE(5, sizeof(ButtonEncoderEvent_t));
     if (encoder_event_queue == 0) {
         assert(false);
     }
@@ -416,6 +479,10 @@ void display_init() {
     // Clear 
     u8g2_ClearBuffer(&display_handler);
     u8g2_ClearDisplay(&display_handler);
+    display_invalidate();
+
+    // Mode screens are drawn by the compositor task
+    display_compositor_init();
 
     // u8g2_SetMaxClipWindow(&display_handler);
     // u8g2_SetFont(&display_handler, u8g2_font_6x13_tr);
@@ -428,8 +495,12 @@ void display_init() {
 
 
 bool http_rest_button_control(struct fs_file *file, int num_params, char *params[], char *values[]) {
-    static char button_control_json_buffer[256];
-    memset(button_control_json_buffer, 0x0, sizeof(button_control_json_buffer));
+    const size_t button_control_json_buffer_size = 256;
+    char * button_control_json_buffer = (char *) rest_response_alloc(button_control_json_buffer_size);
+    if (button_control_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+    memset(button_control_json_buffer, 0x0, button_control_json_buffer_size);
 
     strcat(button_control_json_buffer, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n{\"button_pressed\":[");
 
@@ -494,8 +565,14 @@ bool http_rest_button_control(struct fs_file *file, int num_params, char *params
 bool http_rest_mini_12864_module_config(struct fs_file *file, int num_params, char *params[], char *values[]) {
     // Mappings:
     // b0 (bool): inverted_encoder_direction
+    // b1 (display_rotation_t | int): display_rotation
+    // b2 (int): max_frame_rate_hz
     // ee (bool): save to eeprom
-    static char buf[128];
+    const size_t buf_size = 128;
+    char * buf = (char *) rest_response_alloc(buf_size);
+    if (buf == NULL) {
+        return rest_response_unavailable(file);
+    }
     bool save_to_eeprom = false;
 
     // Control
@@ -508,6 +585,10 @@ bool http_rest_mini_12864_module_config(struct fs_file *file, int num_params, ch
             display_rotation_t display_rotation = (display_rotation_t) atoi(values[idx]);
             mini_12864_module_config.display_rotation = display_rotation;
         }
+        else if (strcmp(params[idx], "b2") == 0) {
+            int max_frame_rate_hz = atoi(values[idx]);
+            mini_12864_module_config.max_frame_rate_hz = max_frame_rate_hz < 1 ? 1 : (max_frame_rate_hz > 50 ? 50 : max_frame_rate_hz);
+        }
         else if (strcmp(params[idx], "ee") == 0) {
             save_to_eeprom = string_to_boolean(values[idx]);
         }
@@ -519,12 +600,13 @@ bool http_rest_mini_12864_module_config(struct fs_file *file, int num_params, ch
     }
 
     // Response
-    snprintf(buf, sizeof(buf), 
+    snprintf(buf, buf_size, 
              "%s"
-             "{\"b0\":%s, \"b1\":%d}", 
+             "{\"b0\":%s, \"b1\":%d, \"b2\":%d}", 
              http_json_header,
              boolean_to_string(mini_12864_module_config.inverted_encoder_direction),
-             mini_12864_module_config.display_rotation);
+             mini_12864_module_config.display_rotation,
+             mini_12864_module_config.max_frame_rate_hz);
     
     size_t response_len = strlen(buf);
     file->data = buf;
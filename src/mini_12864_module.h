@@ -30,6 +30,7 @@ typedef struct {
     uint32_t data_rev;
     bool inverted_encoder_direction;
     display_rotation_t display_rotation;
+    uint8_t max_frame_rate_hz;          // Upper bound of event driven render tasks
 } mini_12864_module_config_t;
 
 
@@ -42,6 +43,11 @@ extern "C" {
  * Wait for button encoder input. 
 */
 ButtonEncoderEvent_t button_wait_for_input(bool block);
+
+/**
+ * Step size for the latest rotation event from the rotation speed, 1 for slow turns and larger for fast spins.
+*/
+uint8_t button_get_encoder_step(void);
 bool mini_12864_module_init(void);
 void button_init(void);
 void display_init(void);
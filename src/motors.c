@@ -4,6 +4,8 @@
 #include <math.h>
 #include <FreeRTOS.h>
 #include <queue.h>
+#include <task.h>
+#include <semphr.h>
 #include <math.h>
 #include "app.h"
 #include "tmc2209.h"
@@ -11,6 +13,7 @@
 #include "configuration.h"
 #include "hardware/gpio.h"
 #include "hardware/pio.h"
+#include "hardware/dma.h"
 #include "hardware/clocks.h"
 #include "stepper.pio.h"
 
@@ -19,16 +22,32 @@
 #include "common.h"
 #include "display.h"  // in case the stepper motor driver failed to initialize
 #include "neopixel_led.h" // in case the stepper motor driver failed to initialize
+#include "servo_gate.h"
+#include "trace.h"
+#include "static_alloc.h"
+
+#if PICO_RP2350
+// Bits 31:28 of TRANS_COUNT select the mode on the RP2350 (all ones is ENDLESS, which never counts down)
+#define STEP_COUNTER_DMA_TRANSFER_COUNT     (DMA_CH0_TRANS_COUNT_COUNT_BITS >> DMA_CH0_TRANS_COUNT_COUNT_LSB)
+#else
+#define STEP_COUNTER_DMA_TRANSFER_COUNT     0xFFFFFFFFu
+#endif
+#define MOTOR_UART_RX_BUFFER_SIZE           32
+#define MOTOR_UART_READ_TIMEOUT_MS          5
+#define MOTOR_DIAGNOSTICS_PERIOD_MS         500
+
+
+// Internal data structure for speed control between tasks. The queue holds only the latest setpoint (mailbox).
+typedef enum {
+    STEPPER_COMMAND_VELOCITY = 0,
+    STEPPER_COMMAND_MOVE,
+} stepper_command_t;
 
-#define STEPPER_LOW_CYCLE_COUNT 13  // Defined as the implementation of stepper.pio
-#define MAX_RESPONSE_TIME   0.01f   // Maximum response time for PIO stepper
-
-
-// Internal data structure for speed control between tasks
 typedef struct {
-    float new_speed_setpoint;
-    float direction;
-    float ramp_rate;
+    stepper_command_t command;
+    float new_velocity;         // Velocity, or the maximum speed of a move (rev/s at the trickler)
+    float revolutions;          // Move distance at the trickler, negative to reverse
+    uint32_t seq;
 } stepper_speed_control_t;
 
 
@@ -53,6 +72,8 @@ const eeprom_motor_data_t default_motor_data = {
 
         .inverted_direction = false,        // Invert the rotation direction if set to true
         .inverted_enable = false,           // Invert the enable flag if set to true
+
+        .ramp_profile = MOTOR_RAMP_LINEAR,
     },
     .motor_data[1] = {
         .full_steps_per_rotation = 200,     // 200: 1.8 deg stepper, 400: 0.9 deg stepper
@@ -67,6 +88,8 @@ const eeprom_motor_data_t default_motor_data = {
 
         .inverted_direction = false,        // Invert the rotation direction if set to true
         .inverted_enable = false,           // Invert the enable flag if set to true
+
+        .ramp_profile = MOTOR_RAMP_LINEAR,
     },
 };
 
@@ -105,98 +128,200 @@ bool _block_wait_for_sync(uart_inst_t * uart) {
 }
 
 
+// CRC8 (poly 0x07) in the reflected domain, see swuart_calcCRC
+static const uint8_t tmc_crc8_table[256] = {
+    0x00, 0x91, 0xE3, 0x72, 0x07, 0x96, 0xE4, 0x75, 0x0E, 0x9F, 0xED, 0x7C, 0x09, 0x98, 0xEA, 0x7B,
+    0x1C, 0x8D, 0xFF, 0x6E, 0x1B, 0x8A, 0xF8, 0x69, 0x12, 0x83, 0xF1, 0x60, 0x15, 0x84, 0xF6, 0x67,
+    0x38, 0xA9, 0xDB, 0x4A, 0x3F, 0xAE, 0xDC, 0x4D, 0x36, 0xA7, 0xD5, 0x44, 0x31, 0xA0, 0xD2, 0x43,
+    0x24, 0xB5, 0xC7, 0x56, 0x23, 0xB2, 0xC0, 0x51, 0x2A, 0xBB, 0xC9, 0x58, 0x2D, 0xBC, 0xCE, 0x5F,
+    0x70, 0xE1, 0x93, 0x02, 0x77, 0xE6, 0x94, 0x05, 0x7E, 0xEF, 0x9D, 0x0C, 0x79, 0xE8, 0x9A, 0x0B,
+    0x6C, 0xFD, 0x8F, 0x1E, 0x6B, 0xFA, 0x88, 0x19, 0x62, 0xF3, 0x81, 0x10, 0x65, 0xF4, 0x86, 0x17,
+    0x48, 0xD9, 0xAB, 0x3A, 0x4F, 0xDE, 0xAC, 0x3D, 0x46, 0xD7, 0xA5, 0x34, 0x41, 0xD0, 0xA2, 0x33,
+    0x54, 0xC5, 0xB7, 0x26, 0x53, 0xC2, 0xB0, 0x21, 0x5A, 0xCB, 0xB9, 0x28, 0x5D, 0xCC, 0xBE, 0x2F,
+    0xE0, 0x71, 0x03, 0x92, 0xE7, 0x76, 0x04, 0x95, 0xEE, 0x7F, 0x0D, 0x9C, 0xE9, 0x78, 0x0A, 0x9B,
+    0xFC, 0x6D, 0x1F, 0x8E, 0xFB, 0x6A, 0x18, 0x89, 0xF2, 0x63, 0x11, 0x80, 0xF5, 0x64, 0x16, 0x87,
+    0xD8, 0x49, 0x3B, 0xAA, 0xDF, 0x4E, 0x3C, 0xAD, 0xD6, 0x47, 0x35, 0xA4, 0xD1, 0x40, 0x32, 0xA3,
+    0xC4, 0x55, 0x27, 0xB6, 0xC3, 0x52, 0x20, 0xB1, 0xCA, 0x5B, 0x29, 0xB8, 0xCD, 0x5C, 0x2E, 0xBF,
+    0x90, 0x01, 0x73, 0xE2, 0x97, 0x06, 0x74, 0xE5, 0x9E, 0x0F, 0x7D, 0xEC, 0x99, 0x08, 0x7A, 0xEB,
+    0x8C, 0x1D, 0x6F, 0xFE, 0x8B, 0x1A, 0x68, 0xF9, 0x82, 0x13, 0x61, 0xF0, 0x85, 0x14, 0x66, 0xF7,
+    0xA8, 0x39, 0x4B, 0xDA, 0xAF, 0x3E, 0x4C, 0xDD, 0xA6, 0x37, 0x45, 0xD4, 0xA1, 0x30, 0x42, 0xD3,
+    0xB4, 0x25, 0x57, 0xC6, 0xB3, 0x22, 0x50, 0xC1, 0xBA, 0x2B, 0x59, 0xC8, 0xBD, 0x2C, 0x5E, 0xCF,
+};
+
+
 void swuart_calcCRC(uint8_t* datagram, uint8_t datagramLength)
 {
-    int i,j;
-    uint8_t* crc = datagram + (datagramLength-1); // CRC located in last byte of message
-    uint8_t currentByte;
-    *crc = 0;
-    for (i=0; i<(datagramLength-1); i++) { // Execute for all bytes of a message
-        currentByte = datagram[i]; // Retrieve a byte to be sent from Array
-        for (j=0; j<8; j++) {
-            if ((*crc >> 7) ^ (currentByte&0x01)) // update CRC based result of XOR operation
-            {
-                *crc = (*crc << 1) ^ 0x07;
-            }
-            else
-            {
-                *crc = (*crc << 1);
-            }
-            currentByte = currentByte >> 1;
-        } // for CRC bit
-    } // for message byte
+    // The TMC CRC shifts the data LSB first into an MSB first CRC8. Computed in the reflected domain it is one table 
+    // lookup per byte, and the result is reflected back at the end.
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < datagramLength - 1; i++) {
+        crc = tmc_crc8_table[crc ^ datagram[i]];
+    }
+
+    crc = (crc & 0xF0) >> 4 | (crc & 0x0F) << 4;
+    crc = (crc & 0xCC) >> 2 | (crc & 0x33) << 2;
+    crc = (crc & 0xAA) >> 1 | (crc & 0x55) << 1;
+
+    datagram[datagramLength - 1] = crc;  // CRC located in last byte of message
+}
+
+
+// Interrupt driven reception for register reads, used once the scheduler is running
+static SemaphoreHandle_t motor_uart_mutex = NULL;
+static SemaphoreHandle_t motor_uart_rx_semaphore = NULL;
+static volatile uint8_t motor_uart_rx_buffer[MOTOR_UART_RX_BUFFER_SIZE];
+static volatile uint8_t motor_uart_rx_count = 0;
+
+
+static void _motor_uart_rx_isr() {
+    BaseType_t higher_priority_task_woken = pdFALSE;
+
+    while (uart_is_readable(MOTOR_UART)) {
+        uint8_t c = uart_getc(MOTOR_UART);
+        if (motor_uart_rx_count < MOTOR_UART_RX_BUFFER_SIZE) {
+            motor_uart_rx_buffer[motor_uart_rx_count++] = c;
+        }
+    }
+
+    xSemaphoreGiveFromISR(motor_uart_rx_semaphore, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
 }
 
 
+static void _motor_uart_rx_init() {
+    motor_uart_mutex = STATIC_SEMAPHORE_CREATE_MUTEX();
+    motor_uart_rx_semaphore = STATIC_SEMAPHORE_CREATE_BINARY();
+
+    uint irq_num = uart_get_index(MOTOR_UART) == 0 ? UART0_IRQ : UART1_IRQ;
+    irq_set_exclusive_handler(irq_num, _motor_uart_rx_isr);
+    irq_set_enabled(irq_num, true);
+}
+
+
+static inline void _take_motor_uart(BaseType_t scheduler_state) {
+    if (scheduler_state != taskSCHEDULER_NOT_STARTED && motor_uart_mutex) {
+        xSemaphoreTake(motor_uart_mutex, portMAX_DELAY);
+    }
+}
+
+
+static inline void _give_motor_uart(BaseType_t scheduler_state) {
+    if (scheduler_state != taskSCHEDULER_NOT_STARTED && motor_uart_mutex) {
+        xSemaphoreGive(motor_uart_mutex);
+    }
+}
+
+
+// Finds a valid reply (sync, master address 0xFF) in the received bytes, skipping the echo of the request
+static bool _parse_read_reply(TMC_uart_write_datagram_t * wdgr) {
+    for (uint8_t idx = 0; idx + sizeof(TMC_uart_write_datagram_t) <= motor_uart_rx_count; idx += 1) {
+        if (motor_uart_rx_buffer[idx] != 0x05 || motor_uart_rx_buffer[idx + 1] != 0xFF) {
+            continue;
+        }
+
+        for (uint8_t i = 0; i < sizeof(TMC_uart_write_datagram_t); i += 1) {
+            wdgr->data[i] = motor_uart_rx_buffer[idx + i];
+        }
+
+        uint8_t crc = wdgr->msg.crc;
+        swuart_calcCRC(wdgr->data, sizeof(TMC_uart_write_datagram_t));
+        if (crc == wdgr->msg.crc) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 
 void tmc_uart_write (trinamic_motor_t driver, TMC_uart_write_datagram_t *datagram)
 {
+    BaseType_t scheduler_state = xTaskGetSchedulerState();
+    _take_motor_uart(scheduler_state);
+
+    // The echo is dropped while the receiver is disabled. Any tail of it caught by the next read is skipped 
+    // when parsing the reply.
     uart_write_blocking(MOTOR_UART, datagram->data, sizeof(TMC_uart_write_datagram_t));
+
+    _give_motor_uart(scheduler_state);
 }
 
 TMC_uart_write_datagram_t *tmc_uart_read (trinamic_motor_t driver, TMC_uart_read_datagram_t *datagram)
 {
     static TMC_uart_write_datagram_t wdgr = {0}; 
 
-    uart_write_blocking(MOTOR_UART, datagram->data, sizeof(TMC_uart_read_datagram_t));
+    BaseType_t scheduler_state = xTaskGetSchedulerState();
+    _take_motor_uart(scheduler_state);
 
-    // At 250k baud rate the transmit time is about 320us. Need to wait long enough to not reading the echo message back.
-    busy_wait_us(20);
-    _enable_uart_rx(MOTOR_UART, true);
-    busy_wait_ms(2);
-    
-    uint8_t sync_flag = 0x05;
-    int8_t idx = -1;
-    while (uart_is_readable_within_us(MOTOR_UART, 2000)) {
-        uint8_t c;
-
-        uart_read_blocking(MOTOR_UART, &c, 1);
-        if (c == sync_flag) {
-            idx = 0;
-        }
+    // An invalid reply fails the address check of the caller
+    memset(&wdgr, 0x0, sizeof(wdgr));
 
-        if (idx >= 0 && idx < 8) {
-            wdgr.data[idx++] = c;
-        }
+    if (scheduler_state == taskSCHEDULER_NOT_STARTED) {
+        uart_write_blocking(MOTOR_UART, datagram->data, sizeof(TMC_uart_read_datagram_t));
 
-        if (idx == 8) {
-            // FIXME: there is known issue that calling IFCNT causes target addr to be incorrect. 
-            // Calculate CRC
-            uint8_t crc = wdgr.msg.crc;
-            swuart_calcCRC(wdgr.data, sizeof(TMC_uart_write_datagram_t));
-            if (crc == wdgr.msg.crc) {
-                break;
+        // At 250k baud rate the transmit time is about 320us. Need to wait long enough to not reading the echo message back.
+        busy_wait_us(20);
+        _enable_uart_rx(MOTOR_UART, true);
+        busy_wait_ms(2);
+        
+        uint8_t sync_flag = 0x05;
+        int8_t idx = -1;
+        while (uart_is_readable_within_us(MOTOR_UART, 2000)) {
+            uint8_t c;
+
+            uart_read_blocking(MOTOR_UART, &c, 1);
+            if (c == sync_flag) {
+                idx = 0;
+            }
+
+            if (idx >= 0 && idx < 8) {
+                wdgr.data[idx++] = c;
+            }
+
+            if (idx == 8) {
+                // FIXME: there is known issue that calling IFCNT causes target addr to be incorrect. 
+                // Calculate CRC
+                uint8_t crc = wdgr.msg.crc;
+                swuart_calcCRC(wdgr.data, sizeof(TMC_uart_write_datagram_t));
+                if (crc == wdgr.msg.crc) {
+                    break;
+                }
+                idx = -1;
             }
-            idx = -1;
         }
-    }
 
-    _enable_uart_rx(MOTOR_UART, false);
+        _enable_uart_rx(MOTOR_UART, false);
+    }
+    else {
+        // Receive the echo and the reply from the interrupt, the task sleeps in the meantime
+        _clear_rx_buffer(MOTOR_UART);
+        motor_uart_rx_count = 0;
+        xSemaphoreTake(motor_uart_rx_semaphore, 0);
 
-    return &wdgr;
-}
+        _enable_uart_rx(MOTOR_UART, true);
+        uart_set_irq_enables(MOTOR_UART, true, false);
 
-uint32_t speed_to_period(float speed, uint32_t pio_clock_speed, uint32_t full_rotation_steps) {
-    // speed: rev/s
-    float step_speed = full_rotation_steps * speed;    // in steps/s
+        uart_write_blocking(MOTOR_UART, datagram->data, sizeof(TMC_uart_read_datagram_t));
 
-    uint32_t full_cycle_count = lroundf(pio_clock_speed / step_speed);
+        TimeOut_t timeout;
+        TickType_t ticks_left = pdMS_TO_TICKS(MOTOR_UART_READ_TIMEOUT_MS);
+        vTaskSetTimeOutState(&timeout);
 
-    // Limit by maximum response time
-    uint32_t max_response_steps = pio_clock_speed * MAX_RESPONSE_TIME;
-    if (full_cycle_count > max_response_steps){ 
-        full_cycle_count = 0;
-    }
+        while (!_parse_read_reply(&wdgr)) {
+            if (xTaskCheckForTimeOut(&timeout, &ticks_left) != pdFALSE) {
+                memset(&wdgr, 0x0, sizeof(wdgr));
+                break;
+            }
+            xSemaphoreTake(motor_uart_rx_semaphore, ticks_left);
+        }
 
-    // Avoid wrap around
-    if (full_cycle_count < STEPPER_LOW_CYCLE_COUNT) {
-        full_cycle_count = STEPPER_LOW_CYCLE_COUNT;
+        uart_set_irq_enables(MOTOR_UART, false, false);
+        _enable_uart_rx(MOTOR_UART, false);
     }
 
-    // High cycle should be calculated as full_cycle - low cycle.
-    uint32_t high_cycle_steps = full_cycle_count - STEPPER_LOW_CYCLE_COUNT;
+    _give_motor_uart(scheduler_state);
 
-    return high_cycle_steps;
+    return &wdgr;
 }
 
 
@@ -247,19 +372,29 @@ bool tmc2209_init (TMC2209_t *driver)
 }
 
 
+static TMC2209_t * _tmc_driver_alloc(void) {
+#if STATIC_ALLOCATION
+    // One per trickler motor
+    static TMC2209_t tmc_drivers[2];
+    static uint8_t tmc_driver_cnt = 0;
+
+    return tmc_driver_cnt < count_of(tmc_drivers) ? &tmc_drivers[tmc_driver_cnt++] : NULL;
+#else
+    return malloc(sizeof(TMC2209_t));
+#endif
+}
+
+
 bool driver_init(motor_config_t * motor_config) {
     // Copy the user config to the driver config and initialize the communication
     // Return True if the initialization is successful, False otherwise. 
     // This must be called after the UART is initialized. 
     
-    // Check if the tmc driver is already initialized. If true then free the previously allocated
-    //  driver then re-create. 
-    if (motor_config->tmc_driver) {
-        free(motor_config->tmc_driver);
+    // A re-init sets up the driver allocated by the first init again
+    TMC2209_t * tmc_driver = (TMC2209_t *) motor_config->tmc_driver;
+    if (tmc_driver == NULL) {
+        tmc_driver = _tmc_driver_alloc();
     }
-
-
-    TMC2209_t * tmc_driver = malloc(sizeof(TMC2209_t));
     if (tmc_driver == NULL) {
         return false;
     }
@@ -300,6 +435,69 @@ bool driver_io_init(motor_config_t * motor_config) {
     return true;
 }
 
+static void _step_counter_start(motor_config_t * motor_config) {
+    PIO pio = motor_config->pio_config.pio;
+    int sm = motor_config->pio_config.sm;
+
+    dma_channel_config c = dma_channel_get_default_config(motor_config->step_counter_dma_channel);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(pio, sm, false));
+
+    dma_channel_configure(motor_config->step_counter_dma_channel, 
+                          &c, 
+                          &motor_config->step_counter_sink, 
+                          &pio->rxf[sm], 
+#if PICO_RP2350
+                          dma_encode_transfer_count(STEP_COUNTER_DMA_TRANSFER_COUNT), 
+#else
+                          STEP_COUNTER_DMA_TRANSFER_COUNT, 
+#endif
+                          true);
+}
+
+
+static void _step_counter_init(motor_config_t * motor_config) {
+    motor_config->step_counter_dma_channel = dma_claim_unused_channel(false);
+    if (motor_config->step_counter_dma_channel < 0) {
+        printf("Unable to claim DMA channel for the step counter\n");
+        return;
+    }
+
+    _step_counter_start(motor_config);
+}
+
+
+static uint32_t _step_counter_read(motor_config_t * motor_config) {
+    if (motor_config->step_counter_dma_channel < 0) {
+        return 0;
+    }
+
+    // The transfer count register reads back the remaining transfers (and the mode bits on the RP2350)
+    uint32_t remaining = dma_channel_hw_addr(motor_config->step_counter_dma_channel)->transfer_count & 
+                         STEP_COUNTER_DMA_TRANSFER_COUNT;
+
+    // Re-arm once the whole transfer count is used up
+    if (remaining == 0) {
+        motor_config->step_counter_base += STEP_COUNTER_DMA_TRANSFER_COUNT;
+        _step_counter_start(motor_config);
+        remaining = STEP_COUNTER_DMA_TRANSFER_COUNT;
+    }
+
+    return motor_config->step_counter_base + (STEP_COUNTER_DMA_TRANSFER_COUNT - remaining);
+}
+
+
+static int64_t _step_counter_get_position(motor_config_t * motor_config) {
+    // step_direction is true for the reverse direction unless the motor direction is inverted
+    bool forward = motor_config->step_direction == motor_config->persistent_config.inverted_direction;
+    int64_t steps_since_sample = (uint32_t) (_step_counter_read(motor_config) - motor_config->position_sample_steps);
+
+    return motor_config->position_steps + (forward ? steps_since_sample : -steps_since_sample);
+}
+
+
 bool driver_pio_init(motor_config_t * motor_config) {
     // Allocate PIO to the stepper
     PIO pio = MOTOR_PIO;  // Always use specified PIO to ensure the resource is claimed
@@ -337,13 +535,16 @@ bool driver_pio_init(motor_config_t * motor_config) {
 
     stepper_program_init(pio, sm, offset, motor_config->step_pin);
 
-    // Start stepper state machine
-    pio_sm_set_enabled(pio, sm, true);
-
     // Record the PIO configuration
     motor_config->pio_config.pio = pio;
     motor_config->pio_config.sm = sm;
 
+    // The step counter is optional, the stepper still works if it is not available
+    _step_counter_init(motor_config);
+
+    // Start stepper state machine
+    pio_sm_set_enabled(pio, sm, true);
+
     return true;
 }
 
@@ -367,6 +568,9 @@ bool motor_config_init(void) {
     memcpy(&coarse_trickler_motor_config.persistent_config, &eeprom_motor_data.motor_data[0], sizeof(motor_persistent_config_t));
     memcpy(&fine_trickler_motor_config.persistent_config, &eeprom_motor_data.motor_data[1], sizeof(motor_persistent_config_t));
 
+    motor_update_ramp_shape(&coarse_trickler_motor_config);
+    motor_update_ramp_shape(&fine_trickler_motor_config);
+
     // Set initial direction
     coarse_trickler_motor_config.step_direction = coarse_trickler_motor_config.persistent_config.inverted_direction ? true : false;
     fine_trickler_motor_config.step_direction = fine_trickler_motor_config.persistent_config.inverted_direction ? true : false;
@@ -374,6 +578,10 @@ bool motor_config_init(void) {
     // Register to eeprom save all
     eeprom_register_handler(motor_config_save);
 
+    // Served together with the other modules by /rest/config
+    rest_register_config_module("coarse_motor_config", http_rest_coarse_motor_config);
+    rest_register_config_module("fine_motor_config", http_rest_fine_motor_config);
+
     return is_ok;
 }
 
@@ -395,96 +603,444 @@ bool motor_config_save() {
 }
 
 
-void speed_ramp(motor_config_t * motor_config, float prev_speed, float new_speed, uint32_t pio_speed) {
+void motor_update_ramp_shape(motor_config_t * motor_config) {
+    speed_ramp_t * ramp = &motor_config->speed_ramp;
+
+    for (uint32_t idx = 0; idx <= SPEED_RAMP_SHAPE_SIZE; idx += 1) {
+        float t = idx / (float) SPEED_RAMP_SHAPE_SIZE;
+
+        if (motor_config->persistent_config.ramp_profile == MOTOR_RAMP_S_CURVE) {
+            // Smoothstep: acceleration 6t(1-t) rises and falls with bounded jerk, the peak is 1.5x the average
+            ramp->shape[idx] = t * t * (3.0f - 2.0f * t);
+        }
+        else {
+            ramp->shape[idx] = t;
+        }
+    }
+
+    ramp->time_scale = motor_config->persistent_config.ramp_profile == MOTOR_RAMP_S_CURVE ? 1.5f : 1.0f;
+}
+
+
+static inline float _ramp_shape_lookup(speed_ramp_t * ramp, float t) {
+    float position = t * SPEED_RAMP_SHAPE_SIZE;
+    uint32_t idx = (uint32_t) position;
+    if (idx >= SPEED_RAMP_SHAPE_SIZE) {
+        return ramp->shape[SPEED_RAMP_SHAPE_SIZE];
+    }
+
+    float fraction = position - idx;
+    return ramp->shape[idx] + (ramp->shape[idx + 1] - ramp->shape[idx]) * fraction;
+}
+
+
+static bool _speed_ramp_timer_callback(repeating_timer_t * rt) {
+    motor_config_t * motor_config = (motor_config_t *) rt->user_data;
+    speed_ramp_t * ramp = &motor_config->speed_ramp;
+
+    pio_sm_clear_fifos(motor_config->pio_config.pio, motor_config->pio_config.sm);
+    pio_sm_put(motor_config->pio_config.pio, motor_config->pio_config.sm, ramp->period_table[ramp->idx]);
+
+    ramp->idx += 1;
+    if (ramp->idx < ramp->length) {
+        return true;
+    }
+
+    // Last period is loaded, wake up the stepper task and stop the timer
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(motor_config->stepper_speed_control_task_handler, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+
+    return false;
+}
+
+
+/*
+    Ramps from prev_speed to new_speed and returns the speed reached. A newer setpoint in the mailbox preempts the 
+    ramp, in which case the speed reached so far is returned.
+*/
+float speed_ramp(motor_config_t * motor_config, float prev_speed, float new_speed, uint32_t pio_speed) {
     // Calculate ramp param
+    speed_ramp_t * ramp = &motor_config->speed_ramp;
+
     float dv = new_speed - prev_speed;
-    float ramp_time_s = fabs(dv / motor_config->persistent_config.angular_acceleration);
+    float ramp_time_s = fabs(dv / motor_config->persistent_config.angular_acceleration) * ramp->time_scale;
     uint32_t full_rotation_steps = motor_config->persistent_config.full_steps_per_rotation * motor_config->persistent_config.microsteps;
-
-    // Calculate termination condition
     uint32_t ramp_time_us = (uint32_t) (fabs(ramp_time_s) * 1e6);
-    uint32_t start_time = time_us_32();
-    uint32_t stop_time = start_time + ramp_time_us;
 
-    float current_speed;
-    uint32_t current_period;
+    // Too short to ramp, apply the new speed directly
+    if (ramp_time_us < SPEED_RAMP_MIN_INTERVAL_US) {
+        uint32_t period = speed_to_period(new_speed, pio_speed, full_rotation_steps);
+        pio_sm_clear_fifos(motor_config->pio_config.pio, motor_config->pio_config.sm);
+        pio_sm_put_blocking(motor_config->pio_config.pio, motor_config->pio_config.sm, period);
+        return new_speed;
+    }
+
+    // Precompute the periods, long ramps use longer intervals to fit in the table
+    uint32_t length = ramp_time_us / SPEED_RAMP_MIN_INTERVAL_US;
+    if (length > SPEED_RAMP_MAX_STEPS) {
+        length = SPEED_RAMP_MAX_STEPS;
+    }
+    uint32_t interval_us = ramp_time_us / length;
+
+    for (uint32_t idx = 0; idx < length; idx += 1) {
+        float current_speed = prev_speed + dv * _ramp_shape_lookup(ramp, (idx + 1) / (float) length);
+        ramp->period_table[idx] = speed_to_period(current_speed, pio_speed, full_rotation_steps);
+    }
+    ramp->length = length;
+    ramp->idx = 0;
+
+    // Clear any stale notification. If a newer setpoint is already waiting there is no point to start.
+    ulTaskNotifyTake(pdTRUE, 0);
+    if (uxQueueMessagesWaiting(motor_config->stepper_speed_control_queue) > 0) {
+        return prev_speed;
+    }
+
+    if (!add_repeating_timer_us(-((int64_t) interval_us), _speed_ramp_timer_callback, motor_config, &ramp->timer)) {
+        // No alarm slot available, jump to the final speed
+        pio_sm_clear_fifos(motor_config->pio_config.pio, motor_config->pio_config.sm);
+        pio_sm_put_blocking(motor_config->pio_config.pio, motor_config->pio_config.sm, ramp->period_table[length - 1]);
+        return new_speed;
+    }
+
+    // Sleep until the alarm loaded the last period, or motor_set_speed posted a newer setpoint
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    if (ramp->idx < ramp->length) {
+        cancel_repeating_timer(&ramp->timer);
+
+        // The PIO keeps running at the last loaded period
+        return prev_speed + dv * _ramp_shape_lookup(ramp, ramp->idx / (float) length);
+    }
+
+    return new_speed;
+}
+
+
+/*
+    Ramps the motor to new_velocity (motor shaft, rev/s), changing the direction if required. 
+    Returns false if a newer command preempted the ramp.
+*/
+static bool _stepper_update_velocity(motor_config_t * motor_config, float new_velocity, uint32_t pio_speed) {
+    float prev_sign = motor_config->prev_velocity >= 0 ? 1.0f : -1.0f;
+    float new_sign = new_velocity >= 0 ? 1.0f : -1.0f;
+
+    // Determine if both have same direction (no need to change DIR pin state)
+    if (prev_sign == new_sign) {
+        // Same direction means only speed change
+        float reached_speed = speed_ramp(motor_config, 
+                                         fabs(motor_config->prev_velocity), 
+                                         fabs(new_velocity), 
+                                         pio_speed);
+        motor_config->prev_velocity = prev_sign * reached_speed;
+
+        return reached_speed == fabs(new_velocity);
+    }
+
+    // Different direction, then ramp down to 0, change direction then ramp up
+    float reached_speed = speed_ramp(motor_config, 
+                                     fabs(motor_config->prev_velocity),
+                                     0.0f,
+                                     pio_speed);
+
+    if (reached_speed > 0) {
+        // Preempted before stopping, keep the current direction
+        motor_config->prev_velocity = prev_sign * reached_speed;
+        return false;
+    }
+
+    // Accumulate the position travelled in the previous direction
+    taskENTER_CRITICAL();
+    motor_config->position_steps = _step_counter_get_position(motor_config);
+    motor_config->position_sample_steps = _step_counter_read(motor_config);
+    motor_config->step_direction = !motor_config->step_direction;
+    taskEXIT_CRITICAL();
+
+    // Toggle the direction
+    gpio_put(motor_config->dir_pin, motor_config->step_direction);
+
+    // Ramp to the new speed
+    reached_speed = speed_ramp(motor_config, 
+                               0.0f,
+                               fabs(new_velocity),
+                               pio_speed);
+    motor_config->prev_velocity = new_sign * reached_speed;
+
+    return reached_speed == fabs(new_velocity);
+}
+
+
+/*
+    Moves the motor by the given revolutions (motor shaft) at up to speed (rev/s), using the step counter to find 
+    the point to start decelerating. Returns false if a newer command preempted the move.
+*/
+static bool _stepper_move(motor_config_t * motor_config, float revolutions, float speed, uint32_t pio_speed) {
+    uint32_t full_rotation_steps = motor_config->persistent_config.full_steps_per_rotation * motor_config->persistent_config.microsteps;
+    float acceleration = motor_config->persistent_config.angular_acceleration;
+    float distance = fabsf(revolutions);
+    float direction = revolutions >= 0 ? 1.0f : -1.0f;
+
+    // Stop first so the move is measured from standstill
+    if (!_stepper_update_velocity(motor_config, 0.0f, pio_speed)) {
+        return false;
+    }
+
+    // Short moves never reach the requested speed. The ramp shape stretches the ramp time, and so the distance.
+    float time_scale = motor_config->speed_ramp.time_scale;
+    float peak_speed = fminf(fabsf(speed), sqrtf(acceleration * distance / time_scale));
+    int64_t decel_steps = (int64_t) (peak_speed * peak_speed / (2 * acceleration) * time_scale * full_rotation_steps);
+    int64_t target_steps = (int64_t) (distance * full_rotation_steps);
+
+    taskENTER_CRITICAL();
+    int64_t start_position = _step_counter_get_position(motor_config);
+    taskEXIT_CRITICAL();
+
+    if (!_stepper_update_velocity(motor_config, direction * peak_speed, pio_speed)) {
+        return false;
+    }
+
+    // Cruise until the deceleration point
     while (true) {
-        uint32_t current_time = time_us_32();
-        if (current_time > stop_time) {
+        taskENTER_CRITICAL();
+        int64_t travelled = (_step_counter_get_position(motor_config) - start_position) * (int64_t) direction;
+        taskEXIT_CRITICAL();
+
+        if (travelled + decel_steps >= target_steps || motor_config->step_counter_dma_channel < 0) {
             break;
         }
 
-        float percentage = (current_time - start_time) / (float) ramp_time_us;
+        if (uxQueueMessagesWaiting(motor_config->stepper_speed_control_queue) > 0) {
+            return false;
+        }
 
-        current_speed = prev_speed + dv * percentage;
-        current_period = speed_to_period(current_speed, pio_speed, full_rotation_steps);
-        pio_sm_clear_fifos(motor_config->pio_config.pio, motor_config->pio_config.sm);
-        pio_sm_put(motor_config->pio_config.pio, motor_config->pio_config.sm, current_period);
+        vTaskDelay(pdMS_TO_TICKS(1));
     }
 
-    current_period = speed_to_period(new_speed, pio_speed, full_rotation_steps);
-    pio_sm_clear_fifos(motor_config->pio_config.pio, motor_config->pio_config.sm);
-    pio_sm_put_blocking(motor_config->pio_config.pio, motor_config->pio_config.sm, current_period);
+    return _stepper_update_velocity(motor_config, 0.0f, pio_speed);
 }
 
 
 void stepper_speed_control_task(void * p) {    
+    motor_config_t * motor_config = (motor_config_t *) p;
+
     // Currently doing speed control
     while (true) {
         // Wait for new speed
-        float new_velocity;
-        xQueueReceive(((motor_config_t *) p)->stepper_speed_control_queue, &new_velocity, portMAX_DELAY);
-
-        // Calculate the speed of the motor
-        new_velocity /= ((motor_config_t *) p)->persistent_config.gear_ratio;
+        stepper_speed_control_t command;
+        xQueueReceive(motor_config->stepper_speed_control_queue, &command, portMAX_DELAY);
+        motor_config->applied_seq = command.seq;
+        motor_config->ramping = true;
+        trace_record(TRACE_EVENT_MOTOR_RAMP_START, motor_config->uart_addr);
 
         // Get latest PIO speed, in case of the change of system clock
         uint32_t pio_speed = clock_get_hz(clk_sys);
 
-        // Determine if both have same direction (no need to change DIR pin state)
-        if ((new_velocity >= 0) == (((motor_config_t *) p)->prev_velocity >= 0)) {
-            // Same direction means only speed change
-            speed_ramp(((motor_config_t *) p), 
-                       fabs(((motor_config_t *) p)->prev_velocity), 
-                       fabs(new_velocity), 
-                       pio_speed);
+        // Calculate the speed of the motor
+        float gear_ratio = motor_config->persistent_config.gear_ratio;
+
+        if (command.command == STEPPER_COMMAND_MOVE) {
+            motor_config->moving = true;
+            _stepper_move(motor_config, command.revolutions / gear_ratio, command.new_velocity / gear_ratio, pio_speed);
+            motor_config->moving = false;
+
+            // Signal the completion, also when preempted since the move is no longer active
+            xSemaphoreGive(motor_config->move_complete_semaphore);
         }
         else {
-            // Different direction, then ramp down to 0, change direction then ramp up
-            speed_ramp(((motor_config_t *) p), 
-                       fabs(((motor_config_t *) p)->prev_velocity),
-                       0.0f,
-                       pio_speed);
-            ((motor_config_t *) p)->step_direction = !((motor_config_t *) p)->step_direction;
-
-            // Toggle the direction
-            gpio_put(((motor_config_t *) p)->dir_pin, ((motor_config_t *) p)->step_direction);
-
-            // Ramp to the new speed
-            speed_ramp(((motor_config_t *) p), 
-                       0.0f,
-                       fabs(new_velocity),
-                       pio_speed);
+            _stepper_update_velocity(motor_config, command.new_velocity / gear_ratio, pio_speed);
         }
 
-        // Update speed
-        ((motor_config_t *) p)->prev_velocity = new_velocity;
+        motor_config->ramping = false;
+        trace_record(TRACE_EVENT_MOTOR_RAMP_END, motor_config->uart_addr);
     }
 }   
 
 
+static void _motor_post_command(motor_config_t * motor_config, stepper_speed_control_t * command) {
+    if (motor_config->stepper_speed_control_queue == NULL) {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    command->seq = ++motor_config->command_seq;
+    motor_config->commanded_velocity = command->command == STEPPER_COMMAND_MOVE ? 0.0f : command->new_velocity;
+    taskEXIT_CRITICAL();
+
+    // Replace any command not yet taken by the motor task, and preempt the ongoing ramp
+    xQueueOverwrite(motor_config->stepper_speed_control_queue, command);
+    trace_record(TRACE_EVENT_MOTOR_ENQUEUE, motor_config->uart_addr);
+    if (motor_config->stepper_speed_control_task_handler) {
+        xTaskNotifyGive(motor_config->stepper_speed_control_task_handler);
+    }
+}
+
+
+static void _motor_post_setpoint(motor_config_t * motor_config, float new_velocity) {
+    stepper_speed_control_t command = {
+        .command = STEPPER_COMMAND_VELOCITY,
+        .new_velocity = new_velocity,
+    };
+
+    _motor_post_command(motor_config, &command);
+}
+
+
 void motor_set_speed(motor_select_t selected_motor, float new_velocity) {
+    // Release both motor tasks together
+    vTaskSuspendAll();
+
     if (selected_motor == SELECT_COARSE_TRICKLER_MOTOR || selected_motor == SELECT_BOTH_MOTOR) {
-        if (coarse_trickler_motor_config.stepper_speed_control_queue) {
-            xQueueSend(coarse_trickler_motor_config.stepper_speed_control_queue, &new_velocity, portMAX_DELAY);
-        }
+        _motor_post_setpoint(&coarse_trickler_motor_config, new_velocity);
     }
 
     if (selected_motor == SELECT_FINE_TRICKLER_MOTOR || selected_motor == SELECT_BOTH_MOTOR) {
-        if (fine_trickler_motor_config.stepper_speed_control_queue) {
-            xQueueSend(fine_trickler_motor_config.stepper_speed_control_queue, &new_velocity, portMAX_DELAY);
-        }
+        _motor_post_setpoint(&fine_trickler_motor_config, new_velocity);
+    }
+
+    xTaskResumeAll();
+}
+
+
+/*
+    Posts both trickler setpoints (and the gate ratio) with the scheduler suspended, so the motor tasks are released
+    together and act on the command in the same tick. A motor already commanded to the same velocity isn't posted
+    again, which also leaves an ongoing move (e.g. the coarse back-off) alone when it is asked to stop.
+*/
+void motor_apply_command(const motor_command_t * command) {
+    vTaskSuspendAll();
+
+    if (!isnan(command->coarse_velocity) && 
+        command->coarse_velocity != coarse_trickler_motor_config.commanded_velocity) {
+        _motor_post_setpoint(&coarse_trickler_motor_config, command->coarse_velocity);
+    }
+
+    if (!isnan(command->fine_velocity) && 
+        command->fine_velocity != fine_trickler_motor_config.commanded_velocity) {
+        _motor_post_setpoint(&fine_trickler_motor_config, command->fine_velocity);
+    }
+
+    if (!isnan(command->gate_ratio)) {
+        servo_gate_set_ratio(command->gate_ratio, false);
+    }
+
+    xTaskResumeAll();
+}
+
+
+static motor_config_t * _get_motor_config(motor_select_t selected_motor) {
+    switch (selected_motor)
+    {
+    case SELECT_COARSE_TRICKLER_MOTOR:
+        return &coarse_trickler_motor_config;
+    case SELECT_FINE_TRICKLER_MOTOR:
+        return &fine_trickler_motor_config;
+    default:
+        return NULL;
+    }
+}
+
+
+// Total steps made by the motor since boot, in either direction. Use the difference of two reads for an interval.
+uint32_t motor_get_step_count(motor_select_t selected_motor) {
+    motor_config_t * motor_config = _get_motor_config(selected_motor);
+    if (motor_config == NULL) {
+        return 0;
+    }
+
+    taskENTER_CRITICAL();
+    uint32_t steps = _step_counter_read(motor_config);
+    taskEXIT_CRITICAL();
+
+    return steps;
+}
+
+
+// Signed position in steps, positive in the forward (non-reversed) direction
+int64_t motor_get_position_steps(motor_select_t selected_motor) {
+    motor_config_t * motor_config = _get_motor_config(selected_motor);
+    if (motor_config == NULL) {
+        return 0;
+    }
+
+    taskENTER_CRITICAL();
+    int64_t position = _step_counter_get_position(motor_config);
+    taskEXIT_CRITICAL();
+
+    return position;
+}
+
+
+// Converts motor steps to revolutions of the trickler (after the gear ratio)
+float motor_steps_to_revolutions(motor_select_t selected_motor, int64_t steps) {
+    motor_config_t * motor_config = _get_motor_config(selected_motor);
+    if (motor_config == NULL) {
+        return 0.0f;
+    }
+
+    uint32_t full_rotation_steps = motor_config->persistent_config.full_steps_per_rotation * motor_config->persistent_config.microsteps;
+
+    return steps / (float) full_rotation_steps * motor_config->persistent_config.gear_ratio;
+}
+
+
+/*
+    Moves the trickler by the given revolutions (negative to reverse) at up to speed_rps, then stops. Any later
+    command preempts the move. Use motor_wait_for_move to block until the move completes.
+*/
+void motor_move_revolutions(motor_select_t selected_motor, float revolutions, float speed_rps) {
+    stepper_speed_control_t command = {
+        .command = STEPPER_COMMAND_MOVE,
+        .new_velocity = speed_rps,
+        .revolutions = revolutions,
+    };
+
+    if (selected_motor == SELECT_COARSE_TRICKLER_MOTOR || selected_motor == SELECT_BOTH_MOTOR) {
+        xSemaphoreTake(coarse_trickler_motor_config.move_complete_semaphore, 0);
+        _motor_post_command(&coarse_trickler_motor_config, &command);
+    }
+
+    if (selected_motor == SELECT_FINE_TRICKLER_MOTOR || selected_motor == SELECT_BOTH_MOTOR) {
+        xSemaphoreTake(fine_trickler_motor_config.move_complete_semaphore, 0);
+        _motor_post_command(&fine_trickler_motor_config, &command);
+    }
+}
+
+
+bool motor_wait_for_move(motor_select_t selected_motor, uint32_t block_time_ms) {
+    motor_config_t * motor_config = _get_motor_config(selected_motor);
+    if (motor_config == NULL || motor_config->move_complete_semaphore == NULL) {
+        return false;
+    }
+
+    return xSemaphoreTake(motor_config->move_complete_semaphore, pdMS_TO_TICKS(block_time_ms)) == pdTRUE;
+}
+
+
+bool motor_get_status(motor_select_t selected_motor, motor_status_t * status) {
+    motor_config_t * motor_config = NULL;
+    switch (selected_motor)
+    {
+    case SELECT_COARSE_TRICKLER_MOTOR:
+        motor_config = &coarse_trickler_motor_config;
+        break;
+    case SELECT_FINE_TRICKLER_MOTOR:
+        motor_config = &fine_trickler_motor_config;
+        break;
+    
+    default:
+        return false;
     }
+
+    taskENTER_CRITICAL();
+    status->commanded_velocity = motor_config->commanded_velocity;
+    status->velocity = motor_config->prev_velocity * motor_config->persistent_config.gear_ratio;
+    status->ramping = motor_config->ramping;
+    status->moving = motor_config->moving;
+    status->command_seq = motor_config->command_seq;
+    status->applied_seq = motor_config->applied_seq;
+    taskEXIT_CRITICAL();
+
+    return true;
 }
 
 
@@ -560,6 +1116,44 @@ float get_motor_min_speed(motor_select_t selected_motor) {
 }
 
 
+static void _sample_diagnostics(motor_config_t * motor_config) {
+    TMC2209_t * tmc_driver = (TMC2209_t *) motor_config->tmc_driver;
+    motor_diagnostics_t * diagnostics = &motor_config->diagnostics;
+
+    if (tmc_driver == NULL) {
+        return;
+    }
+
+    bool is_ok = TMC2209_ReadRegister(tmc_driver, (TMC2209_datagram_t *) &tmc_driver->drv_status);
+    is_ok &= TMC2209_ReadRegister(tmc_driver, (TMC2209_datagram_t *) &tmc_driver->sg_result);
+    is_ok &= TMC2209_ReadRegister(tmc_driver, (TMC2209_datagram_t *) &tmc_driver->tstep);
+
+    if (!is_ok) {
+        diagnostics->valid = false;
+        diagnostics->error_count += 1;
+        return;
+    }
+
+    diagnostics->drv_status = tmc_driver->drv_status.reg.value;
+    diagnostics->sg_result = tmc_driver->sg_result.reg.value & 0x3FF;
+    diagnostics->tstep = tmc_driver->tstep.reg.value & 0xFFFFF;
+    diagnostics->sample_time_ms = to_ms_since_boot(get_absolute_time());
+    diagnostics->valid = true;
+}
+
+
+void motor_diagnostics_task(void * p) {
+    TickType_t last_sample_tick = xTaskGetTickCount();
+
+    while (true) {
+        _sample_diagnostics(&coarse_trickler_motor_config);
+        _sample_diagnostics(&fine_trickler_motor_config);
+
+        vTaskDelayUntil(&last_sample_tick, pdMS_TO_TICKS(MOTOR_DIAGNOSTICS_PERIOD_MS));
+    }
+}
+
+
 motor_init_err_t motors_init(void) {
     bool is_ok;
 
@@ -586,6 +1180,7 @@ motor_init_err_t motors_init(void) {
     gpio_set_function(MOTOR_UART_TX, GPIO_FUNC_UART);
 
     _enable_uart_rx(MOTOR_UART, false);
+    _motor_uart_rx_init();
 
     // 
     // Enable coarse trickler motor at UART ADDR 0
@@ -620,23 +1215,37 @@ motor_init_err_t motors_init(void) {
     }
 
     // Initialize motor related RTOS control
-    coarse_trickler_motor_config.stepper_speed_control_queue = xQueueCreate(2, sizeof(stepper_speed_control_t));
-    fine_trickler_motor_config.stepper_speed_control_queue = xQueueCreate(2, sizeof(stepper_speed_control_t));
+    coarse_trickler_motor_config.move_complete_semaphore = STATIC_SEMAPHORE_CREATE_BINARY();
+    fine_trickler_motor_config.move_complete_semaphore = STATIC_SEMAPHORE_CREATE_BINARY();
+
+    // Single slot queues used as mailboxes, see motor_set_speed
+    coarse_trickler_motor_config.stepper_speed_control_queue = STATIC_QUEUE_CREATE(1, sizeof(stepper_speed_control_t));
+    fine_trickler_motor_config.stepper_speed_control_queue = STATIC_QUEUE_CREATE(1, sizeof(stepper_speed_control_t));
 
     // Create one task for each stepper controller
-    xTaskCreate(stepper_speed_control_task, 
-                "Coarse Trickler", 
-                configMINIMAL_STACK_SIZE, 
-                (void *) &coarse_trickler_motor_config, 
-                9,  // Coarse trickler at higher priority to response faster to stop
-                &coarse_trickler_motor_config.stepper_speed_control_task_handler);
-
-    xTaskCreate(stepper_speed_control_task, 
-                "Fine Trickler", 
-                configMINIMAL_STACK_SIZE, 
-                (void *) &fine_trickler_motor_config, 
-                8, 
-                &fine_trickler_motor_config.stepper_speed_control_task_handler);
+    STATIC_TASK_CREATE_AFFINITY_SET(stepper_speed_control_task, 
+                                    "Coarse Trickler", 
+                                    configMINIMAL_STACK_SIZE, 
+                                    (void *) &coarse_trickler_motor_config, 
+                                    9,  // Coarse trickler at higher priority to response faster to stop
+                                    CONTROL_CORE_AFFINITY_MASK,
+                                    &coarse_trickler_motor_config.stepper_speed_control_task_handler);
+
+    STATIC_TASK_CREATE_AFFINITY_SET(stepper_speed_control_task, 
+                                    "Fine Trickler", 
+                                    configMINIMAL_STACK_SIZE, 
+                                    (void *) &fine_trickler_motor_config, 
+                                    8, 
+                                    CONTROL_CORE_AFFINITY_MASK,
+                                    &fine_trickler_motor_config.stepper_speed_control_task_handler);
+
+    // Driver diagnostics runs at low priority, it only competes with the UI
+    STATIC_TASK_CREATE(motor_diagnostics_task, 
+                       "Motor Diagnostics", 
+                       configMINIMAL_STACK_SIZE, 
+                       NULL, 
+                       2, 
+                       NULL);
 
     return MOTOR_INIT_OK;
 }
@@ -716,7 +1325,7 @@ void handle_motor_init_error(motor_init_err_t err) {
         u8g2_DrawStr(display_handler, 5, 25, error_string);
 
         // Draw error message
-        u8g2_SendBuffer(display_handler);
+        display_update(display_handler);
         delay_ms(2000, scheduler_state);
     }
 }
@@ -734,13 +1343,14 @@ void populate_rest_motor_config(motor_config_t * motor_config, char * buf, size_
     // m7 (float): gear_ratio
     // m8 (bool): inverted_enable
     // m9 (bool): inverted_direction
+    // m10 (motor_ramp_profile_t | int): ramp_profile
     // ee (bool): save to eeprom
 
     // Build response
     snprintf(buf, 
              max_len,
              "%s"
-             "{\"m0\":%0.3f,\"m1\":%ld,\"m2\":%d,\"m3\":%d,\"m4\":%d,\"m5\":%d,\"m6\":%0.3f,\"m7\":%0.7f,\"m8\":%s,\"m9\":%s}",
+             "{\"m0\":%0.3f,\"m1\":%ld,\"m2\":%d,\"m3\":%d,\"m4\":%d,\"m5\":%d,\"m6\":%0.3f,\"m7\":%0.7f,\"m8\":%s,\"m9\":%s,\"m10\":%d}",
              http_json_header,
              motor_config->persistent_config.angular_acceleration, 
              motor_config->persistent_config.full_steps_per_rotation,
@@ -751,7 +1361,8 @@ void populate_rest_motor_config(motor_config_t * motor_config, char * buf, size_
              motor_config->persistent_config.min_speed_rps,
              motor_config->persistent_config.gear_ratio,
              boolean_to_string(motor_config->persistent_config.inverted_enable),
-             boolean_to_string(motor_config->persistent_config.inverted_direction));
+             boolean_to_string(motor_config->persistent_config.inverted_direction),
+             (int) motor_config->persistent_config.ramp_profile);
 }
 
 void apply_rest_motor_config(motor_config_t * motor_config, int num_params, char *params[], char *values[]) {
@@ -798,6 +1409,10 @@ void apply_rest_motor_config(motor_config_t * motor_config, int num_params, char
             bool inverted_direction = string_to_boolean(values[idx]);
             motor_config->persistent_config.inverted_direction = inverted_direction;
         }
+        else if (strcmp(params[idx], "m10") == 0) {
+            motor_config->persistent_config.ramp_profile = (motor_ramp_profile_t) atoi(values[idx]);
+            motor_update_ramp_shape(motor_config);
+        }
         else if (strcmp(params[idx], "ee") == 0) {
             save_to_eeprom = string_to_boolean(values[idx]);
         }
@@ -810,11 +1425,91 @@ void apply_rest_motor_config(motor_config_t * motor_config, int num_params, char
 }
 
 
+void populate_rest_motor_diagnostics(motor_config_t * motor_config, char * buf, size_t max_len) {
+    // Mappings:
+    // d0 (int): DRV_STATUS
+    // d1 (int): SG_RESULT
+    // d2 (int): TSTEP
+    // d3 (bool): Over temperature
+    // d4 (bool): Over temperature pre-warning
+    // d5 (bool): Short to ground or supply
+    // d6 (bool): Open load
+    // d7 (int): CS_ACTUAL
+    // d8 (bool): Standstill
+    // d9 (bool): Last sample is valid
+    // d10 (int): Age of the last sample (ms)
+    // d11 (int): Number of failed samples
+
+    motor_diagnostics_t diagnostics = motor_config->diagnostics;
+    uint32_t drv_status = diagnostics.drv_status;
+
+    snprintf(buf, 
+             max_len,
+             "%s"
+             "{\"d0\":%lu,\"d1\":%u,\"d2\":%lu,\"d3\":%s,\"d4\":%s,\"d5\":%s,\"d6\":%s,\"d7\":%lu,\"d8\":%s,\"d9\":%s,\"d10\":%lu,\"d11\":%lu}",
+             http_json_header,
+             drv_status,
+             diagnostics.sg_result,
+             diagnostics.tstep,
+             boolean_to_string(drv_status & TMC2209_DRV_STATUS_OT),
+             boolean_to_string(drv_status & TMC2209_DRV_STATUS_OTPW),
+             boolean_to_string(drv_status & TMC2209_DRV_STATUS_SHORT_MASK),
+             boolean_to_string(drv_status & TMC2209_DRV_STATUS_OPEN_LOAD_MASK),
+             (drv_status & TMC2209_DRV_STATUS_CS_ACTUAL_MASK) >> TMC2209_DRV_STATUS_CS_ACTUAL_SHIFT,
+             boolean_to_string(drv_status & TMC2209_DRV_STATUS_STST),
+             boolean_to_string(diagnostics.valid),
+             to_ms_since_boot(get_absolute_time()) - diagnostics.sample_time_ms,
+             diagnostics.error_count);
+}
+
+
+bool http_rest_coarse_motor_diagnostics(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    const size_t json_buffer_size = 256;
+    char * json_buffer = (char *) rest_response_alloc(json_buffer_size);
+    if (json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    populate_rest_motor_diagnostics(&coarse_trickler_motor_config, json_buffer, json_buffer_size);
+
+    size_t response_len = strlen(json_buffer);
+    file->data = json_buffer;
+    file->len = response_len;
+    file->index = response_len;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
+
+
+bool http_rest_fine_motor_diagnostics(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    const size_t json_buffer_size = 256;
+    char * json_buffer = (char *) rest_response_alloc(json_buffer_size);
+    if (json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    populate_rest_motor_diagnostics(&fine_trickler_motor_config, json_buffer, json_buffer_size);
+
+    size_t response_len = strlen(json_buffer);
+    file->data = json_buffer;
+    file->len = response_len;
+    file->index = response_len;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
+
+
 bool http_rest_coarse_motor_config(struct fs_file *file, int num_params, char *params[], char *values[]) {
-    static char json_buffer[256];
+    const size_t json_buffer_size = 256;
+    char * json_buffer = (char *) rest_response_alloc(json_buffer_size);
+    if (json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
 
     apply_rest_motor_config(&coarse_trickler_motor_config, num_params, params, values);
-    populate_rest_motor_config(&coarse_trickler_motor_config, json_buffer, sizeof(json_buffer));
+    populate_rest_motor_config(&coarse_trickler_motor_config, json_buffer, json_buffer_size);
 
     size_t response_len = strlen(json_buffer);
     file->data = json_buffer;
@@ -826,10 +1521,14 @@ bool http_rest_coarse_motor_config(struct fs_file *file, int num_params, char *p
 }
 
 bool http_rest_fine_motor_config(struct fs_file *file, int num_params, char *params[], char *values[]) {
-    static char json_buffer[256];
+    const size_t json_buffer_size = 256;
+    char * json_buffer = (char *) rest_response_alloc(json_buffer_size);
+    if (json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
 
     apply_rest_motor_config(&fine_trickler_motor_config, num_params, params, values);
-    populate_rest_motor_config(&fine_trickler_motor_config, json_buffer, sizeof(json_buffer));
+    populate_rest_motor_config(&fine_trickler_motor_config, json_buffer, json_buffer_size);
 
     size_t response_len = strlen(json_buffer);
     file->data = json_buffer;
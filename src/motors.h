@@ -4,12 +4,27 @@
 #include <stdint.h>
 #include <FreeRTOS.h>
 #include <queue.h>
+#include <semphr.h>
+#include "pico/time.h"
 
 #include "common.h"
 #include "http_rest.h"
 
 #define EEPROM_MOTOR_DATA_REV                     5              // 16 byte 
 
+// TMC2209 DRV_STATUS bits
+#define TMC2209_DRV_STATUS_OTPW                   (1u << 0)
+#define TMC2209_DRV_STATUS_OT                     (1u << 1)
+#define TMC2209_DRV_STATUS_SHORT_MASK             (0xFu << 2)     // s2ga, s2gb, s2vsa, s2vsb
+#define TMC2209_DRV_STATUS_OPEN_LOAD_MASK         (0x3u << 6)     // ola, olb
+#define TMC2209_DRV_STATUS_CS_ACTUAL_SHIFT        16
+#define TMC2209_DRV_STATUS_CS_ACTUAL_MASK         (0x1Fu << TMC2209_DRV_STATUS_CS_ACTUAL_SHIFT)
+#define TMC2209_DRV_STATUS_STST                   (1u << 31)
+
+#define SPEED_RAMP_MAX_STEPS                      128
+#define SPEED_RAMP_MIN_INTERVAL_US                1000
+#define SPEED_RAMP_SHAPE_SIZE                     64
+
 
 // Terms
 // Velocity: speed with direction (clockwise or counter-clockwise)
@@ -31,6 +46,12 @@ typedef enum {
 } motor_init_err_t;
 
 
+typedef enum {
+    MOTOR_RAMP_LINEAR = 0,
+    MOTOR_RAMP_S_CURVE = 1,         // Jerk limited, the peak acceleration is angular_acceleration
+} motor_ramp_profile_t;
+
+
 typedef struct {
     uint32_t full_steps_per_rotation;
     uint16_t current_ma;
@@ -44,6 +65,8 @@ typedef struct {
 
     bool inverted_direction;
     bool inverted_enable;
+
+    motor_ramp_profile_t ramp_profile;
 } motor_persistent_config_t;
 
 
@@ -53,6 +76,51 @@ typedef struct {
 } eeprom_motor_data_t;
 
 
+// Precomputed speed ramp, fed to the PIO from a hardware alarm
+typedef struct {
+    uint32_t period_table[SPEED_RAMP_MAX_STEPS];
+    uint16_t length;
+    volatile uint16_t idx;
+    repeating_timer_t timer;
+
+    // Normalised velocity over normalised ramp time, rebuilt when the ramp profile changes
+    float shape[SPEED_RAMP_SHAPE_SIZE + 1];
+    float time_scale;       // Ramp time relative to a linear ramp with the same peak acceleration
+} speed_ramp_t;
+
+
+// Snapshot of the motor control state
+typedef struct {
+    float commanded_velocity;           // Latest setpoint passed to motor_set_speed, in rev/s at the trickler
+    float velocity;                     // Velocity reached by the last completed (or preempted) ramp
+    bool ramping;
+    bool moving;                        // A position move is in progress
+    uint32_t command_seq;               // Sequence number of the latest setpoint
+    uint32_t applied_seq;               // Sequence number of the setpoint the motor task last acted on
+} motor_status_t;
+
+
+// Setpoints for both tricklers and the servo gate, applied together by motor_apply_command. NAN leaves the item as is.
+typedef struct {
+    float coarse_velocity;              // rev/s at the trickler
+    float fine_velocity;                // rev/s at the trickler
+    float gate_ratio;                   // See servo_gate_set_ratio
+} motor_command_t;
+
+#define MOTOR_COMMAND_UNCHANGED     {NAN, NAN, NAN}
+
+
+// Driver registers sampled by the diagnostics task
+typedef struct {
+    uint32_t drv_status;
+    uint16_t sg_result;
+    uint32_t tstep;
+    uint32_t sample_time_ms;
+    uint32_t error_count;
+    bool valid;
+} motor_diagnostics_t;
+
+
 typedef struct {
     // Setings that should be read from EEPROM
     motor_persistent_config_t persistent_config;
@@ -71,6 +139,27 @@ typedef struct {
     float prev_velocity;
     bool step_direction;
 
+    // Setpoint mailbox state
+    volatile float commanded_velocity;
+    volatile uint32_t command_seq;
+    volatile uint32_t applied_seq;
+    volatile bool ramping;
+    volatile bool moving;
+    SemaphoreHandle_t move_complete_semaphore;
+
+    // Hardware timed ramp
+    speed_ramp_t speed_ramp;
+
+    // Updated by motor_diagnostics_task
+    motor_diagnostics_t diagnostics;
+
+    // Step counter, a DMA channel drains one word per step from the state machine RX FIFO
+    int step_counter_dma_channel;       // -1 if no channel is available
+    uint32_t step_counter_sink;
+    uint32_t step_counter_base;         // Steps counted by previous DMA runs
+    int64_t position_steps;             // Signed position at the last direction change
+    uint32_t position_sample_steps;     // Step count at the last direction change
+
     // RTOS control
     TaskHandle_t stepper_speed_control_task_handler;
     QueueHandle_t stepper_speed_control_queue;
@@ -87,8 +176,18 @@ motor_init_err_t motors_init(void);
 bool motor_config_init(void);
 bool motor_config_save(void);
 void motor_task(void *p);
+void motor_diagnostics_task(void * p);
+void motor_update_ramp_shape(motor_config_t * motor_config);
 void motor_set_speed(motor_select_t selected_motor, float new_velocity);
+void motor_apply_command(const motor_command_t * command);
+void motor_move_revolutions(motor_select_t selected_motor, float revolutions, float speed_rps);
+bool motor_wait_for_move(motor_select_t selected_motor, uint32_t block_time_ms);
+uint32_t motor_get_step_count(motor_select_t selected_motor);
+int64_t motor_get_position_steps(motor_select_t selected_motor);
+float motor_steps_to_revolutions(motor_select_t selected_motor, int64_t steps);
+bool motor_get_status(motor_select_t selected_motor, motor_status_t * status);
 uint16_t get_motor_max_speed(motor_select_t selected_motor);
+uint32_t speed_to_period(float speed, uint32_t pio_clock_speed, uint32_t full_rotation_steps);
 float get_motor_min_speed(motor_select_t selected_motor);
 void motor_enable(motor_select_t selected_motor, bool enable);
 const char * get_motor_select_string(motor_select_t selected_motor);
@@ -97,6 +196,8 @@ void handle_motor_init_error(motor_init_err_t err);
 // REST interface
 bool http_rest_coarse_motor_config(struct fs_file *file, int num_params, char *params[], char *values[]);
 bool http_rest_fine_motor_config(struct fs_file *file, int num_params, char *params[], char *values[]);
+bool http_rest_coarse_motor_diagnostics(struct fs_file *file, int num_params, char *params[], char *values[]);
+bool http_rest_fine_motor_diagnostics(struct fs_file *file, int num_params, char *params[], char *values[]);
 
 
 #ifdef __cplusplus
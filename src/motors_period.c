@@ -0,0 +1,44 @@
+#include <stdint.h>
+#include <math.h>
+
+#include "motors.h"
+
+/*
+    The step period conversion of motors.c, kept apart so it builds without the TMC driver and the PIO program
+    (tests/host).
+*/
+#define STEPPER_LOW_CYCLE_COUNT 13  // Defined as the implementation of stepper.pio
+#define STEPPER_MAX_STEP_PERIOD_S   0.1f    // Longest step period, a new period is only picked up after the current step
+#define STEP_RATE_FRACTION_BITS     2       // Fixed-point step rate, pio_clock << 2 stays within 32 bit up to 1 GHz
+
+
+/*
+    Converts a speed (rev/s) into the number of high cycles loaded into stepper.pio, 0 stops the motor.
+
+    The step rate is converted once into a fixed-point value (STEP_RATE_FRACTION_BITS fractional bits), then the
+    period comes from a single 32 bit integer division, which runs on the SIO hardware divider instead of a software
+    float division for every ramp entry. The 32 bit Y counter of the PIO covers periods of several seconds at the
+    full system clock, so the low end is only limited by STEPPER_MAX_STEP_PERIOD_S.
+*/
+uint32_t speed_to_period(float speed, uint32_t pio_clock_speed, uint32_t full_rotation_steps) {
+    // speed: rev/s, step_rate: steps/s in fixed-point
+    uint32_t step_rate = (uint32_t) (fabsf(speed) * full_rotation_steps * (1u << STEP_RATE_FRACTION_BITS));
+
+    // Slower than the longest period the stepper task tolerates (including 0)
+    uint32_t min_step_rate = (uint32_t) ((1u << STEP_RATE_FRACTION_BITS) / STEPPER_MAX_STEP_PERIOD_S);
+    if (step_rate < min_step_rate) {
+        return 0;
+    }
+
+    uint32_t full_cycle_count = (pio_clock_speed << STEP_RATE_FRACTION_BITS) / step_rate;
+
+    // Avoid wrap around
+    if (full_cycle_count < STEPPER_LOW_CYCLE_COUNT) {
+        full_cycle_count = STEPPER_LOW_CYCLE_COUNT;
+    }
+
+    // High cycle should be calculated as full_cycle - low cycle.
+    uint32_t high_cycle_steps = full_cycle_count - STEPPER_LOW_CYCLE_COUNT;
+
+    return high_cycle_steps;
+}
@@ -14,8 +14,11 @@
 #include "common.h"
 #include "profile.h"
 #include "servo_gate.h"
+#include "mini_12864_module.h"
 
 
+#define CHARGE_WEIGHT_DIGIT_CNT     5
+
 // External modules/varaibles
 extern uint8_t charge_weight_digits[];
 extern AppState_t exit_state;
@@ -26,11 +29,11 @@ extern eeprom_profile_data_t profile_data;
 
 
 const char * get_selected_profile_name(void * data, uint16_t idx) {
-    return profile_data.profiles[idx].name;
+    return profile_get_name(idx);
 }
 
 uint16_t get_profile_count() {
-    return MAX_PROFILE_CNT;
+    return profile_get_count();
 }
 
 
@@ -165,6 +168,46 @@ uint8_t render_charge_mode_next_button(mui_t * ui, uint8_t msg) {
 }
 
 
+/*
+    Charge weight digit with encoder acceleration. A slow turn changes the digit by one and wraps around as before, a
+    fast spin steps by more and carries into (or borrows from) the higher digits, so spinning the tenths digit also
+    rolls the grains over.
+*/
+uint8_t charge_weight_digit_wm_mud_pi(mui_t * ui, uint8_t msg) {
+    if ((msg == MUIF_MSG_EVENT_NEXT || msg == MUIF_MSG_EVENT_PREV) && ui->is_mud) {
+        uint8_t step = button_get_encoder_step();
+
+        if (step > 1) {
+            mui_u8g2_u8_min_max_t * vmm = (mui_u8g2_u8_min_max_t *) muif_get_data(ui->uif);
+            uint8_t * value = mui_u8g2_u8mm_get_valptr(vmm);
+
+            int32_t number = 0;
+            int32_t place = 1;
+            int32_t digit_place = 1;
+            for (uint8_t idx = 0; idx < CHARGE_WEIGHT_DIGIT_CNT; idx += 1) {
+                number += charge_weight_digits[idx] * place;
+                if (&charge_weight_digits[idx] == value) {
+                    digit_place = place;
+                }
+                place *= 10;
+            }
+
+            number += (msg == MUIF_MSG_EVENT_NEXT ? step : -step) * digit_place;
+            number = MAX(0, MIN(number, place - 1));
+
+            for (uint8_t idx = 0; idx < CHARGE_WEIGHT_DIGIT_CNT; idx += 1) {
+                charge_weight_digits[idx] = number % 10;
+                number /= 10;
+            }
+
+            return 1;
+        }
+    }
+
+    return mui_u8g2_u8_min_max_wm_mud_pi(ui, msg);
+}
+
+
 uint8_t render_profile_misc_details(mui_t *ui, uint8_t msg) {
     switch(msg)
     {
@@ -270,11 +313,11 @@ muif_t muif_list[] = {
         MUIF_VARIABLE("RB",&servo_gate.gate_state, render_servo_gate_state_with_action),
 
         // input for a number between 0 to 9 //
-        MUIF_U8G2_U8_MIN_MAX("N4", &charge_weight_digits[4], 0, 9, mui_u8g2_u8_min_max_wm_mud_pi),
-        MUIF_U8G2_U8_MIN_MAX("N3", &charge_weight_digits[3], 0, 9, mui_u8g2_u8_min_max_wm_mud_pi),
-        MUIF_U8G2_U8_MIN_MAX("N2", &charge_weight_digits[2], 0, 9, mui_u8g2_u8_min_max_wm_mud_pi),
-        MUIF_U8G2_U8_MIN_MAX("N1", &charge_weight_digits[1], 0, 9, mui_u8g2_u8_min_max_wm_mud_pi),
-        MUIF_U8G2_U8_MIN_MAX("N0", &charge_weight_digits[0], 0, 9, mui_u8g2_u8_min_max_wm_mud_pi),
+        MUIF_U8G2_U8_MIN_MAX("N4", &charge_weight_digits[4], 0, 9, charge_weight_digit_wm_mud_pi),
+        MUIF_U8G2_U8_MIN_MAX("N3", &charge_weight_digits[3], 0, 9, charge_weight_digit_wm_mud_pi),
+        MUIF_U8G2_U8_MIN_MAX("N2", &charge_weight_digits[2], 0, 9, charge_weight_digit_wm_mud_pi),
+        MUIF_U8G2_U8_MIN_MAX("N1", &charge_weight_digits[1], 0, 9, charge_weight_digit_wm_mud_pi),
+        MUIF_U8G2_U8_MIN_MAX("N0", &charge_weight_digits[0], 0, 9, charge_weight_digit_wm_mud_pi),
 
         MUIF_U8G2_U16_LIST("P0", (uint16_t *) &profile_data.current_profile_idx, NULL, get_selected_profile_name, get_profile_count, mui_u8g2_u16_list_parent_wm_pi),
         MUIF_U8G2_U16_LIST("P1", (uint16_t *) &profile_data.current_profile_idx, NULL, get_selected_profile_name, get_profile_count, mui_u8g2_u16_list_child_w1_pi),
@@ -419,6 +462,7 @@ fds_t fds_data[] = {
     MUI_DATA("MU",
         MUI_53 "Select Driver|"
         MUI_51 "Calibration|"
+        MUI_54 "Dead Time|"
         MUI_30 "<-Return"  // back to view 30
     )
     MUI_XYA("GC", 5, 25, 0) 
@@ -572,6 +616,20 @@ fds_t fds_data[] = {
     MUI_XYAT("BN",14, 59, 31, "Back")
     MUI_XYAT("LV", 115, 59, 6, "Next")  // APP_STATE_ENTER_SCALE_CALIBRATION
 
+    // Dead time characterization
+    MUI_FORM(54)
+    MUI_STYLE(1)
+    MUI_LABEL(5, 10, "Warning")
+    MUI_XY("HL", 0,13)
+
+    MUI_STYLE(0)
+    MUI_LABEL(5, 25, "Put pan on the scale and")
+    MUI_LABEL(5, 37, "press Next to measure")
+
+    MUI_STYLE(0)
+    MUI_XYAT("BN",14, 59, 31, "Back")
+    MUI_XYAT("LV", 115, 59, 11, "Next")  // APP_STATE_ENTER_DEAD_TIME_MODE
+
     // Scale driver
     MUI_FORM(53)
     MUI_STYLE(1)
@@ -580,10 +638,10 @@ fds_t fds_data[] = {
 
     MUI_STYLE(0)
     MUI_LABEL(5,25, "Driver:")
-    MUI_XYAT("SD", 50, 25, 60, "A&D FX-i Std|Steinberg SBS|G&G JJB|US Solid JFDBS|JM Science|Creedmoor|Radwag PS R2|Sartorius|Generic")
+    MUI_XYAT("SD", 50, 25, 60, "A&D FX-i Std|Steinberg SBS|G&G JJB|US Solid JFDBS|JM Science|Creedmoor|Radwag PS R2|Sartorius|Generic|Custom")
 
     MUI_LABEL(5,37, "Baudrate:")
-    MUI_XYAT("BR", 50, 37, 60, "4800|9600|19200")
+    MUI_XYAT("BR", 50, 37, 60, "4800|9600|19200|38400|57600|115200")
 
     MUI_STYLE(0)
     MUI_XYAT("BN", 64, 59, 31, " OK ")
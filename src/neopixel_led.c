@@ -22,22 +22,64 @@
 #include <stdint.h>
 #include <FreeRTOS.h>
 #include <task.h>
-#include <semphr.h>
+#include <queue.h>
 #include <string.h>
+#include <math.h>
 
+#include "hardware/dma.h"
 #include "neopixel_led.h"
 #include "generated/ws2812.pio.h"
 #include "configuration.h"
 #include "eeprom.h"
 #include "common.h"
+#include "static_alloc.h"
 
 
+/*
+    The LEDs are driven by a small animation engine running from a repeating hardware timer. Callers only queue a
+    command (fade, blink or progress bar), the timer callback advances the animation every frame and hands the pixels
+    to the PIO state machines through DMA, so a colour change never waits on the LED chains.
+*/
 
-// The parameters for updating the NeoPixel LED colors (including the target LED information)
+#define NEOPIXEL_LED_FRAME_PERIOD_MS        20      // 50 Hz
+#define NEOPIXEL_LED_FADE_MS                100     // Colour changes fade over this time
+#define NEOPIXEL_LED_COMMAND_QUEUE_LEN      8
+#define NEOPIXEL_LED_PROGRESS_OFF           0xFFFF
+
+
+// LEDs on the mini12864 chain, in the order they are sent
+typedef enum {
+    NEOPIXEL_LED_1 = 0,             // Encoder RGB1
+    NEOPIXEL_LED_2,                 // Encoder RGB2
+    NEOPIXEL_LED_BACKLIGHT,         // 12864 Backlight
+
+    NEOPIXEL_LED_CNT,
+} neopixel_led_idx_t;
+
+typedef enum {
+    NEOPIXEL_LED_COMMAND_FADE = 0,
+    NEOPIXEL_LED_COMMAND_BLINK,
+    NEOPIXEL_LED_COMMAND_PROGRESS,
+} neopixel_led_command_type_t;
+
+typedef struct {
+    neopixel_led_command_type_t type;
+    rgbw_u32_t colours[NEOPIXEL_LED_CNT];
+    uint16_t period_ms;                     // Fade time or blink period
+    uint16_t progress_permille;             // NEOPIXEL_LED_PROGRESS_OFF to show the LED1 colour instead
+} neopixel_led_command_t;
+
+// Animation state, only accessed from the frame timer callback once the timer is running
 typedef struct {
-    pio_config_t * pio_config;
-    uint32_t colour;
-} _neopixel_led_colour_update_params_t;
+    rgbw_u32_t from[NEOPIXEL_LED_CNT];
+    rgbw_u32_t to[NEOPIXEL_LED_CNT];
+    rgbw_u32_t current[NEOPIXEL_LED_CNT];
+    bool blink;
+    uint16_t period_ms;
+    uint32_t elapsed_ms;
+    uint16_t progress_permille;
+    bool dirty;                             // The frame differs from the one last sent
+} neopixel_led_animation_t;
 
 
 // Global configuration for neopixel LED instance
@@ -54,6 +96,13 @@ const eeprom_neopixel_led_metadata_t default_neopixel_led_metadata = {
     .pwm_out_led_colour_order = NEOPIXEL_COLOUR_ORDER_RGB,  // Default to RGB colour order
 };
 
+static neopixel_led_animation_t neopixel_led_animation;
+
+// DMA sources, one word per pixel
+static uint32_t mini12864_pixels[NEOPIXEL_LED_CNT];
+static uint32_t pwm3_pixels[NEOPIXEL_LED_CHAIN_COUNT_16];
+
+
 uint32_t urgbw_u32(rgbw_u32_t colour, neopixel_colour_order_t colour_order) {
 
     uint32_t output;
@@ -80,49 +129,213 @@ static inline void put_pixel(pio_config_t * pio_config, uint32_t pixel_grb) {
 
 // Low level function to bypass RTOS to configure colour directly
 void _neopixel_led_set_colour(uint32_t led1_colour, uint32_t led2_colour, uint32_t mini12864_backlight_colour) {
+    // Take the LEDs over from the animation engine
+    if (neopixel_led_config.frame_timer.alarm_id) {
+        cancel_repeating_timer(&neopixel_led_config.frame_timer);
+        neopixel_led_config.frame_timer.alarm_id = 0;
+    }
+    if (neopixel_led_config.mini12864_dma_channel >= 0) {
+        dma_channel_wait_for_finish_blocking(neopixel_led_config.mini12864_dma_channel);
+    }
+
     put_pixel(&neopixel_led_config.mini12864_pio_config, led1_colour);  // Encoder RGB1
     put_pixel(&neopixel_led_config.mini12864_pio_config, led2_colour);  // Encoder RGB2
     put_pixel(&neopixel_led_config.mini12864_pio_config, mini12864_backlight_colour);  // 12864 Backlight
 }
 
-void _neopixel_pwm_out_set_colour(uint32_t new_colour) {
-    for (int i = 0; i < neopixel_led_config.eeprom_neopixel_led_metadata.pwm_out_led_chain_count; i++) {
-        put_pixel(&neopixel_led_config.pwm3_pio_config, new_colour);
+
+static rgbw_u32_t _lerp_colour(rgbw_u32_t from, rgbw_u32_t to, uint32_t numerator, uint32_t denominator) {
+    rgbw_u32_t colour;
+
+    colour.r = from.r + ((int32_t) to.r - from.r) * (int32_t) numerator / (int32_t) denominator;
+    colour.g = from.g + ((int32_t) to.g - from.g) * (int32_t) numerator / (int32_t) denominator;
+    colour.b = from.b + ((int32_t) to.b - from.b) * (int32_t) numerator / (int32_t) denominator;
+    colour.w = from.w + ((int32_t) to.w - from.w) * (int32_t) numerator / (int32_t) denominator;
+
+    return colour;
+}
+
+
+static void _neopixel_led_apply_command(const neopixel_led_command_t * command) {
+    neopixel_led_animation_t * animation = &neopixel_led_animation;
+
+    switch (command->type) {
+        case NEOPIXEL_LED_COMMAND_FADE:
+        case NEOPIXEL_LED_COMMAND_BLINK:
+            // Start from whatever is shown now
+            memcpy(animation->from, animation->current, sizeof(animation->from));
+            memcpy(animation->to, command->colours, sizeof(animation->to));
+            animation->blink = command->type == NEOPIXEL_LED_COMMAND_BLINK;
+            animation->period_ms = command->period_ms;
+            animation->elapsed_ms = 0;
+            break;
+        case NEOPIXEL_LED_COMMAND_PROGRESS:
+            animation->progress_permille = command->progress_permille;
+            break;
+        default:
+            break;
+    }
+
+    animation->dirty = true;
+}
+
+
+static void _neopixel_led_step(uint32_t elapsed_ms) {
+    neopixel_led_animation_t * animation = &neopixel_led_animation;
+    rgbw_u32_t next[NEOPIXEL_LED_CNT];
+
+    animation->elapsed_ms += elapsed_ms;
+    if (animation->blink) {
+        animation->elapsed_ms %= MAX(animation->period_ms, 1);
+    }
+
+    for (uint8_t idx = 0; idx < NEOPIXEL_LED_CNT; idx += 1) {
+        if (animation->blink) {
+            // The backlight stays lit, the display shall remain readable
+            bool on = animation->elapsed_ms < animation->period_ms / 2 || idx == NEOPIXEL_LED_BACKLIGHT;
+            next[idx]._raw_colour = on ? animation->to[idx]._raw_colour : 0;
+        }
+        else if (animation->elapsed_ms >= animation->period_ms) {
+            animation->elapsed_ms = animation->period_ms;
+            next[idx] = animation->to[idx];
+        }
+        else {
+            next[idx] = _lerp_colour(animation->from[idx], animation->to[idx], animation->elapsed_ms, animation->period_ms);
+        }
+
+        if (next[idx]._raw_colour != animation->current[idx]._raw_colour) {
+            animation->current[idx] = next[idx];
+            animation->dirty = true;
+        }
+    }
+}
+
+
+static void _neopixel_led_send_frame(void) {
+    neopixel_led_animation_t * animation = &neopixel_led_animation;
+
+    // Previous frame still going out, try again on the next tick
+    if (dma_channel_is_busy(neopixel_led_config.mini12864_dma_channel) || 
+        dma_channel_is_busy(neopixel_led_config.pwm3_dma_channel)) {
+        return;
+    }
+
+    for (uint8_t idx = 0; idx < NEOPIXEL_LED_CNT; idx += 1) {
+        mini12864_pixels[idx] = urgbw_u32(animation->current[idx], NEOPIXEL_COLOUR_ORDER_GRB) << 8u;
+    }
+
+    /* PWM OUT mirrors LED1, or shows the progress bar in the LED1 colour */
+    uint8_t chain_count = MIN(neopixel_led_config.eeprom_neopixel_led_metadata.pwm_out_led_chain_count, NEOPIXEL_LED_CHAIN_COUNT_16);
+    uint32_t lit_permille = (uint32_t) animation->progress_permille * chain_count;
+    for (uint8_t idx = 0; idx < chain_count; idx += 1) {
+        rgbw_u32_t colour = animation->current[NEOPIXEL_LED_1];
+
+        if (animation->progress_permille != NEOPIXEL_LED_PROGRESS_OFF && lit_permille < (idx + 1) * 1000u) {
+            // Partly lit LED at the end of the bar, the rest is off
+            rgbw_u32_t off = {._raw_colour = 0};
+            colour = lit_permille > idx * 1000u ? _lerp_colour(off, colour, lit_permille - idx * 1000u, 1000) : off;
+        }
+
+        pwm3_pixels[idx] = urgbw_u32(colour, neopixel_led_config.eeprom_neopixel_led_metadata.pwm_out_led_colour_order) << 8u;
+    }
+
+    dma_channel_transfer_from_buffer_now(neopixel_led_config.mini12864_dma_channel, mini12864_pixels, NEOPIXEL_LED_CNT);
+    dma_channel_transfer_from_buffer_now(neopixel_led_config.pwm3_dma_channel, pwm3_pixels, chain_count);
+
+    animation->dirty = false;
+}
+
+
+static bool _neopixel_led_frame_timer_callback(repeating_timer_t * rt) {
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    neopixel_led_command_t command;
+
+    while (xQueueReceiveFromISR(neopixel_led_config.command_queue, &command, &higher_priority_task_woken) == pdTRUE) {
+        _neopixel_led_apply_command(&command);
+    }
+
+    _neopixel_led_step(NEOPIXEL_LED_FRAME_PERIOD_MS);
+
+    if (neopixel_led_animation.dirty) {
+        _neopixel_led_send_frame();
+    }
+
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+
+    return true;
+}
+
+
+static bool _neopixel_led_send_command(const neopixel_led_command_t * command, bool block_wait) {
+    if (neopixel_led_config.command_queue == NULL) {
+        return false;
     }
+
+    return xQueueSend(neopixel_led_config.command_queue, command, block_wait ? portMAX_DELAY : 0) == pdTRUE;
 }
 
 
 void neopixel_led_set_colour(rgbw_u32_t mini12864_backlight_colour, rgbw_u32_t led1_colour, rgbw_u32_t led2_colour, bool block_wait) {
-    // Assign delay time
-    TickType_t ticks_to_wait = 0;
-    if (block_wait) {
-        ticks_to_wait = portMAX_DELAY;
+    neopixel_led_command_t command = {
+        .type = NEOPIXEL_LED_COMMAND_FADE,
+        .period_ms = NEOPIXEL_LED_FADE_MS,
+    };
+    command.colours[NEOPIXEL_LED_1] = led1_colour;
+    command.colours[NEOPIXEL_LED_2] = led2_colour;
+    command.colours[NEOPIXEL_LED_BACKLIGHT] = mini12864_backlight_colour;
+
+    _neopixel_led_send_command(&command, block_wait);
+}
+
+
+void neopixel_led_blink(rgbw_u32_t mini12864_backlight_colour, rgbw_u32_t led1_colour, rgbw_u32_t led2_colour, uint16_t period_ms) {
+    neopixel_led_command_t command = {
+        .type = NEOPIXEL_LED_COMMAND_BLINK,
+        .period_ms = period_ms,
+    };
+    command.colours[NEOPIXEL_LED_1] = led1_colour;
+    command.colours[NEOPIXEL_LED_2] = led2_colour;
+    command.colours[NEOPIXEL_LED_BACKLIGHT] = mini12864_backlight_colour;
+
+    _neopixel_led_send_command(&command, true);
+}
+
+
+void neopixel_led_set_progress(float ratio) {
+    static uint16_t last_progress_permille = NEOPIXEL_LED_PROGRESS_OFF;
+
+    uint16_t progress_permille = NEOPIXEL_LED_PROGRESS_OFF;
+    if (isfinite(ratio)) {
+        progress_permille = (uint16_t) (fmaxf(0.0f, fminf(ratio, 1.0f)) * 1000);
+    }
+
+    // Called on every UI poll while charging, only queue actual changes
+    if (progress_permille == last_progress_permille) {
+        return;
     }
-    // Wait for the mutex
-    if (xSemaphoreTake(neopixel_led_config.mutex, ticks_to_wait) != pdTRUE) {
-        return;  // unable to take mutex, return immediately
+
+    neopixel_led_command_t command = {
+        .type = NEOPIXEL_LED_COMMAND_PROGRESS,
+        .progress_permille = progress_permille,
+    };
+    if (_neopixel_led_send_command(&command, false)) {
+        last_progress_permille = progress_permille;
     }
+}
 
-    /* Important: do not change the order of LED update operations. 
-       Neopixel LEDs on the same string are updated in the order they are sent. The update order has to be: 
-        1. Encoder RGB1
-        2. Encoder RGB2
-        3. 12864 Backlight
-    */
-    _neopixel_led_set_colour(
-        urgbw_u32(led1_colour, NEOPIXEL_COLOUR_ORDER_GRB),
-        urgbw_u32(led2_colour, NEOPIXEL_COLOUR_ORDER_GRB),
-        urgbw_u32(mini12864_backlight_colour, NEOPIXEL_COLOUR_ORDER_GRB)
-    );
 
-    /* Update PWM3 output to mirror new_led1_colour */
-    // Infuse white intensity
-    _neopixel_pwm_out_set_colour(
-        urgbw_u32(led1_colour, neopixel_led_config.eeprom_neopixel_led_metadata.pwm_out_led_colour_order)
-    );
+static int _neopixel_led_dma_init(pio_config_t * pio_config) {
+    int channel = dma_claim_unused_channel(true);
+
+    dma_channel_config config = dma_channel_get_default_config(channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, pio_get_dreq(pio_config->pio, pio_config->sm, true));
 
-    // Release resource
-    xSemaphoreGive(neopixel_led_config.mutex);
+    dma_channel_configure(channel, &config, &pio_config->pio->txf[pio_config->sm], NULL, 0, false);
+
+    return channel;
 }
 
 
@@ -131,6 +344,8 @@ bool neopixel_led_init(void) {
     
     // Initialize configuration
     memset(&neopixel_led_config, 0x0, sizeof(neopixel_led_config));
+    neopixel_led_config.mini12864_dma_channel = -1;
+    neopixel_led_config.pwm3_dma_channel = -1;
     is_ok = load_config(EEPROM_NEOPIXEL_LED_CONFIG_BASE_ADDR, &neopixel_led_config.eeprom_neopixel_led_metadata, &default_neopixel_led_metadata, sizeof(neopixel_led_config.eeprom_neopixel_led_metadata), EEPROM_NEOPIXEL_LED_METADATA_REV);
 
     if (!is_ok) {
@@ -138,10 +353,10 @@ bool neopixel_led_init(void) {
         return is_ok;
     }
 
-    // Initialize the mutex
-    neopixel_led_config.mutex = xSemaphoreCreateMutex();
-    if (neopixel_led_config.mutex == NULL) {
-        printf("Unable to create neopixel LED mutex\n");
+    // Initialize the command queue
+    neopixel_led_config.command_queue = STATIC_QUEUE_CREATE(NEOPIXEL_LED_COMMAND_QUEUE_LEN, sizeof(neopixel_led_command_t));
+    if (neopixel_led_config.command_queue == NULL) {
+        printf("Unable to create neopixel LED command queue\n");
         return false;
     }
 
@@ -163,13 +378,7 @@ bool neopixel_led_init(void) {
     // Save pio and sm for later access
     neopixel_led_config.mini12864_pio_config.pio = pio;
     neopixel_led_config.mini12864_pio_config.sm = sm;
-
-    // Set default colour
-    _neopixel_led_set_colour(
-        urgbw_u32(neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.led1_colour, NEOPIXEL_COLOUR_ORDER_GRB),
-        urgbw_u32(neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.led2_colour, NEOPIXEL_COLOUR_ORDER_GRB),
-        urgbw_u32(neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.mini12864_backlight_colour, NEOPIXEL_COLOUR_ORDER_GRB)
-    );
+    neopixel_led_config.mini12864_dma_channel = _neopixel_led_dma_init(&neopixel_led_config.mini12864_pio_config);
 
     // Configure Neopixel for PWM3
     is_ok = pio_claim_free_sm_and_add_program_for_gpio_range(
@@ -185,17 +394,29 @@ bool neopixel_led_init(void) {
     // Save pio and sm for later access
     neopixel_led_config.pwm3_pio_config.pio = pio;
     neopixel_led_config.pwm3_pio_config.sm = sm;
-
-    // Set default colour for PWM3
-    // Infuse white intensity
-    rgbw_u32_t colour = neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.led1_colour;
-    _neopixel_pwm_out_set_colour(
-        urgbw_u32(colour, neopixel_led_config.eeprom_neopixel_led_metadata.pwm_out_led_colour_order)
-    );
+    neopixel_led_config.pwm3_dma_channel = _neopixel_led_dma_init(&neopixel_led_config.pwm3_pio_config);
+
+    // Start with the default colour, sent by the first frame
+    neopixel_led_animation_t * animation = &neopixel_led_animation;
+    animation->current[NEOPIXEL_LED_1] = neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.led1_colour;
+    animation->current[NEOPIXEL_LED_2] = neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.led2_colour;
+    animation->current[NEOPIXEL_LED_BACKLIGHT] = neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.mini12864_backlight_colour;
+    memcpy(animation->to, animation->current, sizeof(animation->to));
+    animation->progress_permille = NEOPIXEL_LED_PROGRESS_OFF;
+    animation->dirty = true;
+
+    // Negative period: the interval is kept between the starts of the callbacks
+    if (!add_repeating_timer_ms(-NEOPIXEL_LED_FRAME_PERIOD_MS, _neopixel_led_frame_timer_callback, NULL, &neopixel_led_config.frame_timer)) {
+        printf("Unable to start neopixel LED frame timer\n");
+        return false;
+    }
 
     // Register to eeprom save all
     eeprom_register_handler(neopixel_led_config_save);
 
+    // Served together with the other modules by /rest/config
+    rest_register_config_module("neopixel_led_config", http_rest_neopixel_led_config);
+
     return true;
 }
 
@@ -230,34 +451,24 @@ bool http_rest_neopixel_led_config(struct fs_file *file, int num_params, char *p
     // l6 (int): PWM OUT white intensity
     // ee (bool): save to eeprom
 
-    static char neopixel_config_json_buffer[256];
-    bool save_to_eeprom = false;
+    const size_t neopixel_config_json_buffer_size = 256;
+    char * neopixel_config_json_buffer = (char *) rest_response_alloc(neopixel_config_json_buffer_size);
+    if (neopixel_config_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    static const rest_param_t neopixel_led_config_params[] = {
+        REST_PARAM_COLOUR("bl", neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.mini12864_backlight_colour._raw_colour),
+        REST_PARAM_COLOUR("l1", neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.led1_colour._raw_colour),
+        REST_PARAM_COLOUR("l2", neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.led2_colour._raw_colour),
+        REST_PARAM_INT("l3", neopixel_led_config.eeprom_neopixel_led_metadata.pwm_out_led_chain_count),
+        REST_PARAM_BOOL("l4", neopixel_led_config.eeprom_neopixel_led_metadata.pwm_out_led_is_rgbw),
+        REST_PARAM_INT("l5", neopixel_led_config.eeprom_neopixel_led_metadata.pwm_out_led_colour_order),
+    };
 
     // Control
-    for (int idx = 0; idx < num_params; idx += 1) {
-        if (strcmp(params[idx], "bl") == 0) {
-            // Remove %23 (#) from the request
-            neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.mini12864_backlight_colour._raw_colour = hex_string_to_decimal(values[idx]);
-        }
-        else if (strcmp(params[idx], "l1") == 0) {
-            neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.led1_colour._raw_colour = hex_string_to_decimal(values[idx]);
-        }
-        else if (strcmp(params[idx], "l2") == 0) {
-            neopixel_led_config.eeprom_neopixel_led_metadata.default_led_colours.led2_colour._raw_colour = hex_string_to_decimal(values[idx]);
-        }
-        else if (strcmp(params[idx], "l3") == 0) {
-            neopixel_led_config.eeprom_neopixel_led_metadata.pwm_out_led_chain_count = (neopixel_led_chain_count_t) atoi(values[idx]);
-        }
-        else if (strcmp(params[idx], "l4") == 0) {
-            neopixel_led_config.eeprom_neopixel_led_metadata.pwm_out_led_is_rgbw = string_to_boolean(values[idx]);
-        }
-        else if (strcmp(params[idx], "l5") == 0) {
-            neopixel_led_config.eeprom_neopixel_led_metadata.pwm_out_led_colour_order = (neopixel_colour_order_t) atoi(values[idx]);
-        }
-        else if (strcmp(params[idx], "ee") == 0) {
-            save_to_eeprom = string_to_boolean(values[idx]);
-        }
-    }
+    bool save_to_eeprom = rest_apply_params(neopixel_led_config_params, REST_PARAM_TABLE_SIZE(neopixel_led_config_params), 
+                                            num_params, params, values);
 
     // Perform action
     if (save_to_eeprom) {
@@ -266,7 +477,7 @@ bool http_rest_neopixel_led_config(struct fs_file *file, int num_params, char *p
 
     // Response
     snprintf(neopixel_config_json_buffer, 
-             sizeof(neopixel_config_json_buffer),
+             neopixel_config_json_buffer_size,
              "%s"
              "{\"bl\":\"#%06lx\",\"l1\":\"#%06lx\",\"l2\":\"#%06lx\",\"l3\":%d,\"l4\":%s,\"l5\":%d}",
              http_json_header,
@@ -2,7 +2,9 @@
 #define NEOPIXEL_LED_H_
 
 #include <stdbool.h>
-#include <semphr.h>
+#include <FreeRTOS.h>
+#include <queue.h>
+#include "pico/time.h"
 #include "http_rest.h"
 #include "common.h"
 
@@ -78,10 +80,12 @@ typedef struct {
 typedef struct {
     eeprom_neopixel_led_metadata_t eeprom_neopixel_led_metadata;
 
-    SemaphoreHandle_t mutex;
-    TaskHandle_t neopixel_control_task_handler;
+    QueueHandle_t command_queue;        // Commands to the animation engine
+    repeating_timer_t frame_timer;
     pio_config_t mini12864_pio_config;
     pio_config_t pwm3_pio_config;
+    int mini12864_dma_channel;
+    int pwm3_dma_channel;
 } neopixel_led_config_t;
 
 
@@ -92,12 +96,26 @@ extern "C" {
 
 bool neopixel_led_init(void);
 bool neopixel_led_config_save();
+/**
+ * Fade to the new colours. Only queues the command for the animation engine, block_wait waits for room in the queue
+ * rather than dropping the command if it is full.
+ */
 void neopixel_led_set_colour(rgbw_u32_t mini12864_backlight_colour, rgbw_u32_t led1_colour, rgbw_u32_t led2_colour, bool block_wait);
+
+/**
+ * Blink the LED colours (on for half of the period) until the next colour change. The backlight doesn't blink.
+ */
+void neopixel_led_blink(rgbw_u32_t mini12864_backlight_colour, rgbw_u32_t led1_colour, rgbw_u32_t led2_colour, uint16_t period_ms);
+
+/**
+ * Show a progress bar (0 to 1) across the PWM OUT LED chain in the LED1 colour. NAN restores the LED1 mirror.
+ */
+void neopixel_led_set_progress(float ratio);
 bool http_rest_neopixel_led_config(struct fs_file *file, int num_params, char *params[], char *values[]);
 
 uint32_t hex_string_to_decimal(char * string);
 
-// Low level function to bypass RTOS to configure colour directly
+// Low level function to bypass RTOS to configure colour directly. Stops the animation engine for good.
 void _neopixel_led_set_colour(uint32_t led1_colour, uint32_t led2_colour, uint32_t mini12864_backlight_colour);
 
 #ifdef __cplusplus
@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "pid_autotune.h"
+#include "profile.h"
+#include "profile_store.h"
+#include "common.h"
+
+
+/*
+    Iterative PID tuning across successive charges.
+
+    Each candidate set of gains is evaluated over PID_AUTOTUNE_CHARGES_PER_TRIAL real charges. The cost of a charge
+    is the charge time plus a penalty proportional to the final error, so the tuner prefers fast charges that still
+    land on the target. Gains are refined by a coordinate pattern search: every non-zero gain is scaled up, then down,
+    by a multiplicative step, and the step shrinks whenever a full pass brings no improvement.
+*/
+
+// Gains of the profile being tuned. Gains set to zero are considered disabled by the user and are left untouched.
+static const size_t pid_gain_offsets[] = {
+    offsetof(profile_t, coarse_kp),
+    offsetof(profile_t, coarse_ki),
+    offsetof(profile_t, coarse_kd),
+    offsetof(profile_t, fine_kp),
+    offsetof(profile_t, fine_ki),
+    offsetof(profile_t, fine_kd),
+};
+
+#define PID_GAIN_CNT    (sizeof(pid_gain_offsets) / sizeof(pid_gain_offsets[0]))
+
+
+typedef struct {
+    pid_autotune_state_t state;
+    uint16_t profile_idx;               // The tuner works on the selected profile, while it stays selected
+
+    float best_gains[PID_GAIN_CNT];
+    float best_cost;                    // Cost of the best gains, NAN until the baseline is measured
+    bool has_improved;                  // Best gains differ from the gains the tuning started with
+
+    uint8_t gain_idx;                   // Gain under test
+    int8_t direction;                   // 1: scaled up, -1: scaled down, 0: baseline
+    bool improved_in_pass;
+    float step;
+
+    uint16_t trial_count;
+    uint8_t charge_count;               // Charges completed in the current trial
+    float cost_sum;
+} pid_autotune_t;
+
+
+static pid_autotune_t pid_autotune;
+
+
+static inline float * _get_gain(profile_t * profile, uint8_t idx) {
+    return (float *) ((uint8_t *) profile + pid_gain_offsets[idx]);
+}
+
+
+static uint8_t _find_active_gain(uint8_t from_idx) {
+    for (uint8_t idx = from_idx; idx < PID_GAIN_CNT; idx += 1) {
+        if (pid_autotune.best_gains[idx] > 0) {
+            return idx;
+        }
+    }
+
+    return PID_GAIN_CNT;
+}
+
+
+static void _apply_gains(profile_t * profile) {
+    for (uint8_t idx = 0; idx < PID_GAIN_CNT; idx += 1) {
+        *_get_gain(profile, idx) = pid_autotune.best_gains[idx];
+    }
+
+    // Apply the candidate on top of the best gains
+    if (pid_autotune.direction > 0) {
+        *_get_gain(profile, pid_autotune.gain_idx) *= pid_autotune.step;
+    }
+    else if (pid_autotune.direction < 0) {
+        *_get_gain(profile, pid_autotune.gain_idx) /= pid_autotune.step;
+    }
+}
+
+
+static void _select_next_gain(void) {
+    uint8_t next_idx = _find_active_gain(pid_autotune.gain_idx + 1);
+
+    // End of a pass over every gain, refine the step if nothing helped
+    if (next_idx >= PID_GAIN_CNT) {
+        if (!pid_autotune.improved_in_pass) {
+            pid_autotune.step = sqrtf(pid_autotune.step);
+        }
+        pid_autotune.improved_in_pass = false;
+
+        next_idx = _find_active_gain(0);
+    }
+
+    pid_autotune.gain_idx = next_idx;
+    pid_autotune.direction = 1;
+}
+
+
+static void _finish(pid_autotune_state_t final_state) {
+    // Restore the best gains and write them back to the profile
+    pid_autotune.direction = 0;
+
+    if (pid_autotune.profile_idx == profile_get_selected_idx()) {
+        _apply_gains(profile_get_selected());
+
+        if (pid_autotune.has_improved) {
+            profile_data_save();
+        }
+    }
+    else {
+        // The profile was changed under the tuner and kept the trial gains, they are replaced in the store
+        profile_t profile;
+        if (profile_store_load(pid_autotune.profile_idx, &profile)) {
+            _apply_gains(&profile);
+            profile_store_save(pid_autotune.profile_idx, &profile);
+        }
+    }
+
+    pid_autotune.state = final_state;
+}
+
+
+void pid_autotune_start(void) {
+    memset(&pid_autotune, 0x0, sizeof(pid_autotune));
+
+    pid_autotune.profile_idx = profile_get_selected_idx();
+    for (uint8_t idx = 0; idx < PID_GAIN_CNT; idx += 1) {
+        pid_autotune.best_gains[idx] = *_get_gain(profile_get_selected(), idx);
+    }
+
+    pid_autotune.best_cost = NAN;
+    pid_autotune.step = PID_AUTOTUNE_INITIAL_STEP;
+    pid_autotune.gain_idx = _find_active_gain(0);
+
+    // Nothing to tune
+    if (pid_autotune.gain_idx >= PID_GAIN_CNT) {
+        pid_autotune.state = PID_AUTOTUNE_COMPLETE;
+        return;
+    }
+
+    // The first trial measures the baseline with the current gains
+    pid_autotune.state = PID_AUTOTUNE_RUNNING;
+}
+
+
+void pid_autotune_stop(void) {
+    if (pid_autotune.state == PID_AUTOTUNE_RUNNING) {
+        _finish(PID_AUTOTUNE_IDLE);
+    }
+}
+
+
+pid_autotune_state_t pid_autotune_get_state(void) {
+    return pid_autotune.state;
+}
+
+
+void pid_autotune_charge_complete(float elapsed_seconds, float charge_error, float fine_stop_threshold) {
+    if (pid_autotune.state != PID_AUTOTUNE_RUNNING) {
+        return;
+    }
+
+    // The profile was changed under the tuner
+    if (pid_autotune.profile_idx != profile_get_selected_idx()) {
+        pid_autotune_stop();
+        return;
+    }
+
+    float tolerance = fine_stop_threshold > 0 ? fine_stop_threshold : 1.0f;
+    pid_autotune.cost_sum += elapsed_seconds + PID_AUTOTUNE_OVERTHROW_PENALTY_S * fabsf(charge_error) / tolerance;
+    pid_autotune.charge_count += 1;
+
+    if (pid_autotune.charge_count < PID_AUTOTUNE_CHARGES_PER_TRIAL) {
+        return;
+    }
+
+    float cost = pid_autotune.cost_sum / pid_autotune.charge_count;
+    pid_autotune.cost_sum = 0;
+    pid_autotune.charge_count = 0;
+    pid_autotune.trial_count += 1;
+
+    if (pid_autotune.direction == 0) {
+        // Baseline
+        pid_autotune.best_cost = cost;
+        pid_autotune.direction = 1;
+    }
+    else if (cost < pid_autotune.best_cost) {
+        // Keep the candidate and move on to the next gain
+        pid_autotune.best_cost = cost;
+        pid_autotune.best_gains[pid_autotune.gain_idx] = *_get_gain(profile_get_selected(), pid_autotune.gain_idx);
+        pid_autotune.has_improved = true;
+        pid_autotune.improved_in_pass = true;
+
+        _select_next_gain();
+    }
+    else if (pid_autotune.direction > 0) {
+        // Scaling up didn't help, try scaling down
+        pid_autotune.direction = -1;
+    }
+    else {
+        _select_next_gain();
+    }
+
+    if (pid_autotune.step < PID_AUTOTUNE_MIN_STEP || pid_autotune.trial_count >= PID_AUTOTUNE_MAX_TRIALS) {
+        _finish(PID_AUTOTUNE_COMPLETE);
+        return;
+    }
+
+    _apply_gains(profile_get_selected());
+}
+
+
+bool http_rest_pid_autotune(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // s0 (pid_autotune_state_t | int): Autotune state, write 1 to start and 0 to stop
+    // s1 (int): Completed trials
+    // s2 (float): Best cost (charge seconds plus error penalty)
+    // s3 (float): Current multiplicative step
+    // s4 (int): Index of the gain under test (coarse kp, ki, kd, fine kp, ki, kd)
+
+    const size_t pid_autotune_json_buffer_size = 160;
+    char * pid_autotune_json_buffer = (char *) rest_response_alloc(pid_autotune_json_buffer_size);
+    if (pid_autotune_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    // Control
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "s0") == 0) {
+            pid_autotune_state_t new_state = (pid_autotune_state_t) atoi(values[idx]);
+
+            if (new_state == PID_AUTOTUNE_RUNNING && pid_autotune.state != PID_AUTOTUNE_RUNNING) {
+                pid_autotune_start();
+            }
+            else if (new_state == PID_AUTOTUNE_IDLE) {
+                pid_autotune_stop();
+            }
+        }
+    }
+
+    // Response
+    snprintf(pid_autotune_json_buffer,
+             pid_autotune_json_buffer_size,
+             "%s"
+             "{\"s0\":%d,\"s1\":%d,\"s2\":%0.3f,\"s3\":%0.3f,\"s4\":%d}",
+             http_json_header,
+             (int) pid_autotune.state,
+             pid_autotune.trial_count,
+             isfinite(pid_autotune.best_cost) ? pid_autotune.best_cost : 0.0f,
+             pid_autotune.step,
+             pid_autotune.gain_idx);
+
+    size_t data_length = strlen(pid_autotune_json_buffer);
+    file->data = pid_autotune_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef PID_AUTOTUNE_H_
+#define PID_AUTOTUNE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "http_rest.h"
+#include "profile.h"
+
+
+#define PID_AUTOTUNE_CHARGES_PER_TRIAL      2           // Charges averaged per candidate to reject charge to charge noise
+#define PID_AUTOTUNE_MAX_TRIALS             40
+#define PID_AUTOTUNE_INITIAL_STEP           1.5f        // Multiplicative step applied to a gain
+#define PID_AUTOTUNE_MIN_STEP               1.05f       // Tuning completes once the step shrinks below this
+#define PID_AUTOTUNE_OVERTHROW_PENALTY_S    5.0f        // Cost in seconds per fine stop threshold of charge error
+
+
+typedef enum {
+    PID_AUTOTUNE_IDLE = 0,
+    PID_AUTOTUNE_RUNNING = 1,
+    PID_AUTOTUNE_COMPLETE = 2,
+} pid_autotune_state_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Starts tuning the gains of the selected profile. The candidate gains are written into the profile directly 
+// so the charge loop picks them up on the next charge.
+void pid_autotune_start(void);
+
+// Aborts tuning and restore the best gains found so far
+void pid_autotune_stop(void);
+
+pid_autotune_state_t pid_autotune_get_state(void);
+
+// Reports a finished charge to the tuner. Called once per charge after the final weight has settled.
+void pid_autotune_charge_complete(float elapsed_seconds, float charge_error, float fine_stop_threshold);
+
+// REST interface
+bool http_rest_pid_autotune(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PID_AUTOTUNE_H_
@@ -1,15 +1,114 @@
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <math.h>
+#include "pico/platform.h"
 
 #include "profile.h"
+#include "profile_store.h"
 #include "eeprom.h"
 #include "common.h"
 
 
+#define PROFILE_SUMMARY_CHUNK_SIZE      256
+
+// Profile block in the EEPROM before the profiles moved to the profile store, read once to migrate them
+#define LEGACY_PROFILE_CNT      8
+
+// profile_t of the released firmware, as the EEPROM block was written. The fields added since start at zero.
+typedef struct {
+    uint32_t rev;
+    uint32_t compatibility;
+
+    char name[PROFILE_NAME_MAX_LEN];
+
+    float coarse_kp;
+    float coarse_ki;
+    float coarse_kd;
+
+    float coarse_min_flow_speed_rps;
+    float coarse_max_flow_speed_rps;
+
+    float fine_kp;
+    float fine_ki;
+    float fine_kd;
+
+    float fine_min_flow_speed_rps;
+    float fine_max_flow_speed_rps;
+} legacy_profile_t;
+
+_Static_assert(sizeof(legacy_profile_t) == 64, "The legacy profiles shall match the released layout");
+_Static_assert(sizeof(legacy_profile_t) == offsetof(profile_t, coarse_backoff_revolutions),
+               "The legacy profiles shall be the leading part of profile_t");
+
+typedef struct {
+    uint16_t profile_data_rev;
+    uint16_t current_profile_idx;
+
+    legacy_profile_t profiles[LEGACY_PROFILE_CNT];
+} eeprom_profile_data_legacy_t;
+
+// The builds before the profile store that grew profile_t inside the block, the learned fields came first
+typedef struct {
+    legacy_profile_t released;
+
+    float learned_coarse_stop_threshold;
+    float learned_coarse_carry_weight;
+    float learned_overthrow_rate;
+} legacy_learned_profile_t;
+
+typedef struct {
+    uint16_t profile_data_rev;
+    uint16_t current_profile_idx;
+
+    legacy_learned_profile_t profiles[LEGACY_PROFILE_CNT];
+} eeprom_profile_data_legacy_learned_t;
+
+// Then the coarse backoff was inserted before them, which is the leading part of profile_t as it is now
+typedef struct {
+    legacy_profile_t released;
+
+    float coarse_backoff_revolutions;
+
+    float learned_coarse_stop_threshold;
+    float learned_coarse_carry_weight;
+    float learned_overthrow_rate;
+} legacy_backoff_profile_t;
+
+_Static_assert(sizeof(legacy_backoff_profile_t) == offsetof(profile_t, measured_dead_time_ms),
+               "The legacy backoff profiles shall be the leading part of profile_t");
+
+typedef struct {
+    uint16_t profile_data_rev;
+    uint16_t current_profile_idx;
+
+    legacy_backoff_profile_t profiles[LEGACY_PROFILE_CNT];
+} eeprom_profile_data_legacy_backoff_t;
+
+// Room for the block of any of the layouts
+typedef union {
+    eeprom_profile_data_legacy_t released;
+    eeprom_profile_data_legacy_learned_t learned;
+    eeprom_profile_data_legacy_backoff_t backoff;
+} eeprom_profile_data_legacy_block_t;
+
+
 eeprom_profile_data_t profile_data;
 
+// The selected profile, loaded from the profile store when the selection changes
+static profile_t selected_profile;
+static int32_t selected_profile_loaded_idx = -1;
+
 extern void swuart_calcCRC(uint8_t* datagram, uint8_t datagramLength);
 
 const eeprom_profile_data_t default_profile_data = {
+    .profile_data_rev = 0,
+    .current_profile_idx = 0,
+};
+
+// Profiles of a new store
+const eeprom_profile_data_legacy_t default_legacy_profile_data = {
     .profile_data_rev = 0,
     .profiles[0] = {
         .compatibility = 0,
@@ -96,6 +195,68 @@ const eeprom_profile_data_t default_profile_data = {
 
 bool profile_data_save() {
     bool is_ok = save_config(EEPROM_PROFILE_DATA_BASE_ADDR, &profile_data, sizeof(profile_data));
+
+    // Only the selected profile can have changed since it was loaded
+    if (selected_profile_loaded_idx >= 0) {
+        is_ok &= profile_store_save(selected_profile_loaded_idx, &selected_profile);
+    }
+
+    return is_ok;
+}
+
+
+/*
+    Move the profiles from the EEPROM (or the defaults for a new unit) to an empty profile store. The block is read in
+    the layout it was written in, the fields that layout doesn't have start at zero.
+*/
+static bool _profile_data_migrate(void) {
+    eeprom_profile_data_legacy_block_t * block = malloc(sizeof(eeprom_profile_data_legacy_block_t));
+    profile_t * profiles = calloc(LEGACY_PROFILE_CNT, sizeof(profile_t));
+    uint16_t current_profile_idx = 0;
+    bool is_ok = block != NULL && profiles != NULL;
+
+    if (is_ok && read_config(EEPROM_PROFILE_DATA_BASE_ADDR, &block->backoff, sizeof(block->backoff))) {
+        current_profile_idx = block->backoff.current_profile_idx;
+
+        for (uint16_t idx = 0; idx < LEGACY_PROFILE_CNT; idx += 1) {
+            memcpy(&profiles[idx], &block->backoff.profiles[idx], sizeof(legacy_backoff_profile_t));
+        }
+    }
+    else if (is_ok && read_config(EEPROM_PROFILE_DATA_BASE_ADDR, &block->learned, sizeof(block->learned))) {
+        current_profile_idx = block->learned.current_profile_idx;
+
+        for (uint16_t idx = 0; idx < LEGACY_PROFILE_CNT; idx += 1) {
+            legacy_learned_profile_t * legacy_profile = &block->learned.profiles[idx];
+
+            memcpy(&profiles[idx], &legacy_profile->released, sizeof(legacy_profile_t));
+            profiles[idx].learned_coarse_stop_threshold = legacy_profile->learned_coarse_stop_threshold;
+            profiles[idx].learned_coarse_carry_weight = legacy_profile->learned_coarse_carry_weight;
+            profiles[idx].learned_overthrow_rate = legacy_profile->learned_overthrow_rate;
+        }
+    }
+    else if (is_ok) {
+        // The released layout, or the defaults if there is none
+        is_ok = load_config(EEPROM_PROFILE_DATA_BASE_ADDR, &block->released, &default_legacy_profile_data,
+                            sizeof(block->released), EEPROM_PROFILE_DATA_REV);
+        current_profile_idx = block->released.current_profile_idx;
+
+        for (uint16_t idx = 0; idx < LEGACY_PROFILE_CNT; idx += 1) {
+            memcpy(&profiles[idx], &block->released.profiles[idx], sizeof(legacy_profile_t));
+        }
+    }
+
+    for (uint16_t idx = 0; is_ok && idx < LEGACY_PROFILE_CNT; idx += 1) {
+        is_ok = profile_store_save(idx, &profiles[idx]);
+    }
+
+    if (is_ok) {
+        profile_data.profile_data_rev = 0;
+        profile_data.current_profile_idx = current_profile_idx;
+        is_ok = save_config(EEPROM_PROFILE_DATA_BASE_ADDR, &profile_data, sizeof(profile_data));
+    }
+
+    free(profiles);
+    free(block);
     return is_ok;
 }
 
@@ -103,18 +264,36 @@ bool profile_data_save() {
 bool profile_data_init() {
     bool is_ok = true;
 
-    // Read profile index table
+    // Build the name index
+    is_ok = profile_store_init();
+    if (!is_ok) {
+        printf("Unable to read profile store\n");
+        return false;
+    }
+
     memset(&profile_data, 0x0, sizeof(eeprom_profile_data_t));
-    is_ok = load_config(EEPROM_PROFILE_DATA_BASE_ADDR, &profile_data, &default_profile_data, sizeof(profile_data), EEPROM_PROFILE_DATA_REV);
+    if (profile_store_get_count() == 0) {
+        is_ok = _profile_data_migrate();
+    }
+    else {
+        is_ok = load_config(EEPROM_PROFILE_DATA_BASE_ADDR, &profile_data, &default_profile_data, sizeof(profile_data), EEPROM_PROFILE_DATA_REV);
+    }
 
     if (!is_ok) {
         printf("Unable to read profile data\n");
         return false;
     }
 
+    if (profile_data.current_profile_idx >= profile_store_get_count()) {
+        profile_data.current_profile_idx = 0;
+    }
+
     // Register to eeprom save all
     eeprom_register_handler(profile_data_save);
 
+    // Served together with the other modules by /rest/config
+    rest_register_config_module("profile_config", http_rest_profile_config);
+
     return true;
 }
 
@@ -124,15 +303,101 @@ uint16_t profile_get_selected_idx() {
 }
 
 
+uint16_t profile_get_count() {
+    return profile_store_get_count();
+}
+
+
+const char * profile_get_name(uint16_t idx) {
+    const char * name = profile_store_get_name(idx);
+    return name ? name : "";
+}
+
+
 profile_t * profile_get_selected() {
-    return &profile_data.profiles[profile_get_selected_idx()];
+    // The menu changes the index directly
+    uint16_t idx = profile_get_selected_idx();
+
+    if (selected_profile_loaded_idx != idx) {
+        // Changes to the previous profile are kept, as when all profiles were in memory
+        if (selected_profile_loaded_idx >= 0) {
+            profile_store_save(selected_profile_loaded_idx, &selected_profile);
+        }
+
+        if (!profile_store_load(idx, &selected_profile)) {
+            memset(&selected_profile, 0x0, sizeof(selected_profile));
+        }
+        selected_profile_loaded_idx = idx;
+    }
+
+    return &selected_profile;
 }
 
 
-profile_t * profile_select(uint8_t idx) {
+profile_t * profile_select(uint16_t idx) {
     profile_data.current_profile_idx = idx;
 
-    return profile_get_selected(idx);
+    return profile_get_selected();
+}
+
+
+static bool _profile_get_flow_model(const profile_t * profile, motor_select_t motor, float * gain, float * slope) {
+    switch (motor) {
+        case SELECT_COARSE_TRICKLER_MOTOR:
+            *gain = profile->coarse_flow_gain;
+            *slope = profile->coarse_flow_gain_slope;
+            break;
+        case SELECT_FINE_TRICKLER_MOTOR:
+            *gain = profile->measured_flow_gain;
+            *slope = profile->fine_flow_gain_slope;
+            break;
+        default:
+            return false;
+    }
+
+    return *gain > 0;
+}
+
+
+float profile_get_flow_rate(const profile_t * profile, motor_select_t motor, float speed_rps) {
+    float gain;
+    float slope;
+    if (!_profile_get_flow_model(profile, motor, &gain, &slope)) {
+        return NAN;
+    }
+
+    return fmaxf(gain + slope * speed_rps, 0.0f) * speed_rps;
+}
+
+
+float profile_get_flow_speed(const profile_t * profile, motor_select_t motor, float flow_rate) {
+    float gain;
+    float slope;
+    if (!_profile_get_flow_model(profile, motor, &gain, &slope)) {
+        return NAN;
+    }
+
+    // flow_rate = gain * speed + slope * speed^2
+    if (fabsf(slope) < 1e-6f) {
+        return flow_rate / gain;
+    }
+
+    float discriminant = gain * gain + 4.0f * slope * flow_rate;
+    if (discriminant < 0) {
+        return -gain / (2.0f * slope);
+    }
+
+    return (sqrtf(discriminant) - gain) / (2.0f * slope);
+}
+
+
+// Adds a profile after the last one, with the gains of an unused default profile
+static bool profile_add(uint16_t idx) {
+    profile_t profile;
+    memset(&profile, 0x0, sizeof(profile));
+    snprintf(profile.name, sizeof(profile.name), "Profile%u", idx);
+
+    return profile_store_save(idx, &profile);
 }
 
 
@@ -142,7 +407,7 @@ void profile_update_checksum() {
 
 bool http_rest_profile_config(struct fs_file *file, int num_params, char *params[], char *values[]) {
     // Mappings:
-    // pf (int): profile index
+    // pf (int): profile index, the index after the last profile adds a profile
     // p0 (int): rev
     // p1 (int): compatibility
     // p2 (str): name
@@ -156,20 +421,42 @@ bool http_rest_profile_config(struct fs_file *file, int num_params, char *params
     // p10 (float): fine_kd
     // p11 (float): fine_min_flow_speed_rps
     // p12 (float): fine_max_flow_speed_rps
+    // p13 (float): learned_coarse_stop_threshold (write 0 to restart learning)
+    // p14 (float): learned_coarse_carry_weight
+    // p15 (float): learned_overthrow_rate
+    // p16 (float): coarse_backoff_revolutions
+    // p17 (float): measured_dead_time_ms (write 0 to use the cutoff dead time of the charge mode)
+    // p18 (float): measured_response_delay_ms
+    // p19 (float): measured_time_constant_ms
+    // p20 (float): measured_flow_gain
+    // p21 (int): measured_scale_driver
+    // p22 (int): charge_pipeline (0 for the coarse and fine stages above, 1 - 4 for /rest/charge_pipeline_config)
+    // p23 (float): coarse_flow_gain (write 0 to clear the coarse flow model)
+    // p24 (float): coarse_flow_gain_slope
+    // p25 (float): fine_flow_gain_slope
     // ee (bool): save to eeprom
-    static char buf[256];
+    const size_t buf_size = 512;
+    char * buf = (char *) rest_response_alloc(buf_size);
+    if (buf == NULL) {
+        return rest_response_unavailable(file);
+    }
 
     // Read the current loaded profile index
-    uint8_t profile_idx = profile_get_selected_idx();
+    uint16_t profile_idx = profile_get_selected_idx();
 
     // Overwrite the profile index (if applicable)
     for (int idx = 0; idx < num_params; idx += 1) {
         if (strcmp(params[idx], "pf") == 0) {
-            profile_idx = (uint16_t) atoi(values[0]);
+            profile_idx = (uint16_t) atoi(values[idx]);
         }
     }
 
-    if (profile_idx >= MAX_PROFILE_CNT) {
+    // The index after the last profile adds one
+    if (profile_idx == profile_get_count() && profile_idx < MAX_PROFILE_CNT) {
+        profile_add(profile_idx);
+    }
+
+    if (profile_idx >= profile_get_count()) {
         strcpy(buf, "{\"error\":\"InvalidProfileIndex\"}");
     }
 
@@ -218,6 +505,45 @@ bool http_rest_profile_config(struct fs_file *file, int num_params, char *params
             else if (strcmp(params[idx], "p12") == 0) {
                 current_profile->fine_max_flow_speed_rps = strtof(values[idx], NULL);
             }
+            else if (strcmp(params[idx], "p13") == 0) {
+                current_profile->learned_coarse_stop_threshold = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "p14") == 0) {
+                current_profile->learned_coarse_carry_weight = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "p15") == 0) {
+                current_profile->learned_overthrow_rate = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "p16") == 0) {
+                current_profile->coarse_backoff_revolutions = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "p17") == 0) {
+                current_profile->measured_dead_time_ms = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "p18") == 0) {
+                current_profile->measured_response_delay_ms = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "p19") == 0) {
+                current_profile->measured_time_constant_ms = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "p20") == 0) {
+                current_profile->measured_flow_gain = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "p21") == 0) {
+                current_profile->measured_scale_driver = (uint32_t) atoi(values[idx]);
+            }
+            else if (strcmp(params[idx], "p22") == 0) {
+                current_profile->charge_pipeline = (uint32_t) atoi(values[idx]);
+            }
+            else if (strcmp(params[idx], "p23") == 0) {
+                current_profile->coarse_flow_gain = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "p24") == 0) {
+                current_profile->coarse_flow_gain_slope = strtof(values[idx], NULL);
+            }
+            else if (strcmp(params[idx], "p25") == 0) {
+                current_profile->fine_flow_gain_slope = strtof(values[idx], NULL);
+            }
             else if (strcmp(params[idx], "ee") == 0) {
                 save_to_eeprom = string_to_boolean(values[idx]);
             }
@@ -229,9 +555,10 @@ bool http_rest_profile_config(struct fs_file *file, int num_params, char *params
         }
 
         // Response
-        snprintf(buf, sizeof(buf), 
+        snprintf(buf, buf_size, 
                  "%s"
-                 "{\"pf\":%d,\"p0\":%ld,\"p1\":%ld,\"p2\":\"%s\",\"p3\":%0.3f,\"p4\":%0.3f,\"p5\":%0.3f,\"p6\":%0.3f,\"p7\":%0.3f,\"p8\":%0.3f,\"p9\":%0.3f,\"p10\":%0.3f,\"p11\":%0.3f,\"p12\":%0.3f}",
+                 "{\"pf\":%d,\"p0\":%ld,\"p1\":%ld,\"p2\":\"%s\",\"p3\":%0.3f,\"p4\":%0.3f,\"p5\":%0.3f,\"p6\":%0.3f,\"p7\":%0.3f,\"p8\":%0.3f,\"p9\":%0.3f,\"p10\":%0.3f,\"p11\":%0.3f,\"p12\":%0.3f,\"p13\":%0.3f,\"p14\":%0.3f,\"p15\":%0.3f,\"p16\":%0.3f,\"p17\":%0.1f,\"p18\":%0.1f,\"p19\":%0.1f,\"p20\":%0.4f,\"p21\":%lu,\"p22\":%lu,"
+                 "\"p23\":%0.4f,\"p24\":%0.4f,\"p25\":%0.4f}",
                  http_json_header,
                  profile_idx, 
                  current_profile->rev,
@@ -246,7 +573,20 @@ bool http_rest_profile_config(struct fs_file *file, int num_params, char *params
                  current_profile->fine_ki,
                  current_profile->fine_kd,
                  current_profile->fine_min_flow_speed_rps,
-                 current_profile->fine_max_flow_speed_rps);
+                 current_profile->fine_max_flow_speed_rps,
+                 current_profile->learned_coarse_stop_threshold,
+                 current_profile->learned_coarse_carry_weight,
+                 current_profile->learned_overthrow_rate,
+                 current_profile->coarse_backoff_revolutions,
+                 current_profile->measured_dead_time_ms,
+                 current_profile->measured_response_delay_ms,
+                 current_profile->measured_time_constant_ms,
+                 current_profile->measured_flow_gain,
+                 current_profile->measured_scale_driver,
+                 current_profile->charge_pipeline,
+                 current_profile->coarse_flow_gain,
+                 current_profile->coarse_flow_gain_slope,
+                 current_profile->fine_flow_gain_slope);
     }
 
     size_t response_len = strlen(buf);
@@ -259,46 +599,81 @@ bool http_rest_profile_config(struct fs_file *file, int num_params, char *params
 }
 
 
+typedef struct {
+    uint16_t part;              // Next part to send, see _profile_summary_format_part
+    uint16_t count;
+    uint16_t current_profile_idx;
+    char chunk[PROFILE_SUMMARY_CHUNK_SIZE];
+} _profile_summary_state_t;
+
+
+// The summary in parts: the opening, one per profile and the closing. Returns 0 after the last part.
+static size_t _profile_summary_format_part(const _profile_summary_state_t * state, uint16_t part, 
+                                           char * buffer, size_t buffer_size) {
+    if (part == 0) {
+        return snprintf(buffer, buffer_size, "{\"s0\":{");
+    }
+    else if (part <= state->count) {
+        uint16_t profile_idx = part - 1;
+        return snprintf(buffer, buffer_size, "%s\"%u\":\"%s\"", 
+                        profile_idx ? "," : "", profile_idx, profile_get_name(profile_idx));
+    }
+    else if (part == state->count + 1) {
+        return snprintf(buffer, buffer_size, "},\"s1\":%u}", state->current_profile_idx);
+    }
+
+    return 0;
+}
+
+
+static size_t _profile_summary_read(void * state, const char ** data, size_t max_len) {
+    _profile_summary_state_t * summary_state = (_profile_summary_state_t *) state;
+    size_t chunk_len = 0;
+    char part[48];
+
+    max_len = MIN(max_len, sizeof(summary_state->chunk));
+    while (true) {
+        size_t part_len = _profile_summary_format_part(summary_state, summary_state->part, part, sizeof(part));
+        if (part_len == 0 || chunk_len + part_len > max_len) {
+            break;
+        }
+
+        memcpy(summary_state->chunk + chunk_len, part, part_len);
+        chunk_len += part_len;
+        summary_state->part += 1;
+    }
+
+    *data = summary_state->chunk;
+    return chunk_len;
+}
+
+
 bool http_rest_profile_summary(struct fs_file *file, int num_params, char *params[], char *values[])
 {
     // It does not take argument
-    assert(MAX_PROFILE_CNT <= 8);  // Ensures 256 byte buffer us sufficient
-    static char buf[256];
 
     // Response
     // s0 (dict): A dictionary of all profiles in {idx: name} format. 
     // s1 (int): The current loaded profile index
-    memset(buf, 0x0, sizeof(buf));
-    const char * item_template = "\"%d\":\"%s\",";
-
-    // Create header
-    snprintf(buf, sizeof(buf), 
-             "%s{\"s0\":{",
-             http_json_header);
-
-    size_t char_idx = strlen(buf);
-
-    // Write profile information
-    for (uint8_t p_idx=0; p_idx < MAX_PROFILE_CNT; p_idx+=1) {
-        snprintf(&buf[char_idx], sizeof(buf) - char_idx, 
-                 item_template,
-                 p_idx, &profile_data.profiles[p_idx].name);
-        char_idx += strnlen((const char *) &buf[char_idx], sizeof(buf));
+    //
+    // Served from the name index, part by part as the connection drains
+    _profile_summary_state_t * summary_state = (_profile_summary_state_t *) rest_response_alloc(sizeof(_profile_summary_state_t));
+    if (summary_state == NULL) {
+        return rest_response_unavailable(file);
+    }
+    summary_state->part = 0;
+    summary_state->count = profile_get_count();
+    summary_state->current_profile_idx = profile_get_selected_idx();
+
+    size_t body_len = 0;
+    char part[48];
+    for (uint16_t idx = 0; idx <= summary_state->count + 1; idx += 1) {
+        body_len += _profile_summary_format_part(summary_state, idx, part, sizeof(part));
     }
 
-    // Append close bracket (replace the last comma)
-    buf[char_idx - 1] = '}';
-
-    // Append s1
-    snprintf(&buf[char_idx], sizeof(buf) - char_idx,
-             ",\"s1\":%d}", 
-             profile_data.current_profile_idx);
-
-    size_t response_len = strlen(buf);
-    file->data = buf;
-    file->len = response_len;
-    file->index = response_len;
-    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+    if (!rest_response_stream(file, "application/json", body_len, _profile_summary_read, summary_state)) {
+        return rest_response_unavailable(file);
+    }
 
     return true;
-}
\ No newline at end of file
+}
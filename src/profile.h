@@ -4,10 +4,11 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "http_rest.h"
+#include "motors.h"
 
 
 #define PROFILE_NAME_MAX_LEN    16
-#define MAX_PROFILE_CNT         8
+#define MAX_PROFILE_CNT         256         // Kept in the profile store, see profile_store.h
 
 #define EEPROM_PROFILE_DATA_REV             1           // 16 bit
 
@@ -31,14 +32,36 @@ typedef struct
 
     float fine_min_flow_speed_rps;
     float fine_max_flow_speed_rps;
+
+    // Reverse the coarse trickler by this amount when it stops, 0 to disable
+    float coarse_backoff_revolutions;
+
+    // Learned from recorded charges, 0 means not learned yet
+    float learned_coarse_stop_threshold;
+    float learned_coarse_carry_weight;      // Weight delivered by the coarse trickler after it stops
+    float learned_overthrow_rate;           // Moving average of over charges (0.0 - 1.0)
+
+    // Measured by the dead time mode with the scale driver below, 0 means not measured
+    float measured_dead_time_ms;            // Used by the predictive cutoff
+    float measured_response_delay_ms;
+    float measured_time_constant_ms;
+    float measured_flow_gain;               // Fine trickler weight per revolution, the gain of its flow model below
+    uint32_t measured_scale_driver;         // scale_driver_t
+
+    // Stages of the charge, see charge_pipeline.h. 0 runs the coarse and fine stages of the gains above.
+    uint32_t charge_pipeline;
+
+    // Flow model fitted by the flow calibration of the cleanup mode, weight per revolution = gain + slope * speed (rps).
+    // The profile store has no room left for more fields.
+    float coarse_flow_gain;                 // 0 means not calibrated
+    float coarse_flow_gain_slope;
+    float fine_flow_gain_slope;             // Gain is measured_flow_gain
 } profile_t;
 
 
 typedef struct {
     uint16_t profile_data_rev;
     uint16_t current_profile_idx;
-
-    profile_t profiles[MAX_PROFILE_CNT];
 } eeprom_profile_data_t;
 
 
@@ -52,8 +75,20 @@ extern "C" {
 bool profile_data_init(void);
 bool profile_data_save();
 
-profile_t * profile_select(uint8_t idx);
+profile_t * profile_select(uint16_t idx);
 profile_t * profile_get_selected();
+uint16_t profile_get_selected_idx();
+
+// Flow rate (weight per second) of a trickler at speed_rps from the flow model, NAN if not calibrated
+float profile_get_flow_rate(const profile_t * profile, motor_select_t motor, float speed_rps);
+
+// Speed (rps) of a trickler delivering flow_rate from the flow model, the speed of the highest flow if it can't.
+// NAN if not calibrated.
+float profile_get_flow_speed(const profile_t * profile, motor_select_t motor, float flow_rate);
+
+// From the name index, without loading the profiles
+uint16_t profile_get_count();
+const char * profile_get_name(uint16_t idx);
 
 // REST interface
 bool http_rest_profile_config(struct fs_file *file, int num_params, char *params[], char *values[]);
@@ -0,0 +1,279 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include "hardware/flash.h"
+#include "hardware/regs/addressmap.h"
+#include "pico/flash.h"
+#include "pico/platform.h"
+
+#include "profile_store.h"
+#include "common.h"
+#include "crc32.h"
+#include "static_alloc.h"
+
+
+/*
+    Profiles in the QSPI flash, one 128 byte record per saved profile.
+
+    Saving appends a new copy of the profile at the head and the copy with the largest seq wins, so a save writes one
+    record and a power loss leaves the previous copy in place. The head walks through the sectors in turn. When it
+    enters a sector, the sector is erased and the copies still in use in the following sector are moved in first, so
+    that sector holds only outdated copies by the time the head gets there. With up to 256 profiles in 512 slots there
+    is always room to do so.
+
+    The index keeps the slot and the name of every profile, the profile itself is read from the XIP mapped flash when
+    it is loaded.
+*/
+
+#define PROFILE_STORE_SLOT_CNT          (PROFILE_STORE_FLASH_SIZE / sizeof(profile_store_record_t))
+#define PROFILE_STORE_SECTOR_SLOTS      (FLASH_SECTOR_SIZE / sizeof(profile_store_record_t))
+#define PROFILE_STORE_SECTOR_CNT        (PROFILE_STORE_FLASH_SIZE / FLASH_SECTOR_SIZE)
+#define PROFILE_STORE_PAGE_SLOTS        (FLASH_PAGE_SIZE / sizeof(profile_store_record_t))
+#define PROFILE_STORE_NO_SLOT           0xFFFF
+#define PROFILE_STORE_FLASH_TIMEOUT_MS  1000
+
+
+typedef struct __attribute__((packed)) {
+    uint32_t seq;
+    uint16_t profile_idx;
+    uint16_t reserved;
+    profile_t profile;
+    uint8_t padding[116 - sizeof(profile_t)];
+    uint32_t crc32;             // Over the fields above
+} profile_store_record_t;
+
+_Static_assert(sizeof(profile_store_record_t) == 128, "Profile records shall fit the flash pages");
+
+typedef struct {
+    uint32_t offset;
+    const uint8_t * data;       // One page to program, NULL to erase the sector at offset
+} _flash_operation_t;
+
+
+extern char __flash_binary_end;
+
+static const profile_store_record_t * const profile_store_log =
+    (const profile_store_record_t *) (XIP_BASE + PROFILE_STORE_FLASH_OFFSET);
+
+static uint16_t profile_store_slots[PROFILE_STORE_MAX_CNT];
+static char profile_store_names[PROFILE_STORE_MAX_CNT][PROFILE_NAME_MAX_LEN];
+static uint16_t profile_store_count = 0;
+static uint32_t profile_store_next_seq = 0;
+static uint32_t profile_store_head = 0;
+static int32_t profile_store_filled_sector = -1;   // Sector erased for the head, -1 until the head enters one
+static SemaphoreHandle_t profile_store_mutex = NULL;
+static uint8_t profile_store_page[FLASH_PAGE_SIZE];
+
+
+static bool _record_is_valid(const profile_store_record_t * record) {
+    return record->profile_idx < PROFILE_STORE_MAX_CNT &&
+           record->crc32 == crc32_compute(record, offsetof(profile_store_record_t, crc32));
+}
+
+
+// The record is the copy of its profile in use
+static bool _record_is_live(uint32_t slot) {
+    const profile_store_record_t * record = &profile_store_log[slot];
+    return _record_is_valid(record) && profile_store_slots[record->profile_idx] == slot;
+}
+
+
+static void _flash_operation(void * param) {
+    _flash_operation_t * operation = (_flash_operation_t *) param;
+
+    if (operation->data) {
+        flash_range_program(operation->offset, operation->data, FLASH_PAGE_SIZE);
+    }
+    else {
+        flash_range_erase(operation->offset, FLASH_SECTOR_SIZE);
+    }
+}
+
+
+static bool _relocate_live_records(uint32_t sector);
+
+
+static bool _write_record(uint16_t idx, const profile_t * profile) {
+    uint32_t sector = profile_store_head / PROFILE_STORE_SECTOR_SLOTS;
+    _flash_operation_t operation;
+
+    if (profile_store_head % PROFILE_STORE_SECTOR_SLOTS == 0 && (int32_t) sector != profile_store_filled_sector) {
+        // Never erase a profile, a failed save is better
+        for (uint32_t slot = sector * PROFILE_STORE_SECTOR_SLOTS; slot < (sector + 1) * PROFILE_STORE_SECTOR_SLOTS; slot += 1) {
+            if (_record_is_live(slot)) {
+                printf("Profile store sector %lu still in use\n", sector);
+                return false;
+            }
+        }
+
+        operation.offset = PROFILE_STORE_FLASH_OFFSET + sector * FLASH_SECTOR_SIZE;
+        operation.data = NULL;
+        if (flash_safe_execute(_flash_operation, &operation, PROFILE_STORE_FLASH_TIMEOUT_MS) != PICO_OK) {
+            return false;
+        }
+        profile_store_filled_sector = sector;
+
+        if (!_relocate_live_records((sector + 1) % PROFILE_STORE_SECTOR_CNT)) {
+            return false;
+        }
+    }
+
+    uint32_t slot = profile_store_head;
+    profile_store_record_t * record = (profile_store_record_t *)
+        (profile_store_page + (slot % PROFILE_STORE_PAGE_SLOTS) * sizeof(profile_store_record_t));
+
+    // Programming leaves the bits of the other record in the page as they are
+    memset(profile_store_page, 0xFF, sizeof(profile_store_page));
+    memset(record, 0x0, sizeof(profile_store_record_t));
+    record->seq = profile_store_next_seq;
+    record->profile_idx = idx;
+    memcpy(&record->profile, profile, sizeof(profile_t));
+    record->crc32 = crc32_compute(record, offsetof(profile_store_record_t, crc32));
+
+    operation.offset = PROFILE_STORE_FLASH_OFFSET + (slot / PROFILE_STORE_PAGE_SLOTS) * FLASH_PAGE_SIZE;
+    operation.data = profile_store_page;
+    bool is_ok = flash_safe_execute(_flash_operation, &operation, PROFILE_STORE_FLASH_TIMEOUT_MS) == PICO_OK;
+
+    // A slot that was programmed (or partly programmed) is used up either way
+    profile_store_head = (slot + 1) % PROFILE_STORE_SLOT_CNT;
+    profile_store_next_seq += 1;
+
+    if (!is_ok || !_record_is_valid(&profile_store_log[slot])) {
+        return false;
+    }
+
+    profile_store_slots[idx] = slot;
+    strncpy(profile_store_names[idx], profile->name, PROFILE_NAME_MAX_LEN);
+    profile_store_names[idx][PROFILE_NAME_MAX_LEN - 1] = '\0';
+
+    return true;
+}
+
+
+// Copy the profiles of the sector to the head, leaving only outdated copies behind
+static bool _relocate_live_records(uint32_t sector) {
+    for (uint32_t slot = sector * PROFILE_STORE_SECTOR_SLOTS; slot < (sector + 1) * PROFILE_STORE_SECTOR_SLOTS; slot += 1) {
+        if (!_record_is_live(slot)) {
+            continue;
+        }
+
+        profile_t profile;
+        memcpy(&profile, &profile_store_log[slot].profile, sizeof(profile_t));
+        if (!_write_record(profile_store_log[slot].profile_idx, &profile)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool profile_store_init(void) {
+    bool found = false;
+    uint32_t last_seq = 0;
+    uint32_t last_slot = 0;
+
+    memset(profile_store_slots, 0xFF, sizeof(profile_store_slots));
+    memset(profile_store_names, 0x0, sizeof(profile_store_names));
+    profile_store_count = 0;
+    profile_store_mutex = STATIC_SEMAPHORE_CREATE_MUTEX();
+
+    if ((uintptr_t) &__flash_binary_end > XIP_BASE + PROFILE_STORE_FLASH_OFFSET) {
+        printf("No flash left for the profile store\n");
+        return false;
+    }
+
+    for (uint32_t slot = 0; slot < PROFILE_STORE_SLOT_CNT; slot += 1) {
+        const profile_store_record_t * record = &profile_store_log[slot];
+        if (!_record_is_valid(record)) {
+            continue;
+        }
+
+        // The newest copy of each profile
+        uint16_t current_slot = profile_store_slots[record->profile_idx];
+        if (current_slot == PROFILE_STORE_NO_SLOT || record->seq > profile_store_log[current_slot].seq) {
+            profile_store_slots[record->profile_idx] = slot;
+        }
+
+        if (!found || record->seq > last_seq) {
+            found = true;
+            last_seq = record->seq;
+            last_slot = slot;
+        }
+    }
+
+    for (uint16_t idx = 0; idx < PROFILE_STORE_MAX_CNT; idx += 1) {
+        uint16_t slot = profile_store_slots[idx];
+        if (slot != PROFILE_STORE_NO_SLOT) {
+            memcpy(profile_store_names[idx], profile_store_log[slot].profile.name, PROFILE_NAME_MAX_LEN);
+            profile_store_names[idx][PROFILE_NAME_MAX_LEN - 1] = '\0';
+            profile_store_count = idx + 1;
+        }
+    }
+
+    if (found) {
+        profile_store_next_seq = last_seq + 1;
+        profile_store_head = (last_slot + 1) % PROFILE_STORE_SLOT_CNT;
+
+        // Finish the moves out of the next sector if they were cut short
+        if (profile_store_head % PROFILE_STORE_SECTOR_SLOTS != 0) {
+            profile_store_filled_sector = profile_store_head / PROFILE_STORE_SECTOR_SLOTS;
+            _relocate_live_records((profile_store_filled_sector + 1) % PROFILE_STORE_SECTOR_CNT);
+        }
+    }
+
+    return true;
+}
+
+
+uint16_t profile_store_get_count(void) {
+    return profile_store_count;
+}
+
+
+const char * profile_store_get_name(uint16_t idx) {
+    if (idx >= profile_store_count || profile_store_slots[idx] == PROFILE_STORE_NO_SLOT) {
+        return NULL;
+    }
+
+    return profile_store_names[idx];
+}
+
+
+bool profile_store_load(uint16_t idx, profile_t * profile) {
+    if (idx >= profile_store_count || profile_store_slots[idx] == PROFILE_STORE_NO_SLOT) {
+        return false;
+    }
+
+    xSemaphoreTake(profile_store_mutex, portMAX_DELAY);
+    memcpy(profile, &profile_store_log[profile_store_slots[idx]].profile, sizeof(profile_t));
+    xSemaphoreGive(profile_store_mutex);
+
+    return true;
+}
+
+
+bool profile_store_save(uint16_t idx, const profile_t * profile) {
+    if (idx >= PROFILE_STORE_MAX_CNT || idx > profile_store_count) {
+        return false;
+    }
+
+    xSemaphoreTake(profile_store_mutex, portMAX_DELAY);
+
+    bool is_ok = true;
+    uint16_t slot = profile_store_slots[idx];
+    if (slot == PROFILE_STORE_NO_SLOT || memcmp(&profile_store_log[slot].profile, profile, sizeof(profile_t)) != 0) {
+        is_ok = _write_record(idx, profile);
+    }
+
+    if (is_ok && idx == profile_store_count) {
+        profile_store_count += 1;
+    }
+
+    xSemaphoreGive(profile_store_mutex);
+
+    return is_ok;
+}
@@ -0,0 +1,46 @@
+#ifndef PROFILE_STORE_H_
+#define PROFILE_STORE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "profile.h"
+#include "charge_history.h"
+
+
+// 16 sectors below the charge history, 512 record slots for up to PROFILE_STORE_MAX_CNT profiles
+#define PROFILE_STORE_FLASH_SIZE        (64 * 1024)
+#define PROFILE_STORE_FLASH_OFFSET      (PICO_FLASH_SIZE_BYTES - CHARGE_HISTORY_FLASH_SIZE - PROFILE_STORE_FLASH_SIZE)
+#define PROFILE_STORE_MAX_CNT           MAX_PROFILE_CNT
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Builds the name index from the records in flash. Returns false if the store can't be used.
+ */
+bool profile_store_init(void);
+
+/**
+ * Number of profiles in the store, they have the indexes 0 to count - 1.
+ */
+uint16_t profile_store_get_count(void);
+
+/**
+ * Name of a stored profile from the index, NULL if the profile doesn't exist.
+ */
+const char * profile_store_get_name(uint16_t idx);
+
+bool profile_store_load(uint16_t idx, profile_t * profile);
+
+/**
+ * Writes one profile, unless the stored copy is the same. idx may be the count to add a profile.
+ */
+bool profile_store_save(uint16_t idx, const profile_t * profile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PROFILE_STORE_H_
@@ -2,13 +2,14 @@
 #include <queue.h>
 
 #include "rest_app_control.h"
+#include "static_alloc.h"
 
 
 QueueHandle_t rest_event_queue = NULL;
 
 
 void rest_app_control_init() {
-    rest_event_queue = xQueueCreate(1, sizeof(rest_control_event_t));
+    rest_event_queue = STATIC_QUEUE_CREATE(1, sizeof(rest_control_event_t));
 
     if (rest_event_queue == NULL) {
         assert(false);
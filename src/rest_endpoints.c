@@ -3,8 +3,11 @@
 #include "rest_endpoints.h"
 #include "http_rest.h"
 #include "charge_mode.h"
+#include "charge_pipeline.h"
+#include "charge_batch.h"
 #include "motors.h"
 #include "scale.h"
+#include "custom_scale.h"
 #include "wireless.h"
 #include "eeprom.h"
 #include "mini_12864_module.h"
@@ -12,60 +15,77 @@
 #include "neopixel_led.h"
 #include "profile.h"
 #include "cleanup_mode.h"
+#include "dead_time_mode.h"
 #include "servo_gate.h"
 #include "system_control.h"
+#include "charge_trace.h"
+#include "benchmark.h"
+#include "pid_autotune.h"
+#include "charge_history.h"
+#include "boot.h"
+#include "config_snapshot.h"
+#include "trace.h"
 
 // Generated headers by html2header.py under scripts
 #include "display_mirror.html.h"
 #include "web_portal.html.h"
 #include "wizard.html.h"
+#include "plot_weight.html.h"
 
 
 bool http_404_error(struct fs_file *file, int num_params, char *params[], char *values[]) {
 
-    file->data = "HTTP/1.1 404 Not Found\r\nContent-Type: application/json\r\n\r\n"
-                 "{\"error\":404}";
-    file->len = 13;
-    file->index = 13;
+    static const char http_not_found[] = "HTTP/1.1 404 Not Found\r\nContent-Type: application/json\r\n\r\n"
+                                         "{\"error\":404}";
+
+    file->data = http_not_found;
+    file->len = sizeof(http_not_found) - 1;
+    file->index = sizeof(http_not_found) - 1;
     file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
 
     return true;
 }
 
 
-bool http_display_mirror(struct fs_file *file, int num_params, char *params[], char *values[]) {
-    size_t len = strlen(html_display_mirror_html);
+/*
+    Pages come from the headers generated by html2header.py, gzip compressed with their ETag. A browser revalidating 
+    its cached copy (If-None-Match) gets the 304 response instead of the page.
+*/
+#define HTTP_SERVE_PAGE(file, page)  _http_serve_page(file, page, page##_len, page##_etag, page##_not_modified)
 
-    file->data = html_display_mirror_html;
-    file->len = len;
-    file->index = len;
+static bool _http_serve_page(struct fs_file *file, const char * page, size_t page_len, const char * etag, 
+                             const char * not_modified) {
+    if (rest_request_header_contains("If-None-Match", etag)) {
+        file->data = not_modified;
+        file->len = strlen(not_modified);
+    }
+    else {
+        file->data = page;
+        file->len = page_len;
+    }
+    file->index = file->len;
     file->flags = FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT;
 
     return true;
 }
 
 
-bool http_web_portal(struct fs_file *file, int num_params, char *params[], char *values[]) {
-    size_t len = strlen(html_web_portal_html);
+bool http_display_mirror(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    return HTTP_SERVE_PAGE(file, html_display_mirror_html);
+}
 
-    file->data = html_web_portal_html;
-    file->len = len;
-    file->index = len;
-    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT;
 
-    return true;
+bool http_web_portal(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    return HTTP_SERVE_PAGE(file, html_web_portal_html);
 }
 
 
 bool http_wizard(struct fs_file *file, int num_params, char *params[], char *values[]) {
-    size_t len = strlen(html_wizard_html);
-
-    file->data = html_wizard_html;
-    file->len = len;
-    file->index = len;
-    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT;
+    return HTTP_SERVE_PAGE(file, html_wizard_html);
+}
 
-    return true;
+bool http_plot_weight(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    return HTTP_SERVE_PAGE(file, html_plot_weight_html);
 }
 
 
@@ -81,14 +101,35 @@ bool rest_endpoints_init(bool default_wizard) {
     rest_register_handler("/mobile", http_web_portal);
     rest_register_handler("/wizard", http_wizard);
     rest_register_handler("/404", http_404_error);
+    rest_register_handler("/metrics", http_rest_metrics);
     rest_register_handler("/rest/scale_action", http_rest_scale_action);
+    rest_register_handler("/rest/config", http_rest_config);
+    rest_register_handler("/rest/config_snapshot", http_rest_config_snapshot);
+    rest_register_handler("/rest/config_snapshot_import", http_rest_config_snapshot_import);
     rest_register_handler("/rest/scale_config", http_rest_scale_config);
+    rest_register_handler("/rest/scale_telemetry", http_rest_scale_telemetry);
+    rest_register_handler("/rest/custom_scale_config", http_rest_custom_scale_config);
     rest_register_handler("/rest/charge_mode_config", http_rest_charge_mode_config);
     rest_register_handler("/rest/charge_mode_state", http_rest_charge_mode_state);
+    rest_register_handler("/rest/charge_pipeline_config", http_rest_charge_pipeline_config);
+    rest_register_handler("/rest/charge_batch", http_rest_charge_batch);
+    rest_register_handler("/rest/charge_trace", http_rest_charge_trace);
+    rest_register_handler("/rest/charge_history", http_rest_charge_history);
+    rest_register_handler("/rest/charge_history_export", http_rest_charge_history_export);
+    rest_register_handler("/rest/pid_autotune", http_rest_pid_autotune);
     rest_register_handler("/rest/cleanup_mode_state", http_rest_cleanup_mode_state);
+    rest_register_handler("/rest/dead_time_mode_state", http_rest_dead_time_mode_state);
     rest_register_handler("/rest/system_control", http_rest_system_control);
+    rest_register_handler("/rest/task_placement", http_rest_task_placement);
+    rest_register_handler("/rest/task_stats", http_rest_task_stats);
+    rest_register_handler("/rest/heap_stats", http_rest_heap_stats);
+    rest_register_handler("/rest/trace", http_rest_trace);
+    rest_register_handler("/rest/benchmark", http_rest_benchmark);
+    rest_register_handler("/rest/boot", http_rest_boot);
     rest_register_handler("/rest/coarse_motor_config", http_rest_coarse_motor_config);
     rest_register_handler("/rest/fine_motor_config", http_rest_fine_motor_config);
+    rest_register_handler("/rest/coarse_motor_diagnostics", http_rest_coarse_motor_diagnostics);
+    rest_register_handler("/rest/fine_motor_diagnostics", http_rest_fine_motor_diagnostics);
     rest_register_handler("/rest/button_control", http_rest_button_control);
     rest_register_handler("/rest/mini_12864_config", http_rest_mini_12864_module_config);
     rest_register_handler("/rest/wireless_config", http_rest_wireless_config);
@@ -99,6 +140,7 @@ bool rest_endpoints_init(bool default_wizard) {
     rest_register_handler("/rest/servo_gate_config", http_rest_servo_gate_config);
     rest_register_handler("/display_buffer", http_get_display_buffer);
     rest_register_handler("/display_mirror", http_display_mirror);
+    rest_register_handler("/plot_weight", http_plot_weight);
 
     return true;
 }
@@ -4,13 +4,22 @@
 #include <stdlib.h>
 #include <semphr.h>
 #include <inttypes.h>
+#include <string.h>
+#include <stddef.h>
 
+#include "hardware/uart.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
 #include "configuration.h"
 #include "scale.h"
 #include "eeprom.h"
 #include "app.h"
 #include "scale.h"
 #include "common.h"
+#include "trace.h"
+#include "static_alloc.h"
+#include "custom_scale.h"
 
 extern scale_handle_t generic_scale_drv_handle;
 extern scale_handle_t and_fxi_scale_handle;
@@ -21,6 +30,7 @@ extern scale_handle_t jm_science_scale_handle;
 extern scale_handle_t creedmoor_scale_handle;
 extern scale_handle_t radwag_ps_r2_scale_handle;
 extern scale_handle_t sartorius_scale_handle;
+extern scale_handle_t custom_scale_handle;
 
 scale_config_t scale_config;
 const eeprom_scale_data_t default_scale_persistent_config = {
@@ -28,8 +38,120 @@ const eeprom_scale_data_t default_scale_persistent_config = {
     .scale_driver = SCALE_DRIVER_AND_FXI,
     .scale_baudrate = BAUDRATE_19200,
     .scale_uart_format = UART_FMT_8D_1S_NP,
+
+    .outlier_filter_enable = false,
+    .outlier_threshold = 0.5f,
+    .kalman_filter_enable = false,
+    .kalman_measurement_sd = 0.02f,
+    .kalman_flow_noise = 2.0f,
+
+    // Reads any line with a number in it, as the generic driver
+    .custom_protocol = {
+        .frame_size = 0,
+        .sign_offset = -1,
+        .poll_interval_ms = 100,
+    },
 };
 
+// eeprom_scale_data_t of the released firmware, the leading part of the record as it is now
+typedef struct {
+    uint16_t scale_data_rev;
+    scale_driver_t scale_driver;
+    scale_baudrate_t scale_baudrate;
+    scale_uart_format_t scale_uart_format;
+} eeprom_scale_data_legacy_t;
+
+_Static_assert(sizeof(eeprom_scale_data_legacy_t) == offsetof(eeprom_scale_data_t, outlier_filter_enable),
+               "The legacy scale data shall be the leading part of eeprom_scale_data_t");
+
+// The record of the builds with the measurement filter but before the custom protocol
+typedef struct {
+    eeprom_scale_data_legacy_t released;
+
+    bool outlier_filter_enable;
+    float outlier_threshold;
+    bool kalman_filter_enable;
+    float kalman_measurement_sd;
+    float kalman_flow_noise;
+} eeprom_scale_data_legacy_filter_t;
+
+_Static_assert(sizeof(eeprom_scale_data_legacy_filter_t) == offsetof(eeprom_scale_data_t, custom_protocol),
+               "The legacy filter scale data shall be the leading part of eeprom_scale_data_t");
+
+// Receive ring buffer, written by the UART RX interrupt and read by the scale task
+static volatile char _scale_uart_rx_buffer[SCALE_UART_RX_BUFFER_SIZE];
+static volatile uint16_t _scale_uart_rx_head = 0;
+static volatile uint16_t _scale_uart_rx_tail = 0;
+
+// Receive time of every terminator in the ring buffer, taken by the reader when it reads past the terminator. Frames
+// read in one wake-up keep their own capture times.
+#define SCALE_UART_RX_STAMP_FIFO_SIZE             16    // Must be a power of 2
+typedef struct {
+    uint16_t position;              // Ring buffer index following the terminator
+    uint32_t time_us;
+} _scale_uart_rx_stamp_t;
+static volatile _scale_uart_rx_stamp_t _scale_uart_rx_stamps[SCALE_UART_RX_STAMP_FIFO_SIZE];
+static volatile uint8_t _scale_uart_rx_stamp_head = 0;
+static volatile uint8_t _scale_uart_rx_stamp_tail = 0;
+static uint32_t _scale_uart_rx_frame_time_us = 0;   // Of the last terminator read
+
+// Character completing a frame, the reader is woken once per frame. 0 for either line ending, once per CR LF pair.
+static volatile char _scale_uart_rx_wake_char = 0;
+static char _scale_uart_rx_last_char = 0;
+
+// Measurement stream, single producer (scale task) and multiple consumers
+static scale_measurement_t _scale_measurement_ring[SCALE_MEASUREMENT_RING_SIZE];
+static volatile uint32_t _scale_measurement_latest_seq = 0;
+
+// Measurement rate over this many frames, older frames than the fast report command don't count
+#define SCALE_RATE_WINDOW                   16
+#define SCALE_RATE_TIMEOUT_US               1000000     // No frame for this long, the scale isn't reporting
+
+static struct {
+    bool active;
+    uint32_t start_seq;             // Latest measurement when the fast report was commanded
+    float base_rate_hz;             // Rate before the fast report
+} _scale_fast_report;
+
+// Tasks notified (xTaskNotifyGive) on every new measurement, e.g. render tasks
+#define SCALE_MEASUREMENT_MAX_LISTENERS     4
+static TaskHandle_t _scale_measurement_listeners[SCALE_MEASUREMENT_MAX_LISTENERS];
+
+// Tasks blocked in scale_wait_for_measurement, woken on their own notification index so a publish is never missed
+#define SCALE_MEASUREMENT_MAX_WAITERS       8
+#define SCALE_MEASUREMENT_NOTIFY_INDEX      1
+static TaskHandle_t _scale_measurement_waiters[SCALE_MEASUREMENT_MAX_WAITERS];
+
+// Baud rate and format auto-detection
+#define SCALE_AUTODETECT_WINDOW_MS          1500        // Time given to each candidate
+#define SCALE_AUTODETECT_MIN_FRAMES         3           // Frames the driver shall decode to accept a candidate
+
+static struct {
+    volatile scale_autodetect_state_t state;
+    TaskHandle_t task_handle;
+} _scale_autodetect;
+
+// Measurement filter, run by the scale task only
+#define SCALE_OUTLIER_MAX_HOLD              1           // Consecutive invalid readings replaced by the last weight
+#define SCALE_KALMAN_MAX_DT_US              1000000     // A longer gap between the frames restarts the filter
+#define SCALE_KALMAN_INITIAL_FLOW_VAR       100.0f
+#define SCALE_KALMAN_RESET_NIS              25.0f       // An innovation beyond 5 sigma (a zero, the cup removed) restarts the filter
+
+static struct {
+    float history[2];               // Previous valid readings, newest first
+    uint8_t history_cnt;
+    uint8_t invalid_cnt;
+    float last_weight;
+} _scale_outlier_filter;
+
+static struct {
+    bool initialized;
+    uint32_t last_capture_time_us;
+    float weight;
+    float flow_rate;
+    float p00, p01, p11;            // Covariance of the estimate
+} _scale_kalman_filter;
+
 
 void set_scale_driver(scale_driver_t scale_driver) {
     // Update the persistent settings
@@ -81,6 +203,11 @@ void set_scale_driver(scale_driver_t scale_driver) {
             scale_config.scale_handle = &generic_scale_drv_handle;
             break;
         }
+        case SCALE_DRIVER_CUSTOM:
+        {
+            scale_config.scale_handle = &custom_scale_handle;
+            break;
+        }
         default:
             scale_config.scale_handle = &and_fxi_scale_handle;
             break;
@@ -116,6 +243,15 @@ uint32_t get_scale_baudrate(scale_baudrate_t scale_baudrate) {
         case BAUDRATE_19200:
             baudrate_uint = 19200;
             break;
+        case BAUDRATE_38400:
+            baudrate_uint = 38400;
+            break;
+        case BAUDRATE_57600:
+            baudrate_uint = 57600;
+            break;
+        case BAUDRATE_115200:
+            baudrate_uint = 115200;
+            break;
         default:
             break;
     }
@@ -129,6 +265,97 @@ void set_scale_baudrate(scale_baudrate_t baudrate) {
 }
 
 
+/*
+    The scale task keeps decoding while the settings change, a candidate is accepted once the driver has published
+    SCALE_AUTODETECT_MIN_FRAMES valid readings with it. At a wrong rate or format the frames fail the decoder checks
+    (size, header, terminator, digits) and nothing is published.
+*/
+static bool _scale_autodetect_try(scale_baudrate_t baudrate, scale_uart_format_t format) {
+    set_scale_baudrate(baudrate);
+    set_scale_uart_format(format);
+
+    uint32_t seq_cursor = scale_get_latest_measurement_seq();
+    uint8_t frame_cnt = 0;
+    TickType_t start_tick = xTaskGetTickCount();
+    TickType_t window_ticks = pdMS_TO_TICKS(SCALE_AUTODETECT_WINDOW_MS);
+
+    while (true) {
+        scale_measurement_t measurement;
+
+        // Elapsed ticks stay correct when the tick count wraps
+        TickType_t elapsed_ticks = xTaskGetTickCount() - start_tick;
+        if (elapsed_ticks >= window_ticks) {
+            break;
+        }
+
+        uint32_t remaining_ms = (window_ticks - elapsed_ticks) * portTICK_PERIOD_MS;
+        if (!scale_wait_for_measurement(&seq_cursor, remaining_ms, &measurement)) {
+            break;
+        }
+
+        // More than one, the first frame may still hold bytes received with the previous candidate
+        if (isfinite(measurement.raw_weight) && ++frame_cnt >= SCALE_AUTODETECT_MIN_FRAMES) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static void _scale_autodetect_task(void * p) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        scale_baudrate_t previous_baudrate = scale_config.persistent_config.scale_baudrate;
+        scale_uart_format_t previous_format = scale_config.persistent_config.scale_uart_format;
+        bool found = false;
+
+        for (int baudrate = BAUDRATE_CNT - 1; baudrate >= 0 && !found; baudrate -= 1) {
+            for (int format = 0; format < UART_FMT_CNT && !found; format += 1) {
+                found = _scale_autodetect_try((scale_baudrate_t) baudrate, (scale_uart_format_t) format);
+            }
+        }
+
+        if (!found) {
+            set_scale_baudrate(previous_baudrate);
+            set_scale_uart_format(previous_format);
+        }
+
+        printf("Scale auto-detection %s: %lu baud, format %d\n", found ? "found" : "failed",
+               get_scale_baudrate(scale_config.persistent_config.scale_baudrate),
+               scale_config.persistent_config.scale_uart_format);
+
+        _scale_autodetect.state = found ? SCALE_AUTODETECT_FOUND : SCALE_AUTODETECT_FAILED;
+    }
+}
+
+
+bool scale_autodetect_start(void) {
+    // The readings of the charge mode shall not stop
+    if (_scale_autodetect.state == SCALE_AUTODETECT_RUNNING || _scale_fast_report.active) {
+        return false;
+    }
+
+    // Created on the first use, waits for the next one after that
+    if (_scale_autodetect.task_handle == NULL &&
+        STATIC_TASK_CREATE(_scale_autodetect_task, "Scale Autodetect", configMINIMAL_STACK_SIZE, NULL, 2,
+                           &_scale_autodetect.task_handle) != pdPASS) {
+        return false;
+    }
+
+    _scale_autodetect.state = SCALE_AUTODETECT_RUNNING;
+    xTaskNotifyGive(_scale_autodetect.task_handle);
+
+    return true;
+}
+
+
+scale_autodetect_state_t scale_autodetect_get_state(void) {
+    return _scale_autodetect.state;
+}
+
+
 const char * get_scale_driver_string() {
     const char * scale_driver_string = NULL;
 
@@ -157,6 +384,12 @@ const char * get_scale_driver_string() {
         case SCALE_DRIVER_SARTORIUS:
             scale_driver_string = "Sartorius";
             break;
+        case SCALE_DRIVER_GENERIC_DRV:
+            scale_driver_string = "Generic";
+            break;
+        case SCALE_DRIVER_CUSTOM:
+            scale_driver_string = "Custom";
+            break;
         default:
             break;
     }
@@ -165,11 +398,153 @@ const char * get_scale_driver_string() {
 }
 
 
+static void _scale_uart_rx_isr() {
+    bool notify = false;
+
+    while (uart_is_readable(SCALE_UART)) {
+        char ch = (char) uart_get_hw(SCALE_UART)->dr;
+
+        uint16_t next_head = (_scale_uart_rx_head + 1) & (SCALE_UART_RX_BUFFER_SIZE - 1);
+        if (next_head == _scale_uart_rx_tail) {
+            // Buffer is full, drop the byte
+            notify = true;
+            continue;
+        }
+
+        _scale_uart_rx_buffer[_scale_uart_rx_head] = ch;
+        _scale_uart_rx_head = next_head;
+
+        // Wake the reader as soon as the frame is terminated
+        bool terminated = _scale_uart_rx_wake_char ? ch == _scale_uart_rx_wake_char : 
+                          ch == '\r' || (ch == '\n' && _scale_uart_rx_last_char != '\r');
+        _scale_uart_rx_last_char = ch;
+
+        if (terminated) {
+            // Without a free entry the frame takes the time of the one before (no predict step in the filter)
+            uint8_t next_stamp_head = (_scale_uart_rx_stamp_head + 1) & (SCALE_UART_RX_STAMP_FIFO_SIZE - 1);
+            if (next_stamp_head != _scale_uart_rx_stamp_tail) {
+                _scale_uart_rx_stamps[_scale_uart_rx_stamp_head].position = next_head;
+                _scale_uart_rx_stamps[_scale_uart_rx_stamp_head].time_us = time_us_32();
+                _scale_uart_rx_stamp_head = next_stamp_head;
+            }
+
+            trace_record(TRACE_EVENT_SCALE_FRAME, 0);
+            notify = true;
+        }
+    }
+
+    // Also wake the reader when the buffer is half full, in case the terminator never arrives
+    uint16_t used = (_scale_uart_rx_head - _scale_uart_rx_tail) & (SCALE_UART_RX_BUFFER_SIZE - 1);
+    if (used >= SCALE_UART_RX_BUFFER_SIZE / 2) {
+        notify = true;
+    }
+
+    if (notify && scale_config.scale_read_task_handle) {
+        BaseType_t higher_priority_task_woken = pdFALSE;
+        vTaskNotifyGiveFromISR(scale_config.scale_read_task_handle, &higher_priority_task_woken);
+        portYIELD_FROM_ISR(higher_priority_task_woken);
+    }
+}
+
+
+static void _scale_uart_rx_init() {
+    // Disable the FIFO so the interrupt fires on every byte, the ring buffer takes the FIFO role
+    uart_set_fifo_enabled(SCALE_UART, false);
+
+    uint irq_num = uart_get_index(SCALE_UART) == 0 ? UART0_IRQ : UART1_IRQ;
+    irq_set_exclusive_handler(irq_num, _scale_uart_rx_isr);
+    irq_set_enabled(irq_num, true);
+
+    uart_set_irq_enables(SCALE_UART, true, false);
+}
+
+
+/*
+    Sets the character the RX interrupt treats as the end of a frame, see _scale_uart_rx_wake_char. Waking the 
+    reader on the last byte only saves a wake-up per frame for the CR LF terminated frames.
+*/
+void scale_uart_set_frame_terminator(char terminator) {
+    _scale_uart_rx_wake_char = terminator;
+}
+
+
+bool scale_uart_is_readable() {
+    return _scale_uart_rx_head != _scale_uart_rx_tail;
+}
+
+
+char scale_uart_getc() {
+    // Block until data is available
+    while (!scale_uart_is_readable()) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+
+    char ch = _scale_uart_rx_buffer[_scale_uart_rx_tail];
+    uint16_t next_tail = (_scale_uart_rx_tail + 1) & (SCALE_UART_RX_BUFFER_SIZE - 1);
+    _scale_uart_rx_tail = next_tail;
+
+    // Read past a terminator, the next published frame was captured at its time
+    uint8_t stamp_tail = _scale_uart_rx_stamp_tail;
+    if (stamp_tail != _scale_uart_rx_stamp_head && _scale_uart_rx_stamps[stamp_tail].position == next_tail) {
+        _scale_uart_rx_frame_time_us = _scale_uart_rx_stamps[stamp_tail].time_us;
+        _scale_uart_rx_stamp_tail = (stamp_tail + 1) & (SCALE_UART_RX_STAMP_FIFO_SIZE - 1);
+    }
+
+    return ch;
+}
+
+
+/*
+    Block wait until the RX interrupt has received a frame terminator (or the buffer is half full).
+    Only the scale task (scale_read_task_handle) may call this.
+
+    Returns true if data is available to read.
+*/
+bool scale_uart_wait_for_frame(TickType_t block_ticks) {
+    ulTaskNotifyTake(pdTRUE, block_ticks);
+
+    return scale_uart_is_readable();
+}
+
+
+static bool _scale_config_load(void) {
+    eeprom_scale_data_t * config = &scale_config.persistent_config;
+
+    if (read_config(EEPROM_SCALE_CONFIG_BASE_ADDR, config, sizeof(eeprom_scale_data_t))) {
+        return true;
+    }
+
+    // The record of an older firmware. Keep its settings, the fields added since take the defaults.
+    memcpy(config, &default_scale_persistent_config, sizeof(eeprom_scale_data_t));
+
+    eeprom_scale_data_legacy_filter_t legacy_filter;
+    if (read_config(EEPROM_SCALE_CONFIG_BASE_ADDR, &legacy_filter, sizeof(legacy_filter))) {
+        memcpy(config, &legacy_filter, sizeof(legacy_filter));
+        return save_config(EEPROM_SCALE_CONFIG_BASE_ADDR, config, sizeof(eeprom_scale_data_t));
+    }
+
+    eeprom_scale_data_legacy_t legacy;
+    eeprom_scale_data_legacy_t default_legacy = {
+        .scale_data_rev = 0,
+        .scale_driver = default_scale_persistent_config.scale_driver,
+        .scale_baudrate = default_scale_persistent_config.scale_baudrate,
+        .scale_uart_format = default_scale_persistent_config.scale_uart_format,
+    };
+    bool is_ok = load_config(EEPROM_SCALE_CONFIG_BASE_ADDR, &legacy, &default_legacy, sizeof(legacy), EEPROM_SCALE_DATA_REV);
+
+    config->scale_driver = legacy.scale_driver;
+    config->scale_baudrate = legacy.scale_baudrate;
+    config->scale_uart_format = legacy.scale_uart_format;
+
+    return is_ok && save_config(EEPROM_SCALE_CONFIG_BASE_ADDR, config, sizeof(eeprom_scale_data_t));
+}
+
+
 bool scale_init() {
     bool is_ok;
 
     // Read config from EEPROM
-    is_ok = load_config(EEPROM_SCALE_CONFIG_BASE_ADDR, &scale_config.persistent_config, &default_scale_persistent_config, sizeof(scale_config.persistent_config), EEPROM_SCALE_DATA_REV);
+    is_ok = _scale_config_load();
     if (!is_ok) {
         printf("Unable to read scale configuration\n");
         return is_ok;
@@ -186,10 +561,10 @@ bool scale_init() {
 
     // Create control variables
     // Semaphore to indicate the availability of new measurement. 
-    scale_config.scale_measurement_ready = xSemaphoreCreateBinary();
+    scale_config.scale_measurement_ready = STATIC_SEMAPHORE_CREATE_BINARY();
 
     // Mutex to control the access to the serial port write
-    scale_config.scale_serial_write_access_mutex = xSemaphoreCreateMutex();
+    scale_config.scale_serial_write_access_mutex = STATIC_SEMAPHORE_CREATE_MUTEX();
 
     // Initialize the measurement variable
     scale_config.current_scale_measurement = NAN;
@@ -199,11 +574,19 @@ bool scale_init() {
     set_scale_driver(scale_config.persistent_config.scale_driver);
 
     // Create the Task for the listener loop
-    xTaskCreate(scale_config.scale_handle->read_loop_task, "Scale Task", configMINIMAL_STACK_SIZE, NULL, 9, NULL);
+    STATIC_TASK_CREATE_AFFINITY_SET(scale_config.scale_handle->read_loop_task, "Scale Task", configMINIMAL_STACK_SIZE, NULL, 9, 
+                                    CONTROL_CORE_AFFINITY_MASK, &scale_config.scale_read_task_handle);
+
+    // Start receiving from the scale once the reader task is available to be notified
+    _scale_uart_rx_init();
 
     // Register to eeprom save all
     eeprom_register_handler(scale_config_save);
 
+    // Served together with the other modules by /rest/config
+    rest_register_config_module("scale_config", http_rest_scale_config);
+    rest_register_config_module("custom_scale_config", http_rest_custom_scale_config);
+
     return is_ok;
 }
 
@@ -244,6 +627,378 @@ float scale_get_current_measurement() {
 }
 
 
+static float _median_of_3(float a, float b, float c) {
+    return fmaxf(fminf(a, b), fminf(fmaxf(a, b), c));
+}
+
+
+/*
+    Median of 3 outlier rejection. A reading further than outlier_threshold from both the median of itself and the two
+    previous readings and the line through the previous two is replaced by the median: a spike or a single bad frame
+    never reaches the consumers, the steady flow of the coarse trickler passes unchanged and a step (the cup put on
+    the scale) passes one frame later. A single invalid reading (NAN) is replaced by the last weight, consecutive ones
+    pass so a scale that stopped reporting is still noticed.
+*/
+static float _scale_outlier_filter_run(float weight) {
+    if (!isfinite(weight)) {
+        if (_scale_outlier_filter.invalid_cnt < SCALE_OUTLIER_MAX_HOLD && _scale_outlier_filter.history_cnt > 0) {
+            _scale_outlier_filter.invalid_cnt += 1;
+            return _scale_outlier_filter.last_weight;
+        }
+
+        _scale_outlier_filter.history_cnt = 0;
+        return weight;
+    }
+    _scale_outlier_filter.invalid_cnt = 0;
+
+    float filtered_weight = weight;
+    if (_scale_outlier_filter.history_cnt == 2) {
+        float threshold = scale_config.persistent_config.outlier_threshold;
+        float median = _median_of_3(weight, _scale_outlier_filter.history[0], _scale_outlier_filter.history[1]);
+        float extrapolated = 2.0f * _scale_outlier_filter.history[0] - _scale_outlier_filter.history[1];
+        if (fabsf(weight - median) > threshold && fabsf(weight - extrapolated) > threshold) {
+            filtered_weight = median;
+        }
+    }
+    else {
+        _scale_outlier_filter.history_cnt += 1;
+    }
+
+    // The raw readings are kept so a real step reaches the median
+    _scale_outlier_filter.history[1] = _scale_outlier_filter.history[0];
+    _scale_outlier_filter.history[0] = weight;
+    _scale_outlier_filter.last_weight = filtered_weight;
+
+    return filtered_weight;
+}
+
+
+static void _scale_kalman_filter_reset(float weight, uint32_t capture_time_us) {
+    float measurement_var = scale_config.persistent_config.kalman_measurement_sd * 
+                            scale_config.persistent_config.kalman_measurement_sd;
+
+    _scale_kalman_filter.initialized = true;
+    _scale_kalman_filter.last_capture_time_us = capture_time_us;
+    _scale_kalman_filter.weight = weight;
+    _scale_kalman_filter.flow_rate = 0.0f;
+    _scale_kalman_filter.p00 = measurement_var;
+    _scale_kalman_filter.p01 = 0.0f;
+    _scale_kalman_filter.p11 = SCALE_KALMAN_INITIAL_FLOW_VAR;
+}
+
+
+/*
+    Constant flow rate Kalman filter, state [weight, flow rate]. The flow rate is modelled as a random walk driven by
+    kalman_flow_noise, the time step is taken from the capture times so a missed frame doesn't bias the rate. The
+    filter restarts from the reading when it can't follow it: after an invalid reading, a gap in the stream or a jump
+    (zeroing, the cup removed).
+*/
+static void _scale_kalman_filter_run(float weight, uint32_t capture_time_us, float * filtered_weight, float * flow_rate) {
+    if (!isfinite(weight)) {
+        _scale_kalman_filter.initialized = false;
+        *filtered_weight = weight;
+        *flow_rate = NAN;
+        return;
+    }
+
+    int32_t dt_us = (int32_t) (capture_time_us - _scale_kalman_filter.last_capture_time_us);
+    // dt of 0 (two frames on one capture time) only runs the update step
+    if (!_scale_kalman_filter.initialized || dt_us < 0 || dt_us > SCALE_KALMAN_MAX_DT_US) {
+        _scale_kalman_filter_reset(weight, capture_time_us);
+        *filtered_weight = weight;
+        *flow_rate = NAN;
+        return;
+    }
+
+    float dt = dt_us / 1e6f;
+    float q = scale_config.persistent_config.kalman_flow_noise * scale_config.persistent_config.kalman_flow_noise;
+    float r = scale_config.persistent_config.kalman_measurement_sd * scale_config.persistent_config.kalman_measurement_sd;
+
+    // Predict
+    float predicted_weight = _scale_kalman_filter.weight + _scale_kalman_filter.flow_rate * dt;
+    float p00 = _scale_kalman_filter.p00 + dt * (2.0f * _scale_kalman_filter.p01 + dt * _scale_kalman_filter.p11) + 
+                q * dt * dt * dt / 3.0f;
+    float p01 = _scale_kalman_filter.p01 + dt * _scale_kalman_filter.p11 + q * dt * dt / 2.0f;
+    float p11 = _scale_kalman_filter.p11 + q * dt;
+
+    // Update
+    float innovation = weight - predicted_weight;
+    float innovation_var = p00 + r;
+    if (innovation * innovation > SCALE_KALMAN_RESET_NIS * innovation_var) {
+        _scale_kalman_filter_reset(weight, capture_time_us);
+        *filtered_weight = weight;
+        *flow_rate = NAN;
+        return;
+    }
+
+    float k0 = p00 / innovation_var;
+    float k1 = p01 / innovation_var;
+
+    _scale_kalman_filter.weight = predicted_weight + k0 * innovation;
+    _scale_kalman_filter.flow_rate += k1 * innovation;
+    _scale_kalman_filter.p00 = (1.0f - k0) * p00;
+    _scale_kalman_filter.p01 = (1.0f - k0) * p01;
+    _scale_kalman_filter.p11 = p11 - k1 * p01;
+    _scale_kalman_filter.last_capture_time_us = capture_time_us;
+
+    *filtered_weight = _scale_kalman_filter.weight;
+    *flow_rate = _scale_kalman_filter.flow_rate;
+}
+
+
+void scale_publish_measurement(float weight, scale_stability_t stability) {
+    uint32_t seq = _scale_measurement_latest_seq + 1;
+    if (seq == 0) {
+        seq = 1;  // 0 is reserved for no measurement
+    }
+
+    // Filter stage between the driver and the consumers
+    uint32_t capture_time_us = _scale_uart_rx_frame_time_us;
+    float raw_weight = weight;
+    if (scale_config.persistent_config.outlier_filter_enable) {
+        weight = _scale_outlier_filter_run(raw_weight);
+    }
+    else {
+        _scale_outlier_filter.history_cnt = 0;
+    }
+
+    float filtered_weight = weight;
+    float flow_rate = NAN;
+    if (scale_config.persistent_config.kalman_filter_enable) {
+        _scale_kalman_filter_run(weight, capture_time_us, &filtered_weight, &flow_rate);
+    }
+    else {
+        _scale_kalman_filter.initialized = false;
+    }
+
+    // Invalidate the slot first so a consumer copying it concurrently can detect the overwrite
+    scale_measurement_t * slot = &_scale_measurement_ring[seq & (SCALE_MEASUREMENT_RING_SIZE - 1)];
+    slot->seq = 0;
+    __dmb();
+    slot->weight = weight;
+    slot->capture_time_us = capture_time_us;
+    slot->stability = stability;
+    slot->raw_weight = raw_weight;
+    slot->filtered_weight = filtered_weight;
+    slot->flow_rate = flow_rate;
+    __dmb();
+    slot->seq = seq;
+    __dmb();
+    _scale_measurement_latest_seq = seq;
+
+    // Legacy single value interface
+    scale_config.current_scale_measurement = weight;
+
+    if (scale_config.scale_measurement_ready) {
+        xSemaphoreGive(scale_config.scale_measurement_ready);
+    }
+    trace_record(TRACE_EVENT_SCALE_PUBLISH, seq);
+
+    // Wake every waiting consumer, the notification stays pending for a consumer that isn't blocked yet
+    for (uint8_t idx = 0; idx < SCALE_MEASUREMENT_MAX_WAITERS; idx += 1) {
+        TaskHandle_t waiter = _scale_measurement_waiters[idx];
+        if (waiter) {
+            xTaskNotifyGiveIndexed(waiter, SCALE_MEASUREMENT_NOTIFY_INDEX);
+        }
+    }
+
+    for (uint8_t idx = 0; idx < SCALE_MEASUREMENT_MAX_LISTENERS; idx += 1) {
+        if (_scale_measurement_listeners[idx]) {
+            xTaskNotifyGive(_scale_measurement_listeners[idx]);
+        }
+    }
+}
+
+
+/*
+    Registers a task to be notified (xTaskNotifyGive) whenever a measurement is published. The task shall not use 
+    the default notification for anything else.
+*/
+bool scale_register_measurement_listener(TaskHandle_t task_handle) {
+    bool is_ok = false;
+
+    taskENTER_CRITICAL();
+    for (uint8_t idx = 0; idx < SCALE_MEASUREMENT_MAX_LISTENERS; idx += 1) {
+        if (_scale_measurement_listeners[idx] == task_handle) {
+            is_ok = true;
+            break;
+        }
+        if (_scale_measurement_listeners[idx] == NULL) {
+            _scale_measurement_listeners[idx] = task_handle;
+            is_ok = true;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return is_ok;
+}
+
+
+static bool _scale_set_measurement_waiter(TaskHandle_t task_handle, bool waiting) {
+    bool is_ok = false;
+
+    taskENTER_CRITICAL();
+    for (uint8_t idx = 0; idx < SCALE_MEASUREMENT_MAX_WAITERS; idx += 1) {
+        if (waiting && _scale_measurement_waiters[idx] == NULL) {
+            _scale_measurement_waiters[idx] = task_handle;
+            is_ok = true;
+            break;
+        }
+        if (!waiting && _scale_measurement_waiters[idx] == task_handle) {
+            _scale_measurement_waiters[idx] = NULL;
+            is_ok = true;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return is_ok;
+}
+
+
+static bool _scale_copy_measurement(uint32_t seq, scale_measurement_t * measurement) {
+    scale_measurement_t * slot = &_scale_measurement_ring[seq & (SCALE_MEASUREMENT_RING_SIZE - 1)];
+
+    if (slot->seq != seq) {
+        return false;
+    }
+    __dmb();
+    *measurement = *slot;
+    __dmb();
+
+    // The producer may have overwritten the slot during the copy
+    return slot->seq == seq;
+}
+
+
+float scale_get_measurement_rate_hz() {
+    scale_measurement_t newest;
+    scale_measurement_t oldest;
+
+    uint32_t latest_seq = _scale_measurement_latest_seq;
+    if (latest_seq == 0 || !_scale_copy_measurement(latest_seq, &newest) || 
+        time_us_32() - newest.capture_time_us > SCALE_RATE_TIMEOUT_US) {
+        return 0.0f;
+    }
+
+    // Only the frames sent after the fast report command, the first one may still be in the old mode
+    uint32_t first_seq = latest_seq > SCALE_RATE_WINDOW ? latest_seq - SCALE_RATE_WINDOW : 1;
+    if (_scale_fast_report.active && first_seq <= _scale_fast_report.start_seq) {
+        first_seq = _scale_fast_report.start_seq + 1;
+    }
+
+    if (first_seq >= latest_seq || !_scale_copy_measurement(first_seq, &oldest)) {
+        return 0.0f;
+    }
+
+    uint32_t elapsed_us = newest.capture_time_us - oldest.capture_time_us;
+    return elapsed_us ? (latest_seq - first_seq) * 1e6f / elapsed_us : 0.0f;
+}
+
+
+/*
+    Puts the scale in its fastest output mode (e.g. stream every reading) and back to the mode it was set to. The 
+    achieved rate is measured from the frames received after the command, see scale_get_measurement_rate_hz.
+*/
+bool scale_set_fast_report(bool enable) {
+    if (scale_config.scale_handle == NULL || scale_config.scale_handle->set_fast_report == NULL) {
+        return false;
+    }
+
+    if (enable) {
+        _scale_fast_report.base_rate_hz = scale_get_measurement_rate_hz();
+        _scale_fast_report.start_seq = _scale_measurement_latest_seq;
+        _scale_fast_report.active = true;
+        scale_config.scale_handle->set_fast_report(true);
+    }
+    else if (_scale_fast_report.active) {
+        printf("Scale fast report: %0.1f Hz (was %0.1f Hz)\n", 
+               scale_get_measurement_rate_hz(), _scale_fast_report.base_rate_hz);
+        scale_config.scale_handle->set_fast_report(false);
+        _scale_fast_report.active = false;
+    }
+
+    return true;
+}
+
+
+uint32_t scale_get_latest_measurement_seq() {
+    return _scale_measurement_latest_seq;
+}
+
+
+bool scale_get_latest_measurement(scale_measurement_t * measurement) {
+    uint32_t seq;
+
+    do {
+        seq = _scale_measurement_latest_seq;
+        if (seq == 0) {
+            return false;
+        }
+    } while (!_scale_copy_measurement(seq, measurement));
+
+    return true;
+}
+
+
+/*
+    Receive the measurement after *seq_cursor and advance the cursor. Measurements are returned in order. 
+    If the consumer falls more than SCALE_MEASUREMENT_RING_SIZE behind, it skips to the oldest one still
+    available (compare measurement->seq with the previous cursor to detect dropped samples).
+
+    Initialize the cursor with scale_get_latest_measurement_seq() to receive new measurements only.
+    block_time_ms set to 0 to wait indefinitely.
+*/
+bool scale_wait_for_measurement(uint32_t * seq_cursor, uint32_t block_time_ms, scale_measurement_t * measurement) {
+    TickType_t delay_ticks = block_time_ms == 0 ? portMAX_DELAY : pdMS_TO_TICKS(block_time_ms);
+    TimeOut_t timeout;
+
+    vTaskSetTimeOutState(&timeout);
+
+    while (true) {
+        uint32_t latest_seq = _scale_measurement_latest_seq;
+
+        if (latest_seq != *seq_cursor && latest_seq != 0) {
+            uint32_t next_seq = *seq_cursor + 1;
+
+            // Fell behind, skip to the oldest available measurement
+            if (latest_seq - next_seq >= SCALE_MEASUREMENT_RING_SIZE) {
+                next_seq = latest_seq - SCALE_MEASUREMENT_RING_SIZE + 1;
+            }
+
+            if (_scale_copy_measurement(next_seq, measurement)) {
+                *seq_cursor = next_seq;
+                trace_record(TRACE_EVENT_SCALE_TAKE, next_seq);
+                return true;
+            }
+
+            // Overwritten while copying, retry
+            continue;
+        }
+
+        if (xTaskCheckForTimeOut(&timeout, &delay_ticks) == pdTRUE) {
+            return false;
+        }
+
+        // Register before the second check: a measurement published after it leaves the notification pending
+        TaskHandle_t self = xTaskGetCurrentTaskHandle();
+        if (!_scale_set_measurement_waiter(self, true)) {
+            // More consumers than waiter slots, poll
+            vTaskDelay(1);
+            continue;
+        }
+
+        if (_scale_measurement_latest_seq == latest_seq) {
+            ulTaskNotifyTakeIndexed(SCALE_MEASUREMENT_NOTIFY_INDEX, pdTRUE, delay_ticks);
+        }
+
+        _scale_set_measurement_waiter(self, false);
+        xTaskNotifyStateClearIndexed(self, SCALE_MEASUREMENT_NOTIFY_INDEX);
+    }
+}
+
+
 /*
     Block wait for the next available measurement.
 
@@ -262,6 +1017,7 @@ bool scale_block_wait_for_next_measurement(uint32_t block_time_ms, float * curre
     // You can only call this once the scheduler starts
     if (xSemaphoreTake(scale_config.scale_measurement_ready, delay_ticks) == pdTRUE){
         *current_measurement = scale_get_current_measurement();
+        trace_record(TRACE_EVENT_SCALE_TAKE, _scale_measurement_latest_seq);
 
         return true;
     }
@@ -271,14 +1027,287 @@ bool scale_block_wait_for_next_measurement(uint32_t block_time_ms, float * curre
 }
 
 
+// 10^n lookup for the decimal parser, exact in single precision
+static const float _pow10[] = {
+    1.0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f,
+};
+
+
+/*
+    Parse a decimal number (e.g. "  -0012.345") in a single pass without allocation or strtof.
+
+    Leading characters that can't start a number (spaces, prefixes like "ST,") are skipped, and spaces
+    between the sign and the digits are accepted. Parsing stops at the first character after the number.
+    Returns NaN if no digit is found.
+*/
+float scale_parse_decimal(const char * str, size_t len) {
+    size_t idx = 0;
+    bool is_negative = false;
+
+    // Look for the start of a number
+    while (idx < len && !(str[idx] >= '0' && str[idx] <= '9') && str[idx] != '-' && str[idx] != '+' && str[idx] != '.') {
+        idx += 1;
+    }
+
+    // Sign, can be padded with spaces before the digits
+    if (idx < len && (str[idx] == '-' || str[idx] == '+')) {
+        is_negative = str[idx] == '-';
+        idx += 1;
+
+        while (idx < len && str[idx] == ' ') {
+            idx += 1;
+        }
+    }
+
+    uint32_t mantissa = 0;
+    uint8_t significant_digits = 0;
+    uint8_t decimal_places = 0;
+    bool has_digit = false;
+    bool has_point = false;
+
+    for (; idx < len; idx += 1) {
+        char ch = str[idx];
+
+        if (ch >= '0' && ch <= '9') {
+            has_digit = true;
+
+            // Leading zeros don't consume the precision
+            if (mantissa == 0 && ch == '0') {
+                if (has_point && decimal_places < 9) {
+                    decimal_places += 1;
+                }
+                continue;
+            }
+
+            if (significant_digits < 9 && decimal_places < 9) {
+                mantissa = mantissa * 10 + (ch - '0');
+                significant_digits += 1;
+                if (has_point) {
+                    decimal_places += 1;
+                }
+            }
+            else if (!has_point) {
+                // Integer part out of range
+                return NAN;
+            }
+            // Otherwise drop the excess fraction digits
+        }
+        else if (ch == '.' && !has_point) {
+            has_point = true;
+        }
+        else {
+            break;
+        }
+    }
+
+    if (!has_digit) {
+        return NAN;
+    }
+
+    // Up to 7 significant digits (mantissa below 2^24) both operands are exact and the single division rounds as
+    // strtof does. Longer mantissas are rounded on the conversion as well, the result is then within 1 ulp of strtof.
+    float weight = (float) mantissa / _pow10[decimal_places];
+
+    return is_negative ? -weight : weight;
+}
+
+
+/*
+    Feed one received byte to the frame decoder.
+
+    Returns true when a frame is complete, with the decoded weight (NaN if the weight field is invalid) and 
+    decoder->stability updated.
+    Variable length lines without a valid number are dropped.
+*/
+bool scale_frame_decoder_push(const scale_frame_descriptor_t * descriptor, scale_frame_decoder_t * decoder, char ch, float * weight) {
+    bool is_ready = false;
+
+    // A sync character always starts a new frame
+    if (descriptor->sync_char && ch == descriptor->sync_char) {
+        decoder->length = 0;
+    }
+
+    // Variable length line
+    if (descriptor->frame_size == 0) {
+        if (ch == '\r' || ch == '\n') {
+            if (decoder->length > 0) {
+                *weight = scale_parse_decimal(decoder->bytes, decoder->length);
+                is_ready = !isnan(*weight);
+            }
+            decoder->length = 0;
+        }
+        else if (decoder->length < sizeof(decoder->bytes)) {
+            decoder->bytes[decoder->length++] = ch;
+        }
+        else {
+            // Overflow, discard the line
+            decoder->length = 0;
+        }
+
+        return is_ready;
+    }
+
+    // Fixed size frame
+    decoder->bytes[decoder->length++] = ch;
+
+    if (decoder->length == descriptor->frame_size) {
+        if (descriptor->header == NULL || 
+            memcmp(decoder->bytes, descriptor->header, descriptor->header_length) == 0) {
+            *weight = scale_parse_decimal(&decoder->bytes[descriptor->data_offset], descriptor->data_length);
+
+            if (descriptor->sign_offset >= 0 && decoder->bytes[descriptor->sign_offset] == '-') {
+                *weight = -*weight;
+            }
+
+            if (descriptor->stable_char) {
+                decoder->stability = decoder->bytes[descriptor->stable_offset] == descriptor->stable_char ? 
+                                     SCALE_STABILITY_STABLE : SCALE_STABILITY_UNSTABLE;
+            }
+            else {
+                decoder->stability = SCALE_STABILITY_UNKNOWN;
+            }
+
+            is_ready = true;
+        }
+
+        decoder->length = 0;
+    }
+
+    // Resynchronize on the terminator
+    if (descriptor->terminator && ch == descriptor->terminator) {
+        decoder->length = 0;
+    }
+
+    // Never overflow on malformed descriptors
+    if (decoder->length >= sizeof(decoder->bytes)) {
+        decoder->length = 0;
+    }
+
+    return is_ready;
+}
+
+
+/*
+    Listener loop shared by the drivers that only receive frames. Never returns.
+*/
+void scale_frame_listener_loop(const scale_frame_descriptor_t * descriptor) {
+    scale_frame_decoder_t decoder = {0};
+
+    // A fixed frame is complete on its terminator, a line on either line ending
+    scale_uart_set_frame_terminator(descriptor->frame_size ? descriptor->terminator : 0);
+
+    while (true) {
+        // Read all data
+        while (scale_uart_is_readable()) {
+            float weight;
+
+            if (scale_frame_decoder_push(descriptor, &decoder, scale_uart_getc(), &weight)) {
+                scale_publish_measurement(weight, decoder.stability);
+            }
+        }
+
+        // Wait for the RX interrupt to receive the next frame
+        scale_uart_wait_for_frame(portMAX_DELAY);
+    }
+}
+
+
+bool http_rest_scale_telemetry(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // t0 (uint32_t): Sequence number of the last measurement the collector has, 0 for everything available
+    //
+    // Response (application/octet-stream): scale_telemetry_header_t followed by record_count
+    // scale_telemetry_record_t of the measurements after t0, oldest first. A collector more than
+    // SCALE_MEASUREMENT_RING_SIZE measurements behind gets the oldest ones available and sees the gap in seq.
+    static const char telemetry_http_header[] = "HTTP/1.1 200 OK\r\n"
+                                                "Content-Type: application/octet-stream\r\n"
+                                                "Cache-Control: no-store\r\n\r\n";
+    const size_t telemetry_buffer_size = sizeof(telemetry_http_header) + sizeof(scale_telemetry_header_t) + 
+                                         SCALE_MEASUREMENT_RING_SIZE * sizeof(scale_telemetry_record_t);
+    uint8_t * telemetry_buffer = (uint8_t *) rest_response_alloc(telemetry_buffer_size);
+    if (telemetry_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    uint32_t seq_cursor = 0;
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "t0") == 0) {
+            seq_cursor = strtoul(values[idx], NULL, 10);
+        }
+    }
+
+    uint32_t latest_seq = _scale_measurement_latest_seq;
+    uint32_t first_seq = seq_cursor + 1;
+    if (latest_seq - seq_cursor > SCALE_MEASUREMENT_RING_SIZE) {
+        first_seq = latest_seq - SCALE_MEASUREMENT_RING_SIZE + 1;
+    }
+
+    size_t header_len = sizeof(telemetry_http_header) - 1;
+    memcpy(telemetry_buffer, telemetry_http_header, header_len);
+
+    scale_telemetry_record_t * records = (scale_telemetry_record_t *) 
+        (telemetry_buffer + header_len + sizeof(scale_telemetry_header_t));
+    uint16_t record_count = 0;
+
+    // Nothing new (or a cursor ahead of the scale, e.g. after a reboot) returns no record
+    if (latest_seq != 0 && latest_seq - seq_cursor <= UINT32_MAX / 2) {
+        for (uint32_t seq = first_seq; seq != latest_seq + 1; seq += 1) {
+            scale_measurement_t measurement;
+
+            // Overwritten since latest_seq was read, the newer ones follow in the next request
+            if (!_scale_copy_measurement(seq, &measurement)) {
+                continue;
+            }
+
+            records[record_count].seq = measurement.seq;
+            records[record_count].capture_time_us = measurement.capture_time_us;
+            records[record_count].weight = measurement.weight;
+            records[record_count].stability = (uint8_t) measurement.stability;
+            record_count += 1;
+        }
+    }
+
+    scale_telemetry_header_t header = {
+        .version = SCALE_TELEMETRY_VERSION,
+        .record_size = sizeof(scale_telemetry_record_t),
+        .record_count = record_count,
+        .latest_seq = latest_seq,
+        .now_us = time_us_32(),
+    };
+    memcpy(telemetry_buffer + header_len, &header, sizeof(header));
+
+    size_t data_length = header_len + sizeof(header) + record_count * sizeof(scale_telemetry_record_t);
+    file->data = (const char *) telemetry_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
+
+
 bool http_rest_scale_config(struct fs_file *file, int num_params, char *params[], char *values[]) {
     // Mappings:
     // s0 (int): driver index
     // s1 (int): baud rate index
     // s2 (int): uart format index
+    // s3 (float): Measurement rate (Hz), from the frames since the fast report if active
+    // s4 (float): Measurement rate before the fast report (Hz)
+    // s5 (bool): Fast report active (charge mode)
+    // s6 (bool): Outlier filter enable
+    // s7 (float): Outlier threshold
+    // s8 (bool): Kalman filter enable
+    // s9 (float): Kalman measurement standard deviation
+    // s10 (float): Kalman flow noise
+    // s11 (bool): Start the baud rate and format auto-detection, see scale_autodetect_start
+    // s12 (int): Auto-detection state, scale_autodetect_state_t
     // ee (bool): save to eeprom
 
-    static char scale_config_to_json_buffer[256];
+    const size_t scale_config_to_json_buffer_size = 384;
+    char * scale_config_to_json_buffer = (char *) rest_response_alloc(scale_config_to_json_buffer_size);
+    if (scale_config_to_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
     bool save_to_eeprom = false;
 
     // Set value
@@ -295,6 +1324,24 @@ bool http_rest_scale_config(struct fs_file *file, int num_params, char *params[]
             scale_uart_format_t uart_format_idx = (scale_uart_format_t) atoi(values[idx]);
             set_scale_uart_format(uart_format_idx);
         }
+        else if (strcmp(params[idx], "s6") == 0) {
+            scale_config.persistent_config.outlier_filter_enable = string_to_boolean(values[idx]);
+        }
+        else if (strcmp(params[idx], "s7") == 0) {
+            scale_config.persistent_config.outlier_threshold = strtof(values[idx], NULL);
+        }
+        else if (strcmp(params[idx], "s8") == 0) {
+            scale_config.persistent_config.kalman_filter_enable = string_to_boolean(values[idx]);
+        }
+        else if (strcmp(params[idx], "s9") == 0) {
+            scale_config.persistent_config.kalman_measurement_sd = strtof(values[idx], NULL);
+        }
+        else if (strcmp(params[idx], "s10") == 0) {
+            scale_config.persistent_config.kalman_flow_noise = strtof(values[idx], NULL);
+        }
+        else if (strcmp(params[idx], "s11") == 0 && string_to_boolean(values[idx])) {
+            scale_autodetect_start();
+        }
         else if (strcmp(params[idx], "ee") == 0) {
             save_to_eeprom = string_to_boolean(values[idx]);
         }
@@ -306,13 +1353,23 @@ bool http_rest_scale_config(struct fs_file *file, int num_params, char *params[]
     }
 
     snprintf(scale_config_to_json_buffer, 
-             sizeof(scale_config_to_json_buffer),
+             scale_config_to_json_buffer_size,
              "%s"
-             "{\"s0\":%d,\"s1\":%d,\"s2\":%d}", 
+             "{\"s0\":%d,\"s1\":%d,\"s2\":%d,\"s3\":%0.1f,\"s4\":%0.1f,\"s5\":%s,"
+             "\"s6\":%s,\"s7\":%0.3f,\"s8\":%s,\"s9\":%0.3f,\"s10\":%0.3f,\"s12\":%d}", 
              http_json_header,
              scale_config.persistent_config.scale_driver, 
              scale_config.persistent_config.scale_baudrate,
-             scale_config.persistent_config.scale_uart_format);
+             scale_config.persistent_config.scale_uart_format,
+             scale_get_measurement_rate_hz(),
+             _scale_fast_report.base_rate_hz,
+             boolean_to_string(_scale_fast_report.active),
+             boolean_to_string(scale_config.persistent_config.outlier_filter_enable),
+             scale_config.persistent_config.outlier_threshold,
+             boolean_to_string(scale_config.persistent_config.kalman_filter_enable),
+             scale_config.persistent_config.kalman_measurement_sd,
+             scale_config.persistent_config.kalman_flow_noise,
+             (int) scale_autodetect_get_state());
     
     size_t data_length = strlen(scale_config_to_json_buffer);
     file->data = scale_config_to_json_buffer;
@@ -345,11 +1402,15 @@ bool http_rest_scale_action(struct fs_file *file, int num_params, char *params[]
         }
     }
 
-    static char json_buffer[64];
+    const size_t json_buffer_size = 64;
+    char * json_buffer = (char *) rest_response_alloc(json_buffer_size);
+    if (json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
 
     // Response
     snprintf(json_buffer, 
-             sizeof(json_buffer),
+             json_buffer_size,
              "%s"
              "{\"a0\":%d}",
              http_json_header,
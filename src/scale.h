@@ -7,8 +7,20 @@
 #include "app.h"
 #include "http_rest.h"
 #include <semphr.h>
+#include <task.h>
 
-#define EEPROM_SCALE_DATA_REV                     3              // 16 byte 
+#define EEPROM_SCALE_DATA_REV                     3
+
+// Size of the interrupt driven receive ring buffer, must be a power of 2
+#define SCALE_UART_RX_BUFFER_SIZE                 256
+
+// Number of measurements kept for the consumers and the telemetry endpoint, must be a power of 2
+#define SCALE_MEASUREMENT_RING_SIZE               128
+
+#define SCALE_TELEMETRY_VERSION                   1
+
+// Longest frame (or line) the frame decoder accepts
+#define SCALE_FRAME_MAX_SIZE                      32
 
 
 // Abstracted base class
@@ -16,6 +28,9 @@ typedef struct {
     // Basic functions
     void (*read_loop_task)(void *self);
     void (*force_zero)(void);
+
+    // Optional, NULL if the scale can't be told to report faster
+    void (*set_fast_report)(bool enable);
 } scale_handle_t;
 
 
@@ -23,15 +38,29 @@ typedef enum {
     BAUDRATE_4800 = 0,
     BAUDRATE_9600 = 1,
     BAUDRATE_19200 = 2,
+    BAUDRATE_38400 = 3,
+    BAUDRATE_57600 = 4,
+    BAUDRATE_115200 = 5,
+    BAUDRATE_CNT,
 } scale_baudrate_t;
 
 
 typedef enum {
     UART_FMT_8D_1S_NP = 0,
     UART_FMT_7D_1S_NP = 1,
+    UART_FMT_CNT,
 } scale_uart_format_t;
 
 
+// Baud rate and format auto-detection, see scale_autodetect_start
+typedef enum {
+    SCALE_AUTODETECT_IDLE = 0,
+    SCALE_AUTODETECT_RUNNING = 1,
+    SCALE_AUTODETECT_FOUND = 2,
+    SCALE_AUTODETECT_FAILED = 3,        // No candidate decoded, the previous settings are restored
+} scale_autodetect_state_t;
+
+
 typedef enum {
     SCALE_DRIVER_AND_FXI = 0,
     SCALE_DRIVER_STEINBERG_SBS = 1,
@@ -42,6 +71,7 @@ typedef enum {
     SCALE_DRIVER_RADWAG_PS_R2 = 6,
     SCALE_DRIVER_SARTORIUS = 7,
     SCALE_DRIVER_GENERIC_DRV = 8,
+    SCALE_DRIVER_CUSTOM = 9,
 } scale_driver_t;
 
 
@@ -51,20 +81,92 @@ typedef enum {
 } scale_action_t;
 
 
+// Longest header and commands of the custom protocol, as entered (backslash escapes \r \n \t \\ \xHH included)
+#define SCALE_CUSTOM_STRING_SIZE                  16
+
+// Frame format of the custom driver (SCALE_DRIVER_CUSTOM), the fields of scale_frame_descriptor_t. See custom_scale.c
+typedef struct {
+    uint8_t frame_size;
+    char sync_char;
+    char terminator;
+    char header[SCALE_CUSTOM_STRING_SIZE];
+    int8_t sign_offset;
+    uint8_t stable_offset;
+    char stable_char;
+    uint8_t data_offset;
+    uint8_t data_length;
+
+    char poll_command[SCALE_CUSTOM_STRING_SIZE];    // Empty if the scale sends on its own
+    uint16_t poll_interval_ms;                      // Next request after the response, or after this long without
+    char zero_command[SCALE_CUSTOM_STRING_SIZE];    // Empty if the scale can't be zeroed remotely
+} scale_custom_protocol_t;
+
+
 typedef struct {
     uint16_t scale_data_rev;
     scale_driver_t scale_driver;
     scale_baudrate_t scale_baudrate;
     scale_uart_format_t scale_uart_format;
+
+    // Measurement filter, see scale_publish_measurement
+    bool outlier_filter_enable;
+    float outlier_threshold;                // Largest deviation from the median of 3 that passes unchanged
+    bool kalman_filter_enable;
+    float kalman_measurement_sd;            // Noise of a single reading
+    float kalman_flow_noise;                // How fast the flow rate may change (unit / s^2)
+
+    scale_custom_protocol_t custom_protocol;
 } eeprom_scale_data_t;
 
 
+// Describes the frame format sent by a scale. Each driver declares one as a const table.
+typedef struct {
+    uint8_t frame_size;         // Fixed frame length in bytes, 0 for variable length lines terminated by \r or \n
+    char sync_char;             // Character that starts a frame and resets the decoder, 0 if none
+    char terminator;            // Character that resets the decoder, 0 if none
+    const char * header;        // Expected header at the start of the frame, NULL to accept any
+    uint8_t header_length;
+    int8_t sign_offset;         // Offset of a separate sign character, -1 if the sign is part of the data
+    uint8_t stable_offset;      // Offset of the stability flag
+    char stable_char;           // Value of the stability flag when the reading is stable, 0 if not reported
+    uint8_t data_offset;        // Offset of the weight field (fixed frames only)
+    uint8_t data_length;        // Length of the weight field (fixed frames only)
+} scale_frame_descriptor_t;
+
+
+typedef enum {
+    SCALE_STABILITY_UNKNOWN = 0,
+    SCALE_STABILITY_UNSTABLE = 1,
+    SCALE_STABILITY_STABLE = 2,
+} scale_stability_t;
+
+
+typedef struct {
+    char bytes[SCALE_FRAME_MAX_SIZE];
+    uint8_t length;
+    scale_stability_t stability;    // Stability flag of the last decoded frame
+} scale_frame_decoder_t;
+
+
+// A single measurement published by the scale driver
+typedef struct {
+    float weight;               // Reading after the outlier filter
+    uint32_t capture_time_us;   // Time the frame terminator was received
+    uint32_t seq;               // Monotonic sequence number, 0 = no measurement
+    scale_stability_t stability;    // Reported by the scale, if supported
+    float raw_weight;           // Reading as decoded by the driver
+    float filtered_weight;      // Kalman estimate of the weight, weight if the filter is disabled
+    float flow_rate;            // Kalman estimate of the flow rate (unit / s), NAN if the filter is disabled
+} scale_measurement_t;
+
+
 typedef struct {
     eeprom_scale_data_t persistent_config;
     scale_handle_t * scale_handle;
     SemaphoreHandle_t scale_measurement_ready;
     SemaphoreHandle_t scale_serial_write_access_mutex;
     float current_scale_measurement;
+    TaskHandle_t scale_read_task_handle;
 } scale_config_t;
 
 
@@ -78,6 +180,31 @@ bool scale_init();
 float scale_get_current_measurement();
 bool scale_block_wait_for_next_measurement(uint32_t block_time_ms, float * current_measurement);
 
+// Measurement stream, every consumer keeps its own sequence cursor
+uint32_t scale_get_latest_measurement_seq();
+bool scale_get_latest_measurement(scale_measurement_t * measurement);
+bool scale_wait_for_measurement(uint32_t * seq_cursor, uint32_t block_time_ms, scale_measurement_t * measurement);
+
+// Called by the scale drivers when a new frame is decoded
+void scale_publish_measurement(float weight, scale_stability_t stability);
+bool scale_register_measurement_listener(TaskHandle_t task_handle);
+
+// Measurement rate from the capture times of the recent frames, 0 if the scale isn't reporting
+float scale_get_measurement_rate_hz();
+
+// Fastest output of the scale for the charge mode, see set_fast_report. Returns false if the driver can't.
+bool scale_set_fast_report(bool enable);
+
+// Tries the baud rates (fastest first) and formats until the selected driver decodes the frames of the scale. Runs in
+// the background, returns false if it can't start (already running, or the charge mode is active).
+bool scale_autodetect_start(void);
+scale_autodetect_state_t scale_autodetect_get_state(void);
+
+// Frame decoding
+float scale_parse_decimal(const char * str, size_t len);
+bool scale_frame_decoder_push(const scale_frame_descriptor_t * descriptor, scale_frame_decoder_t * decoder, char ch, float * weight);
+void scale_frame_listener_loop(const scale_frame_descriptor_t * descriptor);
+
 void set_scale_driver(scale_driver_t scale_driver);
 
 const char * get_scale_driver_string();
@@ -87,7 +214,31 @@ bool scale_config_save(void);
 // Low lever handler for writing data to the scale
 void scale_write(const char * command, size_t len);
 
+// Low level handlers for reading data from the scale (filled by the UART RX interrupt)
+bool scale_uart_is_readable();
+char scale_uart_getc();
+bool scale_uart_wait_for_frame(TickType_t block_ticks);
+void scale_uart_set_frame_terminator(char terminator);
+
+// Binary telemetry, see http_rest_scale_telemetry. All fields little endian.
+typedef struct __attribute__((packed)) {
+    uint8_t version;                // SCALE_TELEMETRY_VERSION
+    uint8_t record_size;            // sizeof(scale_telemetry_record_t)
+    uint16_t record_count;
+    uint32_t latest_seq;
+    uint32_t now_us;                // Time the response was built, relates the capture times to the present
+} scale_telemetry_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t seq;
+    uint32_t capture_time_us;
+    float weight;
+    uint8_t stability;              // scale_stability_t
+} scale_telemetry_record_t;
+
+
 // REST
+bool http_rest_scale_telemetry(struct fs_file *file, int num_params, char *params[], char *values[]);
 bool http_rest_scale_action(struct fs_file *file, int num_params, char *params[], char *values[]);
 bool http_rest_scale_config(struct fs_file *file, int num_params, char *params[], char *values[]);
 
@@ -3,11 +3,14 @@
 #include <string.h>
 #include <stdlib.h>
 #include "hardware/pwm.h"
+#include "hardware/irq.h"
 #include "hardware/clocks.h"
 #include "configuration.h"
 #include "eeprom.h"
 #include "common.h"
 #include "servo_gate.h"
+#include "trace.h"
+#include "static_alloc.h"
 
 // Attributes
 servo_gate_t servo_gate;
@@ -44,19 +47,33 @@ static inline float clamp01(float x) {
     return x;
 }
 
-static void inline _set_duty_cycle(uint16_t shutter0_duty_cycle, uint16_t shutter1_duty_cycle) {
-    uint32_t reg_level = ((uint32_t) shutter0_duty_cycle) << 16 | shutter1_duty_cycle;
-
-    // Write both levels to the pwm at the same time
-    hw_write_masked(
-        &pwm_hw->slice[SERVO_PWM_SLICE_NUM].cc,
-        reg_level,
-        0xffffffff
-    );
-}
-
-
-static void _servo_gate_set_current_state(float open_ratio) {
+/*
+    Gate trajectories run from the PWM wrap interrupt of the servo slice, one precomputed frame per PWM period. The
+    compare register is double buffered, so a frame written at the wrap is output from the next period on and the
+    servos never see a partial update. Long moves hold each frame for several periods to fit the table.
+*/
+#define SERVO_GATE_TRAJECTORY_SIZE      64
+
+typedef struct {
+    uint32_t cc;                        // Compare levels of both shutters
+    gate_ratio_t ratio;
+} _servo_gate_frame_t;
+
+typedef struct {
+    _servo_gate_frame_t frames[SERVO_GATE_TRAJECTORY_SIZE];
+    uint16_t length;
+    uint16_t periods_per_frame;
+} _servo_gate_trajectory_t;
+
+// Built by the control task in the spare buffer, then handed to the interrupt
+static _servo_gate_trajectory_t _servo_gate_trajectories[2];
+static _servo_gate_trajectory_t * volatile _servo_gate_active_trajectory = NULL;   // NULL while idle
+static uint8_t _servo_gate_spare_trajectory = 0;
+static uint16_t _servo_gate_frame_idx = 0;
+static uint16_t _servo_gate_frame_periods = 0;
+
+
+static uint32_t _servo_gate_ratio_to_cc(float open_ratio) {
     uint16_t shutter0_duty_cycle;
     uint16_t shutter1_duty_cycle;
 
@@ -66,10 +83,106 @@ static void _servo_gate_set_current_state(float open_ratio) {
     shutter0_duty_cycle = _pwm_full_scale_level * (servo_gate.eeprom_servo_gate_config.shutter0_open_duty_cycle + shutter0_range * open_ratio);
     shutter1_duty_cycle = _pwm_full_scale_level * (servo_gate.eeprom_servo_gate_config.shutter1_open_duty_cycle + shutter1_range * open_ratio);
 
-    _set_duty_cycle(shutter0_duty_cycle, shutter1_duty_cycle);
+    return ((uint32_t) shutter0_duty_cycle) << 16 | shutter1_duty_cycle;
+}
+
+
+static void _servo_gate_update_state(gate_ratio_t ratio) {
+    // Update discrete state for reporting/UI
+    if (ratio <= 0.0001f) {
+        servo_gate.gate_state = GATE_OPEN;
+    } else if (ratio >= 0.9999f) {
+        servo_gate.gate_state = GATE_CLOSE;
+    }
+}
+
+
+static void _servo_gate_pwm_wrap_isr() {
+    pwm_clear_irq(SERVO_PWM_SLICE_NUM);
+
+    _servo_gate_trajectory_t * trajectory = _servo_gate_active_trajectory;
+    if (trajectory == NULL) {
+        return;
+    }
+
+    // Write both levels to the pwm at the same time
+    const _servo_gate_frame_t * frame = &trajectory->frames[_servo_gate_frame_idx];
+    pwm_hw->slice[SERVO_PWM_SLICE_NUM].cc = frame->cc;
+    servo_gate.gate_ratio = frame->ratio;
+
+    _servo_gate_frame_periods += 1;
+    if (_servo_gate_frame_periods < trajectory->periods_per_frame) {
+        return;
+    }
+    _servo_gate_frame_periods = 0;
+
+    _servo_gate_frame_idx += 1;
+    if (_servo_gate_frame_idx < trajectory->length) {
+        return;
+    }
+
+    // Last frame is loaded, go idle and signal completion
+    _servo_gate_active_trajectory = NULL;
+    pwm_set_irq_enabled(SERVO_PWM_SLICE_NUM, false);
+
+    _servo_gate_update_state(frame->ratio);
+    trace_record(TRACE_EVENT_GATE_MOVE_END, frame->ratio * 1000);
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    xSemaphoreGiveFromISR(servo_gate.move_ready_semphore, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+
+// Stops the running trajectory where it is. Returns true if one was running.
+static bool _servo_gate_stop_trajectory() {
+    // The interrupt is served by this core, with the slice interrupt masked it can't be half way through
+    pwm_set_irq_enabled(SERVO_PWM_SLICE_NUM, false);
+
+    bool was_running = _servo_gate_active_trajectory != NULL;
+    _servo_gate_active_trajectory = NULL;
+
+    return was_running;
 }
 
 
+static void _servo_gate_start_trajectory(float from_ratio, float to_ratio) {
+    _servo_gate_trajectory_t * trajectory = &_servo_gate_trajectories[_servo_gate_spare_trajectory];
+
+    float delta = to_ratio - from_ratio;
+
+    // 0 = open, 1 = closed
+    float speed = (delta < 0.0f)
+        ? servo_gate.eeprom_servo_gate_config.shutter_open_speed_pct_s
+        : servo_gate.eeprom_servo_gate_config.shutter_close_speed_pct_s;
+
+    if (speed < 0.0001f) speed = 0.0001f;
+
+    // One frame per PWM period, at least the target itself
+    const uint32_t pwm_period_us = (uint32_t) (1e6f / _servo_pwm_freq);
+    uint32_t ramp_time_us = (uint32_t)(fabsf(delta / speed) * 1e6f);
+    uint32_t periods = MAX(1, (ramp_time_us + pwm_period_us - 1) / pwm_period_us);
+
+    trajectory->periods_per_frame = (periods + SERVO_GATE_TRAJECTORY_SIZE - 1) / SERVO_GATE_TRAJECTORY_SIZE;
+    trajectory->length = (periods + trajectory->periods_per_frame - 1) / trajectory->periods_per_frame;
+
+    for (uint16_t idx = 0; idx < trajectory->length; idx += 1) {
+        float ratio = (idx + 1 == trajectory->length) ? to_ratio : 
+                                                         from_ratio + delta * (idx + 1) / trajectory->length;
+        trajectory->frames[idx].cc = _servo_gate_ratio_to_cc(ratio);
+        trajectory->frames[idx].ratio = ratio;
+    }
+
+    _servo_gate_spare_trajectory ^= 1;
+    _servo_gate_frame_idx = 0;
+    _servo_gate_frame_periods = 0;
+    _servo_gate_active_trajectory = trajectory;
+
+    // Start with the next wrap
+    pwm_clear_irq(SERVO_PWM_SLICE_NUM);
+    pwm_set_irq_enabled(SERVO_PWM_SLICE_NUM, true);
+}
+
 
 void servo_gate_set_ratio(gate_ratio_t ratio, bool block_wait) {
     float r = (ratio == SERVO_GATE_RATIO_DISABLED) ? SERVO_GATE_RATIO_DISABLED : clamp01(ratio);
@@ -86,77 +199,39 @@ void servo_gate_set_ratio(gate_ratio_t ratio, bool block_wait) {
 void servo_gate_control_task(void *p) {
     (void)p;
 
-    const float UNKNOWN_RATIO = -2.0f;
-    float prev_open_ratio = UNKNOWN_RATIO;
+    // The wrap interrupt is served by the core enabling it, this task is pinned to the control core
+    irq_set_exclusive_handler(PWM_IRQ_WRAP, _servo_gate_pwm_wrap_isr);
+    irq_set_enabled(PWM_IRQ_WRAP, true);
+
+    bool position_known = false;
 
     while (true) {
         gate_ratio_t new_ratio;
         xQueueReceive(servo_gate.control_queue, &new_ratio, portMAX_DELAY);
 
+        // A new command takes over from where the running trajectory is
+        if (_servo_gate_stop_trajectory()) {
+            trace_record(TRACE_EVENT_GATE_MOVE_END, servo_gate.gate_ratio * 1000);
+        }
+
         // --- DISABLE ---
         if (new_ratio == SERVO_GATE_RATIO_DISABLED) {
             servo_gate.gate_state = GATE_DISABLED;
 
-            // Do NOT modify prev_open_ratio
+            // Do NOT modify the position
             xSemaphoreGive(servo_gate.move_ready_semphore);
             continue;
         }
 
         // Clamp to valid range
         float new_open_ratio = clamp01((float)new_ratio);
+        trace_record(TRACE_EVENT_GATE_MOVE_START, new_open_ratio * 1000);
 
-        // First valid move: set immediately
-        if (prev_open_ratio == UNKNOWN_RATIO) {
-            _servo_gate_set_current_state(new_open_ratio);
-        } else {
-            // Skip ramp if no change
-            if (fabsf(new_open_ratio - prev_open_ratio) > 0.0001f) {
-
-                float delta = new_open_ratio - prev_open_ratio;
+        // First valid move: set immediately, completion is signalled by the interrupt
+        float from_ratio = position_known ? servo_gate.gate_ratio : new_open_ratio;
+        position_known = true;
 
-                // 0 = open, 1 = closed
-                float speed = (delta < 0.0f)
-                    ? servo_gate.eeprom_servo_gate_config.shutter_open_speed_pct_s
-                    : servo_gate.eeprom_servo_gate_config.shutter_close_speed_pct_s;
-
-                if (speed < 0.0001f) speed = 0.0001f;
-
-                uint32_t ramp_time_us = (uint32_t)(fabsf(delta / speed) * 1e6f);
-
-                if (ramp_time_us < 1000) {
-                    _servo_gate_set_current_state(new_open_ratio);
-                } else {
-                    uint32_t start_time = time_us_32();
-                    uint32_t stop_time  = start_time + ramp_time_us;
-
-                    while (true) {
-                        uint32_t current_time = time_us_32();
-                        if (current_time > stop_time) break;
-
-                        float percentage = (current_time - start_time) / (float)ramp_time_us;
-                        float current_ratio = prev_open_ratio + delta * percentage;
-
-                        _servo_gate_set_current_state(current_ratio);
-                    }
-
-                    _servo_gate_set_current_state(new_open_ratio);
-                }
-            }
-        }
-
-        // Update discrete state for reporting/UI
-        if (new_open_ratio <= 0.0001f) {
-            servo_gate.gate_state = GATE_OPEN;
-        } else if (new_open_ratio >= 0.9999f) {
-            servo_gate.gate_state = GATE_CLOSE;
-        }
-
-        // Save last ratio
-        prev_open_ratio = new_open_ratio;
-        servo_gate.gate_ratio = (gate_ratio_t)new_open_ratio;
-
-        // Signal completion
-        xSemaphoreGive(servo_gate.move_ready_semphore);
+        _servo_gate_start_trajectory(from_ratio, new_open_ratio);
     }
 }
 
@@ -180,6 +255,9 @@ bool servo_gate_config_init() {
     // Register to eeprom save all
     eeprom_register_handler(servo_gate_config_save);
 
+    // Served together with the other modules by /rest/config
+    rest_register_config_module("servo_gate_config", http_rest_servo_gate_config);
+
     // Initialize settings
     if (servo_gate.eeprom_servo_gate_config.servo_gate_enable) {
         servo_gate.gate_state = GATE_OPEN;
@@ -215,15 +293,16 @@ bool servo_gate_init() {
     pwm_init(pwm_gpio_to_slice_num(SERVO1_PWM_PIN), &cfg, true);
 
     // Start the RTOS task and queue
-    servo_gate.control_queue = xQueueCreate(1, sizeof(gate_ratio_t));
-    servo_gate.move_ready_semphore = xSemaphoreCreateBinary();
+    servo_gate.control_queue = STATIC_QUEUE_CREATE(1, sizeof(gate_ratio_t));
+    servo_gate.move_ready_semphore = STATIC_SEMAPHORE_CREATE_BINARY();
 
-    xTaskCreate(
+    STATIC_TASK_CREATE_AFFINITY_SET(
         servo_gate_control_task,
         "servo_gate_controller",
         configMINIMAL_STACK_SIZE,
         NULL,
         8,
+        CONTROL_CORE_AFFINITY_MASK,
         &servo_gate.control_task_handler
     );
 
@@ -234,7 +313,11 @@ bool servo_gate_init() {
 
 
 bool http_rest_servo_gate_state(struct fs_file *file, int num_params, char *params[], char *values[]) {
-    static char servo_gate_json_buffer[96];
+    const size_t servo_gate_json_buffer_size = 96;
+    char * servo_gate_json_buffer = (char *) rest_response_alloc(servo_gate_json_buffer_size);
+    if (servo_gate_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
 
     for (int idx = 0; idx < num_params; idx += 1) {
         if (strcmp(params[idx], "g0") == 0) {
@@ -257,7 +340,7 @@ bool http_rest_servo_gate_state(struct fs_file *file, int num_params, char *para
     }
 
     snprintf(servo_gate_json_buffer,
-             sizeof(servo_gate_json_buffer),
+             servo_gate_json_buffer_size,
              "%s"
              "{\"g0\":%d}",
              http_json_header,
@@ -284,38 +367,25 @@ bool http_rest_servo_gate_config(struct fs_file *file, int num_params, char *par
     // c6 (float): shutter_open_speed_pct_s
     // ee (bool): save_to_eeprom
 
-    static char servo_gate_json_buffer[256];
-    bool save_to_eeprom = false;
+    const size_t servo_gate_json_buffer_size = 256;
+    char * servo_gate_json_buffer = (char *) rest_response_alloc(servo_gate_json_buffer_size);
+    if (servo_gate_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
 
+    static const rest_param_t servo_gate_config_params[] = {
+        REST_PARAM_BOOL("c0", servo_gate.eeprom_servo_gate_config.servo_gate_enable),
+        REST_PARAM_FLOAT("c1", servo_gate.eeprom_servo_gate_config.shutter0_close_duty_cycle),
+        REST_PARAM_FLOAT("c2", servo_gate.eeprom_servo_gate_config.shutter0_open_duty_cycle),
+        REST_PARAM_FLOAT("c3", servo_gate.eeprom_servo_gate_config.shutter1_close_duty_cycle),
+        REST_PARAM_FLOAT("c4", servo_gate.eeprom_servo_gate_config.shutter1_open_duty_cycle),
+        REST_PARAM_FLOAT("c5", servo_gate.eeprom_servo_gate_config.shutter_close_speed_pct_s),
+        REST_PARAM_FLOAT("c6", servo_gate.eeprom_servo_gate_config.shutter_open_speed_pct_s),
+    };
 
     // Control
-    for (int idx = 0; idx < num_params; idx += 1) {
-        if (strcmp(params[idx], "c0") == 0) {
-            bool enable = string_to_boolean(values[idx]);
-            servo_gate.eeprom_servo_gate_config.servo_gate_enable = enable;
-        }
-        else if (strcmp(params[idx], "c1") == 0) {
-            servo_gate.eeprom_servo_gate_config.shutter0_close_duty_cycle = strtof(values[idx], NULL);;
-        }
-        else if (strcmp(params[idx], "c2") == 0) {
-            servo_gate.eeprom_servo_gate_config.shutter0_open_duty_cycle = strtof(values[idx], NULL);;
-        }
-        else if (strcmp(params[idx], "c3") == 0) {
-            servo_gate.eeprom_servo_gate_config.shutter1_close_duty_cycle = strtof(values[idx], NULL);;
-        }
-        else if (strcmp(params[idx], "c4") == 0) {
-            servo_gate.eeprom_servo_gate_config.shutter1_open_duty_cycle = strtof(values[idx], NULL);;
-        }
-        else if (strcmp(params[idx], "c5") == 0) {
-            servo_gate.eeprom_servo_gate_config.shutter_close_speed_pct_s = strtof(values[idx], NULL);;
-        }
-        else if (strcmp(params[idx], "c6") == 0) {
-            servo_gate.eeprom_servo_gate_config.shutter_open_speed_pct_s = strtof(values[idx], NULL);;
-        }
-        else if (strcmp(params[idx], "ee") == 0) {
-            save_to_eeprom = string_to_boolean(values[idx]);
-        }
-    }
+    bool save_to_eeprom = rest_apply_params(servo_gate_config_params, REST_PARAM_TABLE_SIZE(servo_gate_config_params), 
+                                            num_params, params, values);
 
     // Perform action
     if (save_to_eeprom) {
@@ -324,7 +394,7 @@ bool http_rest_servo_gate_config(struct fs_file *file, int num_params, char *par
     
     // Response
     snprintf(servo_gate_json_buffer, 
-             sizeof(servo_gate_json_buffer),
+             servo_gate_json_buffer_size,
              "%s"
              "{\"c0\":%s,\"c1\":%0.3f,\"c2\":%0.3f,\"c3\":%0.3f,\"c4\":%0.3f,\"c5\":%0.3f,\"c6\":%0.3f}",
              http_json_header,
@@ -0,0 +1,76 @@
+#ifndef STATIC_ALLOC_H_
+#define STATIC_ALLOC_H_
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <semphr.h>
+#include <event_groups.h>
+
+
+/*
+    Creation of the long-lived kernel objects of the app. Built with STATIC_ALLOCATION (CMake option) every call site
+    gets its own storage in .bss, otherwise the objects come from the FreeRTOS heap. As the storage belongs to the call
+    site, a call site may only create one object: one that runs in a loop or on every re-init needs storage of its own.
+*/
+#if STATIC_ALLOCATION
+
+static inline BaseType_t _static_alloc_task_created(TaskHandle_t handle, TaskHandle_t * created_task) {
+    if (created_task) {
+        *created_task = handle;
+    }
+
+    return handle ? pdPASS : pdFAIL;
+}
+
+#define STATIC_TASK_CREATE(function, name, stack_depth, parameters, priority, created_task) ({                        \
+    static StackType_t _static_stack[stack_depth];                                                                    \
+    static StaticTask_t _static_task;                                                                                 \
+    _static_alloc_task_created(xTaskCreateStatic(function, name, stack_depth, parameters, priority,                   \
+                                                 _static_stack, &_static_task), created_task);                        \
+})
+
+#define STATIC_TASK_CREATE_AFFINITY_SET(function, name, stack_depth, parameters, priority, affinity, created_task) ({ \
+    static StackType_t _static_stack[stack_depth];                                                                    \
+    static StaticTask_t _static_task;                                                                                 \
+    _static_alloc_task_created(xTaskCreateStaticAffinitySet(function, name, stack_depth, parameters, priority,        \
+                                                            _static_stack, &_static_task, affinity), created_task);   \
+})
+
+#define STATIC_QUEUE_CREATE(length, item_size) ({                                                                     \
+    static uint8_t _static_storage[(length) * (item_size)];                                                           \
+    static StaticQueue_t _static_queue;                                                                               \
+    xQueueCreateStatic(length, item_size, _static_storage, &_static_queue);                                           \
+})
+
+#define STATIC_SEMAPHORE_CREATE_MUTEX() ({                                                                            \
+    static StaticSemaphore_t _static_semaphore;                                                                       \
+    xSemaphoreCreateMutexStatic(&_static_semaphore);                                                                  \
+})
+
+#define STATIC_SEMAPHORE_CREATE_BINARY() ({                                                                           \
+    static StaticSemaphore_t _static_semaphore;                                                                       \
+    xSemaphoreCreateBinaryStatic(&_static_semaphore);                                                                 \
+})
+
+#define STATIC_EVENT_GROUP_CREATE() ({                                                                                \
+    static StaticEventGroup_t _static_event_group;                                                                    \
+    xEventGroupCreateStatic(&_static_event_group);                                                                    \
+})
+
+#else
+
+#define STATIC_TASK_CREATE(function, name, stack_depth, parameters, priority, created_task)                           \
+    xTaskCreate(function, name, stack_depth, parameters, priority, created_task)
+
+#define STATIC_TASK_CREATE_AFFINITY_SET(function, name, stack_depth, parameters, priority, affinity, created_task)    \
+    xTaskCreateAffinitySet(function, name, stack_depth, parameters, priority, affinity, created_task)
+
+#define STATIC_QUEUE_CREATE(length, item_size)      xQueueCreate(length, item_size)
+#define STATIC_SEMAPHORE_CREATE_MUTEX()             xSemaphoreCreateMutex()
+#define STATIC_SEMAPHORE_CREATE_BINARY()            xSemaphoreCreateBinary()
+#define STATIC_EVENT_GROUP_CREATE()                 xEventGroupCreate()
+
+#endif  // STATIC_ALLOCATION
+
+#endif  // STATIC_ALLOC_H_
@@ -1,4 +1,7 @@
 #include <string.h>
+#include <malloc.h>
+#include <FreeRTOS.h>
+#include <task.h>
 
 #include "hardware/watchdog.h"
 
@@ -7,10 +10,16 @@
 #include "eeprom.h"
 #include "version.h"
 
+#define TASK_PLACEMENT_MAX_TASKS    24
+#define TASK_STATS_MAX_TASKS        32
+
 extern eeprom_metadata_t metadata;
 
 
 int software_reboot() {
+    // Saves are written behind, don't lose the pending ones
+    eeprom_flush();
+
     watchdog_reboot(0, 0, 0);
 
     return 0;
@@ -27,7 +36,11 @@ bool http_rest_system_control(struct fs_file *file, int num_params, char *params
     // s4 (bool): save_to_eeprom
     // s5 (bool): software_reset
     // s6 (bool): erase_eeprom
-    static char eeprom_config_json_buffer[256];
+    const size_t eeprom_config_json_buffer_size = 256;
+    char * eeprom_config_json_buffer = (char *) rest_response_alloc(eeprom_config_json_buffer_size);
+    if (eeprom_config_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
 
     bool save_to_eeprom_flag = false;
     bool software_reset_flag = false;
@@ -60,7 +73,7 @@ bool http_rest_system_control(struct fs_file *file, int num_params, char *params
 
     // Response
     snprintf(eeprom_config_json_buffer, 
-             sizeof(eeprom_config_json_buffer),
+             eeprom_config_json_buffer_size,
              "%s"
              "{\"s0\":\"%s\",\"s1\":\"%s\",\"s2\":\"%s\",\"s3\":\"%s\",\"s4\":%s,\"s5\":%s,\"s6\":%s}", 
              http_json_header,
@@ -77,3 +90,224 @@ bool http_rest_system_control(struct fs_file *file, int num_params, char *params
 
     return true;
 }
+
+
+bool http_rest_task_placement(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // s0 (int): Control core (scale, PID and stepper tasks), -1 if tasks float
+    // s1 (int): Network and UI core, -1 if tasks float
+    // s2 (list): Running task on each core
+    // s3 (list): Tasks, [name, core affinity mask, priority]
+    const size_t task_placement_json_buffer_size = 1280;
+    char * task_placement_json_buffer = (char *) rest_response_alloc(task_placement_json_buffer_size);
+    if (task_placement_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+    static TaskStatus_t task_status[TASK_PLACEMENT_MAX_TASKS];
+
+    UBaseType_t task_count = uxTaskGetSystemState(task_status, TASK_PLACEMENT_MAX_TASKS, NULL);
+
+    int len = snprintf(task_placement_json_buffer,
+                       task_placement_json_buffer_size,
+                       "%s"
+                       "{\"s0\":%d,\"s1\":%d,\"s2\":[",
+                       http_json_header,
+                       CONTROL_CORE, NETWORK_CORE);
+
+    for (BaseType_t core = 0; core < configNUMBER_OF_CORES; core += 1) {
+        TaskHandle_t running_task = xTaskGetCurrentTaskHandleForCore(core);
+        len += snprintf(task_placement_json_buffer + len,
+                        task_placement_json_buffer_size - len,
+                        "%s\"%s\"",
+                        core ? "," : "",
+                        running_task ? pcTaskGetName(running_task) : "");
+    }
+
+    len += snprintf(task_placement_json_buffer + len, task_placement_json_buffer_size - len, "],\"s3\":[");
+
+    for (UBaseType_t idx = 0; idx < task_count && len < task_placement_json_buffer_size; idx += 1) {
+        len += snprintf(task_placement_json_buffer + len,
+                        task_placement_json_buffer_size - len,
+                        "%s[\"%s\",%lu,%lu]",
+                        idx ? "," : "",
+                        task_status[idx].pcTaskName,
+                        (unsigned long) task_status[idx].uxCoreAffinityMask,
+                        (unsigned long) task_status[idx].uxCurrentPriority);
+    }
+
+    if (len < task_placement_json_buffer_size) {
+        snprintf(task_placement_json_buffer + len, task_placement_json_buffer_size - len, "]}");
+    }
+
+    size_t data_length = strlen(task_placement_json_buffer);
+    file->data = task_placement_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
+
+
+
+// Run time counters of the tasks at the previous /rest/task_stats request, the handlers run one at a time
+static struct {
+    UBaseType_t task_number;
+    configRUN_TIME_COUNTER_TYPE run_time;
+} task_stats_previous[TASK_STATS_MAX_TASKS];
+static UBaseType_t task_stats_previous_count = 0;
+static configRUN_TIME_COUNTER_TYPE task_stats_previous_time = 0;
+
+
+// Run time within the interval, a task created since counts from 0
+static configRUN_TIME_COUNTER_TYPE _task_run_time_since_previous(const TaskStatus_t * status) {
+    for (UBaseType_t idx = 0; idx < task_stats_previous_count; idx += 1) {
+        if (task_stats_previous[idx].task_number == status->xTaskNumber) {
+            return status->ulRunTimeCounter - task_stats_previous[idx].run_time;
+        }
+    }
+
+    return status->ulRunTimeCounter;
+}
+
+
+/*
+    CPU time of each task over the interval since the previous request (since boot on the first), so the figures
+    follow what the trickler is doing when the request is repeated. The run time counter is in microseconds, see
+    portGET_RUN_TIME_COUNTER_VALUE.
+*/
+bool http_rest_task_stats(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // s0 (int): Interval the CPU figures cover (ms)
+    // s1 (list): Load of each core (%), the time its idle task didn't run
+    // s2 (int): Free heap (bytes)
+    // s3 (int): Lowest free heap since boot (bytes)
+    // s4 (list): Tasks, [name, core (-1 if not pinned), priority, CPU (% of one core), stack high water mark (words)]
+    const size_t task_stats_json_buffer_size = 128 + TASK_STATS_MAX_TASKS * 64;
+    char * task_stats_json_buffer = (char *) rest_response_alloc(task_stats_json_buffer_size);
+    if (task_stats_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+    static TaskStatus_t task_status[TASK_STATS_MAX_TASKS];
+
+    UBaseType_t task_count = uxTaskGetSystemState(task_status, TASK_STATS_MAX_TASKS, NULL);
+    configRUN_TIME_COUNTER_TYPE now = portGET_RUN_TIME_COUNTER_VALUE();
+    configRUN_TIME_COUNTER_TYPE interval = now - task_stats_previous_time;
+
+    int len = snprintf(task_stats_json_buffer,
+                       task_stats_json_buffer_size,
+                       "%s"
+                       "{\"s0\":%lu,\"s1\":[",
+                       http_json_header,
+                       (unsigned long) (interval / 1000));
+
+    for (BaseType_t core = 0; core < configNUMBER_OF_CORES; core += 1) {
+        TaskHandle_t idle_task = xTaskGetIdleTaskHandleForCore(core);
+        float load = 0.0f;
+
+        for (UBaseType_t idx = 0; idx < task_count && interval; idx += 1) {
+            if (task_status[idx].xHandle == idle_task) {
+                load = 100.0f * (1.0f - (float) _task_run_time_since_previous(&task_status[idx]) / interval);
+            }
+        }
+
+        len += snprintf(task_stats_json_buffer + len,
+                        task_stats_json_buffer_size - len,
+                        "%s%0.1f",
+                        core ? "," : "",
+                        load > 0.0f ? load : 0.0f);
+    }
+
+    len += snprintf(task_stats_json_buffer + len,
+                    task_stats_json_buffer_size - len,
+                    "],\"s2\":%u,\"s3\":%u,\"s4\":[",
+                    xPortGetFreeHeapSize(),
+                    xPortGetMinimumEverFreeHeapSize());
+
+    for (UBaseType_t idx = 0; idx < task_count && len < task_stats_json_buffer_size; idx += 1) {
+        int core = -1;
+        for (int core_idx = 0; core_idx < configNUMBER_OF_CORES; core_idx += 1) {
+            if (task_status[idx].uxCoreAffinityMask == (1u << core_idx)) {
+                core = core_idx;
+            }
+        }
+
+        configRUN_TIME_COUNTER_TYPE run_time = _task_run_time_since_previous(&task_status[idx]);
+        len += snprintf(task_stats_json_buffer + len,
+                        task_stats_json_buffer_size - len,
+                        "%s[\"%s\",%d,%lu,%0.1f,%lu]",
+                        idx ? "," : "",
+                        task_status[idx].pcTaskName,
+                        core,
+                        (unsigned long) task_status[idx].uxCurrentPriority,
+                        interval ? 100.0f * run_time / interval : 0.0f,
+                        (unsigned long) task_status[idx].usStackHighWaterMark);
+    }
+
+    if (len < task_stats_json_buffer_size) {
+        snprintf(task_stats_json_buffer + len, task_stats_json_buffer_size - len, "]}");
+    }
+
+    for (UBaseType_t idx = 0; idx < task_count; idx += 1) {
+        task_stats_previous[idx].task_number = task_status[idx].xTaskNumber;
+        task_stats_previous[idx].run_time = task_status[idx].ulRunTimeCounter;
+    }
+    task_stats_previous_count = task_count;
+    task_stats_previous_time = now;
+
+    size_t data_length = strlen(task_stats_json_buffer);
+    file->data = task_stats_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
+
+
+bool http_rest_heap_stats(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // h0 (int): Free FreeRTOS heap (bytes)
+    // h1 (int): Lowest free FreeRTOS heap since boot (bytes)
+    // h2 (int): Largest free block (bytes), the largest allocation that can succeed
+    // h3 (int): Free blocks, many small blocks against the free heap means fragmentation
+    // h4 (int): FreeRTOS heap size (bytes)
+    // h5 (int): Allocations since boot
+    // h6 (int): Frees since boot
+    // h7 (bool): Built with STATIC_ALLOCATION
+    // h8 (int): C library (malloc) heap in use (bytes)
+    // h9 (int): Free C library heap in its arena (bytes)
+    const size_t heap_stats_json_buffer_size = 256;
+    char * heap_stats_json_buffer = (char *) rest_response_alloc(heap_stats_json_buffer_size);
+    if (heap_stats_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    HeapStats_t heap_stats;
+    vPortGetHeapStats(&heap_stats);
+    struct mallinfo malloc_info = mallinfo();
+
+    snprintf(heap_stats_json_buffer,
+             heap_stats_json_buffer_size,
+             "%s"
+             "{\"h0\":%u,\"h1\":%u,\"h2\":%u,\"h3\":%u,\"h4\":%u,\"h5\":%u,\"h6\":%u,\"h7\":%s,\"h8\":%u,\"h9\":%u}",
+             http_json_header,
+             heap_stats.xAvailableHeapSpaceInBytes,
+             heap_stats.xMinimumEverFreeBytesRemaining,
+             heap_stats.xSizeOfLargestFreeBlockInBytes,
+             heap_stats.xNumberOfFreeBlocks,
+             configTOTAL_HEAP_SIZE,
+             heap_stats.xNumberOfSuccessfulAllocations,
+             heap_stats.xNumberOfSuccessfulFrees,
+             boolean_to_string(STATIC_ALLOCATION),
+             (unsigned) malloc_info.uordblks,
+             (unsigned) malloc_info.fordblks);
+
+    size_t data_length = strlen(heap_stats_json_buffer);
+    file->data = heap_stats_json_buffer;
+    file->len = data_length;
+    file->index = data_length;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+
+    return true;
+}
@@ -12,6 +12,9 @@ extern "C" {
 
 
 bool http_rest_system_control(struct fs_file *file, int num_params, char *params[], char *values[]);
+bool http_rest_task_placement(struct fs_file *file, int num_params, char *params[], char *values[]);
+bool http_rest_task_stats(struct fs_file *file, int num_params, char *params[], char *values[]);
+bool http_rest_heap_stats(struct fs_file *file, int num_params, char *params[], char *values[]);
 int software_reboot(void);
 
 
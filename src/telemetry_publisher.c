@@ -0,0 +1,125 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <pico/cyw43_arch.h>
+#include "lwip/udp.h"
+#include "lwip/ip_addr.h"
+
+#include "telemetry_publisher.h"
+#include "charge_mode.h"
+#include "common.h"
+#include "static_alloc.h"
+
+
+/*
+    UDP telemetry for fleets of tricklers: one collector listening on a multicast group (or a unicast address) gets
+    every unit's state and charge results without polling any of them over HTTP.
+
+    Each datagram is one JSON object:
+
+        {"host":"opentrickler-xxxx","seq":12,"event":"state","data":{...}}
+
+    host is the mDNS host name of the unit and seq counts the datagrams it sent, so a collector can tell units apart
+    and see losses. "state" events (the keys of /rest/charge_mode_state) are sent every publish_period_ms and
+    "charge" events (the charge result of the "charge" server-sent event) as soon as a charge completes. Multicast is
+    sent with a TTL of 1 and stays on the local network.
+*/
+
+#define TELEMETRY_PUBLISHER_BUFFER_SIZE         320
+#define TELEMETRY_PUBLISHER_MIN_PERIOD_MS       100
+#define TELEMETRY_PUBLISHER_TASK_PRIORITY       1       // Below everything else on the network core
+#define TELEMETRY_PUBLISHER_MULTICAST_TTL       1
+
+
+extern char host_name[18];
+
+static const eeprom_wireless_metadata_t * telemetry_publisher_config = NULL;
+static TaskHandle_t telemetry_publisher_task_handler = NULL;
+static struct udp_pcb * telemetry_publisher_pcb = NULL;
+static uint32_t telemetry_publisher_seq = 0;
+
+
+static void _publish(const ip_addr_t * addr, uint16_t port, const char * event, const char * data) {
+    char datagram[TELEMETRY_PUBLISHER_BUFFER_SIZE];
+
+    int len = snprintf(datagram, sizeof(datagram), "{\"host\":\"%s\",\"seq\":%lu,\"event\":\"%s\",\"data\":%s}", 
+                       host_name, telemetry_publisher_seq, event, data);
+    if (len <= 0 || (size_t) len >= sizeof(datagram)) {
+        return;
+    }
+    telemetry_publisher_seq += 1;
+
+    cyw43_arch_lwip_begin();
+    struct pbuf * p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+    if (p) {
+        memcpy(p->payload, datagram, len);
+        udp_sendto(telemetry_publisher_pcb, p, addr, port);
+        pbuf_free(p);
+    }
+    cyw43_arch_lwip_end();
+}
+
+
+static void telemetry_publisher_task(void * p) {
+    static weight_string_cache_t weight_cache;
+    char data[TELEMETRY_PUBLISHER_BUFFER_SIZE - 64];
+    uint32_t reported_charges = 0;
+    TickType_t last_state_tick = xTaskGetTickCount();
+
+    while (true) {
+        uint32_t period_ms = MAX(telemetry_publisher_config->publish_period_ms, TELEMETRY_PUBLISHER_MIN_PERIOD_MS);
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(period_ms));
+
+        ip_addr_t addr;
+        bool enabled = telemetry_publisher_config->publish_enable && 
+                       telemetry_publisher_config->publish_port != 0 &&
+                       ipaddr_aton(telemetry_publisher_config->publish_address, &addr);
+
+        // Results are consumed while disabled as well, enabling doesn't send an old charge
+        if (charge_mode_format_charge_result(data, sizeof(data), &reported_charges) && enabled) {
+            _publish(&addr, telemetry_publisher_config->publish_port, "charge", data);
+        }
+
+        if (xTaskGetTickCount() - last_state_tick >= pdMS_TO_TICKS(period_ms)) {
+            last_state_tick = xTaskGetTickCount();
+
+            if (enabled && charge_mode_format_state(data, sizeof(data), &weight_cache)) {
+                _publish(&addr, telemetry_publisher_config->publish_port, "state", data);
+            }
+        }
+    }
+}
+
+
+void telemetry_publisher_init(const eeprom_wireless_metadata_t * config) {
+    if (telemetry_publisher_task_handler) {
+        return;
+    }
+
+    cyw43_arch_lwip_begin();
+    telemetry_publisher_pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+    if (telemetry_publisher_pcb) {
+        udp_set_multicast_ttl(telemetry_publisher_pcb, TELEMETRY_PUBLISHER_MULTICAST_TTL);
+    }
+    cyw43_arch_lwip_end();
+
+    if (telemetry_publisher_pcb == NULL) {
+        return;
+    }
+
+    telemetry_publisher_config = config;
+
+    // The state formats floats
+    STATIC_TASK_CREATE(telemetry_publisher_task, "Telemetry Publisher", configMINIMAL_STACK_SIZE * 2, NULL, 
+                       TELEMETRY_PUBLISHER_TASK_PRIORITY, &telemetry_publisher_task_handler);
+}
+
+
+void telemetry_publisher_notify(void) {
+    if (telemetry_publisher_task_handler) {
+        xTaskNotifyGive(telemetry_publisher_task_handler);
+    }
+}
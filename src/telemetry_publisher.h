@@ -0,0 +1,34 @@
+#ifndef TELEMETRY_PUBLISHER_H_
+#define TELEMETRY_PUBLISHER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "wireless.h"
+
+
+#define TELEMETRY_PUBLISHER_DEFAULT_ADDRESS     "239.255.42.42"
+#define TELEMETRY_PUBLISHER_DEFAULT_PORT        4242
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Starts the publisher task. The settings are read from config (publish_*) on every cycle, so changes made through
+ * /rest/wireless_config apply without restarting it. Shall be called after the network is up.
+ */
+void telemetry_publisher_init(const eeprom_wireless_metadata_t * config);
+
+/**
+ * Tells the publisher that a charge completed, its result is sent without waiting for the next state period. Cheap
+ * and safe to call from any task.
+ */
+void telemetry_publisher_notify(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // TELEMETRY_PUBLISHER_H_
@@ -0,0 +1,151 @@
+#include <string.h>
+#include <stdlib.h>
+#include "hardware/sync.h"
+#include "pico/platform.h"
+#include "pico/time.h"
+
+#include "trace.h"
+#include "common.h"
+
+
+/*
+    Hot path trace. Each core appends to its own ring, so the only writers that can meet are a task and the IRQs of
+    the same core: the slot is claimed with the IRQs masked for the increment, then filled. A slot carries the lap
+    of the ring it was written in, which tells the reader a slot being written or overwritten from one that's done.
+*/
+
+typedef struct {
+    uint32_t time_us;
+    uint8_t event;
+    uint8_t lap;
+    uint16_t arg;
+} _trace_slot_t;
+
+typedef struct {
+    volatile uint32_t head;
+    _trace_slot_t slots[TRACE_RING_SIZE];
+} _trace_ring_t;
+
+typedef struct {
+    const uint8_t * data;
+    size_t length;
+    size_t offset;
+} _trace_export_state_t;
+
+
+static _trace_ring_t trace_rings[NUM_CORES];
+static volatile bool trace_enabled = true;
+
+
+void __time_critical_func(trace_record)(trace_event_t event, uint16_t arg) {
+    if (!trace_enabled) {
+        return;
+    }
+
+    // The core is read with the interrupts masked, a task can't migrate to the other core's ring before the claim
+    uint32_t irq_state = save_and_disable_interrupts();
+    _trace_ring_t * ring = &trace_rings[get_core_num()];
+    uint32_t idx = ring->head;
+    ring->head = idx + 1;
+    restore_interrupts(irq_state);
+
+    _trace_slot_t * slot = &ring->slots[idx % TRACE_RING_SIZE];
+    slot->event = TRACE_EVENT_NONE;
+    __dmb();
+    slot->time_us = time_us_32();
+    slot->arg = arg;
+    slot->lap = idx / TRACE_RING_SIZE;
+    __dmb();
+    slot->event = event;
+}
+
+
+// Copies the records of one ring still in place, oldest first
+static uint32_t _trace_copy_ring(uint8_t core, trace_record_t * records, uint32_t * dropped) {
+    _trace_ring_t * ring = &trace_rings[core];
+    uint32_t head = ring->head;
+    uint32_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    uint32_t count = 0;
+
+    *dropped += first;
+
+    for (uint32_t idx = first; idx < head; idx += 1) {
+        _trace_slot_t * slot = &ring->slots[idx % TRACE_RING_SIZE];
+        _trace_slot_t copy;
+
+        uint8_t event = slot->event;
+        __dmb();
+        memcpy(&copy, slot, sizeof(copy));
+        __dmb();
+
+        // Being written, or written again since
+        if (event == TRACE_EVENT_NONE || event != slot->event || copy.lap != (uint8_t) (idx / TRACE_RING_SIZE)) {
+            continue;
+        }
+
+        records[count].time_us = copy.time_us;
+        records[count].event = event;
+        records[count].core = core;
+        records[count].arg = copy.arg;
+        count += 1;
+    }
+
+    return count;
+}
+
+
+static size_t _trace_export_read(void * state, const char ** data, size_t max_len) {
+    _trace_export_state_t * export_state = (_trace_export_state_t *) state;
+
+    size_t len = MIN(export_state->length - export_state->offset, max_len);
+    *data = (const char *) export_state->data + export_state->offset;
+    export_state->offset += len;
+
+    return len;
+}
+
+
+bool http_rest_trace(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    // Mappings
+    // e (bool): Enable (default) or pause the recording
+    //
+    // Response: the trace, see trace_header_t. scripts/trace_timeline.py turns it into a timeline.
+    for (int idx = 0; idx < num_params; idx += 1) {
+        if (strcmp(params[idx], "e") == 0) {
+            trace_enabled = string_to_boolean(values[idx]);
+        }
+    }
+
+    size_t length = sizeof(trace_header_t) + NUM_CORES * TRACE_RING_SIZE * sizeof(trace_record_t);
+    _trace_export_state_t * export_state = (_trace_export_state_t *) rest_response_alloc(sizeof(_trace_export_state_t));
+    uint8_t * data = (uint8_t *) rest_response_alloc(length);
+    if (export_state == NULL || data == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    trace_header_t header = {
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .record_cnt = 0,
+        .now_us = time_us_32(),
+        .dropped = 0,
+    };
+    uint32_t dropped = 0;
+
+    trace_record_t * records = (trace_record_t *) (data + sizeof(trace_header_t));
+    for (uint8_t core = 0; core < NUM_CORES; core += 1) {
+        header.record_cnt += _trace_copy_ring(core, records + header.record_cnt, &dropped);
+    }
+    header.dropped = dropped;
+    memcpy(data, &header, sizeof(header));
+
+    export_state->data = data;
+    export_state->length = sizeof(trace_header_t) + header.record_cnt * sizeof(trace_record_t);
+    export_state->offset = 0;
+
+    if (!rest_response_stream(file, "application/octet-stream", export_state->length, _trace_export_read, export_state)) {
+        return rest_response_unavailable(file);
+    }
+
+    return true;
+}
@@ -0,0 +1,74 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "http_rest.h"
+
+
+#define TRACE_MAGIC                     0x5254544F      // "OTTR"
+#define TRACE_VERSION                   1
+
+// Records kept per core, a power of 2
+#if PICO_RP2350
+#define TRACE_RING_SIZE                 2048
+#else
+#define TRACE_RING_SIZE                 512
+#endif
+
+
+// Keep in line with scripts/trace_timeline.py
+typedef enum {
+    TRACE_EVENT_NONE = 0,
+    TRACE_EVENT_SCALE_FRAME,            // Frame terminator received (UART IRQ)
+    TRACE_EVENT_SCALE_PUBLISH,          // Measurement published, semaphore given. arg: seq
+    TRACE_EVENT_SCALE_TAKE,             // Measurement taken by a consumer. arg: seq
+    TRACE_EVENT_PID_ITERATION,          // Charge control loop acts on a measurement. arg: seq
+    TRACE_EVENT_MOTOR_ENQUEUE,          // Command posted to a stepper task. arg: motor (UART address)
+    TRACE_EVENT_MOTOR_RAMP_START,       // Stepper task takes the command. arg: motor
+    TRACE_EVENT_MOTOR_RAMP_END,         // Target speed (or move) reached. arg: motor
+    TRACE_EVENT_GATE_MOVE_START,        // arg: target ratio in 1/1000
+    TRACE_EVENT_GATE_MOVE_END,          // arg: target ratio in 1/1000
+    TRACE_EVENT_HTTP_REQUEST_START,     // arg: connection
+    TRACE_EVENT_HTTP_REQUEST_END,       // Response sent. arg: connection
+    TRACE_EVENT_CNT,
+} trace_event_t;
+
+
+/*
+    /rest/trace download, little endian:
+        trace_header_t
+        record_cnt times trace_record_t, each core in time order
+*/
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_cnt;
+    uint32_t now_us;            // Time of the download, on the clock of time_us
+    uint32_t dropped;           // Records overwritten before the download
+} trace_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t time_us;           // time_us_32()
+    uint8_t event;              // trace_event_t
+    uint8_t core;
+    uint16_t arg;
+} trace_record_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Records an event with the current time. Safe from any task or IRQ on either core, takes no lock.
+ */
+void trace_record(trace_event_t event, uint16_t arg);
+
+bool http_rest_trace(struct fs_file *file, int num_params, char *params[], char *values[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // TRACE_H_
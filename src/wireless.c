@@ -11,7 +11,11 @@
 #include "mini_12864_module.h"
 #include "http_rest.h"
 #include "rest_endpoints.h"
+#include "event_stream.h"
+#include "telemetry_publisher.h"
 #include "common.h"
+#include "boot.h"
+#include "static_alloc.h"
 #include "lwip/apps/mdns.h"
 
 
@@ -44,6 +48,7 @@ typedef enum {
     WRIELESS_CTRL_START_STA_MODE,
     WIRELESS_CTRL_LED_ON,
     WIRELESS_CTRL_LED_OFF,
+    WIRELESS_CTRL_UPDATE_POWER_MANAGEMENT,
 } wireless_ctrl_t;
 
 
@@ -61,10 +66,22 @@ const eeprom_wireless_metadata_t default_eeprom_wireless_metadata = {
     .auth = AUTH_WPA2_MIXED_PSK,
     .timeout_ms = 30000,    // 30s
     .enable = false,
+
+    .publish_enable = false,
+    .publish_address = TELEMETRY_PUBLISHER_DEFAULT_ADDRESS,
+    .publish_port = TELEMETRY_PUBLISHER_DEFAULT_PORT,
+    .publish_period_ms = 1000,
+
+    .power_mode = WIRELESS_POWER_MODE_PERFORMANCE_WHEN_CHARGING,
 };
 
 static QueueHandle_t wireless_ctrl_queue;
 
+// Power management in effect, the driver starts the connection with power save on
+static volatile bool wireless_charging = false;
+static uint32_t wireless_pm = CYW43_DEFAULT_PM;
+static uint32_t wireless_pm_changes = 0;
+
 // Render task
 const char * wireless_state_strings[] = {
     "Not Initialized",
@@ -80,77 +97,67 @@ char first_line_buffer[35];
 char second_line_buffer[35];
 
 
-void wirelss_info_render_task(void *p) {
-    u8g2_t * display_handler = get_display_handler();
-
-    while (true) {
-        TickType_t last_render_tick = xTaskGetTickCount();
+static TickType_t wirelss_info_render_scene(u8g2_t * display_handler) {
+    // Draw state in the title
+    const char * title_string = wireless_state_strings[wireless_config.current_wireless_state];
+    u8g2_SetFont(display_handler, u8g2_font_helvB08_tr);
+    u8g2_DrawStr(display_handler, 5, 10, title_string);
 
-        u8g2_ClearBuffer(display_handler);
+    // Draw line
+    u8g2_DrawHLine(display_handler, 0, 13, u8g2_GetDisplayWidth(display_handler));
 
-        // Draw state in the title
-        const char * title_string = wireless_state_strings[wireless_config.current_wireless_state];
-        u8g2_SetFont(display_handler, u8g2_font_helvB08_tr);
-        u8g2_DrawStr(display_handler, 5, 10, title_string);
+    // Draw IP address
+    char * ip_addr_string = ipaddr_ntoa(netif_ip4_addr(netif_default));
+    if (strlen(ip_addr_string)) {
+        u8g2_SetFont(display_handler, u8g2_font_6x12_tf);
+        u8g2_DrawStr(display_handler, 5, 23, ip_addr_string);
+    }
 
-        // Draw line
-        u8g2_DrawHLine(display_handler, 0, 13, u8g2_GetDisplayWidth(display_handler));
+    // Draw first line
+    if (strlen(first_line_buffer)) {
+        u8g2_SetFont(display_handler, u8g2_font_6x12_tf);
+        u8g2_DrawStr(display_handler, 5, 33, first_line_buffer);
+    }
 
-        // Draw IP address
-        char * ip_addr_string = ipaddr_ntoa(netif_ip4_addr(netif_default));
-        if (strlen(ip_addr_string)) {
-            u8g2_SetFont(display_handler, u8g2_font_6x12_tf);
-            u8g2_DrawStr(display_handler, 5, 23, ip_addr_string);
-        }
+    // Draw second line
+    if (strlen(second_line_buffer)) {
+        u8g2_SetFont(display_handler, u8g2_font_6x12_tf);
+        u8g2_DrawStr(display_handler, 5, 43, second_line_buffer);
+    }
 
-        // Draw first line
-        if (strlen(first_line_buffer)) {
-            u8g2_SetFont(display_handler, u8g2_font_6x12_tf);
-            u8g2_DrawStr(display_handler, 5, 33, first_line_buffer);
-        }
+    // Draw link status
+    if (wireless_config.current_wireless_state == WIRELESS_STATE_STA_MODE_INIT || 
+        wireless_config.current_wireless_state == WIRELESS_STATE_STA_MODE_LISTEN) {
+            int link_status = cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA);
+            char * link_status_string = NULL;
 
-        // Draw second line
-        if (strlen(second_line_buffer)) {
+            if (link_status == CYW43_LINK_DOWN) {
+                link_status_string = "LINK_DOWN";
+            }
+            else if (link_status == CYW43_LINK_JOIN) {
+                link_status_string = "CYW43_LINK_JOIN";
+            }
+            else if (link_status == CYW43_LINK_NOIP) {
+                link_status_string = "CYW43_LINK_NOIP";
+            }
+            else if (link_status == CYW43_LINK_UP) {
+                link_status_string = "CYW43_LINK_UP";
+            }
+            else if (link_status == CYW43_LINK_FAIL) {
+                link_status_string = "CYW43_LINK_FAIL";
+            }
+            else if (link_status == CYW43_LINK_NONET) {
+                link_status_string = "CYW43_LINK_NONET";
+            }
+            else if (link_status == CYW43_LINK_BADAUTH) {
+                link_status_string = "CYW43_LINK_BADAUTH";
+            }
             u8g2_SetFont(display_handler, u8g2_font_6x12_tf);
-            u8g2_DrawStr(display_handler, 5, 43, second_line_buffer);
+            u8g2_DrawStr(display_handler, 5, 53, link_status_string);
         }
 
-        // Draw link status
-        if (wireless_config.current_wireless_state == WIRELESS_STATE_STA_MODE_INIT || 
-            wireless_config.current_wireless_state == WIRELESS_STATE_STA_MODE_LISTEN) {
-                int link_status = cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA);
-                char * link_status_string = NULL;
-
-                if (link_status == CYW43_LINK_DOWN) {
-                    link_status_string = "LINK_DOWN";
-                }
-                else if (link_status == CYW43_LINK_JOIN) {
-                    link_status_string = "CYW43_LINK_JOIN";
-                }
-                else if (link_status == CYW43_LINK_NOIP) {
-                    link_status_string = "CYW43_LINK_NOIP";
-                }
-                else if (link_status == CYW43_LINK_UP) {
-                    link_status_string = "CYW43_LINK_UP";
-                }
-                else if (link_status == CYW43_LINK_FAIL) {
-                    link_status_string = "CYW43_LINK_FAIL";
-                }
-                else if (link_status == CYW43_LINK_NONET) {
-                    link_status_string = "CYW43_LINK_NONET";
-                }
-                else if (link_status == CYW43_LINK_BADAUTH) {
-                    link_status_string = "CYW43_LINK_BADAUTH";
-                }
-                u8g2_SetFont(display_handler, u8g2_font_6x12_tf);
-                u8g2_DrawStr(display_handler, 5, 53, link_status_string);
-            }
-
 
-        u8g2_SendBuffer(display_handler);
-
-        vTaskDelayUntil(&last_render_tick, pdMS_TO_TICKS(200));
-    }
+    return pdMS_TO_TICKS(200);
 }
 
 
@@ -166,11 +173,15 @@ bool wireless_init() {
     }
 
     // Create Wireless handler task
-    xTaskCreate(wireless_task, "Wireless Task", 512, NULL, 3, NULL);
+    STATIC_TASK_CREATE(wireless_task, "Wireless Task", 512, NULL, 3, NULL);
 
     // Register to eeprom save all
     eeprom_register_handler(wireless_config_save);
 
+    // Served together with the other modules by /rest/config
+    rest_register_config_module("wireless_config", http_rest_wireless_config);
+    rest_register_metrics(wireless_format_metrics);
+
     // Generate the hostname
     char id[4];
     eeprom_get_board_id(id, sizeof(id));
@@ -187,6 +198,73 @@ bool wireless_config_save() {
 }
 
 
+/*
+    The power save of the CYW43 holds the frames for the station until its next wake up, tens of milliseconds added
+    to the REST and event stream delivery. Only the STA connection has power save, the AP mode is left alone.
+*/
+static uint32_t _wireless_expected_pm(void) {
+    switch (wireless_config.eeprom_wireless_metadata.power_mode) {
+        case WIRELESS_POWER_MODE_PERFORMANCE:
+            return CYW43_NONE_PM;
+        case WIRELESS_POWER_MODE_PERFORMANCE_WHEN_CHARGING:
+            return wireless_charging ? CYW43_NONE_PM : CYW43_DEFAULT_PM;
+        case WIRELESS_POWER_MODE_DEFAULT:
+        default:
+            return CYW43_DEFAULT_PM;
+    }
+}
+
+
+// Runs in the wireless task
+static void _wireless_update_power_management(void) {
+    if (wireless_config.current_wireless_state != WIRELESS_STATE_STA_MODE_LISTEN) {
+        return;
+    }
+
+    uint32_t pm = _wireless_expected_pm();
+    if (pm == wireless_pm) {
+        return;
+    }
+
+    if (cyw43_wifi_pm(&cyw43_state, pm) == 0) {
+        wireless_pm = pm;
+        wireless_pm_changes += 1;
+    }
+    else {
+        printf("Unable to set the CYW43 power management\n");
+    }
+}
+
+
+static void _wireless_request_power_management_update(void) {
+    if (wireless_ctrl_queue) {
+        wireless_ctrl_t wireless_ctrl = WIRELESS_CTRL_UPDATE_POWER_MANAGEMENT;
+        xQueueSend(wireless_ctrl_queue, &wireless_ctrl, 0);
+    }
+}
+
+
+void wireless_set_charging(bool charging) {
+    wireless_charging = charging;
+    _wireless_request_power_management_update();
+}
+
+
+// Power management for /metrics
+static size_t wireless_format_metrics(char * buffer, size_t buffer_size) {
+    return snprintf(buffer, buffer_size,
+                    "# TYPE opentrickler_wireless_power_mode gauge\n"
+                    "opentrickler_wireless_power_mode %d\n"
+                    "# TYPE opentrickler_wireless_power_save gauge\n"
+                    "opentrickler_wireless_power_save %d\n"
+                    "# TYPE opentrickler_wireless_power_save_changes_total counter\n"
+                    "opentrickler_wireless_power_save_changes_total %lu\n",
+                    (int) wireless_config.eeprom_wireless_metadata.power_mode,
+                    wireless_pm != CYW43_NONE_PM,
+                    wireless_pm_changes);
+}
+
+
 uint32_t get_cyw43_auth(cyw43_auth_t auth) {
     uint32_t cyw43_auth = 0;
 
@@ -278,7 +356,7 @@ void wireless_task(void *p) {
     memset(second_line_buffer, 0x0, sizeof(second_line_buffer));
 
     wireless_config.current_wireless_state = WIRELESS_STATE_NOT_INITIALIZED;
-    wireless_ctrl_queue = xQueueCreate(5, sizeof(wireless_ctrl_t));
+    wireless_ctrl_queue = STATIC_QUEUE_CREATE(5, sizeof(wireless_ctrl_t));
 
     if (cyw43_arch_init()) {
         exit(-1);
@@ -290,7 +368,7 @@ void wireless_task(void *p) {
     if (led_interface_task_handler == NULL) {
         // The render task shall have lower priority than the current one
         UBaseType_t current_task_priority = uxTaskPriorityGet(xTaskGetCurrentTaskHandle());
-        xTaskCreate(led_interface_task, "LED Interface Task", configMINIMAL_STACK_SIZE, NULL, current_task_priority - 1, &led_interface_task_handler);
+        STATIC_TASK_CREATE(led_interface_task, "LED Interface Task", configMINIMAL_STACK_SIZE, NULL, current_task_priority - 1, &led_interface_task_handler);
     }
     else {
         vTaskResume(led_interface_task_handler);
@@ -355,8 +433,13 @@ void wireless_task(void *p) {
         // Add secondary service to allow client to discover with service _opentrickler._tcp.local
         mdns_resp_add_service(&cyw43_state.netif[CYW43_ITF_STA], "app_httpd", "_opentrickler", DNSSD_PROTO_TCP, 80, srv_txt, NULL);
         cyw43_arch_lwip_end();
+
+        _wireless_update_power_management();
     }
 
+    // The handlers reach every module, the slower boot stages shall be done first
+    boot_wait_for_stages(BOOT_STAGES_ALL);
+
     // Initialize REST endpoints
     // If the current wireless state is AP mode then we will map / to the wifi configuration
     rest_endpoints_init(wireless_config.current_wireless_state == WIRELESS_STATE_AP_MODE_LISTEN);
@@ -366,6 +449,14 @@ void wireless_task(void *p) {
     httpd_init();
     cyw43_arch_lwip_end();
 
+    // Start the event stream server (display mirror)
+    event_stream_init();
+
+    // Fleet telemetry, only meaningful on the local network
+    if (wireless_config.current_wireless_state == WIRELESS_STATE_STA_MODE_LISTEN) {
+        telemetry_publisher_init(&wireless_config.eeprom_wireless_metadata);
+    }
+
     while (true) {
         wireless_ctrl_t wireless_ctrl;
 
@@ -378,6 +469,9 @@ void wireless_task(void *p) {
             case WIRELESS_CTRL_LED_OFF:
                 cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, false);
                 break;
+            case WIRELESS_CTRL_UPDATE_POWER_MANAGEMENT:
+                _wireless_update_power_management();
+                break;
             default:
                 break;
         }
@@ -391,15 +485,7 @@ void wireless_task(void *p) {
 
 
 uint8_t wireless_view_wifi_info(void) {
-    static TaskHandle_t wirelss_info_render_task_handler = NULL;
-    if (wirelss_info_render_task_handler == NULL) {
-        // The render task shall have lower priority than the current one
-        UBaseType_t current_task_priority = uxTaskPriorityGet(xTaskGetCurrentTaskHandle());
-        xTaskCreate(wirelss_info_render_task, "Wireless Display Render Task", configMINIMAL_STACK_SIZE, NULL, current_task_priority - 1, &wirelss_info_render_task_handler);
-    }
-    else {
-        vTaskResume(wirelss_info_render_task_handler);
-    }
+    display_set_scene(wirelss_info_render_scene);
 
     bool quit = false;
     while (quit == false) {
@@ -411,7 +497,7 @@ uint8_t wireless_view_wifi_info(void) {
         }
     }
 
-    vTaskSuspend(wirelss_info_render_task_handler);
+    display_set_scene(NULL);
 
     return 40;  // Returns to the Wireless menu (view 40)
 }
@@ -424,52 +510,60 @@ bool http_rest_wireless_config(struct fs_file *file, int num_params, char *param
     // w2 (int): auth
     // w3 (int): timeout_ms
     // w4 (bool): enable
+    // w5 (bool): publish_enable
+    // w6 (str): publish_address
+    // w7 (int): publish_port
+    // w8 (int): publish_period_ms
+    // w9 (int): power_mode, wireless_power_mode_t
     // ee (bool): save to eeprom
 
-    static char wireless_config_json_buffer[256];
-    bool save_to_eeprom = false;
+    const size_t wireless_config_json_buffer_size = 256;
+    char * wireless_config_json_buffer = (char *) rest_response_alloc(wireless_config_json_buffer_size);
+    if (wireless_config_json_buffer == NULL) {
+        return rest_response_unavailable(file);
+    }
+
+    static const rest_param_t wireless_config_params[] = {
+        REST_PARAM_STRING("w0", wireless_config.eeprom_wireless_metadata.ssid),
+        REST_PARAM_STRING("w1", wireless_config.eeprom_wireless_metadata.pw),
+        REST_PARAM_INT("w2", wireless_config.eeprom_wireless_metadata.auth),
+        REST_PARAM_INT("w3", wireless_config.eeprom_wireless_metadata.timeout_ms),
+        REST_PARAM_BOOL("w4", wireless_config.eeprom_wireless_metadata.enable),
+        REST_PARAM_BOOL("w5", wireless_config.eeprom_wireless_metadata.publish_enable),
+        REST_PARAM_STRING("w6", wireless_config.eeprom_wireless_metadata.publish_address),
+        REST_PARAM_INT("w7", wireless_config.eeprom_wireless_metadata.publish_port),
+        REST_PARAM_INT("w8", wireless_config.eeprom_wireless_metadata.publish_period_ms),
+        REST_PARAM_INT("w9", wireless_config.eeprom_wireless_metadata.power_mode),
+    };
 
     // If the argument includes control, then update the settings
-    for (int idx = 0; idx < num_params; idx += 1) {
-        if (strcmp(params[idx], "w0") == 0) {
-            strncpy(wireless_config.eeprom_wireless_metadata.ssid, values[idx], sizeof(wireless_config.eeprom_wireless_metadata.ssid)); 
-        }
-        else if (strcmp(params[idx], "w1") == 0) {
-            strncpy(wireless_config.eeprom_wireless_metadata.pw, values[idx], sizeof(wireless_config.eeprom_wireless_metadata.pw)); 
-        }
-        else if (strcmp(params[idx], "w2") == 0) {
-            cyw43_auth_t auth = (cyw43_auth_t) atoi(values[idx]);
-            wireless_config.eeprom_wireless_metadata.auth = auth;
-        }
-        else if (strcmp(params[idx], "w3") == 0) {
-            int timeout_ms = (uint16_t) atoi(values[idx]);
-            wireless_config.eeprom_wireless_metadata.timeout_ms = timeout_ms;
-        }
-        else if (strcmp(params[idx], "w4") == 0) {
-            bool enable = string_to_boolean(values[idx]);
-            wireless_config.eeprom_wireless_metadata.enable = enable;
-        }
-        else if (strcmp(params[idx], "ee") == 0) {
-            save_to_eeprom = string_to_boolean(values[idx]);
-        }
-    }
+    bool save_to_eeprom = rest_apply_params(wireless_config_params, REST_PARAM_TABLE_SIZE(wireless_config_params), 
+                                            num_params, params, values);
 
     // Perform action
+    _wireless_request_power_management_update();
+
     if (save_to_eeprom) {
         wireless_config_save();
     }
 
     // Response
     snprintf(wireless_config_json_buffer, 
-             sizeof(wireless_config_json_buffer),
+             wireless_config_json_buffer_size,
              "%s"
-             "{\"w0\":\"%s\",\"w2\":%d,\"w3\":%"PRId32",\"w4\":%s}",
+             "{\"w0\":\"%s\",\"w2\":%d,\"w3\":%"PRId32",\"w4\":%s,"
+             "\"w5\":%s,\"w6\":\"%s\",\"w7\":%u,\"w8\":%"PRIu32",\"w9\":%d}",
              http_json_header,
              wireless_config.eeprom_wireless_metadata.ssid,
             //  wireless_config.eeprom_wireless_metadata.pw,  // No, we don't send the password over anymore
              wireless_config.eeprom_wireless_metadata.auth,
              wireless_config.eeprom_wireless_metadata.timeout_ms,
-             boolean_to_string(wireless_config.eeprom_wireless_metadata.enable));
+             boolean_to_string(wireless_config.eeprom_wireless_metadata.enable),
+             boolean_to_string(wireless_config.eeprom_wireless_metadata.publish_enable),
+             wireless_config.eeprom_wireless_metadata.publish_address,
+             wireless_config.eeprom_wireless_metadata.publish_port,
+             wireless_config.eeprom_wireless_metadata.publish_period_ms,
+             (int) wireless_config.eeprom_wireless_metadata.power_mode);
 
     size_t data_length = strlen(wireless_config_json_buffer);
     file->data = wireless_config_json_buffer;
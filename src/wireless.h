@@ -15,6 +15,14 @@ typedef enum {
 } cyw43_auth_t;
 
 
+// CYW43 power management
+typedef enum {
+    WIRELESS_POWER_MODE_DEFAULT = 0,                    // Power save (CYW43_DEFAULT_PM) at all times
+    WIRELESS_POWER_MODE_PERFORMANCE_WHEN_CHARGING = 1,  // Power save off while the charge mode runs
+    WIRELESS_POWER_MODE_PERFORMANCE = 2,                // Power save off at all times
+} wireless_power_mode_t;
+
+
 typedef struct {
     uint16_t wireless_data_rev;
     char ssid[32];
@@ -22,6 +30,14 @@ typedef struct {
     cyw43_auth_t auth;
     uint32_t timeout_ms;
     bool enable;
+
+    // Telemetry publisher, see telemetry_publisher.h
+    bool publish_enable;
+    char publish_address[16];           // IPv4 multicast group or the unicast address of a collector
+    uint16_t publish_port;
+    uint32_t publish_period_ms;         // State period, charge results are sent as they complete
+
+    wireless_power_mode_t power_mode;
 } eeprom_wireless_metadata_t;
 
 
@@ -38,6 +54,12 @@ bool wireless_init(void);
 bool wireless_config_save();
 uint8_t wireless_view_wifi_info(void);
 
+/**
+ * Tells the wireless task whether the charge mode runs, the power management follows it in
+ * WIRELESS_POWER_MODE_PERFORMANCE_WHEN_CHARGING.
+ */
+void wireless_set_charging(bool charging);
+
 bool http_rest_wireless_config(struct fs_file *file, int num_params, char *params[], char *values[]);
 
 #ifdef __cplusplus
@@ -5,6 +5,14 @@
 
 /* Specify board PIN mapping
     Reference: https://github.com/eamars/RaspberryPi-Pico-Motor-Expansion-Board?tab=readme-ov-file#peripherals
+
+    Peripherals in use: uart0 scale, uart1 TMC bus (addresses 0 and 1, 2 and 3 are free), spi0 display, i2c1 EEPROM,
+    pio0 steppers, ws2812 wherever a state machine is free, PWM slice 5 servo gate. Every user GPIO (0 - 22, 26 - 28)
+    is assigned, GPIO 23 - 25 and 29 are taken by the CYW43 on the Pico W. A second trickler pair and scale (dual
+    station) need a board with more GPIO and a third UART (PIO UART) for the second scale.
+
+    The Pico 2 W (RP2350A) has the same GPIO, the pin mapping is shared. Its third PIO block (pio2) is left free, four 
+    state machines for the PIO UART and the steppers of a second station.
 */
 
 #define WATCHDOG_LED_PIN CYW43_WL_GPIO_LED_PIN
@@ -0,0 +1,69 @@
+/*
+    Host run of the benchmark cases of src/benchmark.cpp (built with BENCHMARK_HOST), the same cases /rest/benchmark
+    runs on the target. The results are nanoseconds per call on the host clock: they don't predict the cycle counts of
+    the target, they are for comparing two versions of a hot path on the desk before flashing.
+
+    The route table is filled with the URIs rest_endpoints_init registers, so the rest_get_handler case searches a
+    table of the size it has on the target.
+
+    Usage
+
+        benchmark
+        benchmark --iterations 100000
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "benchmark.h"
+#include "http_rest.h"
+
+
+static const char * benchmark_routes[] = {
+    "/", "/mobile", "/wizard", "/404", "/metrics",
+    "/rest/scale_action", "/rest/config", "/rest/config_snapshot", "/rest/config_snapshot_import",
+    "/rest/scale_config", "/rest/scale_telemetry", "/rest/custom_scale_config",
+    "/rest/charge_mode_config", "/rest/charge_mode_state", "/rest/charge_pipeline_config", "/rest/charge_batch",
+    "/rest/charge_trace", "/rest/charge_history", "/rest/charge_history_export", "/rest/pid_autotune",
+    "/rest/cleanup_mode_state", "/rest/dead_time_mode_state", "/rest/system_control", "/rest/task_placement",
+    "/rest/task_stats", "/rest/heap_stats", "/rest/trace", "/rest/benchmark", "/rest/boot",
+    "/rest/coarse_motor_config", "/rest/fine_motor_config", "/rest/coarse_motor_diagnostics",
+    "/rest/fine_motor_diagnostics", "/rest/button_control", "/rest/mini_12864_config", "/rest/wireless_config",
+    "/rest/neopixel_led_config", "/rest/profile_config", "/rest/profile_summary", "/rest/servo_gate_state",
+    "/rest/servo_gate_config", "/display_buffer", "/display_mirror", "/plot_weight",
+};
+
+
+static bool benchmark_route_handler(struct fs_file *file, int num_params, char *params[], char *values[]) {
+    return false;
+}
+
+
+int main(int argc, char * argv[]) {
+    uint32_t iterations = BENCHMARK_DEFAULT_ITERATIONS;
+
+    for (int idx = 1; idx < argc; idx += 1) {
+        if (strcmp(argv[idx], "--iterations") == 0 && idx + 1 < argc) {
+            iterations = strtoul(argv[++idx], NULL, 10);
+        }
+        else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[idx]);
+            return 2;
+        }
+    }
+
+    for (const char * uri : benchmark_routes) {
+        rest_register_handler(uri, benchmark_route_handler);
+    }
+
+    benchmark_result_t results[32];
+    uint8_t count = benchmark_run(iterations, results, sizeof(results) / sizeof(results[0]));
+
+    printf("%-24s %10s %10s %10s  (ns per call, %u iterations)\n", "case", "min", "mean", "max", iterations);
+    for (uint8_t idx = 0; idx < count; idx += 1) {
+        printf("%-24s %10u %10u %10u\n", results[idx].name, results[idx].min_cycles, results[idx].mean_cycles,
+               results[idx].max_cycles);
+    }
+
+    return count > 0 ? 0 : 1;
+}
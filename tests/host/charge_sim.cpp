@@ -0,0 +1,474 @@
+/*
+    Simulation of the charge loop on the host: the control loop of the charge mode (_charge_control_run), the scale
+    path (RX interrupt, frame decoder of the A&D driver, measurement filters and stream) and the profile and pipeline
+    modules are the firmware sources, only the plant is simulated. The plant is the powder flow of the two tricklers
+    and a scale sampling the pan, sending A&D frames over the UART at the configured baud rate.
+
+    Running a few thousand charges gives repeatable charge time and error distributions to compare control changes
+    before bench testing. Every charge that doesn't complete within the timeout fails the run.
+
+    Usage
+
+        charge_sim --charges 2000 --target 40
+        charge_sim --predictive-cutoff --dead-time-ms 250
+        charge_sim --kalman-filter --fine-kd 0
+*/
+#include "charge_mode.cpp"
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "hardware/uart.h"
+#include "configuration.h"
+#include "host_kernel.h"
+
+extern "C" const scale_frame_descriptor_t * sim_and_fxi_frame_descriptor;
+
+#define SIM_STEPS_PER_REV       3200
+
+typedef struct {
+    double charges = 1000;
+    double seed = 1;
+    double target = 40.0;
+    double timeout_s = 120.0;
+
+    // Charge mode config and profile, NAN keeps the default of the firmware
+    double coarse_stop_threshold = NAN;
+    double fine_stop_threshold = NAN;
+    bool predictive_cutoff = false;
+    double dead_time_ms = NAN;
+    bool kalman_filter = false;
+    bool outlier_filter = false;
+
+    double coarse_kp = NAN;
+    double coarse_ki = NAN;
+    double coarse_kd = NAN;
+    double fine_kp = NAN;
+    double fine_ki = NAN;
+    double fine_kd = NAN;
+
+    // Plant
+    double coarse_weight_per_rev = 2.0;
+    double fine_weight_per_rev = 0.3;
+    double kernel_weight = 0.02;
+    double drop_delay_ms = 150.0;
+    double scale_rate_hz = 10.0;
+    double scale_latency_ms = 100.0;
+    double scale_noise = 0.005;
+    double scale_resolution = 0.02;
+    double scale_baudrate = 19200;
+} sim_args_t;
+
+
+/*
+    Powder delivered by one trickler. The flow is proportional to the speed, arrives in whole kernels and reaches the
+    pan after the drop (in flight) delay.
+*/
+class PowderModel {
+public:
+    double weight_per_rev;
+    double speed_rps = 0;
+    double revolutions = 0;
+
+    PowderModel(std::mt19937 & rng, double weight_per_rev, double kernel_weight, double drop_delay_s) :
+        weight_per_rev(weight_per_rev), rng(rng), kernel_weight(kernel_weight), drop_delay_s(drop_delay_s) {}
+
+    void reset() {
+        speed_rps = 0;
+        accumulated = 0;
+        in_flight.clear();
+    }
+
+    double step(double now_s, double dt_s) {
+        revolutions += speed_rps * dt_s;
+
+        // Kernels leave the tube at irregular intervals, a reversing trickler delivers nothing
+        if (speed_rps > 0) {
+            accumulated += speed_rps * weight_per_rev * dt_s * irregularity(rng);
+        }
+        while (accumulated >= kernel_weight) {
+            accumulated -= kernel_weight;
+            in_flight.push_back(now_s + drop_delay_s);
+        }
+
+        double landed = 0;
+        while (!in_flight.empty() && in_flight.front() <= now_s) {
+            landed += kernel_weight;
+            in_flight.pop_front();
+        }
+
+        return landed;
+    }
+
+private:
+    std::mt19937 & rng;
+    std::uniform_real_distribution<double> irregularity{0.5, 1.5};
+    double kernel_weight;
+    double drop_delay_s;
+    double accumulated = 0;
+    std::deque<double> in_flight;       // Landing times
+};
+
+
+/*
+    Scale sampling the pan at a fixed update rate. The reported weight is filtered by the scale (modelled as latency),
+    quantised to the display resolution and affected by noise. Each reading is sent as an A&D frame, the bytes take
+    the time of the baud rate on the line.
+*/
+class ScaleModel {
+public:
+    ScaleModel(std::mt19937 & rng, const sim_args_t & args) :
+        rng(rng), noise(0, args.scale_noise), period_s(1.0 / args.scale_rate_hz), latency_s(args.scale_latency_ms / 1000.0),
+        resolution(args.scale_resolution), bytes_per_s(args.scale_baudrate / 10.0) {}
+
+    void reset() {
+        history.clear();
+        pan_weight = 0;
+    }
+
+    void step(double now_s, double weight) {
+        history.push_back({now_s, weight});
+
+        if (now_s >= next_frame_s) {
+            next_frame_s += period_s;
+            send_frame(now_s);
+        }
+
+        // Bytes on the line until now
+        byte_credit += bytes_per_s * 0.001;
+        size_t len = std::min((size_t) byte_credit, line.size());
+        if (len > 0) {
+            host_uart_receive(SCALE_UART, line.data(), len);
+            line.erase(0, len);
+            byte_credit -= len;
+        }
+        if (line.empty()) {
+            byte_credit = 0;
+        }
+    }
+
+private:
+    std::mt19937 & rng;
+    std::normal_distribution<double> noise;
+    double period_s;
+    double latency_s;
+    double resolution;
+    double bytes_per_s;
+
+    std::deque<std::pair<double, double>> history;      // (time_s, pan weight)
+    double pan_weight = 0;
+    double next_frame_s = 0;
+    std::string line;
+    double byte_credit = 0;
+
+    void send_frame(double now_s) {
+        // Weight seen by the load cell latency_s ago
+        double sample_time_s = now_s - latency_s;
+        while (!history.empty() && history.front().first <= sample_time_s) {
+            pan_weight = history.front().second;
+            history.pop_front();
+        }
+
+        double weight = std::round((pan_weight + noise(rng)) / resolution) * resolution;
+
+        // header[2], comma, data[9], unit[3], terminator[2], see and_fxi_frame_descriptor
+        char frame[32];
+        snprintf(frame, sizeof(frame), "ST,%+09.2f GN\r\n", weight);
+        line += frame;
+    }
+};
+
+
+static std::mt19937 sim_rng;
+static PowderModel * sim_coarse;
+static PowderModel * sim_fine;
+static ScaleModel * sim_scale;
+static double sim_pan_weight = 0;
+static scale_frame_decoder_t sim_decoder;
+
+// Charge being run, aborted as the operator would after the timeout
+static uint64_t sim_charge_start_us = 0;
+static uint64_t sim_charge_timeout_us = 0;
+static bool sim_charging = false;
+
+
+// Runs on every tick of the virtual clock: the plant, then the scale task (above the control task on the target)
+static void sim_tick(void) {
+    double now_s = time_us_64() / 1e6;
+
+    sim_pan_weight += sim_coarse->step(now_s, 0.001) + sim_fine->step(now_s, 0.001);
+    sim_scale->step(now_s, sim_pan_weight);
+
+    // The frame listener loop of the driver
+    while (scale_uart_is_readable()) {
+        float weight;
+        if (scale_frame_decoder_push(sim_and_fxi_frame_descriptor, &sim_decoder, scale_uart_getc(), &weight)) {
+            scale_publish_measurement(weight, sim_decoder.stability);
+        }
+    }
+
+    if (sim_charging && !charge_control_abort && time_us_64() - sim_charge_start_us > sim_charge_timeout_us) {
+        charge_control_abort = true;
+        xTaskAbortDelay(xTaskGetCurrentTaskHandle());
+    }
+}
+
+
+// Motor API of the control loop, drives the plant
+void motor_set_speed(motor_select_t selected_motor, float new_velocity) {
+    if (selected_motor == SELECT_COARSE_TRICKLER_MOTOR || selected_motor == SELECT_BOTH_MOTOR) {
+        sim_coarse->speed_rps = new_velocity;
+    }
+    if (selected_motor == SELECT_FINE_TRICKLER_MOTOR || selected_motor == SELECT_BOTH_MOTOR) {
+        sim_fine->speed_rps = new_velocity;
+    }
+}
+
+
+void motor_apply_command(const motor_command_t * command) {
+    if (!isnan(command->coarse_velocity)) {
+        motor_set_speed(SELECT_COARSE_TRICKLER_MOTOR, command->coarse_velocity);
+    }
+    if (!isnan(command->fine_velocity)) {
+        motor_set_speed(SELECT_FINE_TRICKLER_MOTOR, command->fine_velocity);
+    }
+    if (!isnan(command->gate_ratio)) {
+        servo_gate_set_ratio(command->gate_ratio, false);
+    }
+}
+
+
+// The back off is instant, the reverse doesn't deliver powder
+void motor_move_revolutions(motor_select_t selected_motor, float revolutions, float speed_rps) {
+    PowderModel * trickler = selected_motor == SELECT_COARSE_TRICKLER_MOTOR ? sim_coarse : sim_fine;
+    trickler->revolutions += revolutions;
+}
+
+
+bool motor_wait_for_move(motor_select_t selected_motor, uint32_t block_time_ms) {
+    return true;
+}
+
+
+void motor_enable(motor_select_t selected_motor, bool enable) {
+}
+
+
+int64_t motor_get_position_steps(motor_select_t selected_motor) {
+    PowderModel * trickler = selected_motor == SELECT_COARSE_TRICKLER_MOTOR ? sim_coarse : sim_fine;
+    return (int64_t) (trickler->revolutions * SIM_STEPS_PER_REV);
+}
+
+
+float motor_steps_to_revolutions(motor_select_t selected_motor, int64_t steps) {
+    return (float) steps / SIM_STEPS_PER_REV;
+}
+
+
+uint16_t get_motor_max_speed(motor_select_t selected_motor) {
+    return 20;
+}
+
+
+float get_motor_min_speed(motor_select_t selected_motor) {
+    return 0.0f;
+}
+
+
+// Runs a charge from an empty pan, returns false if it timed out
+static bool simulate_charge(const sim_args_t & args, double * charge_time_s, double * error) {
+    sim_coarse->reset();
+    sim_fine->reset();
+    sim_scale->reset();
+    sim_pan_weight = 0;
+
+    // The cup is back and zeroed, let the readings of the empty pan through the scale
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    charge_mode_config.target_charge_weight = args.target;
+    charge_control_abort = false;
+    sim_charge_start_us = time_us_64();
+    sim_charging = true;
+
+    bool completed = _charge_control_run();
+    *charge_time_s = (time_us_64() - sim_charge_start_us) / 1e6;
+    sim_charging = false;
+
+    // Stop as charge_mode_wait_for_complete does on an abort, then let the powder in flight land
+    motor_set_speed(SELECT_BOTH_MOTOR, 0);
+    vTaskDelay(pdMS_TO_TICKS(args.drop_delay_ms + 500));
+    *error = sim_pan_weight - args.target;
+
+    return completed;
+}
+
+
+static double percentile(std::vector<double> values, double ratio) {
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t) (ratio * values.size()))];
+}
+
+
+static bool parse_args(int argc, char * argv[], sim_args_t * args) {
+    const struct {
+        const char * name;
+        double * value;
+    } options[] = {
+        {"--charges", &args->charges},
+        {"--seed", &args->seed},
+        {"--target", &args->target},
+        {"--timeout-s", &args->timeout_s},
+        {"--coarse-stop-threshold", &args->coarse_stop_threshold},
+        {"--fine-stop-threshold", &args->fine_stop_threshold},
+        {"--dead-time-ms", &args->dead_time_ms},
+        {"--coarse-kp", &args->coarse_kp},
+        {"--coarse-ki", &args->coarse_ki},
+        {"--coarse-kd", &args->coarse_kd},
+        {"--fine-kp", &args->fine_kp},
+        {"--fine-ki", &args->fine_ki},
+        {"--fine-kd", &args->fine_kd},
+        {"--coarse-weight-per-rev", &args->coarse_weight_per_rev},
+        {"--fine-weight-per-rev", &args->fine_weight_per_rev},
+        {"--kernel-weight", &args->kernel_weight},
+        {"--drop-delay-ms", &args->drop_delay_ms},
+        {"--scale-rate-hz", &args->scale_rate_hz},
+        {"--scale-latency-ms", &args->scale_latency_ms},
+        {"--scale-noise", &args->scale_noise},
+        {"--scale-resolution", &args->scale_resolution},
+        {"--scale-baudrate", &args->scale_baudrate},
+    };
+    const struct {
+        const char * name;
+        bool * value;
+    } flags[] = {
+        {"--predictive-cutoff", &args->predictive_cutoff},
+        {"--kalman-filter", &args->kalman_filter},
+        {"--outlier-filter", &args->outlier_filter},
+    };
+
+    for (int idx = 1; idx < argc; idx += 1) {
+        bool matched = false;
+
+        for (const auto & flag : flags) {
+            if (strcmp(argv[idx], flag.name) == 0) {
+                *flag.value = true;
+                matched = true;
+            }
+        }
+
+        for (const auto & option : options) {
+            if (strcmp(argv[idx], option.name) == 0 && idx + 1 < argc) {
+                *option.value = strtod(argv[++idx], NULL);
+                matched = true;
+            }
+        }
+
+        if (!matched) {
+            fprintf(stderr, "Unknown argument: %s\n", argv[idx]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// Overrides a setting of the firmware if given on the command line
+static void apply_arg(float * setting, double value) {
+    if (!isnan(value)) {
+        *setting = value;
+    }
+}
+
+
+int main(int argc, char * argv[]) {
+    sim_args_t args;
+    if (!parse_args(argc, argv, &args)) {
+        return 2;
+    }
+
+    sim_rng.seed((uint32_t) args.seed);
+    PowderModel coarse(sim_rng, args.coarse_weight_per_rev, args.kernel_weight, args.drop_delay_ms / 1000.0);
+    PowderModel fine(sim_rng, args.fine_weight_per_rev, args.kernel_weight, args.drop_delay_ms / 1000.0);
+    ScaleModel scale(sim_rng, args);
+    sim_coarse = &coarse;
+    sim_fine = &fine;
+    sim_scale = &scale;
+    sim_charge_timeout_us = (uint64_t) (args.timeout_s * 1e6);
+
+    // Bring up the modules of the charge loop as the app does, from a blank EEPROM
+    if (!profile_data_init() || !scale_init() || !charge_mode_config_init()) {
+        fprintf(stderr, "Unable to initialize the firmware modules\n");
+        return 1;
+    }
+    scale_uart_set_frame_terminator(sim_and_fxi_frame_descriptor->terminator);
+    host_kernel_set_tick_hook(sim_tick);
+
+    eeprom_charge_mode_data_t * charge_mode_data = &charge_mode_config.eeprom_charge_mode_data;
+    apply_arg(&charge_mode_data->coarse_stop_threshold, args.coarse_stop_threshold);
+    apply_arg(&charge_mode_data->fine_stop_threshold, args.fine_stop_threshold);
+    apply_arg(&charge_mode_data->cutoff_dead_time_ms, args.dead_time_ms);
+    charge_mode_data->predictive_cutoff_enable = args.predictive_cutoff;
+    scale_config.persistent_config.kalman_filter_enable = args.kalman_filter;
+    scale_config.persistent_config.outlier_filter_enable = args.outlier_filter;
+
+    profile_t * profile = profile_get_selected();
+    apply_arg(&profile->coarse_kp, args.coarse_kp);
+    apply_arg(&profile->coarse_ki, args.coarse_ki);
+    apply_arg(&profile->coarse_kd, args.coarse_kd);
+    apply_arg(&profile->fine_kp, args.fine_kp);
+    apply_arg(&profile->fine_ki, args.fine_ki);
+    apply_arg(&profile->fine_kd, args.fine_kd);
+
+    std::vector<double> charge_times;
+    std::vector<double> errors;
+    int timeouts = 0;
+    int charge_cnt = (int) args.charges;
+
+    for (int idx = 0; idx < charge_cnt; idx += 1) {
+        double charge_time_s;
+        double error;
+
+        if (!simulate_charge(args, &charge_time_s, &error)) {
+            timeouts += 1;
+        }
+        charge_times.push_back(charge_time_s);
+        errors.push_back(error);
+    }
+
+    if (charge_cnt <= 0) {
+        return 0;
+    }
+
+    float fine_stop_threshold = charge_mode_data->fine_stop_threshold;
+    int over_charges = std::count_if(errors.begin(), errors.end(), [=](double e) { return e >= fine_stop_threshold; });
+    int under_charges = std::count_if(errors.begin(), errors.end(), [=](double e) { return e <= -fine_stop_threshold; });
+
+    double time_sum = 0;
+    double error_sum = 0;
+    double max_abs_error = 0;
+    for (int idx = 0; idx < charge_cnt; idx += 1) {
+        time_sum += charge_times[idx];
+        error_sum += errors[idx];
+        max_abs_error = std::max(max_abs_error, fabs(errors[idx]));
+    }
+    double error_mean = error_sum / charge_cnt;
+    double error_var = 0;
+    for (double error : errors) {
+        error_var += (error - error_mean) * (error - error_mean) / charge_cnt;
+    }
+
+    printf("Profile:       %s\n", profile->name);
+    printf("Charges:       %d\n", charge_cnt);
+    printf("Charge time:   mean %.2f s, p50 %.2f s, p95 %.2f s\n",
+           time_sum / charge_cnt, percentile(charge_times, 0.5), percentile(charge_times, 0.95));
+    printf("Error:         mean %+.4f, sd %.4f, max abs %.4f\n", error_mean, sqrt(error_var), max_abs_error);
+    printf("Over charges:  %d (%.1f %%)\n", over_charges, 100.0 * over_charges / charge_cnt);
+    printf("Under charges: %d (%.1f %%)\n", under_charges, 100.0 * under_charges / charge_cnt);
+    printf("Timeouts:      %d\n", timeouts);
+
+    return timeouts ? 1 : 0;
+}
@@ -0,0 +1,322 @@
+/*
+    Migration of the configs an older firmware left in the EEPROM. Each case writes a block in the layout of that
+    firmware with save_config (as the old firmware did), brings the module up from it as the app does and checks that
+    the stored settings survive the update, with the fields added since at zero. The modules migrate once per boot,
+    so each run takes one case.
+
+    Usage
+
+        config_migration <case>
+
+    where <case> is one of the names in test_cases, e.g. profiles_released.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "common.h"
+#include "eeprom.h"
+#include "profile.h"
+#include "profile_store.h"
+#include "scale.h"
+
+
+static int failures = 0;
+
+#define CHECK(cond) do {                                                        \
+    if (!(cond)) {                                                              \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures += 1;                                                          \
+    }                                                                           \
+} while (0)
+
+
+// profile_t and the profile block of the released firmware
+typedef struct {
+    uint32_t rev;
+    uint32_t compatibility;
+
+    char name[PROFILE_NAME_MAX_LEN];
+
+    float coarse_kp;
+    float coarse_ki;
+    float coarse_kd;
+
+    float coarse_min_flow_speed_rps;
+    float coarse_max_flow_speed_rps;
+
+    float fine_kp;
+    float fine_ki;
+    float fine_kd;
+
+    float fine_min_flow_speed_rps;
+    float fine_max_flow_speed_rps;
+} release_profile_t;
+
+typedef struct {
+    uint16_t profile_data_rev;
+    uint16_t current_profile_idx;
+
+    release_profile_t profiles[8];
+} release_profile_data_t;
+
+
+// The profiles of 286df71 (learned coarse stop threshold), appended to the released ones in the block
+typedef struct {
+    release_profile_t released;
+
+    float learned_coarse_stop_threshold;
+    float learned_coarse_carry_weight;
+    float learned_overthrow_rate;
+} learned_profile_t;
+
+typedef struct {
+    uint16_t profile_data_rev;
+    uint16_t current_profile_idx;
+
+    learned_profile_t profiles[8];
+} learned_profile_data_t;
+
+
+// The profiles of 991a6ad (coarse backoff), inserted before the learned fields
+typedef struct {
+    release_profile_t released;
+
+    float coarse_backoff_revolutions;
+
+    float learned_coarse_stop_threshold;
+    float learned_coarse_carry_weight;
+    float learned_overthrow_rate;
+} backoff_profile_t;
+
+typedef struct {
+    uint16_t profile_data_rev;
+    uint16_t current_profile_idx;
+
+    backoff_profile_t profiles[8];
+} backoff_profile_data_t;
+
+
+static void _fill_release_profile(release_profile_t * profile, int idx) {
+    snprintf(profile->name, sizeof(profile->name), "User%d", idx);
+    profile->coarse_kp = 0.01f * (idx + 1);
+    profile->fine_kd = 1.0f * (idx + 1);
+    profile->fine_max_flow_speed_rps = 0.5f * (idx + 1);
+}
+
+
+// Brings the profiles up and checks the released fields of the migrated profiles
+static void _check_release_profiles(void) {
+    CHECK(profile_data_init());
+    CHECK(profile_store_get_count() == 8);
+    CHECK(profile_get_selected_idx() == 5);
+
+    for (uint16_t idx = 0; idx < 8; idx += 1) {
+        profile_t profile;
+        char name[PROFILE_NAME_MAX_LEN];
+        snprintf(name, sizeof(name), "User%d", idx);
+
+        CHECK(profile_store_load(idx, &profile));
+        CHECK(strcmp(profile.name, name) == 0);
+        CHECK(profile.coarse_kp == 0.01f * (idx + 1));
+        CHECK(profile.fine_kd == 1.0f * (idx + 1));
+        CHECK(profile.fine_max_flow_speed_rps == 0.5f * (idx + 1));
+
+        // Added since any of the layouts
+        CHECK(profile.measured_dead_time_ms == 0.0f);
+        CHECK(profile.charge_pipeline == 0);
+        CHECK(profile.fine_flow_gain_slope == 0.0f);
+    }
+}
+
+
+static void test_profiles_released(void) {
+    release_profile_data_t stored;
+    memset(&stored, 0x0, sizeof(stored));
+
+    stored.current_profile_idx = 5;
+    for (int idx = 0; idx < 8; idx += 1) {
+        _fill_release_profile(&stored.profiles[idx], idx);
+    }
+    CHECK(save_config(EEPROM_PROFILE_DATA_BASE_ADDR, &stored, sizeof(stored)));
+
+    _check_release_profiles();
+
+    for (uint16_t idx = 0; idx < 8; idx += 1) {
+        profile_t profile;
+        CHECK(profile_store_load(idx, &profile));
+        CHECK(profile.coarse_backoff_revolutions == 0.0f);
+        CHECK(profile.learned_coarse_stop_threshold == 0.0f);
+    }
+}
+
+
+static void test_profiles_learned(void) {
+    learned_profile_data_t stored;
+    memset(&stored, 0x0, sizeof(stored));
+
+    stored.current_profile_idx = 5;
+    for (int idx = 0; idx < 8; idx += 1) {
+        _fill_release_profile(&stored.profiles[idx].released, idx);
+        stored.profiles[idx].learned_coarse_stop_threshold = 2.0f + idx;
+        stored.profiles[idx].learned_coarse_carry_weight = 0.1f * idx;
+        stored.profiles[idx].learned_overthrow_rate = 0.05f;
+    }
+    CHECK(save_config(EEPROM_PROFILE_DATA_BASE_ADDR, &stored, sizeof(stored)));
+
+    _check_release_profiles();
+
+    for (uint16_t idx = 0; idx < 8; idx += 1) {
+        profile_t profile;
+        CHECK(profile_store_load(idx, &profile));
+        CHECK(profile.coarse_backoff_revolutions == 0.0f);
+        CHECK(profile.learned_coarse_stop_threshold == 2.0f + idx);
+        CHECK(profile.learned_coarse_carry_weight == 0.1f * idx);
+        CHECK(profile.learned_overthrow_rate == 0.05f);
+    }
+}
+
+
+static void test_profiles_backoff(void) {
+    backoff_profile_data_t stored;
+    memset(&stored, 0x0, sizeof(stored));
+
+    stored.current_profile_idx = 5;
+    for (int idx = 0; idx < 8; idx += 1) {
+        _fill_release_profile(&stored.profiles[idx].released, idx);
+        stored.profiles[idx].coarse_backoff_revolutions = 0.25f * idx;
+        stored.profiles[idx].learned_coarse_stop_threshold = 2.0f + idx;
+        stored.profiles[idx].learned_coarse_carry_weight = 0.1f * idx;
+        stored.profiles[idx].learned_overthrow_rate = 0.05f;
+    }
+    CHECK(save_config(EEPROM_PROFILE_DATA_BASE_ADDR, &stored, sizeof(stored)));
+
+    _check_release_profiles();
+
+    for (uint16_t idx = 0; idx < 8; idx += 1) {
+        profile_t profile;
+        CHECK(profile_store_load(idx, &profile));
+        CHECK(profile.coarse_backoff_revolutions == 0.25f * idx);
+        CHECK(profile.learned_coarse_stop_threshold == 2.0f + idx);
+        CHECK(profile.learned_coarse_carry_weight == 0.1f * idx);
+        CHECK(profile.learned_overthrow_rate == 0.05f);
+    }
+}
+
+
+// eeprom_scale_data_t of the released firmware
+typedef struct {
+    uint16_t scale_data_rev;
+    scale_driver_t scale_driver;
+    scale_baudrate_t scale_baudrate;
+    scale_uart_format_t scale_uart_format;
+} release_scale_data_t;
+
+
+// The record of cfdf5af (measurement filter), before the custom protocol
+typedef struct {
+    release_scale_data_t released;
+
+    bool outlier_filter_enable;
+    float outlier_threshold;
+    bool kalman_filter_enable;
+    float kalman_measurement_sd;
+    float kalman_flow_noise;
+} filter_scale_data_t;
+
+
+// Brings the scale up and checks the record it stored in the current layout, the custom protocol at the defaults
+static void _check_scale_config(eeprom_scale_data_t * stored) {
+    CHECK(scale_init());
+
+    CHECK(read_config(EEPROM_SCALE_CONFIG_BASE_ADDR, stored, sizeof(eeprom_scale_data_t)));
+    CHECK(stored->scale_driver == SCALE_DRIVER_SARTORIUS);
+    CHECK(stored->scale_baudrate == BAUDRATE_9600);
+    CHECK(stored->scale_uart_format == UART_FMT_7D_1S_NP);
+
+    CHECK(stored->custom_protocol.sign_offset == -1);
+    CHECK(stored->custom_protocol.poll_interval_ms == 100);
+}
+
+
+static void _fill_release_scale_data(release_scale_data_t * data) {
+    data->scale_driver = SCALE_DRIVER_SARTORIUS;
+    data->scale_baudrate = BAUDRATE_9600;
+    data->scale_uart_format = UART_FMT_7D_1S_NP;
+}
+
+
+static void test_scale_released(void) {
+    release_scale_data_t stored;
+    memset(&stored, 0x0, sizeof(stored));
+
+    _fill_release_scale_data(&stored);
+    CHECK(save_config(EEPROM_SCALE_CONFIG_BASE_ADDR, &stored, sizeof(stored)));
+
+    eeprom_scale_data_t config;
+    _check_scale_config(&config);
+    CHECK(config.outlier_filter_enable == false);
+    CHECK(config.outlier_threshold == 0.5f);
+    CHECK(config.kalman_measurement_sd == 0.02f);
+    CHECK(config.kalman_flow_noise == 2.0f);
+}
+
+
+static void test_scale_filter(void) {
+    filter_scale_data_t stored;
+    memset(&stored, 0x0, sizeof(stored));
+
+    _fill_release_scale_data(&stored.released);
+    stored.outlier_filter_enable = true;
+    stored.outlier_threshold = 0.3f;
+    stored.kalman_filter_enable = true;
+    stored.kalman_measurement_sd = 0.05f;
+    stored.kalman_flow_noise = 4.0f;
+    CHECK(save_config(EEPROM_SCALE_CONFIG_BASE_ADDR, &stored, sizeof(stored)));
+
+    eeprom_scale_data_t config;
+    _check_scale_config(&config);
+    CHECK(config.outlier_filter_enable == true);
+    CHECK(config.outlier_threshold == 0.3f);
+    CHECK(config.kalman_filter_enable == true);
+    CHECK(config.kalman_measurement_sd == 0.05f);
+    CHECK(config.kalman_flow_noise == 4.0f);
+}
+
+
+static const struct {
+    const char * name;
+    void (*run)(void);
+} test_cases[] = {
+    {"profiles_released", test_profiles_released},
+    {"profiles_learned", test_profiles_learned},
+    {"profiles_backoff", test_profiles_backoff},
+    {"scale_released", test_scale_released},
+    {"scale_filter", test_scale_filter},
+};
+
+
+int main(int argc, char * argv[]) {
+    const char * name = argc > 1 ? argv[1] : "";
+    bool found = false;
+
+    for (const auto & test_case : test_cases) {
+        if (strcmp(test_case.name, name) == 0) {
+            test_case.run();
+            found = true;
+        }
+    }
+
+    if (!found) {
+        fprintf(stderr, "Unknown case: %s\n", name);
+        return 2;
+    }
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("%s passed\n", name);
+    return 0;
+}
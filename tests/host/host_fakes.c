@@ -0,0 +1,237 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <FreeRTOS.h>
+#include <queue.h>
+
+#include "app.h"
+#include "crc32.h"
+#include "eeprom.h"
+#include "profile_store.h"
+#include "http_rest.h"
+#include "mini_12864_module.h"
+#include "display.h"
+#include "neopixel_led.h"
+#include "servo_gate.h"
+#include "event_stream.h"
+#include "telemetry_publisher.h"
+#include "charge_history.h"
+#include "charge_batch.h"
+#include "pid_autotune.h"
+#include "wireless.h"
+
+/*
+    Stand-ins of the modules the host build doesn't compile. The EEPROM and the profile store keep their contents in
+    memory (a new unit, the modules load their defaults), the rest does nothing: no display, LEDs, network or buttons,
+    and no servo gate.
+*/
+#define HOST_EEPROM_SIZE        (32 * 1024)
+
+static uint8_t host_eeprom[HOST_EEPROM_SIZE];
+static bool host_eeprom_erased = false;
+
+static profile_t * host_profiles[PROFILE_STORE_MAX_CNT];
+static uint16_t host_profile_cnt = 0;
+
+AppState_t exit_state = APP_STATE_DEFAULT;
+QueueHandle_t encoder_event_queue = NULL;
+neopixel_led_config_t neopixel_led_config;
+servo_gate_t servo_gate = {
+    .gate_ratio = SERVO_GATE_RATIO_DISABLED,
+};
+
+
+static void _host_eeprom_erase(void) {
+    if (!host_eeprom_erased) {
+        memset(host_eeprom, 0xff, sizeof(host_eeprom));
+        host_eeprom_erased = true;
+    }
+}
+
+
+bool eeprom_read_crc32(uint16_t data_addr, uint8_t * data, size_t len, size_t crc_len, uint32_t * crc) {
+    _host_eeprom_erase();
+    if (data_addr + len > HOST_EEPROM_SIZE) {
+        return false;
+    }
+
+    memcpy(data, &host_eeprom[data_addr], len);
+    *crc = crc32_compute(data, crc_len);
+
+    return true;
+}
+
+
+bool eeprom_write(uint16_t data_addr, uint8_t * data, size_t len) {
+    _host_eeprom_erase();
+    if (data_addr + len > HOST_EEPROM_SIZE) {
+        return false;
+    }
+
+    memcpy(&host_eeprom[data_addr], data, len);
+
+    return true;
+}
+
+
+void eeprom_register_handler(eeprom_save_handler_t handler) {
+}
+
+
+bool profile_store_init(void) {
+    return true;
+}
+
+
+uint16_t profile_store_get_count(void) {
+    return host_profile_cnt;
+}
+
+
+const char * profile_store_get_name(uint16_t idx) {
+    return idx < host_profile_cnt ? host_profiles[idx]->name : NULL;
+}
+
+
+bool profile_store_load(uint16_t idx, profile_t * profile) {
+    if (idx >= host_profile_cnt) {
+        return false;
+    }
+
+    memcpy(profile, host_profiles[idx], sizeof(profile_t));
+    return true;
+}
+
+
+bool profile_store_save(uint16_t idx, const profile_t * profile) {
+    if (idx > host_profile_cnt || idx >= PROFILE_STORE_MAX_CNT) {
+        return false;
+    }
+
+    if (idx == host_profile_cnt) {
+        host_profiles[idx] = malloc(sizeof(profile_t));
+        if (!host_profiles[idx]) {
+            return false;
+        }
+        host_profile_cnt += 1;
+    }
+
+    memcpy(host_profiles[idx], profile, sizeof(profile_t));
+    return true;
+}
+
+
+// The checksum of the TMC datagrams (motors.c), only used for the profile checksum here
+void swuart_calcCRC(uint8_t * datagram, uint8_t datagramLength) {
+}
+
+
+void rest_register_config_module(const char * name, rest_handler_t f) {
+}
+
+
+void rest_register_metrics(rest_metrics_formatter_t f) {
+}
+
+
+bool rest_apply_params(const rest_param_t * table, size_t table_size, int num_params, char *params[], char *values[]) {
+    return false;
+}
+
+
+void * rest_response_alloc(size_t size) {
+    return NULL;
+}
+
+
+bool rest_response_unavailable(struct fs_file *file) {
+    return false;
+}
+
+
+bool rest_response_stream(struct fs_file *file, const char * content_type, size_t body_len,
+                          rest_stream_read_t read, void * state) {
+    return false;
+}
+
+
+ButtonEncoderEvent_t button_wait_for_input(bool block) {
+    return BUTTON_NO_EVENT;
+}
+
+
+void display_set_scene(display_scene_render_t scene) {
+}
+
+
+void display_request_render(void) {
+}
+
+
+void neopixel_led_set_colour(rgbw_u32_t mini12864_backlight_colour, rgbw_u32_t led1_colour, rgbw_u32_t led2_colour,
+                             bool block_wait) {
+}
+
+
+void neopixel_led_blink(rgbw_u32_t mini12864_backlight_colour, rgbw_u32_t led1_colour, rgbw_u32_t led2_colour,
+                        uint16_t period_ms) {
+}
+
+
+void neopixel_led_set_progress(float ratio) {
+}
+
+
+void servo_gate_set_ratio(float ratio, bool block_wait) {
+    servo_gate.gate_ratio = ratio;
+}
+
+
+void event_stream_register_topic(event_stream_topic_t topic, const char * path, event_stream_producer_t producer) {
+}
+
+
+void event_stream_notify(event_stream_topic_t topic) {
+}
+
+
+void telemetry_publisher_notify(void) {
+}
+
+
+void wireless_set_charging(bool charging) {
+}
+
+
+void charge_history_append(float target_weight, float final_weight, float predicted_weight, float charge_time_s,
+                           uint8_t profile_idx, uint8_t flags) {
+}
+
+
+bool charge_batch_init(void) {
+    return true;
+}
+
+
+void charge_batch_start(uint32_t size) {
+}
+
+
+bool charge_batch_add(float final_weight, float charge_time_s, bool over_charged, bool under_charged) {
+    return false;
+}
+
+
+void charge_batch_get_summary(charge_batch_summary_t * summary) {
+    memset(summary, 0x0, sizeof(charge_batch_summary_t));
+}
+
+
+void pid_autotune_stop(void) {
+}
+
+
+void pid_autotune_charge_complete(float elapsed_seconds, float charge_error, float fine_stop_threshold) {
+}
@@ -0,0 +1,402 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <semphr.h>
+
+#include "pico/time.h"
+#include "host_kernel.h"
+
+/*
+    Kernel of the host build. There is one thread of execution, the task that runs the code under test: the tasks
+    created by the sources are recorded but never run. Time is virtual, it only moves while the running task blocks
+    (a delay, a notification or queue wait, busy_wait_us) and it moves in ticks of 1 ms. The hook runs on every tick,
+    it stands for the rest of the system (the scale, the motors) and is what may unblock the running task.
+*/
+#define HOST_KERNEL_NOTIFY_INDEX_CNT    2
+
+struct host_task {
+    TaskFunction_t function;
+    const char * name;
+    uint32_t notify_value[HOST_KERNEL_NOTIFY_INDEX_CNT];
+    volatile bool delay_aborted;
+};
+
+struct host_queue {
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t * storage;
+};
+
+static struct host_task host_running_task = {.name = "host"};
+static uint64_t host_time_us = 0;
+static host_kernel_tick_hook_t host_tick_hook = NULL;
+
+
+void host_kernel_set_tick_hook(host_kernel_tick_hook_t hook) {
+    host_tick_hook = hook;
+}
+
+
+// Moves the clock on by us, running the hook on every tick boundary crossed
+static void _host_kernel_advance_us(uint64_t us) {
+    uint64_t end_us = host_time_us + us;
+
+    while (true) {
+        uint64_t next_tick_us = (host_time_us / 1000 + 1) * 1000;
+        if (next_tick_us > end_us) {
+            break;
+        }
+
+        host_time_us = next_tick_us;
+        if (host_tick_hook) {
+            host_tick_hook();
+        }
+    }
+
+    host_time_us = end_us;
+}
+
+
+// Blocks the running task until the condition holds, the timeout expires or the delay is aborted
+static bool _host_kernel_block(bool (*condition)(void * arg), void * arg, TickType_t ticks_to_wait) {
+    TickType_t waited = 0;
+
+    while (!condition(arg)) {
+        if (host_running_task.delay_aborted || (ticks_to_wait != portMAX_DELAY && waited >= ticks_to_wait)) {
+            host_running_task.delay_aborted = false;
+            return false;
+        }
+
+        _host_kernel_advance_us(1000);
+        waited += 1;
+    }
+
+    return true;
+}
+
+
+uint64_t time_us_64(void) {
+    return host_time_us;
+}
+
+
+uint32_t time_us_32(void) {
+    return (uint32_t) host_time_us;
+}
+
+
+void busy_wait_us(uint64_t us) {
+    _host_kernel_advance_us(us);
+}
+
+
+void sleep_ms(uint32_t ms) {
+    _host_kernel_advance_us((uint64_t) ms * 1000);
+}
+
+
+void * pvPortMalloc(size_t size) {
+    return malloc(size);
+}
+
+
+void vPortFree(void * ptr) {
+    free(ptr);
+}
+
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char * name, uint32_t stack_depth, void * parameters,
+                       UBaseType_t priority, TaskHandle_t * created_task) {
+    struct host_task * task = calloc(1, sizeof(struct host_task));
+    if (!task) {
+        return pdFAIL;
+    }
+
+    task->function = function;
+    task->name = name;
+    if (created_task) {
+        *created_task = task;
+    }
+
+    return pdPASS;
+}
+
+
+BaseType_t xTaskCreateAffinitySet(TaskFunction_t function, const char * name, uint32_t stack_depth, void * parameters,
+                                  UBaseType_t priority, UBaseType_t affinity, TaskHandle_t * created_task) {
+    return xTaskCreate(function, name, stack_depth, parameters, priority, created_task);
+}
+
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task && task != &host_running_task) {
+        free(task);
+    }
+}
+
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return &host_running_task;
+}
+
+
+BaseType_t xTaskGetSchedulerState(void) {
+    return taskSCHEDULER_RUNNING;
+}
+
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t) (host_time_us / 1000);
+}
+
+
+void vTaskDelay(TickType_t ticks) {
+    _host_kernel_advance_us((uint64_t) ticks * 1000);
+}
+
+
+void vTaskDelayUntil(TickType_t * previous_wake_tick, TickType_t increment) {
+    TickType_t wake_tick = *previous_wake_tick + increment;
+    TickType_t now = xTaskGetTickCount();
+
+    if ((int32_t) (wake_tick - now) > 0) {
+        vTaskDelay(wake_tick - now);
+    }
+    *previous_wake_tick = wake_tick;
+}
+
+
+BaseType_t xTaskAbortDelay(TaskHandle_t task) {
+    task->delay_aborted = true;
+    return pdPASS;
+}
+
+
+void vTaskSetTimeOutState(TimeOut_t * timeout) {
+    timeout->entry_tick = xTaskGetTickCount();
+}
+
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t * timeout, TickType_t * ticks_to_wait) {
+    if (*ticks_to_wait == portMAX_DELAY) {
+        return pdFALSE;
+    }
+
+    TickType_t elapsed = xTaskGetTickCount() - timeout->entry_tick;
+    if (elapsed >= *ticks_to_wait) {
+        *ticks_to_wait = 0;
+        return pdTRUE;
+    }
+
+    *ticks_to_wait -= elapsed;
+    vTaskSetTimeOutState(timeout);
+    return pdFALSE;
+}
+
+
+BaseType_t xTaskNotifyGiveIndexed(TaskHandle_t task, UBaseType_t index) {
+    task->notify_value[index] += 1;
+    return pdPASS;
+}
+
+
+void vTaskNotifyGiveIndexedFromISR(TaskHandle_t task, UBaseType_t index, BaseType_t * higher_priority_task_woken) {
+    xTaskNotifyGiveIndexed(task, index);
+    if (higher_priority_task_woken) {
+        *higher_priority_task_woken = pdFALSE;
+    }
+}
+
+
+static bool _host_kernel_notified(void * arg) {
+    return host_running_task.notify_value[(UBaseType_t) arg] != 0;
+}
+
+
+uint32_t ulTaskNotifyTakeIndexed(UBaseType_t index, BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    if (!_host_kernel_block(_host_kernel_notified, (void *) index, ticks_to_wait)) {
+        return 0;
+    }
+
+    uint32_t value = host_running_task.notify_value[index];
+    host_running_task.notify_value[index] = clear_on_exit ? 0 : value - 1;
+
+    return value;
+}
+
+
+BaseType_t xTaskNotifyStateClearIndexed(TaskHandle_t task, UBaseType_t index) {
+    (void) task;
+    (void) index;
+
+    // Pending state and value are one here, the value is left as the kernel does
+    return pdTRUE;
+}
+
+
+BaseType_t xTaskNotifyIndexed(TaskHandle_t task, UBaseType_t index, uint32_t value, int action) {
+    switch (action) {
+        case eSetBits:
+            task->notify_value[index] |= value;
+            break;
+        case eIncrement:
+            task->notify_value[index] += 1;
+            break;
+        case eSetValueWithOverwrite:
+            task->notify_value[index] = value;
+            break;
+        default:
+            break;
+    }
+
+    return pdPASS;
+}
+
+
+BaseType_t xTaskNotifyWaitIndexed(UBaseType_t index, uint32_t clear_on_entry, uint32_t clear_on_exit,
+                                  uint32_t * value, TickType_t ticks_to_wait) {
+    host_running_task.notify_value[index] &= ~clear_on_entry;
+
+    bool notified = _host_kernel_block(_host_kernel_notified, (void *) index, ticks_to_wait);
+    if (value) {
+        *value = host_running_task.notify_value[index];
+    }
+    host_running_task.notify_value[index] &= ~clear_on_exit;
+
+    return notified ? pdTRUE : pdFALSE;
+}
+
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct host_queue * queue = calloc(1, sizeof(struct host_queue));
+    if (!queue) {
+        return NULL;
+    }
+
+    queue->length = length;
+    queue->item_size = item_size;
+    if (item_size) {
+        queue->storage = calloc(length, item_size);
+        if (!queue->storage) {
+            free(queue);
+            return NULL;
+        }
+    }
+
+    return queue;
+}
+
+
+static bool _host_queue_has_space(void * arg) {
+    struct host_queue * queue = arg;
+    return queue->count < queue->length;
+}
+
+
+static bool _host_queue_has_item(void * arg) {
+    struct host_queue * queue = arg;
+    return queue->count > 0;
+}
+
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void * item, TickType_t ticks_to_wait) {
+    if (!_host_kernel_block(_host_queue_has_space, queue, ticks_to_wait)) {
+        return pdFALSE;
+    }
+
+    if (queue->item_size) {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->storage + tail * queue->item_size, item, queue->item_size);
+    }
+    queue->count += 1;
+
+    return pdTRUE;
+}
+
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void * item) {
+    xQueueReset(queue);
+    return xQueueSend(queue, item, 0);
+}
+
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void * item, TickType_t ticks_to_wait) {
+    if (!_host_kernel_block(_host_queue_has_item, queue, ticks_to_wait)) {
+        return pdFALSE;
+    }
+
+    if (queue->item_size) {
+        memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+    }
+
+    return pdTRUE;
+}
+
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void * item, TickType_t ticks_to_wait) {
+    if (!xQueuePeek(queue, item, ticks_to_wait)) {
+        return pdFALSE;
+    }
+
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count -= 1;
+
+    return pdTRUE;
+}
+
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    return queue->count;
+}
+
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    queue->head = 0;
+    queue->count = 0;
+
+    return pdPASS;
+}
+
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xQueueCreate(1, 0);
+}
+
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+    if (mutex) {
+        xSemaphoreGive(mutex);
+    }
+
+    return mutex;
+}
+
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void) {
+    return xSemaphoreCreateMutex();
+}
+
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
+    return xQueueReceive(semaphore, NULL, ticks_to_wait);
+}
+
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return xQueueSend(semaphore, NULL, 0);
+}
+
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t * higher_priority_task_woken) {
+    if (higher_priority_task_woken) {
+        *higher_priority_task_woken = pdFALSE;
+    }
+
+    return xSemaphoreGive(semaphore);
+}
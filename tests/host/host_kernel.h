@@ -0,0 +1,19 @@
+#ifndef HOST_KERNEL_H_
+#define HOST_KERNEL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*host_kernel_tick_hook_t)(void);
+
+/**
+ * Sets the function run on every tick (1 ms) of the virtual clock, see host_kernel.c.
+ */
+void host_kernel_set_tick_hook(host_kernel_tick_hook_t hook);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_KERNEL_H_
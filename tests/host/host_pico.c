@@ -0,0 +1,130 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "hardware/uart.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include <u8g2.h>
+
+/*
+    Peripherals of the host build: the UARTs with their RX interrupt, the interrupt handlers and what the display code
+    links against.
+*/
+#define HOST_UART_CNT       2
+#define HOST_IRQ_CNT        32
+
+typedef struct {
+    uart_hw_t hw;
+    bool rx_pending;
+    char rx_char;
+} host_uart_t;
+
+static host_uart_t host_uarts[HOST_UART_CNT];
+static irq_handler_t host_irq_handlers[HOST_IRQ_CNT];
+static bool host_irq_enabled[HOST_IRQ_CNT];
+static void (*host_uart_tx_sink)(uart_inst_t * uart, const uint8_t * data, size_t len) = NULL;
+
+pio_hw_t host_pio_hw[3];
+
+const uint8_t u8g2_font_helvB08_tr[] = {0};
+const uint8_t u8g2_font_helvR08_tr[] = {0};
+const uint8_t u8g2_font_profont11_tf[] = {0};
+const uint8_t u8g2_font_profont22_tf[] = {0};
+
+
+static host_uart_t * _host_uart(uart_inst_t * uart) {
+    return &host_uarts[uart_get_index(uart)];
+}
+
+
+unsigned int uart_get_index(uart_inst_t * uart) {
+    return uart == uart0 ? 0 : 1;
+}
+
+
+unsigned int uart_init(uart_inst_t * uart, unsigned int baudrate) {
+    return baudrate;
+}
+
+
+unsigned int uart_set_baudrate(uart_inst_t * uart, unsigned int baudrate) {
+    return baudrate;
+}
+
+
+void uart_set_format(uart_inst_t * uart, unsigned int data_bits, unsigned int stop_bits, uart_parity_t parity) {
+}
+
+
+void uart_set_fifo_enabled(uart_inst_t * uart, bool enabled) {
+}
+
+
+void uart_set_irq_enables(uart_inst_t * uart, bool rx_has_data, bool tx_needs_data) {
+}
+
+
+// The received byte moves to the data register once seen, as the next read of dr is the one that takes it
+bool uart_is_readable(uart_inst_t * uart) {
+    host_uart_t * host_uart = _host_uart(uart);
+    if (!host_uart->rx_pending) {
+        return false;
+    }
+
+    host_uart->hw.dr = (uint8_t) host_uart->rx_char;
+    host_uart->rx_pending = false;
+
+    return true;
+}
+
+
+uart_hw_t * uart_get_hw(uart_inst_t * uart) {
+    return &_host_uart(uart)->hw;
+}
+
+
+void uart_write_blocking(uart_inst_t * uart, const uint8_t * src, size_t len) {
+    if (host_uart_tx_sink) {
+        host_uart_tx_sink(uart, src, len);
+    }
+}
+
+
+void uart_tx_wait_blocking(uart_inst_t * uart) {
+}
+
+
+void host_uart_receive(uart_inst_t * uart, const char * data, size_t len) {
+    unsigned int irq_num = uart_get_index(uart) == 0 ? UART0_IRQ : UART1_IRQ;
+
+    for (size_t idx = 0; idx < len; idx += 1) {
+        host_uart_t * host_uart = _host_uart(uart);
+        host_uart->rx_char = data[idx];
+        host_uart->rx_pending = true;
+
+        host_irq_raise(irq_num);
+    }
+}
+
+
+void host_uart_set_tx_sink(void (*sink)(uart_inst_t * uart, const uint8_t * data, size_t len)) {
+    host_uart_tx_sink = sink;
+}
+
+
+void irq_set_exclusive_handler(unsigned int num, irq_handler_t handler) {
+    host_irq_handlers[num] = handler;
+}
+
+
+void irq_set_enabled(unsigned int num, bool enabled) {
+    host_irq_enabled[num] = enabled;
+}
+
+
+void host_irq_raise(unsigned int num) {
+    if (host_irq_enabled[num] && host_irq_handlers[num]) {
+        host_irq_handlers[num]();
+    }
+}
@@ -0,0 +1,7 @@
+/*
+    The A&D FXi driver built with its frame descriptor reachable, used by charge_sim.cpp to decode the frames of the
+    simulated scale as the driver does. Built instead of src/and_scale.c.
+*/
+#include "and_scale.c"
+
+const scale_frame_descriptor_t * sim_and_fxi_frame_descriptor = &and_fxi_frame_descriptor;
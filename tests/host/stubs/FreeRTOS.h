@@ -0,0 +1,64 @@
+#ifndef HOST_FREERTOS_H_
+#define HOST_FREERTOS_H_
+
+/*
+    FreeRTOS API of the host build (tests/host). One thread of execution on a virtual clock, see host_kernel.c: a
+    blocking call advances the clock (and runs the simulation hooked to it) instead of switching tasks.
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>      // Pulled in by the SDK headers on the target
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t StackType_t;
+typedef void (*TaskFunction_t)(void *);
+
+typedef struct host_task * TaskHandle_t;
+typedef struct host_queue * QueueHandle_t;
+typedef struct host_queue * SemaphoreHandle_t;
+typedef struct host_event_group * EventGroupHandle_t;
+
+typedef struct {
+    TickType_t entry_tick;
+} TimeOut_t;
+
+#define pdFALSE                     ((BaseType_t) 0)
+#define pdTRUE                      ((BaseType_t) 1)
+#define pdPASS                      pdTRUE
+#define pdFAIL                      pdFALSE
+#define portMAX_DELAY               ((TickType_t) 0xffffffffUL)
+#define configTICK_RATE_HZ          1000
+#define portTICK_PERIOD_MS          ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)           ((TickType_t) (((uint64_t) (ms) * configTICK_RATE_HZ) / 1000U))
+#define configMINIMAL_STACK_SIZE    256
+#define configMAX_PRIORITIES        32
+#define tskNO_AFFINITY              ((UBaseType_t) -1)
+#define CONTROL_CORE_AFFINITY_MASK  tskNO_AFFINITY
+#define NETWORK_CORE_AFFINITY_MASK  tskNO_AFFINITY
+
+#define taskSCHEDULER_NOT_STARTED   ((BaseType_t) 1)
+#define taskSCHEDULER_RUNNING       ((BaseType_t) 2)
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define taskENTER_CRITICAL_FROM_ISR()   0
+#define taskEXIT_CRITICAL_FROM_ISR(x)   ((void) (x))
+#define portYIELD_FROM_ISR(x)       ((void) (x))
+#define configASSERT(x)             ((void) 0)
+
+void * pvPortMalloc(size_t size);
+void vPortFree(void * ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_FREERTOS_H_
@@ -0,0 +1,16 @@
+#ifndef HOST_HARDWARE_CLOCKS_H_
+#define HOST_HARDWARE_CLOCKS_H_
+
+#include <stdint.h>
+
+enum clock_index {
+    clk_sys = 5,
+};
+
+// Nominal RP2040 system clock, for the code that derives periods from it
+static inline uint32_t clock_get_hz(enum clock_index clk_index) {
+    (void) clk_index;
+    return 125000000;
+}
+
+#endif  // HOST_HARDWARE_CLOCKS_H_
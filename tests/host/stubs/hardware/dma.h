@@ -0,0 +1,95 @@
+#ifndef HOST_HARDWARE_DMA_H_
+#define HOST_HARDWARE_DMA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// No DMA on the host: no channel can be claimed, the callers take their software paths
+typedef struct {
+    uint32_t ctrl;
+} dma_channel_config;
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2,
+};
+
+#define DMA_SNIFF_CTRL_CALC_VALUE_CRC32R    1
+
+static inline int dma_claim_unused_channel(bool required) {
+    (void) required;
+    return -1;
+}
+
+static inline dma_channel_config dma_channel_get_default_config(unsigned int channel) {
+    (void) channel;
+    dma_channel_config config = {0};
+    return config;
+}
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config * c, enum dma_channel_transfer_size size) {
+    (void) c;
+    (void) size;
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config * c, bool incr) {
+    (void) c;
+    (void) incr;
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config * c, bool incr) {
+    (void) c;
+    (void) incr;
+}
+
+static inline void channel_config_set_sniff_enable(dma_channel_config * c, bool sniff_enable) {
+    (void) c;
+    (void) sniff_enable;
+}
+
+static inline void channel_config_set_dreq(dma_channel_config * c, unsigned int dreq) {
+    (void) c;
+    (void) dreq;
+}
+
+static inline void dma_channel_configure(unsigned int channel, const dma_channel_config * config, volatile void * write_addr,
+                                         const volatile void * read_addr, uint32_t transfer_count, bool trigger) {
+    (void) channel;
+    (void) config;
+    (void) write_addr;
+    (void) read_addr;
+    (void) transfer_count;
+    (void) trigger;
+}
+
+static inline void dma_channel_wait_for_finish_blocking(unsigned int channel) {
+    (void) channel;
+}
+
+static inline void dma_sniffer_enable(unsigned int channel, unsigned int mode, bool force_channel_enable) {
+    (void) channel;
+    (void) mode;
+    (void) force_channel_enable;
+}
+
+static inline void dma_sniffer_set_output_reverse_enabled(bool enable) {
+    (void) enable;
+}
+
+static inline void dma_sniffer_set_output_invert_enabled(bool enable) {
+    (void) enable;
+}
+
+static inline void dma_sniffer_set_data_accumulator(uint32_t seed_value) {
+    (void) seed_value;
+}
+
+static inline uint32_t dma_sniffer_get_data_accumulator(void) {
+    return 0;
+}
+
+static inline void dma_sniffer_disable(void) {
+}
+
+#endif  // HOST_HARDWARE_DMA_H_
@@ -0,0 +1,42 @@
+#ifndef HOST_HARDWARE_GPIO_H_
+#define HOST_HARDWARE_GPIO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define GPIO_OUT                1
+#define GPIO_IN                 0
+
+enum gpio_function {
+    GPIO_FUNC_SPI = 1,
+    GPIO_FUNC_UART = 2,
+    GPIO_FUNC_I2C = 3,
+    GPIO_FUNC_PWM = 4,
+    GPIO_FUNC_SIO = 5,
+};
+
+static inline void gpio_set_function(unsigned int gpio, enum gpio_function fn) {
+    (void) gpio;
+    (void) fn;
+}
+
+static inline void gpio_init(unsigned int gpio) {
+    (void) gpio;
+}
+
+static inline void gpio_set_dir(unsigned int gpio, bool out) {
+    (void) gpio;
+    (void) out;
+}
+
+static inline void gpio_put(unsigned int gpio, bool value) {
+    (void) gpio;
+    (void) value;
+}
+
+static inline bool gpio_get(unsigned int gpio) {
+    (void) gpio;
+    return false;
+}
+
+#endif  // HOST_HARDWARE_GPIO_H_
@@ -0,0 +1,9 @@
+#ifndef HOST_HARDWARE_I2C_H_
+#define HOST_HARDWARE_I2C_H_
+
+typedef struct i2c_inst i2c_inst_t;
+
+#define i2c0        ((i2c_inst_t *) 0x1)
+#define i2c1        ((i2c_inst_t *) 0x2)
+
+#endif  // HOST_HARDWARE_I2C_H_
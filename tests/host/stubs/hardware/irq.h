@@ -0,0 +1,24 @@
+#ifndef HOST_HARDWARE_IRQ_H_
+#define HOST_HARDWARE_IRQ_H_
+
+#include <stdbool.h>
+
+#define UART0_IRQ       20
+#define UART1_IRQ       21
+
+typedef void (*irq_handler_t)(void);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The handlers are kept by host_pico.c, host_irq_raise() runs one
+void irq_set_exclusive_handler(unsigned int num, irq_handler_t handler);
+void irq_set_enabled(unsigned int num, bool enabled);
+void host_irq_raise(unsigned int num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_HARDWARE_IRQ_H_
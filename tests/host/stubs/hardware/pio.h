@@ -0,0 +1,19 @@
+#ifndef HOST_HARDWARE_PIO_H_
+#define HOST_HARDWARE_PIO_H_
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t rxf[4];
+    uint32_t txf[4];
+} pio_hw_t;
+
+typedef pio_hw_t * PIO;
+
+extern pio_hw_t host_pio_hw[3];
+
+#define pio0        (&host_pio_hw[0])
+#define pio1        (&host_pio_hw[1])
+#define pio2        (&host_pio_hw[2])
+
+#endif  // HOST_HARDWARE_PIO_H_
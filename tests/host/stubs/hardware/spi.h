@@ -0,0 +1,9 @@
+#ifndef HOST_HARDWARE_SPI_H_
+#define HOST_HARDWARE_SPI_H_
+
+typedef struct spi_inst spi_inst_t;
+
+#define spi0        ((spi_inst_t *) 0x1)
+#define spi1        ((spi_inst_t *) 0x2)
+
+#endif  // HOST_HARDWARE_SPI_H_
@@ -0,0 +1,42 @@
+#ifndef HOST_HARDWARE_SYNC_H_
+#define HOST_HARDWARE_SYNC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/platform.h"
+
+typedef volatile uint32_t spin_lock_t;
+
+static inline void __dmb(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t save_and_disable_interrupts(void) {
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status) {
+    (void) status;
+}
+
+static inline spin_lock_t * spin_lock_init(unsigned int lock_num) {
+    static spin_lock_t locks[32];
+    return &locks[lock_num & 31];
+}
+
+static inline int spin_lock_claim_unused(bool required) {
+    (void) required;
+    return 0;
+}
+
+static inline uint32_t spin_lock_blocking(spin_lock_t * lock) {
+    (void) lock;
+    return 0;
+}
+
+static inline void spin_unlock(spin_lock_t * lock, uint32_t saved_irq) {
+    (void) lock;
+    (void) saved_irq;
+}
+
+#endif  // HOST_HARDWARE_SYNC_H_
@@ -0,0 +1,51 @@
+#ifndef HOST_HARDWARE_UART_H_
+#define HOST_HARDWARE_UART_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "hardware/gpio.h"
+
+/*
+    UART of the host build. The receive side holds the byte host_uart_receive is delivering, the transmit side is
+    handed to the sink set by host_uart_set_tx_sink (e.g. the scale commands of the simulation).
+*/
+typedef struct {
+    uint32_t dr;
+} uart_hw_t;
+
+typedef struct uart_inst uart_inst_t;
+
+typedef enum {
+    UART_PARITY_NONE,
+    UART_PARITY_EVEN,
+    UART_PARITY_ODD,
+} uart_parity_t;
+
+#define uart0       ((uart_inst_t *) 0x1)
+#define uart1       ((uart_inst_t *) 0x2)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned int uart_init(uart_inst_t * uart, unsigned int baudrate);
+unsigned int uart_set_baudrate(uart_inst_t * uart, unsigned int baudrate);
+void uart_set_format(uart_inst_t * uart, unsigned int data_bits, unsigned int stop_bits, uart_parity_t parity);
+void uart_set_fifo_enabled(uart_inst_t * uart, bool enabled);
+void uart_set_irq_enables(uart_inst_t * uart, bool rx_has_data, bool tx_needs_data);
+bool uart_is_readable(uart_inst_t * uart);
+uart_hw_t * uart_get_hw(uart_inst_t * uart);
+unsigned int uart_get_index(uart_inst_t * uart);
+void uart_write_blocking(uart_inst_t * uart, const uint8_t * src, size_t len);
+void uart_tx_wait_blocking(uart_inst_t * uart);
+
+// Delivers bytes to the RX interrupt of uart one by one, as the hardware without FIFO does
+void host_uart_receive(uart_inst_t * uart, const char * data, size_t len);
+void host_uart_set_tx_sink(void (*sink)(uart_inst_t * uart, const uint8_t * data, size_t len));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_HARDWARE_UART_H_
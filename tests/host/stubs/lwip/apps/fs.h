@@ -0,0 +1,16 @@
+#ifndef HOST_LWIP_APPS_FS_H_
+#define HOST_LWIP_APPS_FS_H_
+
+// The fs_file of the lwIP httpd, as far as the REST handlers use it
+#define FS_FILE_FLAGS_HEADER_INCLUDED     0x01
+#define FS_FILE_FLAGS_HEADER_PERSISTENT   0x02
+
+struct fs_file {
+    const char * data;
+    int len;
+    int index;
+    void * pextension;
+    unsigned char flags;
+};
+
+#endif  // HOST_LWIP_APPS_FS_H_
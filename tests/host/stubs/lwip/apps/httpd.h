@@ -0,0 +1,10 @@
+#ifndef HOST_LWIP_APPS_HTTPD_H_
+#define HOST_LWIP_APPS_HTTPD_H_
+
+#include <stdbool.h>
+#include "lwip/apps/fs.h"
+
+#define LWIP_HTTPD_DYNAMIC_HEADERS          0
+#define LWIP_HTTPD_MAX_REQUEST_URI_LEN      128
+
+#endif  // HOST_LWIP_APPS_HTTPD_H_
@@ -0,0 +1,14 @@
+#ifndef HOST_LWIP_DEBUG_H_
+#define HOST_LWIP_DEBUG_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LWIP_ASSERT(message, assertion) do {                                \
+    if (!(assertion)) {                                                     \
+        fprintf(stderr, "Assertion \"%s\" failed at %s:%d\n", message, __FILE__, __LINE__);    \
+        abort();                                                            \
+    }                                                                       \
+} while (0)
+
+#endif  // HOST_LWIP_DEBUG_H_
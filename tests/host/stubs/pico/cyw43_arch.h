@@ -0,0 +1,6 @@
+#ifndef HOST_PICO_CYW43_ARCH_H_
+#define HOST_PICO_CYW43_ARCH_H_
+
+#define CYW43_WL_GPIO_LED_PIN   0
+
+#endif  // HOST_PICO_CYW43_ARCH_H_
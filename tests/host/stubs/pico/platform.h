@@ -0,0 +1,28 @@
+#ifndef HOST_PICO_PLATFORM_H_
+#define HOST_PICO_PLATFORM_H_
+
+#include <stdint.h>
+
+#define __time_critical_func(name)      name
+#define __not_in_flash_func(name)       name
+#define __not_in_flash(group)
+#define __no_inline_not_in_flash_func(name) name
+#define __unused                        __attribute__((unused))
+
+#define NUM_CORES                       2
+
+#ifndef MIN
+#define MIN(a, b)                       ((b) > (a) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b)                       ((a) > (b) ? (a) : (b))
+#endif
+
+static inline unsigned int get_core_num(void) {
+    return 0;
+}
+
+static inline void tight_loop_contents(void) {
+}
+
+#endif  // HOST_PICO_PLATFORM_H_
@@ -0,0 +1,9 @@
+#ifndef HOST_PICO_STDLIB_H_
+#define HOST_PICO_STDLIB_H_
+
+#include "pico/platform.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+#include "hardware/uart.h"
+
+#endif  // HOST_PICO_STDLIB_H_
@@ -0,0 +1,32 @@
+#ifndef HOST_PICO_TIME_H_
+#define HOST_PICO_TIME_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Virtual clock of host_kernel.c
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+void busy_wait_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+// Not run on the host, only declared for the structs that hold one
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t * rt);
+
+struct repeating_timer {
+    int64_t delay_us;
+    repeating_timer_callback_t callback;
+    void * user_data;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_PICO_TIME_H_
@@ -0,0 +1,10 @@
+#ifndef HOST_PICO_TYPES_H_
+#define HOST_PICO_TYPES_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+
+#endif  // HOST_PICO_TYPES_H_
@@ -0,0 +1,24 @@
+#ifndef HOST_QUEUE_H_
+#define HOST_QUEUE_H_
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void * item, TickType_t ticks_to_wait);
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void * item);
+BaseType_t xQueueReceive(QueueHandle_t queue, void * item, TickType_t ticks_to_wait);
+BaseType_t xQueuePeek(QueueHandle_t queue, void * item, TickType_t ticks_to_wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+BaseType_t xQueueReset(QueueHandle_t queue);
+
+#define xQueueSendToBack(queue, item, ticks)    xQueueSend(queue, item, ticks)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_QUEUE_H_
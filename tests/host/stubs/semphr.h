@@ -0,0 +1,24 @@
+#ifndef HOST_SEMPHR_H_
+#define HOST_SEMPHR_H_
+
+#include "queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t * higher_priority_task_woken);
+
+#define xSemaphoreTakeRecursive(semaphore, ticks)   xSemaphoreTake(semaphore, ticks)
+#define xSemaphoreGiveRecursive(semaphore)          xSemaphoreGive(semaphore)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_SEMPHR_H_
@@ -0,0 +1,52 @@
+#ifndef HOST_TASK_H_
+#define HOST_TASK_H_
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char * name, uint32_t stack_depth, void * parameters,
+                       UBaseType_t priority, TaskHandle_t * created_task);
+BaseType_t xTaskCreateAffinitySet(TaskFunction_t function, const char * name, uint32_t stack_depth, void * parameters,
+                                  UBaseType_t priority, UBaseType_t affinity, TaskHandle_t * created_task);
+void vTaskDelete(TaskHandle_t task);
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskGetSchedulerState(void);
+TickType_t xTaskGetTickCount(void);
+
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t * previous_wake_tick, TickType_t increment);
+BaseType_t xTaskAbortDelay(TaskHandle_t task);
+
+void vTaskSetTimeOutState(TimeOut_t * timeout);
+BaseType_t xTaskCheckForTimeOut(TimeOut_t * timeout, TickType_t * ticks_to_wait);
+
+// Notifications, one slot per index of every task
+BaseType_t xTaskNotifyGiveIndexed(TaskHandle_t task, UBaseType_t index);
+uint32_t ulTaskNotifyTakeIndexed(UBaseType_t index, BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+BaseType_t xTaskNotifyStateClearIndexed(TaskHandle_t task, UBaseType_t index);
+BaseType_t xTaskNotifyIndexed(TaskHandle_t task, UBaseType_t index, uint32_t value, int action);
+BaseType_t xTaskNotifyWaitIndexed(UBaseType_t index, uint32_t clear_on_entry, uint32_t clear_on_exit,
+                                  uint32_t * value, TickType_t ticks_to_wait);
+void vTaskNotifyGiveIndexedFromISR(TaskHandle_t task, UBaseType_t index, BaseType_t * higher_priority_task_woken);
+
+#define eNoAction                   0
+#define eSetBits                    1
+#define eIncrement                  2
+#define eSetValueWithOverwrite      3
+
+#define xTaskNotifyGive(task)                           xTaskNotifyGiveIndexed(task, 0)
+#define ulTaskNotifyTake(clear, ticks)                  ulTaskNotifyTakeIndexed(0, clear, ticks)
+#define xTaskNotifyStateClear(task)                     xTaskNotifyStateClearIndexed(task, 0)
+#define xTaskNotify(task, value, action)                xTaskNotifyIndexed(task, 0, value, action)
+#define xTaskNotifyWait(entry, exit, value, ticks)      xTaskNotifyWaitIndexed(0, entry, exit, value, ticks)
+#define vTaskNotifyGiveFromISR(task, woken)             vTaskNotifyGiveIndexedFromISR(task, 0, woken)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_TASK_H_
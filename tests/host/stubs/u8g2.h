@@ -0,0 +1,57 @@
+#ifndef HOST_U8G2_H_
+#define HOST_U8G2_H_
+
+#include <stdint.h>
+
+// No display on the host, the scenes draw into nothing
+typedef struct {
+    uint8_t unused;
+} u8g2_t;
+
+typedef uint8_t u8g2_uint_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const uint8_t u8g2_font_helvB08_tr[];
+extern const uint8_t u8g2_font_helvR08_tr[];
+extern const uint8_t u8g2_font_profont11_tf[];
+extern const uint8_t u8g2_font_profont22_tf[];
+
+static inline void u8g2_SetFont(u8g2_t * u8g2, const uint8_t * font) {
+    (void) u8g2;
+    (void) font;
+}
+
+static inline u8g2_uint_t u8g2_DrawStr(u8g2_t * u8g2, u8g2_uint_t x, u8g2_uint_t y, const char * str) {
+    (void) u8g2;
+    (void) x;
+    (void) y;
+    (void) str;
+    return 0;
+}
+
+static inline u8g2_uint_t u8g2_GetStrWidth(u8g2_t * u8g2, const char * str) {
+    (void) u8g2;
+    (void) str;
+    return 0;
+}
+
+static inline u8g2_uint_t u8g2_GetDisplayWidth(u8g2_t * u8g2) {
+    (void) u8g2;
+    return 128;
+}
+
+static inline void u8g2_DrawHLine(u8g2_t * u8g2, u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w) {
+    (void) u8g2;
+    (void) x;
+    (void) y;
+    (void) w;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_U8G2_H_
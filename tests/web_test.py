@@ -10,7 +10,9 @@ Dependencies from pip:
 """
 
 import json
-from flask import Flask, send_from_directory
+import struct
+import zlib
+from flask import Flask, request, send_from_directory
 import os
 
 
@@ -55,7 +57,22 @@ def rest_charge_mode_status():
             "s1": current_weight,
             "s2": state,
             "s3": event,
-            "s4": "AR2208"}
+            "s4": "AR2208",
+            "s6": current_charge_weight_set_point,
+            "s7": 0.0,
+            "s8": 0.0,
+            "s9": 0.0,
+            "s10": 0,
+            "s11": 100000,
+            "s12": 1200,
+            "s13": 2500,
+            "s14": 0,
+            "s15": 0,
+            "s16": 800,
+            "s17": 900,
+            "s18": 0,
+            "s19": 0.0,
+            "s20": 0}
 
 
 @app.route("/rest/scale_action")
@@ -70,37 +87,43 @@ def rest_profile_summary():
 
 @app.route('/rest/scale_config')
 def rest_scale_config():
-    return {"s0":0,"s1":2}
+    return {"s0":0,"s1":2,"s2":0,"s3":10.0,"s4":5.0,"s5":False,
+            "s6":False,"s7":0.5,"s8":False,"s9":0.02,"s10":2.0,"s12":0}
+
+
+@app.route('/rest/custom_scale_config')
+def rest_custom_scale_config():
+    return {"q0":0,"q1":0,"q2":0,"q3":"","q4":-1,"q5":0,"q6":0,"q7":0,"q8":0,"q9":"","q10":100,"q11":"","q12":True}
 
 
 @app.route('/rest/profile_config')
 def rest_profile_config():
-    return {"pf":1,"p0":0,"p1":0,"p2":"AR2209,gr","p3":0.025,"p4":0.000,"p5":0.300,"p6":0.100,"p7":5.000,"p8":2.000,"p9":0.000,"p10":10.000,"p11":0.080,"p12":5.000}
+    return {"pf":1,"p0":0,"p1":0,"p2":"AR2209,gr","p3":0.025,"p4":0.000,"p5":0.300,"p6":0.100,"p7":5.000,"p8":2.000,"p9":0.000,"p10":10.000,"p11":0.080,"p12":5.000,"p13":0.000,"p14":0.000,"p15":0.000,"p16":0.000,"p17":0.0,"p18":0.0,"p19":0.0,"p20":0.0000,"p21":0,"p22":0,"p23":0.0000,"p24":0.0000,"p25":0.0000}
 
 
 @app.route('/rest/charge_mode_config')
 def rest_charge_mode_config():
-    return {"c1":"#00ff00","c2":"#ffff00","c3":"#ff0000","c4":"#0000ff","c5":3.000,"c6":0.030,"c7":0.020,"c8":0.020,"c9":0}
+    return {"c1":"#00ff00","c2":"#ffff00","c3":"#ff0000","c4":"#0000ff","c5":3.000,"c6":0.030,"c7":0.020,"c8":0.020,"c9":0,"c14":False,"c15":250.0,"c16":False,"c17":0.05,"c18":25.0,"c19":False,"c20":"#0000ff","c21":0.0,"c22":False,"c23":0,"c24":False,"c25":2.00,"c26":0.0}
 
 
 @app.route('/rest/cleanup_mode_state')
 def rest_cleanup_mode_state():
-    return {"s0":0,"s1":0.000}
+    return {"s0":0,"s1":0.000,"s2":False,"s3":0,"s4":0,"s5":0.000,"s6":0.0000,"s7":0.0000,"s8":0.0000,"s9":0.0000}
 
 
 @app.route('/rest/wireless_config')
 def rest_wireless_config():
-    return {"w0":"dummy_ssid","w2":"3","w3":30000,"w4":True}
+    return {"w0":"dummy_ssid","w2":"3","w3":30000,"w4":True,"w5":False,"w6":"239.255.42.42","w7":4242,"w8":1000,"w9":1}
 
 
 @app.route('/rest/coarse_motor_config')
 def rest_coarse_motor_config():
-    return {"m0":50.000,"m1":200,"m2":800,"m3":256,"m4":5,"m5":110,"m6":0.100,"m7":1.2500000,"m8":False,"m9":False}
+    return {"m0":50.000,"m1":200,"m2":800,"m3":256,"m4":5,"m5":110,"m6":0.100,"m7":1.2500000,"m8":False,"m9":False,"m10":0}
 
 
 @app.route('/rest/fine_motor_config')
 def rest_fine_motor_config():
-    return {"m0":50.000,"m1":200,"m2":800,"m3":256,"m4":5,"m5":110,"m6":0.100,"m7":2.1052630,"m8":False,"m9":False}
+    return {"m0":50.000,"m1":200,"m2":800,"m3":256,"m4":5,"m5":110,"m6":0.100,"m7":2.1052630,"m8":False,"m9":False,"m10":0}
 
 
 @app.route('/rest/neopixel_led_config')
@@ -110,7 +133,7 @@ def rest_neopixel_led_config():
 
 @app.route('/rest/button_config')
 def rest_button_config():
-    return {"b0":True}
+    return {"b0":True, "b1":0, "b2":20}
 
 @app.route('/rest/servo_gate_config')
 def rest_servo_gate_config():
@@ -118,6 +141,31 @@ def rest_servo_gate_config():
 
 
 
+@app.route('/rest/config')
+def rest_config():
+    return {"scale_config": rest_scale_config(),
+            "custom_scale_config": rest_custom_scale_config(),
+            "profile_config": rest_profile_config(),
+            "charge_mode_config": rest_charge_mode_config(),
+            "wireless_config": rest_wireless_config(),
+            "coarse_motor_config": rest_coarse_motor_config(),
+            "fine_motor_config": rest_fine_motor_config(),
+            "neopixel_led_config": rest_neopixel_led_config(),
+            "servo_gate_config": rest_servo_gate_config()}
+
+
+@app.route('/rest/config_snapshot')
+def rest_config_snapshot():
+    # Header, no regions and the CRC32 of the header
+    header = struct.pack("<IHHI", 0x5343544F, 1, 0, 16)
+    return header + struct.pack("<I", zlib.crc32(header)), 200, {"Content-Type": "application/octet-stream"}
+
+
+@app.route('/rest/config_snapshot_import')
+def rest_config_snapshot_import():
+    return {"i0": 0, "i1": 1 if request.args.get("c") else 0}
+
+
 @app.route('/rest/system_control')
 def rest_system_control():
     return {"s0":"8381FFF","s1":"1.2.10-dirty","s2":"8f201d6","s3":"Debug","s4":False,"s5":False,"s6":False}